@@ -1,2 +1,14 @@
 findphp:
 	@echo $(PHP_EXECUTABLE)
+
+vld_bin2txt: $(srcdir)/tools/vld_bin2txt.c $(srcdir)/binary.h
+	$(CC) -O2 -o $@ $(srcdir)/tools/vld_bin2txt.c
+
+vld_lookup: $(srcdir)/tools/vld_lookup.c $(srcdir)/dumpindex.h
+	$(CC) -O2 -o $@ $(srcdir)/tools/vld_lookup.c
+
+vld_collector: $(srcdir)/tools/vld_collector.c $(srcdir)/unixsock.h
+	$(CC) -O2 -o $@ $(srcdir)/tools/vld_collector.c
+
+vld_counters: $(srcdir)/tools/vld_counters.c $(srcdir)/counters.h
+	$(CC) -O2 -o $@ $(srcdir)/tools/vld_counters.c
@@ -0,0 +1,400 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "php.h"
+#include "php_vld.h"
+#include "srm_oparray.h"
+#include "allocprof.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+typedef struct _vld_alloc_function {
+	zend_string *name;
+	zend_string *filename;
+	uint32_t     line_start;
+	zend_ulong   bytes;
+} vld_alloc_function;
+
+/* Sites are kept for as long as the request runs, also when the code they
+ * belong to is freed, so they carry everything that is reported about them */
+typedef struct _vld_alloc_site {
+	const zend_op          *opline;
+	vld_alloc_function     *function;
+	uint32_t                nr;
+	uint32_t                lineno;
+	zend_uchar              opcode;
+	zend_ulong              allocs;
+	zend_ulong              bytes;
+	zend_ulong              live;
+	zend_ulong              peak;
+	zend_ulong              freed;
+	struct _vld_alloc_site *next;
+} vld_alloc_site;
+
+typedef struct _vld_alloc_pointer {
+	vld_alloc_site *site;
+	zend_ulong      bytes;
+} vld_alloc_pointer;
+
+struct _vld_alloc_state {
+	zend_mm_heap   *heap;
+	void          *(*old_malloc)(size_t);
+	void           (*old_free)(void *);
+	void          *(*old_realloc)(void *, size_t);
+	int             busy;
+	zend_long       every;
+	zend_long       bytes_interval;
+	zend_long       countdown;
+	zend_ulong      allocs;
+	zend_ulong      bytes;
+	zend_ulong      sampled;
+	HashTable       functions; /* only touched while busy, so in request memory */
+	HashTable       sites;     /* by opline, only the newest site of each */
+	HashTable       pointers;
+	vld_alloc_site *all_sites;
+};
+
+/* {{{ Recording */
+static void vld_alloc_function_dtor(zval *zv)
+{
+	vld_alloc_function *f = Z_PTR_P(zv);
+
+	zend_string_release(f->name);
+	if (f->filename) {
+		zend_string_release(f->filename);
+	}
+	free(f);
+}
+
+static void vld_alloc_pointer_dtor(zval *zv)
+{
+	free(Z_PTR_P(zv));
+}
+
+static vld_alloc_function *vld_alloc_function_find(struct _vld_alloc_state *state, const zend_op_array *opa)
+{
+	zend_string        *name = vld_function_name((const zend_function *) opa);
+	zend_string        *key;
+	vld_alloc_function *f;
+
+	key = strpprintf(0, "%s %s:%d", ZSTR_VAL(name), ZSTR_VAL(opa->filename), opa->line_start);
+	if ((f = zend_hash_find_ptr(&state->functions, key)) != NULL) {
+		zend_string_release(key);
+		zend_string_release(name);
+		return f;
+	}
+
+	f = calloc(1, sizeof(vld_alloc_function));
+	f->name = name;
+	f->filename = zend_string_copy(opa->filename);
+	f->line_start = opa->line_start;
+	zend_hash_add_ptr(&state->functions, key, f);
+	zend_string_release(key);
+
+	return f;
+}
+
+/* The op that the innermost frame of user code is at, or NULL when no user
+ * code is running. The VM only stores the opline in the frame when a handler
+ * calls SAVE_OPLINE(), and not all handlers that allocate do so first, so
+ * the op can be one that ran earlier in the same function. The function is
+ * always right */
+static vld_alloc_site *vld_alloc_site_find(struct _vld_alloc_state *state)
+{
+	zend_execute_data *ex = EG(current_execute_data);
+	zend_op_array     *opa;
+	const zend_op     *opline;
+	vld_alloc_site    *site;
+
+	while (ex && (!ex->func || !ZEND_USER_CODE(ex->func->type))) {
+		ex = ex->prev_execute_data;
+	}
+	if (!ex) {
+		return NULL;
+	}
+
+	opa = &ex->func->op_array;
+	opline = ex->opline;
+	if (!opline || opline < opa->opcodes || opline >= opa->opcodes + opa->last) {
+		return NULL;
+	}
+
+	/* Freed code leaves its sites behind, and new code may take its place */
+	site = zend_hash_index_find_ptr(&state->sites, (zend_ulong) (zend_uintptr_t) opline);
+	if (site && site->opcode == opline->opcode && site->lineno == opline->lineno) {
+		return site;
+	}
+
+	site = calloc(1, sizeof(vld_alloc_site));
+	site->opline = opline;
+	site->function = vld_alloc_function_find(state, opa);
+	site->nr = opline - opa->opcodes;
+	site->lineno = opline->lineno;
+	site->opcode = opline->opcode;
+	site->next = state->all_sites;
+	state->all_sites = site;
+	zend_hash_index_update_ptr(&state->sites, (zend_ulong) (zend_uintptr_t) opline, site);
+
+	return site;
+}
+
+/* Returns how many allocations a sampled allocation of size bytes stands
+ * for, and sets bytes to how many bytes, or returns 0 when it is not
+ * sampled */
+static zend_ulong vld_alloc_sample(struct _vld_alloc_state *state, size_t size, zend_ulong *bytes)
+{
+	zend_ulong crossed;
+
+	if (state->bytes_interval > 0) {
+		state->countdown -= size;
+		if (state->countdown > 0) {
+			return 0;
+		}
+		crossed = 1 + (zend_ulong) -state->countdown / state->bytes_interval;
+		state->countdown += crossed * state->bytes_interval;
+		*bytes = crossed * state->bytes_interval;
+		return size && *bytes > size ? *bytes / size : 1;
+	}
+
+	if (--state->countdown > 0) {
+		return 0;
+	}
+	state->countdown = state->every;
+	*bytes = (zend_ulong) state->every * size;
+	return state->every;
+}
+
+static void vld_alloc_record(struct _vld_alloc_state *state, void *ptr, size_t size)
+{
+	vld_alloc_site    *site;
+	vld_alloc_pointer *pointer;
+	zend_ulong         allocs, bytes = 0;
+
+	state->allocs++;
+	state->bytes += size;
+
+	if (!(allocs = vld_alloc_sample(state, size, &bytes))) {
+		return;
+	}
+
+	state->busy = 1;
+	state->sampled++;
+	if ((site = vld_alloc_site_find(state)) != NULL) {
+		site->allocs += allocs;
+		site->bytes += bytes;
+		site->live += bytes;
+		if (site->live > site->peak) {
+			site->peak = site->live;
+		}
+		site->function->bytes += bytes;
+
+		pointer = malloc(sizeof(vld_alloc_pointer));
+		pointer->site = site;
+		pointer->bytes = bytes;
+		zend_hash_index_update_ptr(&state->pointers, (zend_ulong) (zend_uintptr_t) ptr, pointer);
+	}
+	state->busy = 0;
+}
+
+static void vld_alloc_forget(struct _vld_alloc_state *state, void *ptr)
+{
+	zend_ulong         key = (zend_ulong) (zend_uintptr_t) ptr;
+	vld_alloc_pointer *pointer;
+	vld_alloc_site    *site;
+
+	if ((pointer = zend_hash_index_find_ptr(&state->pointers, key)) == NULL) {
+		return;
+	}
+
+	state->busy = 1;
+	pointer->site->live -= pointer->bytes;
+	if ((site = vld_alloc_site_find(state)) != NULL) {
+		site->freed += pointer->bytes;
+	}
+	zend_hash_index_del(&state->pointers, key);
+	state->busy = 0;
+}
+/* }}} */
+
+/* {{{ Handlers */
+static void *vld_alloc_malloc(size_t size)
+{
+	struct _vld_alloc_state *state = VLD_G(alloc);
+	void                    *ptr;
+
+	ptr = state->old_malloc ? state->old_malloc(size) : zend_mm_alloc(state->heap, size);
+	if (ptr && !state->busy) {
+		vld_alloc_record(state, ptr, size);
+	}
+	return ptr;
+}
+
+static void vld_alloc_free(void *ptr)
+{
+	struct _vld_alloc_state *state = VLD_G(alloc);
+
+	if (ptr && !state->busy && zend_hash_num_elements(&state->pointers)) {
+		vld_alloc_forget(state, ptr);
+	}
+	if (state->old_free) {
+		state->old_free(ptr);
+	} else {
+		zend_mm_free(state->heap, ptr);
+	}
+}
+
+/* Counts as freeing the old block and allocating the new one */
+static void *vld_alloc_realloc(void *ptr, size_t size)
+{
+	struct _vld_alloc_state *state = VLD_G(alloc);
+	void                    *new_ptr;
+
+	if (ptr && !state->busy && zend_hash_num_elements(&state->pointers)) {
+		vld_alloc_forget(state, ptr);
+	}
+	new_ptr = state->old_realloc ? state->old_realloc(ptr, size) : zend_mm_realloc(state->heap, ptr, size);
+	if (new_ptr && !state->busy) {
+		vld_alloc_record(state, new_ptr, size);
+	}
+	return new_ptr;
+}
+/* }}} */
+
+/* {{{ Reporting */
+static int vld_alloc_compare(const void *a, const void *b)
+{
+	const vld_alloc_site *sa = *(const vld_alloc_site **) a;
+	const vld_alloc_site *sb = *(const vld_alloc_site **) b;
+
+	if (sa->function != sb->function) {
+		if (sa->function->bytes != sb->function->bytes) {
+			return sa->function->bytes < sb->function->bytes ? 1 : -1;
+		}
+		return sa->function < sb->function ? -1 : 1;
+	}
+	if (sa->bytes != sb->bytes) {
+		return sa->bytes < sb->bytes ? 1 : -1;
+	}
+	return sa->nr < sb->nr ? -1 : (sa->nr > sb->nr ? 1 : 0);
+}
+
+static void vld_alloc_report(struct _vld_alloc_state *state)
+{
+	vld_alloc_site **list, *site;
+	uint32_t         count = 0, i, shown = 0;
+
+	vld_printf(stderr, "Allocations: %" ZEND_ULONG_FMT_SPEC " of %" ZEND_ULONG_FMT_SPEC " bytes, %" ZEND_ULONG_FMT_SPEC " sampled", state->allocs, state->bytes, state->sampled);
+	if (state->bytes_interval > 0) {
+		vld_printf(stderr, " every %" ZEND_LONG_FMT_SPEC " bytes\n\n", state->bytes_interval);
+	} else {
+		vld_printf(stderr, " every %" ZEND_LONG_FMT_SPEC " allocations\n\n", state->every);
+	}
+
+	for (site = state->all_sites; site; site = site->next) {
+		count++;
+	}
+	if (!count) {
+		return;
+	}
+
+	list = malloc(count * sizeof(vld_alloc_site *));
+	count = 0;
+	for (site = state->all_sites; site; site = site->next) {
+		list[count++] = site;
+	}
+	qsort(list, count, sizeof(vld_alloc_site *), vld_alloc_compare);
+
+	for (i = 0; i < count; i++) {
+		site = list[i];
+		if (i == 0 || site->function != list[i - 1]->function) {
+			if (i) {
+				vld_printf(stderr, "\n");
+			}
+			vld_printf(stderr, "Allocations of %s %s:%d, %" ZEND_ULONG_FMT_SPEC " bytes:\n", ZSTR_VAL(site->function->name), ZSTR_VAL(site->function->filename), site->function->line_start, site->function->bytes);
+			vld_printf(stderr, "line      # op                               allocs      bytes       peak       live      freed\n");
+			vld_printf(stderr, "-------------------------------------------------------------------------------------------------\n");
+			shown = 0;
+		}
+		if (shown < VLD_ALLOC_TOP && (site->bytes || site->freed)) {
+			const char *name = vld_opcode_name(site->opcode);
+
+			shown++;
+			vld_printf(stderr, "%5u %6u %-28s %10" ZEND_ULONG_FMT_SPEC " %10" ZEND_ULONG_FMT_SPEC " %10" ZEND_ULONG_FMT_SPEC " %10" ZEND_ULONG_FMT_SPEC " %10" ZEND_ULONG_FMT_SPEC "\n",
+				site->lineno, site->nr, name ? name : "UNKNOWN",
+				site->allocs, site->bytes, site->peak, site->live, site->freed);
+		}
+	}
+	vld_printf(stderr, "\n");
+
+	free(list);
+}
+/* }}} */
+
+int vld_alloc_enabled(void)
+{
+	return VLD_G(alloc_profile);
+}
+
+void vld_alloc_start(void)
+{
+	struct _vld_alloc_state *state;
+
+	if (!vld_alloc_enabled()) {
+		return;
+	}
+
+	state = calloc(1, sizeof(struct _vld_alloc_state));
+	state->heap = zend_mm_get_heap();
+	zend_mm_get_custom_handlers(state->heap, &state->old_malloc, &state->old_free, &state->old_realloc);
+	state->every = VLD_G(alloc_sample_every) > 0 ? VLD_G(alloc_sample_every) : 1;
+	state->bytes_interval = VLD_G(alloc_sample_bytes);
+	state->countdown = state->bytes_interval > 0 ? state->bytes_interval : state->every;
+	zend_hash_init(&state->functions, 64, NULL, vld_alloc_function_dtor, 0);
+	zend_hash_init(&state->sites, 256, NULL, NULL, 1);
+	zend_hash_init(&state->pointers, 1024, NULL, vld_alloc_pointer_dtor, 1);
+
+	VLD_G(alloc) = state;
+	zend_mm_set_custom_handlers(state->heap, vld_alloc_malloc, vld_alloc_free, vld_alloc_realloc);
+}
+
+/* The handlers have to be gone before the memory manager shuts down, as it
+ * does not clean up a heap with custom handlers */
+void vld_alloc_stop(void)
+{
+	struct _vld_alloc_state *state = VLD_G(alloc);
+	vld_alloc_site          *site, *next;
+
+	if (!state) {
+		return;
+	}
+
+	zend_mm_set_custom_handlers(state->heap, state->old_malloc, state->old_free, state->old_realloc);
+	VLD_G(alloc) = NULL;
+
+	vld_alloc_report(state);
+
+	for (site = state->all_sites; site; site = next) {
+		next = site->next;
+		free(site);
+	}
+	zend_hash_destroy(&state->pointers);
+	zend_hash_destroy(&state->sites);
+	zend_hash_destroy(&state->functions);
+	free(state);
+}
@@ -0,0 +1,38 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __ALLOCPROF_H__
+#define __ALLOCPROF_H__
+
+/* Allocation profiler
+ *
+ * With vld.alloc_profile, custom handlers are put on the Zend memory
+ * manager's heap for the duration of the request. They pass every call on
+ * to the heap, or to the custom handlers that were there before, and
+ * attribute sampled allocations to the op that the innermost user code
+ * frame is at, as far as the VM stored it in the frame: the function is
+ * exact, the op only approximate. The pointers of sampled allocations are remembered, so that
+ * freeing them again takes them out of the live bytes of the op that
+ * allocated them.
+ *
+ * Either every vld.alloc_sample_every'th allocation is sampled, counting
+ * for that many allocations, or one allocation every time another
+ * vld.alloc_sample_bytes bytes were allocated, counting for those bytes.
+ * Allocations that the profiler makes itself are never sampled. */
+
+#define VLD_ALLOC_TOP 10 /* ops per function in the report */
+
+int vld_alloc_enabled(void);
+void vld_alloc_start(void);
+void vld_alloc_stop(void);
+
+#endif
@@ -0,0 +1,342 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#include "php.h"
+#include "php_vld.h"
+#include "branchinfo.h"
+#include "srm_oparray.h"
+#include "arraydump.h"
+#include "runtime.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+static void vld_literal_to_zval(zval *dst, zval *literal)
+{
+	switch (Z_TYPE_P(literal)) {
+		case IS_NULL:
+		case IS_FALSE:
+		case IS_TRUE:
+		case IS_LONG:
+		case IS_DOUBLE:
+		case IS_STRING:
+		case IS_ARRAY:
+			ZVAL_COPY(dst, literal);
+			break;
+#if PHP_VERSION_ID < 70300
+		case IS_CONSTANT:
+			ZVAL_STR_COPY(dst, Z_STR_P(literal));
+			break;
+#endif
+		case IS_CONSTANT_AST:
+			ZVAL_STRING(dst, "<const ast>");
+			break;
+		default:
+			ZVAL_NULL(dst);
+			break;
+	}
+}
+
+static void vld_znode_to_array(zval *dst, unsigned int node_type, znode_op node, zend_op_array *opa, int opline)
+{
+	vld_znode_info znode;
+	zval           tmp;
+
+	vld_decode_znode(opa, opline, node_type, node, &znode);
+
+	array_init(dst);
+	add_assoc_string(dst, "type", (char*) (znode.type ? znode.type : "UNKNOWN"));
+
+	switch (node_type) {
+		case IS_CONST:
+		case VLD_IS_CLASS:
+			add_assoc_long(dst, "literal", znode.value);
+			vld_literal_to_zval(&tmp, znode.literal);
+			add_assoc_zval(dst, "value", &tmp);
+			break;
+
+		case IS_TMP_VAR:
+		case IS_VAR:
+		case VLD_IS_OPNUM:
+		case VLD_IS_OPLINE:
+		case VLD_IS_INDEX:
+			add_assoc_long(dst, "value", znode.value);
+			break;
+
+		case IS_CV:
+			add_assoc_long(dst, "value", znode.value);
+			if (znode.name) {
+				add_assoc_str(dst, "name", zend_string_copy(znode.name));
+			}
+			break;
+
+#if PHP_VERSION_ID >= 70200
+		case VLD_IS_JMP_ARRAY: {
+			zend_ulong   num;
+			zend_string *key;
+			zval        *val;
+			zend_long    target;
+
+			array_init(&tmp);
+			ZEND_HASH_FOREACH_KEY_VAL_IND(Z_ARRVAL_P(znode.literal), num, key, val) {
+				target = opline + (Z_LVAL_P(val) / sizeof(zend_op));
+				if (key == NULL) {
+					add_index_long(&tmp, num, target);
+				} else {
+					add_assoc_long_ex(&tmp, ZSTR_VAL(key), ZSTR_LEN(key), target);
+				}
+			} ZEND_HASH_FOREACH_END();
+			add_assoc_zval(dst, "value", &tmp);
+			break;
+		}
+#endif
+	}
+}
+
+static void vld_op_to_array(zval *dst, zend_op_array *opa, unsigned int nr, vld_set *set, vld_branch_info *branch_info)
+{
+	const zend_op *op = &opa->opcodes[nr];
+	unsigned int   base_address = (unsigned int)(zend_intptr_t)&(opa->opcodes[0]);
+	const char    *name = vld_opcode_name(op->opcode);
+	vld_op_info    info;
+	zval           operand;
+
+	vld_decode_op(op, base_address, &info);
+
+	array_init(dst);
+	add_assoc_long(dst, "line", op->lineno);
+	add_assoc_long(dst, "opcode", op->opcode);
+	if (name) {
+		add_assoc_string(dst, "name", (char*) name);
+	} else {
+		add_assoc_null(dst, "name");
+	}
+	add_assoc_string(dst, "fetch", (char*) info.fetch_type);
+	if (info.flags & EXT_VAL) {
+		add_assoc_long(dst, "extended_value", op->extended_value);
+	} else {
+		add_assoc_null(dst, "extended_value");
+	}
+	add_assoc_bool(dst, "reachable", vld_set_in(set, nr) ? 1 : 0);
+	add_assoc_bool(dst, "entry", vld_set_in(branch_info->entry_points, nr) ? 1 : 0);
+	add_assoc_bool(dst, "branch_start", vld_set_in(branch_info->starts, nr) ? 1 : 0);
+	add_assoc_bool(dst, "branch_end", vld_set_in(branch_info->ends, nr) ? 1 : 0);
+	if (VLD_G(count_executions)) {
+		vld_profile *profile = vld_runtime_find(opa);
+
+		if (profile) {
+			add_assoc_long(dst, "hits", profile->hits[nr]);
+		} else {
+			add_assoc_long(dst, "hits", 0);
+		}
+	}
+
+#if PHP_VERSION_ID >= 70100
+	if ((info.flags & RES_USED) && op->result_type != IS_UNUSED) {
+#else
+	if ((info.flags & RES_USED) && !(op->VLD_EXTENDED_VALUE(result) & EXT_TYPE_UNUSED)) {
+#endif
+		vld_znode_to_array(&operand, info.res_type, op->result, opa, nr);
+		add_assoc_zval(dst, "result", &operand);
+	} else {
+		add_assoc_null(dst, "result");
+	}
+
+	if ((info.flags & OP1_USED) && info.op1_type != IS_UNUSED) {
+		vld_znode_to_array(&operand, info.op1_type, op->op1, opa, nr);
+		add_assoc_zval(dst, "op1", &operand);
+	} else {
+		add_assoc_null(dst, "op1");
+	}
+
+	if (info.flags & OP2_INCLUDE) {
+		const char *include_type = vld_include_type_name(op->extended_value);
+
+		array_init(&operand);
+		add_assoc_string(&operand, "type", (char*) "INCLUDE");
+		add_assoc_string(&operand, "value", (char*) (include_type ? include_type : "UNKNOWN"));
+		add_assoc_zval(dst, "op2", &operand);
+	} else if ((info.flags & OP2_USED) && info.op2_type != IS_UNUSED) {
+		vld_znode_to_array(&operand, info.op2_type, op->op2, opa, nr);
+		add_assoc_zval(dst, "op2", &operand);
+	} else {
+		add_assoc_null(dst, "op2");
+	}
+
+	if (info.flags & EXT_VAL_JMP_ABS) {
+		add_assoc_long(dst, "ext_target", op->extended_value);
+	} else if (info.flags & EXT_VAL_JMP_REL) {
+		add_assoc_long(dst, "ext_target", nr + ((int) op->extended_value / (int) sizeof(zend_op)));
+	}
+}
+
+static void vld_branch_info_to_array(zval *branches, zval *paths, zend_op_array *opa, vld_branch_info *branch_info)
+{
+	unsigned int i, j;
+	zval         branch, outs, taken, path;
+
+	array_init(branches);
+	for (i = 0; i < branch_info->starts->size; i++) {
+		if (!vld_set_in(branch_info->starts, i)) {
+			continue;
+		}
+
+		array_init(&branch);
+		add_assoc_long(&branch, "line_start", branch_info->branches[i].start_lineno);
+		add_assoc_long(&branch, "line_end", branch_info->branches[i].end_lineno);
+		add_assoc_long(&branch, "op_start", i);
+		add_assoc_long(&branch, "op_end", branch_info->branches[i].end_op);
+
+		array_init(&outs);
+		array_init(&taken);
+		for (j = 0; j < branch_info->branches[i].outs_count; j++) {
+			if (branch_info->branches[i].outs[j]) {
+				add_next_index_long(&outs, branch_info->branches[i].outs[j]);
+				if (VLD_G(branch_coverage)) {
+					add_next_index_bool(&taken, vld_runtime_edge_taken(opa, i, j) == 1);
+				}
+			}
+		}
+		add_assoc_zval(&branch, "outs", &outs);
+		if (VLD_G(branch_coverage)) {
+			add_assoc_zval(&branch, "taken", &taken);
+		} else {
+			zval_ptr_dtor(&taken);
+		}
+
+		add_index_zval(branches, i, &branch);
+	}
+
+	array_init(paths);
+	for (i = 0; i < branch_info->paths_count; i++) {
+		array_init_size(&path, branch_info->paths[i]->elements_count);
+		for (j = 0; j < branch_info->paths[i]->elements_count; j++) {
+			add_next_index_long(&path, branch_info->paths[i]->elements[j]);
+		}
+		add_next_index_zval(paths, &path);
+	}
+}
+
+void vld_oparray_to_array(zval *dst, zend_op_array *opa)
+{
+	unsigned int     i;
+	int              verbosity = VLD_G(verbosity);
+	vld_set         *set;
+	vld_branch_info *branch_info;
+	zval             tmp, list, branches, paths;
+
+	set = vld_set_create(opa->last);
+	branch_info = vld_branch_info_create(opa->last);
+
+	/* The analysis reports its progress through VLD_PRINT, which has no place
+	 * in a return value */
+	VLD_G(verbosity) = 0;
+	vld_analyse_oparray(opa, set, branch_info);
+	vld_branch_post_process(opa, branch_info);
+	vld_branch_find_paths(branch_info);
+	VLD_G(verbosity) = verbosity;
+
+	array_init(dst);
+	if (opa->filename) {
+		add_assoc_str(dst, "filename", zend_string_copy(opa->filename));
+	} else {
+		add_assoc_null(dst, "filename");
+	}
+	if (opa->function_name) {
+		add_assoc_str(dst, "function_name", zend_string_copy(opa->function_name));
+	} else {
+		add_assoc_null(dst, "function_name");
+	}
+	if (opa->scope) {
+		add_assoc_str(dst, "class", zend_string_copy(opa->scope->name));
+	} else {
+		add_assoc_null(dst, "class");
+	}
+	add_assoc_long(dst, "line_start", opa->line_start);
+	add_assoc_long(dst, "line_end", opa->line_end);
+	add_assoc_long(dst, "num_ops", opa->last);
+
+	array_init_size(&list, opa->last_var);
+	for (i = 0; i < (unsigned int) opa->last_var; i++) {
+		add_next_index_str(&list, zend_string_copy(opa->vars[i]));
+	}
+	add_assoc_zval(dst, "compiled_vars", &list);
+
+	array_init_size(&list, opa->last_literal);
+	for (i = 0; i < (unsigned int) opa->last_literal; i++) {
+		vld_literal_to_zval(&tmp, &opa->literals[i]);
+		add_next_index_zval(&list, &tmp);
+	}
+	add_assoc_zval(dst, "literals", &list);
+
+	array_init_size(&list, opa->last);
+	for (i = 0; i < opa->last; i++) {
+		vld_op_to_array(&tmp, opa, i, set, branch_info);
+		add_next_index_zval(&list, &tmp);
+	}
+	add_assoc_zval(dst, "opcodes", &list);
+
+	vld_branch_info_to_array(&branches, &paths, opa, branch_info);
+	add_assoc_zval(dst, "branches", &branches);
+	add_assoc_zval(dst, "paths", &paths);
+
+	vld_set_free(set);
+	vld_branch_info_free(branch_info);
+
+#if PHP_VERSION_ID >= 80100
+	array_init_size(&list, opa->num_dynamic_func_defs);
+	for (i = 0; i < opa->num_dynamic_func_defs; i++) {
+		vld_oparray_to_array(&tmp, opa->dynamic_func_defs[i]);
+		add_next_index_zval(&list, &tmp);
+	}
+	add_assoc_zval(dst, "dynamic_functions", &list);
+#endif
+}
+
+void vld_class_to_array(zval *dst, zend_class_entry *ce)
+{
+	zend_string   *key;
+	zend_function *func;
+	zend_string   *parent_name = NULL;
+	zval           methods, tmp;
+
+#if PHP_VERSION_ID >= 70400
+	if (!(ce->ce_flags & ZEND_ACC_LINKED)) {
+		parent_name = ce->parent_name;
+	} else
+#endif
+	if (ce->parent) {
+		parent_name = ce->parent->name;
+	}
+
+	array_init(dst);
+	add_assoc_str(dst, "name", zend_string_copy(ce->name));
+	if (parent_name) {
+		add_assoc_str(dst, "parent", zend_string_copy(parent_name));
+	} else {
+		add_assoc_null(dst, "parent");
+	}
+	if (ce->type == ZEND_USER_CLASS && ce->info.user.filename) {
+		add_assoc_str(dst, "filename", zend_string_copy(ce->info.user.filename));
+		add_assoc_long(dst, "line_start", ce->info.user.line_start);
+		add_assoc_long(dst, "line_end", ce->info.user.line_end);
+	}
+
+	array_init(&methods);
+	ZEND_HASH_FOREACH_STR_KEY_PTR(&ce->function_table, key, func) {
+		if (func->type != ZEND_USER_FUNCTION || !key) {
+			continue;
+		}
+		vld_oparray_to_array(&tmp, &func->op_array);
+		zend_hash_update(Z_ARRVAL(methods), key, &tmp);
+	} ZEND_HASH_FOREACH_END();
+	add_assoc_zval(dst, "methods", &methods);
+}
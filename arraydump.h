@@ -0,0 +1,21 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __ARRAYDUMP_H__
+#define __ARRAYDUMP_H__
+
+#include "php.h"
+
+void vld_oparray_to_array(zval *dst, zend_op_array *opa);
+void vld_class_to_array(zval *dst, zend_class_entry *ce);
+
+#endif
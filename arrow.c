@@ -0,0 +1,500 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arrow.h"
+
+#ifndef VLD_ARROW_NO_PHP
+#include "php.h"
+#include "php_vld.h"
+#include "srm_oparray.h"
+#include "output.h"
+#endif
+
+/* {{{ Byte buffers */
+static void vld_arrow_buf_reserve(vld_arrow_buf *buf, size_t extra)
+{
+	if (buf->len + extra <= buf->size) {
+		return;
+	}
+	while (buf->len + extra > buf->size) {
+		buf->size = buf->size ? buf->size * 2 : 1024;
+	}
+	buf->data = realloc(buf->data, buf->size);
+}
+
+static void vld_arrow_buf_append(vld_arrow_buf *buf, const void *data, size_t len)
+{
+	vld_arrow_buf_reserve(buf, len);
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static size_t vld_arrow_buf_zero(vld_arrow_buf *buf, size_t len)
+{
+	size_t pos = buf->len;
+
+	vld_arrow_buf_reserve(buf, len);
+	memset(buf->data + pos, 0, len);
+	buf->len += len;
+
+	return pos;
+}
+
+static void vld_arrow_buf_pad(vld_arrow_buf *buf, size_t align)
+{
+	if (buf->len % align) {
+		vld_arrow_buf_zero(buf, align - buf->len % align);
+	}
+}
+
+static void vld_arrow_put16(vld_arrow_buf *buf, size_t pos, uint16_t value)
+{
+	buf->data[pos]     = value;
+	buf->data[pos + 1] = value >> 8;
+}
+
+static void vld_arrow_put32(vld_arrow_buf *buf, size_t pos, uint32_t value)
+{
+	vld_arrow_put16(buf, pos, value);
+	vld_arrow_put16(buf, pos + 2, value >> 16);
+}
+
+static void vld_arrow_put64(vld_arrow_buf *buf, size_t pos, uint64_t value)
+{
+	vld_arrow_put32(buf, pos, (uint32_t) value);
+	vld_arrow_put32(buf, pos + 4, (uint32_t) (value >> 32));
+}
+
+static void vld_arrow_append32(vld_arrow_buf *buf, uint32_t value)
+{
+	vld_arrow_put32(buf, vld_arrow_buf_zero(buf, 4), value);
+}
+/* }}} */
+
+/* {{{ Flatbuffers
+ * Arrow's metadata is encoded as flatbuffers. The few tables that are needed
+ * are written front to back: every table is preceded by its vtable, and
+ * anything a table refers to is written after it, so that all offsets point
+ * forwards as the format requires. Offsets are patched in once the target
+ * has been written. */
+#define VLD_FB_MAX_FIELDS 8
+
+/* Lays out a table with fields of the given sizes, where 0 marks a field
+ * that is not present, and returns the table's position. The positions of
+ * the fields are returned in pos[], for the caller to fill in. */
+static size_t vld_fb_table(vld_arrow_buf *buf, int count, const int *sizes, size_t *pos)
+{
+	uint16_t offsets[VLD_FB_MAX_FIELDS];
+	size_t   table_size = 4, vtable, table;
+	int      i, size;
+
+	/* Largest fields first, so that they are all naturally aligned as the
+	 * table itself starts at an eight byte boundary */
+	for (i = 0; i < count; i++) {
+		offsets[i] = 0;
+	}
+	for (size = 8; size >= 1; size /= 2) {
+		for (i = 0; i < count; i++) {
+			if (sizes[i] == size) {
+				table_size = (table_size + size - 1) & ~((size_t) size - 1);
+				offsets[i] = (uint16_t) table_size;
+				table_size += size;
+			}
+		}
+	}
+
+	vld_arrow_buf_pad(buf, 2);
+	vtable = vld_arrow_buf_zero(buf, 4 + 2 * count);
+	vld_arrow_put16(buf, vtable, 4 + 2 * count);
+	vld_arrow_put16(buf, vtable + 2, (uint16_t) table_size);
+	for (i = 0; i < count; i++) {
+		vld_arrow_put16(buf, vtable + 4 + 2 * i, offsets[i]);
+	}
+
+	vld_arrow_buf_pad(buf, 8);
+	table = vld_arrow_buf_zero(buf, table_size);
+	vld_arrow_put32(buf, table, (uint32_t) (table - vtable));
+
+	for (i = 0; i < count; i++) {
+		pos[i] = table + offsets[i];
+	}
+	return table;
+}
+
+static void vld_fb_offset(vld_arrow_buf *buf, size_t field, size_t target)
+{
+	vld_arrow_put32(buf, field, (uint32_t) (target - field));
+}
+
+static size_t vld_fb_string(vld_arrow_buf *buf, const char *str)
+{
+	size_t pos, len = strlen(str);
+
+	vld_arrow_buf_pad(buf, 4);
+	pos = buf->len;
+	vld_arrow_append32(buf, (uint32_t) len);
+	vld_arrow_buf_append(buf, str, len + 1);
+
+	return pos;
+}
+
+/* Returns the position of the vector; its elements start four bytes later */
+static size_t vld_fb_vector(vld_arrow_buf *buf, uint32_t count, size_t element_size, size_t element_align)
+{
+	size_t pos;
+
+	vld_arrow_buf_pad(buf, 4);
+	while ((buf->len + 4) % element_align) {
+		vld_arrow_buf_zero(buf, 4);
+	}
+	pos = buf->len;
+	vld_arrow_append32(buf, count);
+	vld_arrow_buf_zero(buf, count * element_size);
+
+	return pos;
+}
+/* }}} */
+
+/* {{{ Messages */
+#define VLD_ARROW_V5               4
+#define VLD_ARROW_HEADER_SCHEMA    1
+#define VLD_ARROW_HEADER_BATCH     3
+#define VLD_ARROW_TYPE_INT         2
+#define VLD_ARROW_TYPE_UTF8        5
+
+typedef struct _vld_arrow_column {
+	const char *name;
+	int         type;
+	int         bit_width;
+	int         is_signed;
+	int         nullable;
+} vld_arrow_column;
+
+static const vld_arrow_column vld_arrow_columns[VLD_ARROW_COLUMNS] = {
+	{ "file",           VLD_ARROW_TYPE_UTF8, 0,  0, 0 },
+	{ "function",       VLD_ARROW_TYPE_UTF8, 0,  0, 1 },
+	{ "op_index",       VLD_ARROW_TYPE_INT,  32, 1, 0 },
+	{ "line",           VLD_ARROW_TYPE_INT,  32, 1, 0 },
+	{ "opcode",         VLD_ARROW_TYPE_INT,  8,  0, 0 },
+	{ "op1_type",       VLD_ARROW_TYPE_INT,  8,  0, 0 },
+	{ "op2_type",       VLD_ARROW_TYPE_INT,  8,  0, 0 },
+	{ "result_type",    VLD_ARROW_TYPE_INT,  8,  0, 0 },
+	{ "extended_value", VLD_ARROW_TYPE_INT,  32, 0, 0 },
+	{ "block_id",       VLD_ARROW_TYPE_INT,  32, 1, 0 }
+};
+
+/* Starts a Message table, and returns the position of its header field. The
+ * position of the body length is returned in body_length_pos. */
+static size_t vld_arrow_message(vld_arrow_buf *buf, int header_type, size_t *body_length_pos)
+{
+	static const int sizes[4] = { 2, 1, 4, 8 }; /* version, header_type, header, bodyLength */
+	size_t           pos[4], root, table;
+
+	root  = vld_arrow_buf_zero(buf, 4);
+	table = vld_fb_table(buf, 4, sizes, pos);
+	vld_fb_offset(buf, root, table);
+
+	vld_arrow_put16(buf, pos[0], VLD_ARROW_V5);
+	buf->data[pos[1]] = header_type;
+	*body_length_pos = pos[3];
+
+	return pos[2];
+}
+
+/* Writes the continuation marker and the metadata length, the metadata
+ * padded to eight bytes, and the body */
+static void vld_arrow_emit(vld_arrow_writer *writer, vld_arrow_buf *metadata, vld_arrow_buf *body)
+{
+	unsigned char prefix[8];
+
+	vld_arrow_buf_pad(metadata, 8);
+
+	memset(prefix, 0xff, 4);
+	prefix[4] = metadata->len;
+	prefix[5] = metadata->len >> 8;
+	prefix[6] = metadata->len >> 16;
+	prefix[7] = metadata->len >> 24;
+
+	writer->write((const char *) prefix, sizeof(prefix));
+	writer->write((const char *) metadata->data, metadata->len);
+	if (body && body->len) {
+		writer->write((const char *) body->data, body->len);
+	}
+}
+
+void vld_arrow_write_schema(vld_arrow_writer *writer)
+{
+	static const int schema_sizes[2] = { 2, 4 };             /* endianness, fields */
+	static const int field_sizes[6]  = { 4, 1, 1, 4, 0, 4 }; /* name, nullable, type_type, type, dictionary, children */
+	static const int int_sizes[2]    = { 4, 1 };             /* bitWidth, is_signed */
+	vld_arrow_buf    buf = { NULL, 0, 0 };
+	size_t           header, body_length, schema_pos[2], fields, field_pos[6], type_pos[2], target;
+	int              i;
+
+	header = vld_arrow_message(&buf, VLD_ARROW_HEADER_SCHEMA, &body_length);
+	vld_fb_offset(&buf, header, vld_fb_table(&buf, 2, schema_sizes, schema_pos));
+
+	fields = vld_fb_vector(&buf, VLD_ARROW_COLUMNS, 4, 4);
+	vld_fb_offset(&buf, schema_pos[1], fields);
+
+	for (i = 0; i < VLD_ARROW_COLUMNS; i++) {
+		const vld_arrow_column *column = &vld_arrow_columns[i];
+
+		vld_fb_offset(&buf, fields + 4 + 4 * i, vld_fb_table(&buf, 6, field_sizes, field_pos));
+		buf.data[field_pos[1]] = column->nullable;
+		buf.data[field_pos[2]] = column->type;
+
+		target = vld_fb_string(&buf, column->name);
+		vld_fb_offset(&buf, field_pos[0], target);
+
+		if (column->type == VLD_ARROW_TYPE_INT) {
+			target = vld_fb_table(&buf, 2, int_sizes, type_pos);
+			vld_arrow_put32(&buf, type_pos[0], column->bit_width);
+			buf.data[type_pos[1]] = column->is_signed;
+		} else {
+			target = vld_fb_table(&buf, 0, NULL, NULL);
+		}
+		vld_fb_offset(&buf, field_pos[3], target);
+
+		vld_fb_offset(&buf, field_pos[5], vld_fb_vector(&buf, 0, 4, 4));
+	}
+
+	vld_arrow_emit(writer, &buf, NULL);
+	free(buf.data);
+}
+
+void vld_arrow_write_batch(vld_arrow_writer *writer)
+{
+	static const int batch_sizes[3] = { 8, 4, 4 }; /* length, nodes, buffers */
+	vld_arrow_buf   *buffers[22];
+	vld_arrow_buf    buf = { NULL, 0, 0 }, body = { NULL, 0, 0 }, empty = { NULL, 0, 0 };
+	size_t           header, body_length, batch_pos[3], nodes, buffer_list;
+	int              i, count = 0;
+
+	if (!writer->rows) {
+		return;
+	}
+
+	/* Validity, offsets and data for the strings, validity and data for the
+	 * numbers; only the function name can be null */
+	buffers[count++] = &empty;
+	buffers[count++] = &writer->file_offsets;
+	buffers[count++] = &writer->file_data;
+	buffers[count++] = writer->function_nulls ? &writer->function_validity : &empty;
+	buffers[count++] = &writer->function_offsets;
+	buffers[count++] = &writer->function_data;
+	buffers[count++] = &empty; buffers[count++] = &writer->op_index;
+	buffers[count++] = &empty; buffers[count++] = &writer->line;
+	buffers[count++] = &empty; buffers[count++] = &writer->opcode;
+	buffers[count++] = &empty; buffers[count++] = &writer->op1_type;
+	buffers[count++] = &empty; buffers[count++] = &writer->op2_type;
+	buffers[count++] = &empty; buffers[count++] = &writer->result_type;
+	buffers[count++] = &empty; buffers[count++] = &writer->extended_value;
+	buffers[count++] = &empty; buffers[count++] = &writer->block_id;
+
+	header = vld_arrow_message(&buf, VLD_ARROW_HEADER_BATCH, &body_length);
+	vld_fb_offset(&buf, header, vld_fb_table(&buf, 3, batch_sizes, batch_pos));
+	vld_arrow_put64(&buf, batch_pos[0], writer->rows);
+
+	nodes = vld_fb_vector(&buf, VLD_ARROW_COLUMNS, 16, 8);
+	vld_fb_offset(&buf, batch_pos[1], nodes);
+	for (i = 0; i < VLD_ARROW_COLUMNS; i++) {
+		vld_arrow_put64(&buf, nodes + 4 + 16 * i, writer->rows);
+		vld_arrow_put64(&buf, nodes + 4 + 16 * i + 8, i == 1 ? writer->function_nulls : 0);
+	}
+
+	buffer_list = vld_fb_vector(&buf, count, 16, 8);
+	vld_fb_offset(&buf, batch_pos[2], buffer_list);
+	for (i = 0; i < count; i++) {
+		vld_arrow_put64(&buf, buffer_list + 4 + 16 * i, body.len);
+		vld_arrow_put64(&buf, buffer_list + 4 + 16 * i + 8, buffers[i]->len);
+		if (buffers[i]->len) {
+			vld_arrow_buf_append(&body, buffers[i]->data, buffers[i]->len);
+		}
+		vld_arrow_buf_pad(&body, 8);
+	}
+
+	vld_arrow_put64(&buf, body_length, body.len);
+
+	vld_arrow_emit(writer, &buf, &body);
+	free(buf.data);
+	free(body.data);
+
+	writer->file_offsets.len = writer->file_data.len = 0;
+	writer->function_validity.len = writer->function_offsets.len = writer->function_data.len = 0;
+	writer->op_index.len = writer->line.len = writer->opcode.len = 0;
+	writer->op1_type.len = writer->op2_type.len = writer->result_type.len = 0;
+	writer->extended_value.len = writer->block_id.len = 0;
+	writer->rows = writer->function_nulls = 0;
+
+	vld_arrow_append32(&writer->file_offsets, 0);
+	vld_arrow_append32(&writer->function_offsets, 0);
+}
+
+/* The end of stream marker is a continuation marker with a metadata length
+ * of 0 */
+void vld_arrow_write_end(vld_arrow_writer *writer)
+{
+	static const unsigned char end[8] = { 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0 };
+
+	writer->write((const char *) end, sizeof(end));
+}
+/* }}} */
+
+void vld_arrow_writer_init(vld_arrow_writer *writer, vld_arrow_write_func write)
+{
+	memset(writer, 0, sizeof(*writer));
+	writer->write = write;
+
+	vld_arrow_append32(&writer->file_offsets, 0);
+	vld_arrow_append32(&writer->function_offsets, 0);
+}
+
+void vld_arrow_add_row(vld_arrow_writer *writer, const char *file, size_t file_len, const char *function, size_t function_len, int32_t op_index, int32_t line, uint8_t opcode, uint8_t op1_type, uint8_t op2_type, uint8_t result_type, uint32_t extended_value, int32_t block_id)
+{
+	uint32_t row = writer->rows++;
+
+	vld_arrow_buf_append(&writer->file_data, file, file_len);
+	vld_arrow_append32(&writer->file_offsets, (uint32_t) writer->file_data.len);
+
+	if (row % 8 == 0) {
+		vld_arrow_buf_zero(&writer->function_validity, 1);
+	}
+	if (function) {
+		writer->function_validity.data[row / 8] |= 1 << (row % 8);
+		vld_arrow_buf_append(&writer->function_data, function, function_len);
+	} else {
+		writer->function_nulls++;
+	}
+	vld_arrow_append32(&writer->function_offsets, (uint32_t) writer->function_data.len);
+
+	vld_arrow_append32(&writer->op_index, (uint32_t) op_index);
+	vld_arrow_append32(&writer->line, (uint32_t) line);
+	vld_arrow_buf_append(&writer->opcode, &opcode, 1);
+	vld_arrow_buf_append(&writer->op1_type, &op1_type, 1);
+	vld_arrow_buf_append(&writer->op2_type, &op2_type, 1);
+	vld_arrow_buf_append(&writer->result_type, &result_type, 1);
+	vld_arrow_append32(&writer->extended_value, extended_value);
+	vld_arrow_append32(&writer->block_id, (uint32_t) block_id);
+}
+
+void vld_arrow_writer_free(vld_arrow_writer *writer)
+{
+	free(writer->file_offsets.data);
+	free(writer->file_data.data);
+	free(writer->function_validity.data);
+	free(writer->function_offsets.data);
+	free(writer->function_data.data);
+	free(writer->op_index.data);
+	free(writer->line.data);
+	free(writer->opcode.data);
+	free(writer->op1_type.data);
+	free(writer->op2_type.data);
+	free(writer->result_type.data);
+	free(writer->extended_value.data);
+	free(writer->block_id.data);
+}
+
+#ifndef VLD_ARROW_NO_PHP
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+struct _vld_arrow_state {
+	vld_arrow_writer  writer;
+	char             *function;
+	size_t            function_len;
+	int32_t           block_id;
+};
+
+void vld_arrow_open(void)
+{
+	struct _vld_arrow_state *state = calloc(1, sizeof(struct _vld_arrow_state));
+
+	/* Every request writes a stream of its own, which vld_output_write()
+	 * keeps in one piece until it is appended to the file under a lock */
+	vld_arrow_writer_init(&state->writer, vld_output_write);
+	vld_arrow_write_schema(&state->writer);
+
+	VLD_G(arrow) = state;
+}
+
+void vld_arrow_close(void)
+{
+	struct _vld_arrow_state *state = VLD_G(arrow);
+
+	if (!state) {
+		return;
+	}
+
+	vld_arrow_write_batch(&state->writer);
+	vld_arrow_write_end(&state->writer);
+	vld_arrow_writer_free(&state->writer);
+	free(state->function);
+	free(state);
+
+	VLD_G(arrow) = NULL;
+}
+
+void vld_arrow_oparray_header(zend_op_array *opa)
+{
+	struct _vld_arrow_state *state = VLD_G(arrow);
+
+	if (!state) {
+		return;
+	}
+
+	free(state->function);
+	state->function = NULL;
+	state->function_len = 0;
+	state->block_id = 0;
+
+	if (opa->function_name && opa->scope) {
+		state->function_len = ZSTR_LEN(opa->scope->name) + 2 + ZSTR_LEN(opa->function_name);
+		state->function = malloc(state->function_len + 1);
+		snprintf(state->function, state->function_len + 1, "%s::%s", ZSTR_VAL(opa->scope->name), ZSTR_VAL(opa->function_name));
+	} else if (opa->function_name) {
+		state->function_len = ZSTR_LEN(opa->function_name);
+		state->function = malloc(state->function_len + 1);
+		memcpy(state->function, ZSTR_VAL(opa->function_name), state->function_len + 1);
+	}
+}
+
+void vld_arrow_op(zend_op_array *opa, unsigned int nr, int notdead, int entry, int start, int end)
+{
+	struct _vld_arrow_state *state = VLD_G(arrow);
+	const zend_op           *op = &opa->opcodes[nr];
+
+	if (!state) {
+		return;
+	}
+
+	/* Ops are dumped in order, so the block an op belongs to is the one
+	 * that started last */
+	if (start) {
+		state->block_id = nr;
+	}
+
+	vld_arrow_add_row(
+		&state->writer,
+		opa->filename ? ZSTR_VAL(opa->filename) : "", opa->filename ? ZSTR_LEN(opa->filename) : 0,
+		state->function, state->function_len,
+		nr, op->lineno, op->opcode,
+		op->VLD_TYPE(op1), op->VLD_TYPE(op2), op->VLD_TYPE(result),
+		op->extended_value, state->block_id
+	);
+
+	if (state->writer.rows >= VLD_ARROW_BATCH_ROWS) {
+		vld_arrow_write_batch(&state->writer);
+	}
+}
+#endif
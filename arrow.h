@@ -0,0 +1,74 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __ARROW_H__
+#define __ARROW_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Apache Arrow IPC stream writer
+ *
+ * Every dumped opcode becomes a row of (file, function, op_index, line,
+ * opcode, op1_type, op2_type, result_type, extended_value, block_id), and
+ * rows are written out as record batches of up to VLD_ARROW_BATCH_ROWS.
+ * Every request writes a complete stream, from the schema message to the end
+ * of stream marker, so a file that several requests append to holds one
+ * stream after the other. */
+
+#define VLD_ARROW_BATCH_ROWS 65536
+#define VLD_ARROW_COLUMNS    10
+
+typedef struct _vld_arrow_buf {
+	unsigned char *data;
+	size_t         len;
+	size_t         size;
+} vld_arrow_buf;
+
+typedef void (*vld_arrow_write_func)(const char *data, size_t len);
+
+typedef struct _vld_arrow_writer {
+	vld_arrow_write_func write;
+	uint32_t             rows;
+	uint32_t             function_nulls;
+	vld_arrow_buf        file_offsets;
+	vld_arrow_buf        file_data;
+	vld_arrow_buf        function_validity;
+	vld_arrow_buf        function_offsets;
+	vld_arrow_buf        function_data;
+	vld_arrow_buf        op_index;
+	vld_arrow_buf        line;
+	vld_arrow_buf        opcode;
+	vld_arrow_buf        op1_type;
+	vld_arrow_buf        op2_type;
+	vld_arrow_buf        result_type;
+	vld_arrow_buf        extended_value;
+	vld_arrow_buf        block_id;
+} vld_arrow_writer;
+
+void vld_arrow_writer_init(vld_arrow_writer *writer, vld_arrow_write_func write);
+void vld_arrow_write_schema(vld_arrow_writer *writer);
+void vld_arrow_add_row(vld_arrow_writer *writer, const char *file, size_t file_len, const char *function, size_t function_len, int32_t op_index, int32_t line, uint8_t opcode, uint8_t op1_type, uint8_t op2_type, uint8_t result_type, uint32_t extended_value, int32_t block_id);
+void vld_arrow_write_batch(vld_arrow_writer *writer);
+void vld_arrow_write_end(vld_arrow_writer *writer);
+void vld_arrow_writer_free(vld_arrow_writer *writer);
+
+#ifndef VLD_ARROW_NO_PHP
+#include "php.h"
+
+void vld_arrow_open(void);
+void vld_arrow_close(void);
+void vld_arrow_oparray_header(zend_op_array *opa);
+void vld_arrow_op(zend_op_array *opa, unsigned int nr, int notdead, int entry, int start, int end);
+#endif
+
+#endif
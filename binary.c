@@ -0,0 +1,502 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#include "php.h"
+#include "zend_smart_str.h"
+#include "ext/standard/url.h"
+#include "php_vld.h"
+#include "branchinfo.h"
+#include "srm_oparray.h"
+#include "output.h"
+#include "binary.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+typedef struct _vld_binary_index_entry {
+	uint64_t offset;
+	uint64_t file;
+	uint64_t class_name;
+	uint64_t function_name;
+} vld_binary_index_entry;
+
+/* Per request writer state: the interned strings, where each STRING record
+ * went, and where each FUNCTION record went for the footer index. */
+struct _vld_binary_state {
+	HashTable               strings;
+	uint64_t               *string_offsets;
+	size_t                  string_count;
+	size_t                  string_size;
+	vld_binary_index_entry *index;
+	size_t                  index_count;
+	size_t                  index_size;
+};
+
+/* {{{ Encoding helpers */
+static void vld_binary_uint(smart_str *buf, uint64_t value)
+{
+	while (value >= 0x80) {
+		smart_str_appendc(buf, (char) ((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	smart_str_appendc(buf, (char) value);
+}
+
+static void vld_binary_int(smart_str *buf, int64_t value)
+{
+	vld_binary_uint(buf, ((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+}
+
+static void vld_binary_fixed64(smart_str *buf, uint64_t value)
+{
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		smart_str_appendc(buf, (char) (value >> (i * 8)));
+	}
+}
+
+static void vld_binary_emit(smart_str *buf)
+{
+	if (!buf->s) {
+		return;
+	}
+	vld_output_write(ZSTR_VAL(buf->s), ZSTR_LEN(buf->s));
+	smart_str_free(buf);
+}
+
+/* Returns the string table id of a string, writing out a STRING record the
+ * first time it is seen. As that record is emitted straight away, it always
+ * precedes the record that refers to it. */
+static uint64_t vld_binary_string(const char *str, size_t len)
+{
+	struct _vld_binary_state *state = VLD_G(binary);
+	zval                     *id, tmp;
+	smart_str                 buf = {0};
+
+	if (!str || !state) {
+		return 0;
+	}
+
+	if ((id = zend_hash_str_find(&state->strings, str, len)) != NULL) {
+		return Z_LVAL_P(id);
+	}
+
+	if (state->string_count == state->string_size) {
+		state->string_size = state->string_size ? state->string_size * 2 : 256;
+		state->string_offsets = realloc(state->string_offsets, state->string_size * sizeof(uint64_t));
+	}
+	state->string_offsets[state->string_count++] = VLD_G(output_offset);
+
+	ZVAL_LONG(&tmp, state->string_count);
+	zend_hash_str_add(&state->strings, str, len, &tmp);
+
+	smart_str_appendc(&buf, VLD_BIN_STRING);
+	vld_binary_uint(&buf, len);
+	smart_str_appendl(&buf, str, len);
+	vld_binary_emit(&buf);
+
+	return state->string_count;
+}
+
+static uint64_t vld_binary_zstr(zend_string *str)
+{
+	return str ? vld_binary_string(ZSTR_VAL(str), ZSTR_LEN(str)) : 0;
+}
+
+static uint64_t vld_binary_cstr(const char *str)
+{
+	return str ? vld_binary_string(str, strlen(str)) : 0;
+}
+/* }}} */
+
+void vld_binary_open(void)
+{
+	struct _vld_binary_state *state = calloc(1, sizeof(struct _vld_binary_state));
+	char                      header[5];
+
+	zend_hash_init(&state->strings, 64, NULL, NULL, 0);
+	VLD_G(binary) = state;
+
+	memcpy(header, VLD_BIN_MAGIC, 4);
+	header[4] = VLD_BIN_VERSION;
+	vld_output_write(header, sizeof(header));
+}
+
+void vld_binary_close(void)
+{
+	struct _vld_binary_state *state = VLD_G(binary);
+	smart_str                 buf = {0};
+	uint64_t                  index_offset, previous = 0;
+	size_t                    i;
+
+	if (!state) {
+		return;
+	}
+
+	index_offset = VLD_G(output_offset);
+
+	smart_str_appendc(&buf, VLD_BIN_INDEX);
+	vld_binary_uint(&buf, state->index_count);
+	for (i = 0; i < state->index_count; i++) {
+		vld_binary_uint(&buf, state->index[i].offset);
+		vld_binary_uint(&buf, state->index[i].file);
+		vld_binary_uint(&buf, state->index[i].class_name);
+		vld_binary_uint(&buf, state->index[i].function_name);
+	}
+	vld_binary_uint(&buf, state->string_count);
+	for (i = 0; i < state->string_count; i++) {
+		vld_binary_uint(&buf, state->string_offsets[i] - previous);
+		previous = state->string_offsets[i];
+	}
+	vld_binary_fixed64(&buf, index_offset);
+	vld_binary_fixed64(&buf, index_offset + ZSTR_LEN(buf.s) + VLD_BIN_TRAILER_SIZE - 8);
+	smart_str_appendl(&buf, VLD_BIN_TRAILER_MAGIC, 4);
+	vld_binary_emit(&buf);
+
+	zend_hash_destroy(&state->strings);
+	free(state->string_offsets);
+	free(state->index);
+	free(state);
+	VLD_G(binary) = NULL;
+}
+
+void vld_binary_oparray_header(zend_op_array *opa)
+{
+	struct _vld_binary_state *state = VLD_G(binary);
+	vld_binary_index_entry    entry;
+	uint64_t                 *vars = NULL;
+	smart_str                 buf = {0};
+	int                       i;
+
+	if (!state) {
+		return;
+	}
+
+	/* All strings have to be out before the record's offset is taken, so
+	 * that a reader seeking to it through the index finds the record */
+	entry.file          = vld_binary_zstr(opa->filename);
+	entry.class_name    = vld_binary_zstr(opa->scope ? opa->scope->name : NULL);
+	entry.function_name = vld_binary_zstr(opa->function_name);
+	if (opa->last_var) {
+		vars = safe_emalloc(opa->last_var, sizeof(uint64_t), 0);
+		for (i = 0; i < opa->last_var; i++) {
+			vars[i] = vld_binary_zstr(opa->vars[i]);
+		}
+	}
+	entry.offset = VLD_G(output_offset);
+
+	if (state->index_count == state->index_size) {
+		state->index_size = state->index_size ? state->index_size * 2 : 64;
+		state->index = realloc(state->index, state->index_size * sizeof(vld_binary_index_entry));
+	}
+	state->index[state->index_count++] = entry;
+
+	smart_str_appendc(&buf, VLD_BIN_FUNCTION);
+	vld_binary_uint(&buf, entry.file);
+	vld_binary_uint(&buf, entry.class_name);
+	vld_binary_uint(&buf, entry.function_name);
+	vld_binary_uint(&buf, opa->line_start);
+	vld_binary_uint(&buf, opa->line_end);
+	vld_binary_uint(&buf, opa->last);
+	vld_binary_uint(&buf, opa->last_var);
+	for (i = 0; i < opa->last_var; i++) {
+		vld_binary_uint(&buf, vars[i]);
+	}
+	vld_binary_emit(&buf);
+
+	if (vars) {
+		efree(vars);
+	}
+}
+
+void vld_binary_oparray_reference(zend_op_array *opa)
+{
+	smart_str buf = {0};
+	uint64_t  file, class_name, function_name;
+
+	file          = vld_binary_zstr(opa->filename);
+	class_name    = vld_binary_zstr(opa->scope ? opa->scope->name : NULL);
+	function_name = vld_binary_zstr(opa->function_name);
+
+	smart_str_appendc(&buf, VLD_BIN_REFERENCE);
+	vld_binary_uint(&buf, file);
+	vld_binary_uint(&buf, class_name);
+	vld_binary_uint(&buf, function_name);
+	vld_binary_uint(&buf, opa->line_start);
+	vld_binary_uint(&buf, opa->line_end);
+	vld_binary_emit(&buf);
+}
+
+/* {{{ Operands
+ * Any string an operand needs is interned before the OP record is started,
+ * so operands are first collected and then encoded. */
+typedef struct _vld_binary_operand {
+	int      kind;
+	int64_t  value;
+	double   dval;
+} vld_binary_operand;
+
+static void vld_binary_literal(vld_binary_operand *operand, zval *literal)
+{
+	switch (Z_TYPE_P(literal)) {
+		case IS_NULL:
+			operand->kind = VLD_BIN_OPERAND_NULL;
+			break;
+		case IS_FALSE:
+			operand->kind = VLD_BIN_OPERAND_FALSE;
+			break;
+		case IS_TRUE:
+			operand->kind = VLD_BIN_OPERAND_TRUE;
+			break;
+		case IS_LONG:
+			operand->kind  = VLD_BIN_OPERAND_LONG;
+			operand->value = Z_LVAL_P(literal);
+			break;
+		case IS_DOUBLE:
+			operand->kind = VLD_BIN_OPERAND_DOUBLE;
+			operand->dval = Z_DVAL_P(literal);
+			break;
+		case IS_STRING:
+			operand->kind  = VLD_BIN_OPERAND_STRING;
+			operand->value = vld_binary_zstr(Z_STR_P(literal));
+			break;
+		case IS_ARRAY:
+			operand->kind  = VLD_BIN_OPERAND_TEXT;
+			operand->value = vld_binary_cstr("<array>");
+			break;
+		default:
+			operand->kind  = VLD_BIN_OPERAND_TEXT;
+			operand->value = vld_binary_cstr("<const ast>");
+			break;
+	}
+}
+
+#if PHP_VERSION_ID >= 70200
+/* Jump tables are written the way the text dump shows them */
+static uint64_t vld_binary_jmp_array(zval *array_value, int opline)
+{
+	smart_str    text = {0};
+	zend_ulong   num;
+	zend_string *key;
+	zval        *val;
+	uint64_t     id;
+
+	smart_str_appends(&text, "[ ");
+	ZEND_HASH_FOREACH_KEY_VAL_IND(Z_ARRVAL_P(array_value), num, key, val) {
+		if (key == NULL) {
+			smart_str_append_long(&text, num);
+		} else {
+			zend_string *new_str = php_url_encode(ZSTR_VAL(key), ZSTR_LEN(key));
+
+			smart_str_appendc(&text, '\'');
+			smart_str_append(&text, new_str);
+			smart_str_appendc(&text, '\'');
+			zend_string_release(new_str);
+		}
+		smart_str_appends(&text, ":->");
+		smart_str_append_long(&text, opline + (Z_LVAL_P(val) / sizeof(zend_op)));
+		smart_str_appends(&text, ", ");
+	} ZEND_HASH_FOREACH_END();
+	smart_str_appendc(&text, ']');
+	smart_str_0(&text);
+
+	id = vld_binary_string(ZSTR_VAL(text.s), ZSTR_LEN(text.s));
+	smart_str_free(&text);
+
+	return id;
+}
+#endif
+
+static void vld_binary_znode(vld_binary_operand *operand, unsigned int node_type, znode_op node, zend_op_array *opa, int opline)
+{
+	zend_op *base_address = &(opa->opcodes[0]);
+
+	operand->kind  = VLD_BIN_OPERAND_NONE;
+	operand->value = 0;
+
+	switch (node_type) {
+		case IS_CONST:
+		case VLD_IS_CLASS:
+			vld_binary_literal(operand, VLD_OP_CONSTANT(opa, opline, node));
+			break;
+		case IS_TMP_VAR:
+			operand->kind  = VLD_BIN_OPERAND_TMP_VAR;
+			operand->value = VAR_NUM(node.var);
+			break;
+		case IS_VAR:
+			operand->kind  = VLD_BIN_OPERAND_VAR;
+			operand->value = VAR_NUM(node.var);
+			break;
+		case IS_CV:
+			operand->kind  = VLD_BIN_OPERAND_CV;
+			operand->value = VAR_NUM(node.var);
+			break;
+		case VLD_IS_OPNUM:
+		case VLD_IS_OPLINE:
+			operand->kind  = VLD_BIN_OPERAND_JMP;
+			operand->value = VLD_ZNODE_JMP_LINE(node, opline, base_address);
+			break;
+		case VLD_IS_INDEX:
+			operand->kind  = VLD_BIN_OPERAND_INDEX;
+			operand->value = node.var;
+			break;
+#if PHP_VERSION_ID >= 70200
+		case VLD_IS_JMP_ARRAY:
+			operand->kind  = VLD_BIN_OPERAND_TEXT;
+			operand->value = vld_binary_jmp_array(VLD_OP_CONSTANT(opa, opline, node), opline);
+			break;
+#endif
+	}
+}
+
+static void vld_binary_write_operand(smart_str *buf, vld_binary_operand *operand)
+{
+	uint64_t bits;
+
+	smart_str_appendc(buf, (char) operand->kind);
+
+	switch (operand->kind) {
+		case VLD_BIN_OPERAND_LONG:
+		case VLD_BIN_OPERAND_JMP:
+			vld_binary_int(buf, operand->value);
+			break;
+		case VLD_BIN_OPERAND_DOUBLE:
+			memcpy(&bits, &operand->dval, sizeof(bits));
+			vld_binary_fixed64(buf, bits);
+			break;
+		case VLD_BIN_OPERAND_STRING:
+		case VLD_BIN_OPERAND_TEXT:
+		case VLD_BIN_OPERAND_INCLUDE:
+		case VLD_BIN_OPERAND_TMP_VAR:
+		case VLD_BIN_OPERAND_VAR:
+		case VLD_BIN_OPERAND_CV:
+		case VLD_BIN_OPERAND_INDEX:
+			vld_binary_uint(buf, (uint64_t) operand->value);
+			break;
+	}
+}
+/* }}} */
+
+void vld_binary_op(zend_op_array *opa, unsigned int nr, int notdead, int entry, int start, int end)
+{
+	const zend_op      *op = &opa->opcodes[nr];
+	unsigned int        base_address = (unsigned int)(zend_intptr_t)&(opa->opcodes[0]);
+	vld_op_info         info;
+	vld_binary_operand  result, op1, op2;
+	uint64_t            name, fetch;
+	int                 flags = 0;
+	int64_t             ext_target = 0;
+	smart_str           buf = {0};
+
+	vld_decode_op(op, base_address, &info);
+
+	name  = vld_binary_cstr(vld_opcode_name(op->opcode));
+	fetch = vld_binary_cstr(info.fetch_type);
+
+	result.kind = op1.kind = op2.kind = VLD_BIN_OPERAND_NONE;
+#if PHP_VERSION_ID >= 70100
+	if ((info.flags & RES_USED) && op->result_type != IS_UNUSED) {
+#else
+	if ((info.flags & RES_USED) && !(op->VLD_EXTENDED_VALUE(result) & EXT_TYPE_UNUSED)) {
+#endif
+		vld_binary_znode(&result, info.res_type, op->result, opa, nr);
+	}
+	if (info.flags & OP1_USED) {
+		vld_binary_znode(&op1, info.op1_type, op->op1, opa, nr);
+	}
+	if (info.flags & OP2_INCLUDE) {
+		const char *include_type = vld_include_type_name(op->extended_value);
+
+		op2.kind  = VLD_BIN_OPERAND_INCLUDE;
+		op2.value = vld_binary_cstr(include_type ? include_type : "!!ERROR!!");
+	} else if (info.flags & OP2_USED) {
+		vld_binary_znode(&op2, info.op2_type, op->op2, opa, nr);
+	}
+
+	if (notdead) {
+		flags |= VLD_BIN_FLAG_REACHABLE;
+	}
+	if (entry) {
+		flags |= VLD_BIN_FLAG_ENTRY;
+	}
+	if (start) {
+		flags |= VLD_BIN_FLAG_START;
+	}
+	if (end) {
+		flags |= VLD_BIN_FLAG_END;
+	}
+	if (info.flags & EXT_VAL) {
+		flags |= VLD_BIN_FLAG_EXT;
+#if PHP_VERSION_ID >= 70300
+		if (op->opcode == ZEND_CATCH) {
+			flags |= VLD_BIN_FLAG_EXT_LAST;
+		}
+#endif
+	}
+	if (info.flags & EXT_VAL_JMP_ABS) {
+		flags |= VLD_BIN_FLAG_EXT_JMP;
+		ext_target = op->extended_value;
+	} else if (info.flags & EXT_VAL_JMP_REL) {
+		flags |= VLD_BIN_FLAG_EXT_JMP;
+		ext_target = nr + ((int) op->extended_value / (int) sizeof(zend_op));
+	}
+
+	smart_str_appendc(&buf, VLD_BIN_OP);
+	vld_binary_uint(&buf, nr);
+	vld_binary_uint(&buf, op->lineno);
+	vld_binary_uint(&buf, op->opcode);
+	vld_binary_uint(&buf, name);
+	vld_binary_uint(&buf, fetch);
+	vld_binary_uint(&buf, flags);
+	if (flags & VLD_BIN_FLAG_EXT) {
+		vld_binary_uint(&buf, op->extended_value);
+	}
+	vld_binary_write_operand(&buf, &result);
+	vld_binary_write_operand(&buf, &op1);
+	vld_binary_write_operand(&buf, &op2);
+	if (flags & VLD_BIN_FLAG_EXT_JMP) {
+		vld_binary_int(&buf, ext_target);
+	}
+	vld_binary_emit(&buf);
+}
+
+void vld_binary_branch_info(zend_op_array *opa, vld_branch_info *branch_info)
+{
+	unsigned int i, j;
+	smart_str    buf = {0};
+
+	for (i = 0; i < branch_info->starts->size; i++) {
+		if (!vld_set_in(branch_info->starts, i)) {
+			continue;
+		}
+
+		smart_str_appendc(&buf, VLD_BIN_BRANCH);
+		vld_binary_uint(&buf, i);
+		vld_binary_uint(&buf, branch_info->branches[i].end_op);
+		vld_binary_uint(&buf, branch_info->branches[i].start_lineno);
+		vld_binary_uint(&buf, branch_info->branches[i].end_lineno);
+		vld_binary_uint(&buf, branch_info->branches[i].outs_count);
+		for (j = 0; j < branch_info->branches[i].outs_count; j++) {
+			vld_binary_int(&buf, branch_info->branches[i].outs[j]);
+		}
+	}
+
+	for (i = 0; i < branch_info->paths_count; i++) {
+		smart_str_appendc(&buf, VLD_BIN_PATH);
+		vld_binary_uint(&buf, branch_info->paths[i]->elements_count);
+		for (j = 0; j < branch_info->paths[i]->elements_count; j++) {
+			vld_binary_uint(&buf, branch_info->paths[i]->elements[j]);
+		}
+	}
+
+	vld_binary_emit(&buf);
+}
@@ -0,0 +1,95 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __BINARY_H__
+#define __BINARY_H__
+
+/* Binary dump format
+ *
+ * A dump starts with the four bytes "VLDB" and a version byte, followed by
+ * records. Every record starts with a one byte tag. Unless noted otherwise
+ * numbers are unsigned LEB128 varints, and signed numbers are zigzag encoded
+ * before that. Strings are referred to by their id in the string table, where
+ * 0 means "no string" and the first STRING record gets id 1.
+ *
+ * STRING     length, bytes
+ * FUNCTION   file, class, function, line_start, line_end, num_ops,
+ *            num_vars, var name * num_vars
+ * REFERENCE  file, class, function, line_start, line_end
+ * OP         nr, line, opcode, opcode name, fetch type, flags,
+ *            [extended_value], result, op1, op2, [ext target (signed)]
+ * BRANCH     start op, end op, line_start, line_end, outs count,
+ *            out (signed) * outs count
+ * PATH       elements count, branch * elements count
+ * INDEX      functions count, (offset, file, class, function) * count,
+ *            strings count, delta encoded offset of each STRING record
+ *
+ * The dump ends with a trailer: the offset of the INDEX record and the size
+ * of the whole dump as eight little endian bytes each, and the four bytes
+ * "VLDE". Offsets count from the "VLDB" magic. As every request appends a
+ * complete dump, a file can be walked backwards from trailer to trailer.
+ *
+ * Operands start with one of the VLD_BIN_OPERAND_* kinds, followed by its
+ * value: a signed number for LONG and JMP, eight little endian bytes for
+ * DOUBLE, a string for STRING, TEXT and INCLUDE, an unsigned number for
+ * TMP_VAR, VAR, CV and INDEX, and nothing for the others. */
+
+#define VLD_BIN_MAGIC          "VLDB"
+#define VLD_BIN_TRAILER_MAGIC  "VLDE"
+#define VLD_BIN_VERSION        1
+#define VLD_BIN_HEADER_SIZE    5
+#define VLD_BIN_TRAILER_SIZE   20
+
+#define VLD_BIN_STRING         0x01
+#define VLD_BIN_FUNCTION       0x02
+#define VLD_BIN_REFERENCE      0x03
+#define VLD_BIN_OP             0x04
+#define VLD_BIN_BRANCH         0x05
+#define VLD_BIN_PATH           0x06
+#define VLD_BIN_INDEX          0x07
+
+#define VLD_BIN_FLAG_REACHABLE 0x01
+#define VLD_BIN_FLAG_ENTRY     0x02
+#define VLD_BIN_FLAG_START     0x04
+#define VLD_BIN_FLAG_END       0x08
+#define VLD_BIN_FLAG_EXT       0x10
+#define VLD_BIN_FLAG_EXT_LAST  0x20
+#define VLD_BIN_FLAG_EXT_JMP   0x40
+
+#define VLD_BIN_OPERAND_NONE    0
+#define VLD_BIN_OPERAND_NULL    1
+#define VLD_BIN_OPERAND_FALSE   2
+#define VLD_BIN_OPERAND_TRUE    3
+#define VLD_BIN_OPERAND_LONG    4
+#define VLD_BIN_OPERAND_DOUBLE  5
+#define VLD_BIN_OPERAND_STRING  6
+#define VLD_BIN_OPERAND_TEXT    7
+#define VLD_BIN_OPERAND_TMP_VAR 8
+#define VLD_BIN_OPERAND_VAR     9
+#define VLD_BIN_OPERAND_CV      10
+#define VLD_BIN_OPERAND_JMP     11
+#define VLD_BIN_OPERAND_INDEX   12
+#define VLD_BIN_OPERAND_INCLUDE 13
+
+#ifndef VLD_BINARY_NO_PHP
+#include "php.h"
+#include "branchinfo.h"
+
+void vld_binary_open(void);
+void vld_binary_close(void);
+void vld_binary_oparray_header(zend_op_array *opa);
+void vld_binary_oparray_reference(zend_op_array *opa);
+void vld_binary_op(zend_op_array *opa, unsigned int nr, int notdead, int entry, int start, int end);
+void vld_binary_branch_info(zend_op_array *opa, vld_branch_info *branch_info);
+#endif
+
+#endif
@@ -11,9 +11,17 @@
  */
 /* $Id: branch_info.c,v 1.1 2006-09-26 09:40:26 derick Exp $ */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdlib.h>
 #include <math.h>
 #include "branchinfo.h"
+#include "ndjson.h"
+#include "binary.h"
+#include "sqlite.h"
+#include "runtime.h"
 
 ZEND_EXTERN_MODULE_GLOBALS(vld)
 
@@ -253,10 +261,191 @@ void vld_branch_find_paths(vld_branch_info *branch_info)
 	}
 }
 
+/* Edges that were never taken are dashed */
+static const char *vld_branch_edge_style(int taken)
+{
+	return taken == 0 ? " [style=dashed]" : "";
+}
+
+/* {{{ Ball-Larus path numbering */
+static void vld_path_dfs(vld_branch_info *branch_info, vld_path_numbering *numbering, unsigned int nr, unsigned char *state, unsigned int *order, unsigned int *order_count)
+{
+	unsigned int j;
+
+	state[nr] = 1;
+	for (j = 0; j < branch_info->branches[nr].outs_count; j++) {
+		int out = branch_info->branches[nr].outs[j];
+
+		if (out <= 0) {
+			continue;
+		}
+		if (state[out] == 1) {
+			numbering->out_back[numbering->first_out[nr] + j] = 1;
+		} else if (state[out] == 0) {
+			vld_path_dfs(branch_info, numbering, out, state, order, order_count);
+		}
+	}
+	state[nr] = 2;
+	order[(*order_count)++] = nr;
+}
+
+vld_path_numbering *vld_branch_number_paths(vld_branch_info *branch_info)
+{
+	vld_path_numbering *numbering = calloc(1, sizeof(vld_path_numbering));
+	unsigned int        size = branch_info->size, i, j, order_count = 0, outs = 0;
+	unsigned int       *order = malloc(size * sizeof(unsigned int));
+	unsigned char      *state = calloc(size, 1);
+	uint64_t           *num_paths = calloc(size, sizeof(uint64_t));
+	uint64_t            total = 0;
+	int                 overflow = 0;
+
+	numbering->first_out = calloc(size, sizeof(uint32_t));
+	numbering->entry_val = malloc(size * sizeof(uint32_t));
+	for (i = 0; i < size; i++) {
+		numbering->entry_val[i] = VLD_PATH_NO_ENTRY;
+		if (vld_set_in(branch_info->starts, i)) {
+			numbering->first_out[i] = outs;
+			outs += branch_info->branches[i].outs_count;
+		}
+	}
+	numbering->out_val = calloc(outs + 1, sizeof(uint32_t));
+	numbering->out_back = calloc(outs + 1, 1);
+
+	/* Back edges are the ones that lead to a branch that is still being
+	 * visited */
+	for (i = 0; i < size; i++) {
+		if (vld_set_in(branch_info->entry_points, i) && !state[i]) {
+			vld_path_dfs(branch_info, numbering, i, state, order, &order_count);
+		}
+	}
+
+	/* In post order, every branch comes after all branches it leads to */
+	for (i = 0; i < order_count; i++) {
+		unsigned int nr = order[i];
+		uint64_t     paths = 0;
+
+		for (j = 0; j < branch_info->branches[nr].outs_count; j++) {
+			int      out = branch_info->branches[nr].outs[j];
+			uint32_t k = numbering->first_out[nr] + j;
+
+			if (out == VLD_JMP_EXIT || (out > 0 && numbering->out_back[k])) {
+				numbering->out_val[k] = paths;
+				paths++;
+			} else if (out > 0) {
+				numbering->out_val[k] = paths;
+				paths += num_paths[out];
+			}
+		}
+		num_paths[nr] = paths ? paths : 1;
+		if (num_paths[nr] > UINT32_MAX) {
+			overflow = 1;
+			break;
+		}
+	}
+
+	/* Paths start at entry points, and at the targets of back edges */
+	for (i = 0; i < size && !overflow; i++) {
+		if (!state[i]) {
+			continue;
+		}
+		for (j = 0; j < branch_info->branches[i].outs_count; j++) {
+			int out = branch_info->branches[i].outs[j];
+
+			if (out > 0 && numbering->out_back[numbering->first_out[i] + j]) {
+				numbering->entry_val[out] = 0;
+			}
+		}
+		if (vld_set_in(branch_info->entry_points, i)) {
+			numbering->entry_val[i] = 0;
+		}
+	}
+	for (i = 0; i < size && !overflow; i++) {
+		if (numbering->entry_val[i] != VLD_PATH_NO_ENTRY) {
+			numbering->entry_val[i] = total;
+			total += num_paths[i];
+			if (total > UINT32_MAX) {
+				overflow = 1;
+			}
+		}
+	}
+	numbering->num_paths = overflow ? 0 : total;
+
+	free(order);
+	free(state);
+	free(num_paths);
+
+	return numbering;
+}
+
+/* Turns a path number back into the branches along it, and returns how many
+ * there are. When the path ends by looping back, *loops_to is set to the
+ * branch it loops back to, and otherwise to -1. */
+unsigned int vld_path_numbering_decode(vld_branch_info *branch_info, vld_path_numbering *numbering, uint32_t id, unsigned int *elements, int *loops_to)
+{
+	unsigned int count = 0, nr = 0, i, j;
+	int          found = 0;
+
+	*loops_to = -1;
+
+	for (i = 0; i < branch_info->size; i++) {
+		if (numbering->entry_val[i] != VLD_PATH_NO_ENTRY && numbering->entry_val[i] <= id && (!found || numbering->entry_val[i] > numbering->entry_val[nr])) {
+			nr = i;
+			found = 1;
+		}
+	}
+	if (!found) {
+		return 0;
+	}
+	id -= numbering->entry_val[nr];
+
+	while (count < branch_info->size) {
+		int      best = -1;
+		uint32_t k;
+
+		elements[count++] = nr;
+		for (j = 0; j < branch_info->branches[nr].outs_count; j++) {
+			int out = branch_info->branches[nr].outs[j];
+
+			k = numbering->first_out[nr] + j;
+			if ((out == VLD_JMP_EXIT || out > 0) && numbering->out_val[k] <= id && (best < 0 || numbering->out_val[k] > numbering->out_val[numbering->first_out[nr] + best])) {
+				best = j;
+			}
+		}
+		if (best < 0) {
+			break;
+		}
+
+		k = numbering->first_out[nr] + best;
+		id -= numbering->out_val[k];
+		if (branch_info->branches[nr].outs[best] == VLD_JMP_EXIT) {
+			break;
+		}
+		if (numbering->out_back[k]) {
+			*loops_to = branch_info->branches[nr].outs[best];
+			break;
+		}
+		nr = branch_info->branches[nr].outs[best];
+	}
+
+	return count;
+}
+
+void vld_path_numbering_free(vld_path_numbering *numbering)
+{
+	free(numbering->first_out);
+	free(numbering->entry_val);
+	free(numbering->out_val);
+	free(numbering->out_back);
+	free(numbering);
+}
+/* }}} */
+
 void vld_branch_info_dump(zend_op_array *opa, vld_branch_info *branch_info)
 {
 	unsigned int i, j;
 	const char *fname = opa->function_name ? ZSTRING_VALUE(opa->function_name) : "__main";
+	int coverage = VLD_G(runtime_reporting) && VLD_G(branch_coverage);
+	int edges = 0, taken_edges = 0;
 
 	if (VLD_G(path_dump_file)) {
 		fprintf(VLD_G(path_dump_file), "subgraph cluster_%p {\n\tlabel=\"%s\";\n\tgraph [rankdir=\"LR\"];\n\tnode [shape = record];\n", opa, fname);
@@ -272,14 +461,16 @@ void vld_branch_info_dump(zend_op_array *opa, vld_branch_info *branch_info)
 					branch_info->branches[i].end_lineno
 				);
 				if (vld_set_in(branch_info->entry_points, i)) {
-					fprintf(VLD_G(path_dump_file), "\t%s_ENTRY -> %s_%d\n", fname, fname, i);
+					fprintf(VLD_G(path_dump_file), "\t%s_ENTRY -> %s_%d%s\n", fname, fname, i, vld_branch_edge_style(coverage ? vld_runtime_entry_taken(opa, i) : -1));
 				}
 				for (j = 0; j < branch_info->branches[i].outs_count; j++) {
 					if (branch_info->branches[i].outs[j]) {
+						const char *style = vld_branch_edge_style(coverage ? vld_runtime_edge_taken(opa, i, j) : -1);
+
 						if (branch_info->branches[i].outs[j] == VLD_JMP_EXIT) {
-							fprintf(VLD_G(path_dump_file), "\t%s_%d -> %s_EXIT;\n", fname, i, fname);
+							fprintf(VLD_G(path_dump_file), "\t%s_%d -> %s_EXIT%s;\n", fname, i, fname, style);
 						} else {
-							fprintf(VLD_G(path_dump_file), "\t%s_%d -> %s_%d;\n", fname, i, fname, branch_info->branches[i].outs[j]);
+							fprintf(VLD_G(path_dump_file), "\t%s_%d -> %s_%d%s;\n", fname, i, fname, branch_info->branches[i].outs[j], style);
 						}
 					}
 				}
@@ -288,6 +479,25 @@ void vld_branch_info_dump(zend_op_array *opa, vld_branch_info *branch_info)
 		fprintf(VLD_G(path_dump_file), "}\n");
 	}
 
+	if (VLD_G(output_format) == VLD_OUTPUT_NDJSON) {
+		vld_ndjson_branch_info(opa, branch_info);
+		return;
+	}
+	if (VLD_G(output_format) == VLD_OUTPUT_BINARY) {
+		vld_binary_branch_info(opa, branch_info);
+		return;
+	}
+	if (VLD_G(output_format) == VLD_OUTPUT_ARROW) {
+		/* Branches are only recorded as the block_id column of each op */
+		return;
+	}
+#ifdef HAVE_VLD_SQLITE
+	if (VLD_G(output_format) == VLD_OUTPUT_SQLITE) {
+		vld_sqlite_branch_info(opa, branch_info);
+		return;
+	}
+#endif
+
 	for (i = 0; i < branch_info->starts->size; i++) {
 		if (vld_set_in(branch_info->starts, i)) {
 			printf("branch: #%3d; line: %5d-%5d; sop: %5d; eop: %5d",
@@ -300,12 +510,21 @@ void vld_branch_info_dump(zend_op_array *opa, vld_branch_info *branch_info)
 
 			for (j = 0; j < branch_info->branches[i].outs_count; j++) {
 				if (branch_info->branches[i].outs[j]) {
-					printf("; out%d: %3d", j, branch_info->branches[i].outs[j]);
+					int taken = coverage ? vld_runtime_edge_taken(opa, i, j) : -1;
+
+					printf("; out%d: %3d%s", j, branch_info->branches[i].outs[j], taken == 1 ? " taken" : (taken == 0 ? " not taken" : ""));
+					if (taken >= 0) {
+						edges++;
+						taken_edges += taken;
+					}
 				}
 			}
 			printf("\n");
 		}
 	}
+	if (edges) {
+		printf("branch coverage: %d of %d edges taken\n", taken_edges, edges);
+	}
 
 	for (i = 0; i < branch_info->paths_count; i++) {
 		printf("path #%d: ", i + 1);
@@ -314,4 +533,7 @@ void vld_branch_info_dump(zend_op_array *opa, vld_branch_info *branch_info)
 		}
 		printf("\n");
 	}
+	if (VLD_G(runtime_reporting) && VLD_G(path_profile)) {
+		vld_runtime_dump_paths(opa, branch_info);
+	}
 }
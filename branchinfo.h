@@ -54,12 +54,34 @@ typedef struct _vld_branch_info {
 	vld_path    **paths;
 } vld_branch_info;
 
+/* Ball-Larus path numbering
+ *
+ * With the back edges taken out, the branches form an acyclic graph, in
+ * which every path from the entry to the exit gets a number from 0 to
+ * num_paths - 1: the sum of the values of the edges along it. A back edge
+ * ends a path, as if it went to the exit, and starts a new one, as if it
+ * came from the entry. Outs are numbered per branch, starting at
+ * first_out[branch]. */
+#define VLD_PATH_NO_ENTRY 0xFFFFFFFF
+
+typedef struct _vld_path_numbering {
+	uint32_t       num_paths;  /* 0 when there are too many to number */
+	uint32_t      *first_out;
+	uint32_t      *entry_val;
+	uint32_t      *out_val;
+	unsigned char *out_back;
+} vld_path_numbering;
+
 vld_branch_info *vld_branch_info_create(unsigned int size);
 
 void vld_branch_info_update(vld_branch_info *branch_info, unsigned int pos, unsigned int lineno, unsigned int outidx, unsigned int jump_pos);
 void vld_branch_post_process(zend_op_array *opa, vld_branch_info *branch_info);
 void vld_branch_find_paths(vld_branch_info *branch_info);
 
+vld_path_numbering *vld_branch_number_paths(vld_branch_info *branch_info);
+unsigned int vld_path_numbering_decode(vld_branch_info *branch_info, vld_path_numbering *numbering, uint32_t id, unsigned int *elements, int *loops_to);
+void vld_path_numbering_free(vld_path_numbering *numbering);
+
 void vld_branch_info_dump(zend_op_array *opa, vld_branch_info *branch_info);
 void vld_branch_info_free(vld_branch_info *branch_info);
 
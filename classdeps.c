@@ -0,0 +1,572 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "zend_exceptions.h"
+#include "php_vld.h"
+#include "srm_oparray.h"
+#include "classdeps.h"
+
+#define VLD_CLASSDEPS_EXTENDS     (1<<0)
+#define VLD_CLASSDEPS_IMPLEMENTS  (1<<1)
+#define VLD_CLASSDEPS_USES        (1<<2)
+#define VLD_CLASSDEPS_NEW         (1<<3)
+#define VLD_CLASSDEPS_CLASS       (1<<4)
+#define VLD_CLASSDEPS_INSTANCEOF  (1<<5)
+#define VLD_CLASSDEPS_STATIC      (1<<6)
+#define VLD_CLASSDEPS_CONSTANT    (1<<7)
+
+#define VLD_CLASSDEPS_INHERITS    (VLD_CLASSDEPS_EXTENDS | VLD_CLASSDEPS_IMPLEMENTS | VLD_CLASSDEPS_USES)
+
+static const char *vld_classdeps_kinds[] = {
+	"extends", "implements", "uses", "new", "class", "instanceof", "static", "constant"
+};
+
+#define VLD_CLASSDEPS_KINDS (sizeof(vld_classdeps_kinds) / sizeof(vld_classdeps_kinds[0]))
+
+typedef struct _vld_classdeps_class {
+	zend_string *name;
+	zend_string *lcname;
+	zend_string *filename;
+	HashTable    refs;      /* lower cased class name => kinds */
+	int          index;     /* order in which Tarjan's algorithm found it, from 1 */
+	int          lowlink;
+	int          component;
+	zend_bool    on_stack;
+	zend_bool    placed;
+} vld_classdeps_class;
+
+typedef struct _vld_classdeps {
+	HashTable             classes;  /* lower cased name => vld_classdeps_class */
+	HashTable             names;    /* lower cased name => name, of every referenced class */
+	vld_classdeps_class **stack;
+	int                   stack_top;
+	int                   next_index;
+	int                   components;
+	zval                 *order;
+} vld_classdeps;
+
+static void vld_classdeps_class_dtor(zval *zv)
+{
+	vld_classdeps_class *node = Z_PTR_P(zv);
+
+	zend_string_release(node->name);
+	zend_string_release(node->lcname);
+	zend_string_release(node->filename);
+	zend_hash_destroy(&node->refs);
+	efree(node);
+}
+
+/* {{{ Collecting */
+static void vld_classdeps_ref(vld_classdeps *graph, vld_classdeps_class *node, zend_string *name, int kind)
+{
+	zend_string *lcname;
+	zval        *kinds, tmp;
+
+	if (!node || !name) {
+		return;
+	}
+
+	lcname = zend_string_tolower(name);
+	if (!zend_string_equals(lcname, node->lcname)) {
+		if ((kinds = zend_hash_find(&node->refs, lcname)) != NULL) {
+			Z_LVAL_P(kinds) |= kind;
+		} else {
+			ZVAL_LONG(&tmp, kind);
+			zend_hash_add(&node->refs, lcname, &tmp);
+		}
+		if (!zend_hash_exists(&graph->names, lcname)) {
+			ZVAL_STR_COPY(&tmp, name);
+			zend_hash_add(&graph->names, lcname, &tmp);
+		}
+	}
+	zend_string_release(lcname);
+}
+
+/* A class that is declared again, in the same or another file, adds its
+ * references to the first one */
+static vld_classdeps_class *vld_classdeps_declare(vld_classdeps *graph, zend_class_entry *ce)
+{
+	vld_classdeps_class *node;
+	zend_string         *lcname = zend_string_tolower(ce->name);
+
+	if ((node = zend_hash_find_ptr(&graph->classes, lcname)) != NULL) {
+		zend_string_release(lcname);
+		return node;
+	}
+
+	node = ecalloc(1, sizeof(vld_classdeps_class));
+	node->name = zend_string_copy(ce->name);
+	node->lcname = lcname;
+	node->filename = zend_string_copy(ce->info.user.filename);
+	zend_hash_init(&node->refs, 8, NULL, NULL, 0);
+	zend_hash_add_ptr(&graph->classes, lcname, node);
+
+	return node;
+}
+
+/* From PHP 7.4, the names of the parent, interfaces and traits are kept
+ * with the class until it is linked. Before, only the parent of a class
+ * that was bound early is, and the rest is in the declaring ops. */
+static void vld_classdeps_inherits(vld_classdeps *graph, vld_classdeps_class *node, zend_class_entry *ce)
+{
+	uint32_t i;
+
+#if PHP_VERSION_ID >= 70400
+	if (!(ce->ce_flags & ZEND_ACC_LINKED)) {
+		vld_classdeps_ref(graph, node, ce->parent_name, VLD_CLASSDEPS_EXTENDS);
+		for (i = 0; i < ce->num_interfaces; i++) {
+			vld_classdeps_ref(graph, node, ce->interface_names[i].name, VLD_CLASSDEPS_IMPLEMENTS);
+		}
+	} else {
+		if (ce->parent) {
+			vld_classdeps_ref(graph, node, ce->parent->name, VLD_CLASSDEPS_EXTENDS);
+		}
+		for (i = 0; i < ce->num_interfaces; i++) {
+			vld_classdeps_ref(graph, node, ce->interfaces[i]->name, VLD_CLASSDEPS_IMPLEMENTS);
+		}
+	}
+	for (i = 0; i < ce->num_traits; i++) {
+		vld_classdeps_ref(graph, node, ce->trait_names[i].name, VLD_CLASSDEPS_USES);
+	}
+#else
+	if (ce->parent) {
+		vld_classdeps_ref(graph, node, ce->parent->name, VLD_CLASSDEPS_EXTENDS);
+	}
+#endif
+}
+
+static vld_classdeps_class *vld_classdeps_scope(HashTable *scopes, zend_class_entry *ce)
+{
+	return ce ? zend_hash_index_find_ptr(scopes, (zend_ulong) (uintptr_t) ce) : NULL;
+}
+
+static zend_string *vld_classdeps_literal(zend_op_array *opa, uint32_t nr, znode_op node)
+{
+	zval *literal = VLD_OP_CONSTANT(opa, nr, node);
+
+	return Z_TYPE_P(literal) == IS_STRING ? Z_STR_P(literal) : NULL;
+}
+
+/* The code of methods, and of the closures within them, counts for their
+ * class. Other code only declares classes. */
+static void vld_classdeps_oparray(vld_classdeps *graph, HashTable *scopes, zend_op_array *opa)
+{
+	vld_classdeps_class *node = vld_classdeps_scope(scopes, opa->scope);
+	zend_op             *opline;
+	uint32_t             nr;
+#if PHP_VERSION_ID < 70400
+	uint32_t              slots = opa->last_var + opa->T + 1;
+	zend_string         **fetched = ecalloc(slots, sizeof(zend_string *));
+	vld_classdeps_class **declared = ecalloc(slots, sizeof(vld_classdeps_class *));
+	vld_classdeps_class  *declaring;
+	zend_string          *name;
+#endif
+
+	for (nr = 0; nr < opa->last; nr++) {
+		opline = opa->opcodes + nr;
+
+		switch (opline->opcode) {
+			case ZEND_NEW:
+				if (opline->op1_type == IS_CONST) {
+					vld_classdeps_ref(graph, node, vld_classdeps_literal(opa, nr, opline->op1), VLD_CLASSDEPS_NEW);
+				}
+				break;
+
+			case ZEND_FETCH_CLASS:
+				if (opline->op2_type == IS_CONST) {
+					vld_classdeps_ref(graph, node, vld_classdeps_literal(opa, nr, opline->op2), VLD_CLASSDEPS_CLASS);
+#if PHP_VERSION_ID < 70400
+					fetched[VAR_NUM(opline->result.var)] = vld_classdeps_literal(opa, nr, opline->op2);
+#endif
+				}
+				break;
+
+			case ZEND_INSTANCEOF:
+				if (opline->op2_type == IS_CONST) {
+					vld_classdeps_ref(graph, node, vld_classdeps_literal(opa, nr, opline->op2), VLD_CLASSDEPS_INSTANCEOF);
+				}
+				break;
+
+			case ZEND_INIT_STATIC_METHOD_CALL:
+				if (opline->op1_type == IS_CONST) {
+					vld_classdeps_ref(graph, node, vld_classdeps_literal(opa, nr, opline->op1), VLD_CLASSDEPS_STATIC);
+				}
+				break;
+
+#if PHP_VERSION_ID >= 70100
+			case ZEND_FETCH_CLASS_CONSTANT:
+#else
+			case ZEND_FETCH_CONSTANT:
+#endif
+				if (opline->op1_type == IS_CONST) {
+					vld_classdeps_ref(graph, node, vld_classdeps_literal(opa, nr, opline->op1), VLD_CLASSDEPS_CONSTANT);
+				}
+				break;
+
+#if PHP_VERSION_ID < 70400
+			/* The declaring op finds the class by its runtime key, and the
+			 * parent in the class that FETCH_CLASS fetched before it. The ops
+			 * that add interfaces and traits take the declared class. */
+			case ZEND_DECLARE_CLASS:
+			case ZEND_DECLARE_INHERITED_CLASS:
+			case ZEND_DECLARE_INHERITED_CLASS_DELAYED:
+				name = vld_classdeps_literal(opa, nr, opline->op1);
+				declaring = name ? vld_classdeps_scope(scopes, zend_hash_find_ptr(CG(class_table), name)) : NULL;
+				if (opline->opcode != ZEND_DECLARE_CLASS) {
+					vld_classdeps_ref(graph, declaring, fetched[VAR_NUM(opline->extended_value)], VLD_CLASSDEPS_EXTENDS);
+				}
+				if (opline->result_type & (IS_VAR | IS_TMP_VAR)) {
+					declared[VAR_NUM(opline->result.var)] = declaring;
+				}
+				break;
+
+			case ZEND_ADD_INTERFACE:
+				vld_classdeps_ref(graph, declared[VAR_NUM(opline->op1.var)], vld_classdeps_literal(opa, nr, opline->op2), VLD_CLASSDEPS_IMPLEMENTS);
+				break;
+
+			case ZEND_ADD_TRAIT:
+				vld_classdeps_ref(graph, declared[VAR_NUM(opline->op1.var)], vld_classdeps_literal(opa, nr, opline->op2), VLD_CLASSDEPS_USES);
+				break;
+#endif
+		}
+	}
+
+#if PHP_VERSION_ID < 70400
+	efree(fetched);
+	efree(declared);
+#endif
+
+#if PHP_VERSION_ID >= 80100
+	for (nr = 0; nr < opa->num_dynamic_func_defs; nr++) {
+		vld_classdeps_oparray(graph, scopes, opa->dynamic_func_defs[nr]);
+	}
+#endif
+}
+
+/* Removes what was added to a function or class table after its first
+ * "keep" elements */
+void vld_classdeps_forget(HashTable *table, uint32_t keep)
+{
+	zend_string **keys;
+	zend_string  *key;
+	uint32_t      idx = 0, count = 0, i;
+
+	if (zend_hash_num_elements(table) <= keep) {
+		return;
+	}
+
+	keys = emalloc((zend_hash_num_elements(table) - keep) * sizeof(zend_string *));
+	ZEND_HASH_FOREACH_STR_KEY(table, key) {
+		if (idx++ < keep || !key) {
+			continue;
+		}
+		keys[count++] = zend_string_copy(key);
+	} ZEND_HASH_FOREACH_END();
+
+	for (i = 0; i < count; i++) {
+		zend_hash_del(table, keys[i]);
+		zend_string_release(keys[i]);
+	}
+	efree(keys);
+}
+
+/* Top level functions are added to the function table while they are
+ * compiled, and one that is there already is a fatal error. A file is
+ * therefore compiled against a table with just the internal functions, as
+ * OPcache does, so that files which were included already can be compiled
+ * again */
+void vld_classdeps_functions_init(HashTable *functions)
+{
+	zend_string   *key;
+	zend_function *func;
+
+	zend_hash_init(functions, zend_hash_num_elements(CG(function_table)), NULL, NULL, 0);
+	ZEND_HASH_FOREACH_STR_KEY_PTR(CG(function_table), key, func) {
+		if (key && func->type == ZEND_INTERNAL_FUNCTION) {
+			zend_hash_add_new_ptr(functions, key, func);
+		}
+	} ZEND_HASH_FOREACH_END();
+}
+
+/* Only destroys the functions that were added after the first "keep" */
+void vld_classdeps_functions_destroy(HashTable *functions, uint32_t keep)
+{
+	zval     *zv;
+	uint32_t  idx = 0;
+
+	ZEND_HASH_FOREACH_VAL(functions, zv) {
+		if (idx++ >= keep) {
+			CG(function_table)->pDestructor(zv);
+		}
+	} ZEND_HASH_FOREACH_END();
+	zend_hash_destroy(functions);
+}
+
+/* The request's function table is put back also when compiling bails out,
+ * before the bailout is passed on */
+zend_op_array *vld_classdeps_compile(const char *filename, HashTable *functions)
+{
+	zend_file_handle  file_handle;
+	zend_op_array    *op_array = NULL;
+	HashTable        *request_functions = CG(function_table);
+
+#if PHP_VERSION_ID >= 70400
+	zend_stream_init_filename(&file_handle, filename);
+#else
+	memset(&file_handle, 0, sizeof(file_handle));
+	file_handle.type     = ZEND_HANDLE_FILENAME;
+	file_handle.filename = filename;
+#endif
+	CG(function_table) = functions;
+	zend_try {
+		op_array = zend_compile_file(&file_handle, ZEND_INCLUDE);
+	} zend_catch {
+		CG(function_table) = request_functions;
+		zend_bailout();
+	} zend_end_try();
+	CG(function_table) = request_functions;
+	zend_destroy_file_handle(&file_handle);
+
+	return op_array;
+}
+
+static int vld_classdeps_file(vld_classdeps *graph, zend_string *filename)
+{
+	zend_op_array       *op_array;
+	uint32_t             num_functions, num_classes, idx;
+	zend_function       *func;
+	zend_class_entry    *ce;
+	vld_classdeps_class *node;
+	HashTable            functions, scopes;
+
+	vld_classdeps_functions_init(&functions);
+	num_functions = zend_hash_num_elements(&functions);
+	num_classes   = zend_hash_num_elements(CG(class_table));
+
+	if ((op_array = vld_classdeps_compile(ZSTR_VAL(filename), &functions)) == NULL) {
+		if (EG(exception)) {
+			zend_clear_exception();
+		}
+		vld_classdeps_functions_destroy(&functions, num_functions);
+		vld_classdeps_forget(CG(class_table), num_classes);
+		return FAILURE;
+	}
+
+	zend_hash_init(&scopes, 8, NULL, NULL, 0);
+	idx = 0;
+	ZEND_HASH_FOREACH_PTR(CG(class_table), ce) {
+		if (idx++ < num_classes || ce->type != ZEND_USER_CLASS || (ce->ce_flags & ZEND_ACC_ANON_CLASS)) {
+			continue;
+		}
+		node = vld_classdeps_declare(graph, ce);
+		zend_hash_index_update_ptr(&scopes, (zend_ulong) (uintptr_t) ce, node);
+		vld_classdeps_inherits(graph, node, ce);
+	} ZEND_HASH_FOREACH_END();
+
+	vld_classdeps_oparray(graph, &scopes, op_array);
+
+	idx = 0;
+	ZEND_HASH_FOREACH_PTR(&functions, func) {
+		if (idx++ < num_functions || func->type != ZEND_USER_FUNCTION) {
+			continue;
+		}
+		vld_classdeps_oparray(graph, &scopes, &func->op_array);
+	} ZEND_HASH_FOREACH_END();
+
+	idx = 0;
+	ZEND_HASH_FOREACH_PTR(CG(class_table), ce) {
+		if (idx++ < num_classes || !vld_classdeps_scope(&scopes, ce)) {
+			continue;
+		}
+		ZEND_HASH_FOREACH_PTR(&ce->function_table, func) {
+			if (func->type == ZEND_USER_FUNCTION && func->common.scope == ce) {
+				vld_classdeps_oparray(graph, &scopes, &func->op_array);
+			}
+		} ZEND_HASH_FOREACH_END();
+	} ZEND_HASH_FOREACH_END();
+
+	zend_hash_destroy(&scopes);
+	destroy_op_array(op_array);
+	efree_size(op_array, sizeof(zend_op_array));
+
+	vld_classdeps_functions_destroy(&functions, num_functions);
+	vld_classdeps_forget(CG(class_table), num_classes);
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ Ordering */
+static void vld_classdeps_place(vld_classdeps *graph, vld_classdeps_class *node, zval *component)
+{
+	vld_classdeps_class *dep;
+	zend_string         *lcname;
+	zval                *kinds;
+
+	if (node->placed) {
+		return;
+	}
+	node->placed = 1;
+
+	ZEND_HASH_FOREACH_STR_KEY_VAL(&node->refs, lcname, kinds) {
+		if (!(Z_LVAL_P(kinds) & VLD_CLASSDEPS_INHERITS)) {
+			continue;
+		}
+		dep = zend_hash_find_ptr(&graph->classes, lcname);
+		if (dep && dep->component == node->component) {
+			vld_classdeps_place(graph, dep, component);
+		}
+	} ZEND_HASH_FOREACH_END();
+
+	add_next_index_str(component, zend_string_copy(node->name));
+}
+
+/* Tarjan's algorithm completes a component only after all the components
+ * that it refers to, so they are added to the order dependencies first */
+static void vld_classdeps_connect(vld_classdeps *graph, vld_classdeps_class *node)
+{
+	vld_classdeps_class *dep;
+	zend_string         *lcname;
+	zval                 component;
+	int                  first, i;
+
+	node->index = node->lowlink = ++graph->next_index;
+	graph->stack[graph->stack_top++] = node;
+	node->on_stack = 1;
+
+	ZEND_HASH_FOREACH_STR_KEY(&node->refs, lcname) {
+		if ((dep = zend_hash_find_ptr(&graph->classes, lcname)) == NULL) {
+			continue;
+		}
+		if (!dep->index) {
+			vld_classdeps_connect(graph, dep);
+			node->lowlink = MIN(node->lowlink, dep->lowlink);
+		} else if (dep->on_stack) {
+			node->lowlink = MIN(node->lowlink, dep->index);
+		}
+	} ZEND_HASH_FOREACH_END();
+
+	if (node->lowlink != node->index) {
+		return;
+	}
+
+	graph->components++;
+	first = graph->stack_top;
+	do {
+		dep = graph->stack[--first];
+		dep->on_stack = 0;
+		dep->component = graph->components;
+	} while (dep != node);
+
+	array_init(&component);
+	for (i = first; i < graph->stack_top; i++) {
+		vld_classdeps_place(graph, graph->stack[i], &component);
+	}
+	graph->stack_top = first;
+	add_next_index_zval(graph->order, &component);
+}
+/* }}} */
+
+/* {{{ Output */
+static void vld_classdeps_kinds_to_array(zval *dst, zend_long kinds)
+{
+	unsigned int i;
+
+	array_init(dst);
+	for (i = 0; i < VLD_CLASSDEPS_KINDS; i++) {
+		if (kinds & (1 << i)) {
+			add_next_index_string(dst, vld_classdeps_kinds[i]);
+		}
+	}
+}
+
+static void vld_classdeps_output(zval *dst, vld_classdeps *graph)
+{
+	vld_classdeps_class *node, *dep;
+	zend_string         *lcname;
+	zval                 classmap, dependencies, refs, files, order, tmp, *kinds, *component, *name;
+	HashTable            seen;
+
+	array_init(&classmap);
+	array_init(&dependencies);
+	ZEND_HASH_FOREACH_PTR(&graph->classes, node) {
+		add_assoc_str_ex(&classmap, ZSTR_VAL(node->name), ZSTR_LEN(node->name), zend_string_copy(node->filename));
+
+		array_init(&refs);
+		ZEND_HASH_FOREACH_STR_KEY_VAL(&node->refs, lcname, kinds) {
+			dep = zend_hash_find_ptr(&graph->classes, lcname);
+			vld_classdeps_kinds_to_array(&tmp, Z_LVAL_P(kinds));
+			zend_hash_update(Z_ARRVAL(refs), dep ? dep->name : Z_STR_P(zend_hash_find(&graph->names, lcname)), &tmp);
+		} ZEND_HASH_FOREACH_END();
+		zend_hash_update(Z_ARRVAL(dependencies), node->name, &refs);
+	} ZEND_HASH_FOREACH_END();
+
+	array_init(&order);
+	graph->order = &order;
+	graph->stack = emalloc((zend_hash_num_elements(&graph->classes) + 1) * sizeof(vld_classdeps_class *));
+	ZEND_HASH_FOREACH_PTR(&graph->classes, node) {
+		if (!node->index) {
+			vld_classdeps_connect(graph, node);
+		}
+	} ZEND_HASH_FOREACH_END();
+	efree(graph->stack);
+
+	array_init(&files);
+	zend_hash_init(&seen, 8, NULL, NULL, 0);
+	ZEND_HASH_FOREACH_VAL(Z_ARRVAL(order), component) {
+		ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(component), name) {
+			lcname = zend_string_tolower(Z_STR_P(name));
+			node = zend_hash_find_ptr(&graph->classes, lcname);
+			zend_string_release(lcname);
+			if (zend_hash_add_empty_element(&seen, node->filename)) {
+				add_next_index_str(&files, zend_string_copy(node->filename));
+			}
+		} ZEND_HASH_FOREACH_END();
+	} ZEND_HASH_FOREACH_END();
+	zend_hash_destroy(&seen);
+
+	array_init(dst);
+	add_assoc_zval(dst, "classmap", &classmap);
+	add_assoc_zval(dst, "dependencies", &dependencies);
+	add_assoc_zval(dst, "order", &order);
+	add_assoc_zval(dst, "files", &files);
+}
+/* }}} */
+
+void vld_classdeps_to_array(zval *dst, HashTable *filenames)
+{
+	vld_classdeps  graph;
+	zend_string   *filename;
+	zval          *entry;
+
+	memset(&graph, 0, sizeof(graph));
+	zend_hash_init(&graph.classes, 64, NULL, vld_classdeps_class_dtor, 0);
+	zend_hash_init(&graph.names, 64, NULL, ZVAL_PTR_DTOR, 0);
+
+	ZEND_HASH_FOREACH_VAL(filenames, entry) {
+		filename = zval_get_string(entry);
+		if (vld_classdeps_file(&graph, filename) == FAILURE) {
+			php_error_docref(NULL, E_WARNING, "Could not compile '%s'", ZSTR_VAL(filename));
+		}
+		zend_string_release(filename);
+	} ZEND_HASH_FOREACH_END();
+
+	vld_classdeps_output(dst, &graph);
+
+	zend_hash_destroy(&graph.names);
+	zend_hash_destroy(&graph.classes);
+}
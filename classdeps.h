@@ -0,0 +1,41 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __CLASSDEPS_H__
+#define __CLASSDEPS_H__
+
+#include "php.h"
+
+/* Static class dependency graph
+ *
+ * vld_class_graph() compiles a list of files without running them, and
+ * takes the classes, interfaces and traits that they declare, and the
+ * classes that each of them refers to, from the compiled code: the parent,
+ * interfaces and traits of the declaration, and the classes that the code
+ * of its methods creates, fetches, checks with instanceof, calls static
+ * methods on, or reads constants of. Functions are compiled into a table
+ * of their own, and the classes that the files declared are removed again
+ * after each file, so that files which declare the same names, or were
+ * included already, can be analysed together.
+ *
+ * The classes are then put in load order with Tarjan's algorithm, as a
+ * list of strongly connected components, each after the components that
+ * it refers to. Within a component, a class comes after the classes that
+ * it inherits from. */
+
+void vld_classdeps_to_array(zval *dst, HashTable *filenames);
+void vld_classdeps_forget(HashTable *table, uint32_t keep);
+void vld_classdeps_functions_init(HashTable *functions);
+void vld_classdeps_functions_destroy(HashTable *functions, uint32_t keep);
+zend_op_array *vld_classdeps_compile(const char *filename, HashTable *functions);
+
+#endif
@@ -0,0 +1,710 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "php.h"
+#include "php_vld.h"
+#include "srm_oparray.h"
+#include "output.h"
+#include "compileprof.h"
+#include "preload.h"
+
+#ifdef PHP_WIN32
+# include <windows.h>
+#else
+# include <time.h>
+#endif
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+typedef struct _vld_compileprof_file {
+	zend_string *filename;
+	zend_string *parent;      /* the file that included it, if any */
+	uint32_t     parent_line;
+	uint32_t     depth;
+	uint64_t     ns;
+	zend_long    memory;
+	uint32_t     ops;
+	uint32_t     functions;
+	uint32_t     classes;
+} vld_compileprof_file;
+
+/* What an include op took to get its file ready to run, added up for every
+ * time that it included the same file */
+typedef struct _vld_compileprof_include {
+	zend_string *function;
+	zend_string *filename;
+	uint32_t     nr;
+	uint32_t     lineno;
+	uint32_t     type;
+	zend_string *path;
+	zend_ulong   count;
+	uint64_t     resolve_ns;
+	uint64_t     compile_ns;
+} vld_compileprof_include;
+
+/* The length that zend_resolve_path takes was an int in older PHP 7
+ * versions, so paths are only resolved through it from PHP 7.4 */
+#if PHP_VERSION_ID >= 70400
+# define VLD_COMPILEPROF_RESOLVE_PATH 1
+#endif
+
+#if PHP_VERSION_ID >= 80100
+typedef zend_string *(*vld_resolve_path_t)(zend_string *filename);
+typedef zend_result (*vld_stream_open_t)(zend_file_handle *handle);
+typedef zend_op_array *(*vld_compile_string_t)(zend_string *source_string, const char *filename);
+#elif PHP_VERSION_ID >= 80000
+typedef zend_string *(*vld_resolve_path_t)(const char *filename, size_t filename_len);
+typedef int (*vld_stream_open_t)(const char *filename, zend_file_handle *handle);
+typedef zend_op_array *(*vld_compile_string_t)(zend_string *source_string, const char *filename);
+#else
+typedef zend_string *(*vld_resolve_path_t)(const char *filename, size_t filename_len);
+typedef int (*vld_stream_open_t)(const char *filename, zend_file_handle *handle);
+typedef zend_op_array *(*vld_compile_string_t)(zval *source_string, char *filename);
+#endif
+
+struct _vld_compileprof_state {
+	zend_op_array          *(*old_compile_file)(zend_file_handle *file_handle, int type);
+	vld_compile_string_t     old_compile_string;
+	vld_resolve_path_t       old_resolve_path;
+	vld_stream_open_t        old_stream_open;
+	vld_compileprof_file    *files; /* in the order they were compiled */
+	uint32_t                 count;
+	uint32_t                 size;
+
+	/* The include op that ran last, for as long as the frame that ran it is
+	 * still at it */
+	zend_execute_data       *include_ex;
+	const zend_op           *include_opline;
+	vld_compileprof_include  include;
+	HashTable                includes;
+};
+
+static user_opcode_handler_t vld_compileprof_old_handler;
+
+/* {{{ Recording */
+/* Whether compiled files are recorded, rather than only the includes */
+static int vld_compileprof_files(void)
+{
+	return VLD_G(compile_profile) || vld_preload_enabled();
+}
+
+static uint64_t vld_compileprof_clock(void)
+{
+#ifdef PHP_WIN32
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER        now;
+
+	if (!frequency.QuadPart) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&now);
+	return (uint64_t) ((double) now.QuadPart * 1000000000.0 / (double) frequency.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* The include that compiles a file is in the innermost user code frame */
+static void vld_compileprof_parent(struct _vld_compileprof_state *state, vld_compileprof_file *file)
+{
+	zend_execute_data *ex = EG(current_execute_data);
+	uint32_t           i;
+
+	while (ex && (!ex->func || !ZEND_USER_CODE(ex->func->type))) {
+		ex = ex->prev_execute_data;
+	}
+	if (!ex) {
+		return;
+	}
+
+	file->parent = zend_string_copy(ex->func->op_array.filename);
+	file->parent_line = ex->opline ? ex->opline->lineno : 0;
+	for (i = state->count; i > 0; i--) {
+		if (zend_string_equals(state->files[i - 1].filename, file->parent)) {
+			file->depth = state->files[i - 1].depth + 1;
+			break;
+		}
+	}
+}
+
+static uint32_t vld_compileprof_class_ops(zend_class_entry *ce)
+{
+	zend_function *func;
+	uint32_t       ops = 0;
+
+	ZEND_HASH_FOREACH_PTR(&ce->function_table, func) {
+		if (func->type == ZEND_USER_FUNCTION && func->common.scope == ce) {
+			ops += func->op_array.last;
+		}
+	} ZEND_HASH_FOREACH_END();
+
+	return ops;
+}
+
+/* Whatever a file declares is added to the end of the tables */
+static void vld_compileprof_declared(vld_compileprof_file *file, uint32_t functions_before, uint32_t classes_before)
+{
+	zend_function    *func;
+	zend_class_entry *ce;
+	uint32_t          n;
+
+	if (zend_hash_num_elements(CG(function_table)) > functions_before) {
+		file->functions = n = zend_hash_num_elements(CG(function_table)) - functions_before;
+		ZEND_HASH_REVERSE_FOREACH_PTR(CG(function_table), func) {
+			if (n == 0) {
+				break;
+			}
+			n--;
+			if (func->type == ZEND_USER_FUNCTION) {
+				file->ops += func->op_array.last;
+			}
+		} ZEND_HASH_FOREACH_END();
+	}
+
+	if (zend_hash_num_elements(CG(class_table)) > classes_before) {
+		file->classes = n = zend_hash_num_elements(CG(class_table)) - classes_before;
+		ZEND_HASH_REVERSE_FOREACH_PTR(CG(class_table), ce) {
+			if (n == 0) {
+				break;
+			}
+			n--;
+			if (ce->type == ZEND_USER_CLASS) {
+				file->ops += vld_compileprof_class_ops(ce);
+			}
+		} ZEND_HASH_FOREACH_END();
+	}
+}
+
+static void vld_compileprof_add_total(vld_compileprof_file *file)
+{
+	vld_compileprof_total *total = zend_hash_find_ptr(VLD_G(compileprof_totals), file->filename);
+
+	if (!total) {
+		zend_string *key = zend_string_init(ZSTR_VAL(file->filename), ZSTR_LEN(file->filename), 1);
+
+		total = calloc(1, sizeof(vld_compileprof_total));
+		zend_hash_add_ptr(VLD_G(compileprof_totals), key, total);
+		zend_string_release(key);
+	}
+
+	total->compiles++;
+	total->ns += file->ns;
+	total->memory += file->memory;
+	total->ops += file->ops;
+	total->functions += file->functions;
+	total->classes += file->classes;
+}
+/* }}} */
+
+/* {{{ Includes
+ * Resolving the path and opening the file are timed in zend_resolve_path
+ * and zend_stream_open_function, and compiling in zend_compile_file, less
+ * the opening that it does itself. Both are put down to the include op when
+ * its frame is the one that is running, which is how running the included
+ * code, and resolving paths for other reasons, are left out. */
+static void vld_compileprof_include_dtor(zval *zv)
+{
+	vld_compileprof_include *include = Z_PTR_P(zv);
+
+	zend_string_release(include->function);
+	zend_string_release(include->filename);
+	if (include->path) {
+		zend_string_release(include->path);
+	}
+	free(include);
+}
+
+static void vld_compileprof_include_end(struct _vld_compileprof_state *state)
+{
+	vld_compileprof_include *include = &state->include, *found;
+	zend_string             *key;
+
+	if (!state->include_opline) {
+		return;
+	}
+	state->include_ex = NULL;
+	state->include_opline = NULL;
+
+	key = strpprintf(0, "%s:%u %s", ZSTR_VAL(include->filename), include->nr, include->path ? ZSTR_VAL(include->path) : "");
+	if ((found = zend_hash_find_ptr(&state->includes, key)) != NULL) {
+		found->count++;
+		found->resolve_ns += include->resolve_ns;
+		found->compile_ns += include->compile_ns;
+		zend_string_release(include->function);
+		zend_string_release(include->filename);
+		if (include->path) {
+			zend_string_release(include->path);
+		}
+	} else {
+		found = malloc(sizeof(vld_compileprof_include));
+		*found = *include;
+		found->count = 1;
+		zend_hash_add_ptr(&state->includes, key, found);
+	}
+	zend_string_release(key);
+}
+
+static int vld_compileprof_include_handler(zend_execute_data *execute_data)
+{
+	struct _vld_compileprof_state *state = VLD_G(compileprof);
+
+	if (state && VLD_G(include_profile)) {
+		zend_op_array *opa = &execute_data->func->op_array;
+		const zend_op *opline = execute_data->opline;
+
+		vld_compileprof_include_end(state);
+		memset(&state->include, 0, sizeof(vld_compileprof_include));
+		state->include_ex = execute_data;
+		state->include_opline = opline;
+		state->include.function = vld_function_name((zend_function *) opa);
+		state->include.filename = zend_string_copy(opa->filename);
+		state->include.nr = opline - opa->opcodes;
+		state->include.lineno = opline->lineno;
+		state->include.type = opline->extended_value;
+	}
+
+	return vld_compileprof_old_handler ? vld_compileprof_old_handler(execute_data) : ZEND_USER_OPCODE_DISPATCH;
+}
+
+static vld_compileprof_include *vld_compileprof_include_current(struct _vld_compileprof_state *state)
+{
+	zend_execute_data *ex = EG(current_execute_data);
+
+	if (state && state->include_opline && ex == state->include_ex && ex->opline == state->include_opline) {
+		return &state->include;
+	}
+	return NULL;
+}
+
+static void vld_compileprof_include_path(vld_compileprof_include *include, const char *path, size_t len)
+{
+	if (!include->path) {
+		include->path = zend_string_init(path, len, 0);
+	}
+}
+
+#ifdef VLD_COMPILEPROF_RESOLVE_PATH
+# if PHP_VERSION_ID >= 80100
+static zend_string *vld_compileprof_resolve_path(zend_string *filename)
+# else
+static zend_string *vld_compileprof_resolve_path(const char *filename, size_t filename_len)
+# endif
+{
+	struct _vld_compileprof_state *state = VLD_G(compileprof);
+	vld_compileprof_include       *include = vld_compileprof_include_current(state);
+	zend_string                   *resolved;
+	uint64_t                       start = vld_compileprof_clock();
+
+# if PHP_VERSION_ID >= 80100
+	resolved = state->old_resolve_path(filename);
+# else
+	resolved = state->old_resolve_path(filename, filename_len);
+# endif
+	if (include) {
+		include->resolve_ns += vld_compileprof_clock() - start;
+		if (resolved) {
+			vld_compileprof_include_path(include, ZSTR_VAL(resolved), ZSTR_LEN(resolved));
+		}
+	}
+	return resolved;
+}
+#endif
+
+#if PHP_VERSION_ID >= 80100
+static zend_result vld_compileprof_stream_open(zend_file_handle *handle)
+#else
+static int vld_compileprof_stream_open(const char *filename, zend_file_handle *handle)
+#endif
+{
+	struct _vld_compileprof_state *state = VLD_G(compileprof);
+	vld_compileprof_include       *include = vld_compileprof_include_current(state);
+	uint64_t                       start = vld_compileprof_clock();
+	int                            result;
+
+#if PHP_VERSION_ID >= 80100
+	result = state->old_stream_open(handle);
+#else
+	result = state->old_stream_open(filename, handle);
+#endif
+	if (include) {
+		include->resolve_ns += vld_compileprof_clock() - start;
+		if (result == SUCCESS && handle->opened_path) {
+			vld_compileprof_include_path(include, ZSTR_VAL(handle->opened_path), ZSTR_LEN(handle->opened_path));
+		}
+	}
+	return result;
+}
+
+#if PHP_VERSION_ID < 80000
+static zend_op_array *vld_compileprof_compile_string(zval *source_string, char *filename)
+#else
+static zend_op_array *vld_compileprof_compile_string(zend_string *source_string, const char *filename)
+#endif
+{
+	struct _vld_compileprof_state *state = VLD_G(compileprof);
+	vld_compileprof_include       *include = vld_compileprof_include_current(state);
+	uint64_t                       start = vld_compileprof_clock();
+	zend_op_array                 *op_array;
+
+	op_array = state->old_compile_string(source_string, filename);
+	if (include) {
+		include->compile_ns += vld_compileprof_clock() - start;
+	}
+	return op_array;
+}
+
+static zend_op_array *vld_compileprof_compile_file(zend_file_handle *file_handle, int type)
+{
+	struct _vld_compileprof_state *state = VLD_G(compileprof);
+	vld_compileprof_include       *include = vld_compileprof_include_current(state);
+	vld_compileprof_file           file;
+	uint32_t                       functions = zend_hash_num_elements(CG(function_table));
+	uint32_t                       classes = zend_hash_num_elements(CG(class_table));
+	size_t                         memory = zend_memory_usage(0);
+	uint64_t                       start, resolve_ns = include ? include->resolve_ns : 0;
+	zend_op_array                 *op_array;
+
+	memset(&file, 0, sizeof(file));
+	if (vld_compileprof_files()) {
+		vld_compileprof_parent(state, &file);
+	}
+
+	start = vld_compileprof_clock();
+	op_array = state->old_compile_file(file_handle, type);
+	file.ns = vld_compileprof_clock() - start;
+	file.memory = (zend_long) zend_memory_usage(0) - (zend_long) memory;
+
+	if (include) {
+		include->compile_ns += file.ns - (include->resolve_ns - resolve_ns);
+		if (op_array) {
+			vld_compileprof_include_path(include, ZSTR_VAL(op_array->filename), ZSTR_LEN(op_array->filename));
+		}
+	}
+
+	if (!op_array || !vld_compileprof_files()) {
+		if (file.parent) {
+			zend_string_release(file.parent);
+		}
+		return op_array;
+	}
+
+	file.filename = zend_string_copy(op_array->filename);
+	file.ops = op_array->last;
+	vld_compileprof_declared(&file, functions, classes);
+	vld_compileprof_add_total(&file);
+
+	if (state->count == state->size) {
+		state->size = state->size ? state->size * 2 : 16;
+		state->files = realloc(state->files, state->size * sizeof(vld_compileprof_file));
+	}
+	state->files[state->count++] = file;
+
+	return op_array;
+}
+/* }}} */
+
+/* {{{ Reporting */
+static int vld_compileprof_compare(const void *a, const void *b)
+{
+	const vld_compileprof_file *fa = *(const vld_compileprof_file **) a;
+	const vld_compileprof_file *fb = *(const vld_compileprof_file **) b;
+
+	if (fa->ns != fb->ns) {
+		return fa->ns < fb->ns ? 1 : -1;
+	}
+	return fa < fb ? -1 : (fa > fb);
+}
+
+static void vld_compileprof_report(struct _vld_compileprof_state *state)
+{
+	vld_compileprof_file **list, *file;
+	uint64_t               ns = 0;
+	uint32_t               i;
+
+	if (!state->count) {
+		return;
+	}
+
+	list = malloc(state->count * sizeof(vld_compileprof_file *));
+	for (i = 0; i < state->count; i++) {
+		list[i] = &state->files[i];
+		ns += state->files[i].ns;
+	}
+	qsort(list, state->count, sizeof(vld_compileprof_file *), vld_compileprof_compare);
+
+	vld_printf(stderr, "Compiled files: %u in %.3f ms\n", state->count, ns / 1000000.0);
+	vld_printf(stderr, " time (ms)     memory    ops functions classes  file\n");
+	vld_printf(stderr, "-------------------------------------------------------\n");
+	for (i = 0; i < state->count; i++) {
+		file = list[i];
+		vld_printf(stderr, "%10.3f %10" ZEND_LONG_FMT_SPEC " %6u %9u %7u  %s\n",
+			file->ns / 1000000.0, file->memory, file->ops, file->functions, file->classes, ZSTR_VAL(file->filename));
+	}
+
+	vld_printf(stderr, "\nInclude tree:\n");
+	for (i = 0; i < state->count; i++) {
+		file = &state->files[i];
+		vld_printf(stderr, "%*s%s %.3f ms", (int) file->depth * 2, "", ZSTR_VAL(file->filename), file->ns / 1000000.0);
+		if (file->parent) {
+			vld_printf(stderr, ", from %s:%u", ZSTR_VAL(file->parent), file->parent_line);
+		}
+		vld_printf(stderr, "\n");
+	}
+	vld_printf(stderr, "\n");
+
+	free(list);
+}
+
+static int vld_compileprof_compare_includes(const void *a, const void *b)
+{
+	const vld_compileprof_include *ia = *(const vld_compileprof_include **) a;
+	const vld_compileprof_include *ib = *(const vld_compileprof_include **) b;
+	uint64_t                       ta = ia->resolve_ns + ia->compile_ns;
+	uint64_t                       tb = ib->resolve_ns + ib->compile_ns;
+
+	if (ta != tb) {
+		return ta < tb ? 1 : -1;
+	}
+	return ia < ib ? -1 : (ia > ib);
+}
+
+static void vld_compileprof_report_includes(struct _vld_compileprof_state *state)
+{
+	vld_compileprof_include **list, *include;
+	uint64_t                  resolve_ns = 0, compile_ns = 0;
+	zend_ulong                count = 0;
+	uint32_t                  n = 0, i;
+
+	if (!zend_hash_num_elements(&state->includes)) {
+		return;
+	}
+
+	list = malloc(zend_hash_num_elements(&state->includes) * sizeof(vld_compileprof_include *));
+	ZEND_HASH_FOREACH_PTR(&state->includes, include) {
+		list[n++] = include;
+		count += include->count;
+		resolve_ns += include->resolve_ns;
+		compile_ns += include->compile_ns;
+	} ZEND_HASH_FOREACH_END();
+	qsort(list, n, sizeof(vld_compileprof_include *), vld_compileprof_compare_includes);
+
+	vld_printf(stderr, "Includes: %" ZEND_ULONG_FMT_SPEC " in %.3f ms, %.3f ms resolving, %.3f ms compiling\n",
+		count, (resolve_ns + compile_ns) / 1000000.0, resolve_ns / 1000000.0, compile_ns / 1000000.0);
+	vld_printf(stderr, "     count   resolve (ms)   compile (ms)  line      # type          function, file -> included file\n");
+	vld_printf(stderr, "-----------------------------------------------------------------------------------------------------\n");
+	for (i = 0; i < n; i++) {
+		const char *type;
+
+		include = list[i];
+		type = vld_include_type_name(include->type);
+		vld_printf(stderr, "%10" ZEND_ULONG_FMT_SPEC " %14.3f %14.3f %5u %6u %-12s  %s, %s -> %s\n",
+			include->count, include->resolve_ns / 1000000.0, include->compile_ns / 1000000.0,
+			include->lineno, include->nr, type ? type : "UNKNOWN",
+			ZSTR_VAL(include->function), ZSTR_VAL(include->filename), include->path ? ZSTR_VAL(include->path) : "-");
+	}
+	vld_printf(stderr, "\n");
+
+	free(list);
+}
+
+typedef struct _vld_compileprof_entry {
+	zend_string           *filename;
+	vld_compileprof_total *total;
+} vld_compileprof_entry;
+
+static int vld_compileprof_compare_totals(const void *a, const void *b)
+{
+	const vld_compileprof_entry *ea = a;
+	const vld_compileprof_entry *eb = b;
+
+	if (ea->total->ns != eb->total->ns) {
+		return ea->total->ns < eb->total->ns ? 1 : -1;
+	}
+	return strcmp(ZSTR_VAL(ea->filename), ZSTR_VAL(eb->filename));
+}
+
+/* Rewritten after every request, as processes are rarely shut down in a way
+ * that would let them write it at the end */
+static void vld_compileprof_write_totals(void)
+{
+	vld_compileprof_entry *list;
+	vld_compileprof_total *total;
+	zend_string           *key;
+	char                  *filename;
+	FILE                  *file;
+	uint32_t               count = 0, i;
+
+	if (!VLD_G(compile_profile_totals) || !VLD_G(compile_profile_totals)[0]) {
+		return;
+	}
+
+	filename = vld_output_filename(VLD_G(compile_profile_totals));
+	if ((file = fopen(filename, "w")) == NULL) {
+		php_error(E_WARNING, "vld: Can not open '%s' for the compile totals", filename);
+		free(filename);
+		return;
+	}
+
+	list = malloc((zend_hash_num_elements(VLD_G(compileprof_totals)) + 1) * sizeof(vld_compileprof_entry));
+	ZEND_HASH_FOREACH_STR_KEY_PTR(VLD_G(compileprof_totals), key, total) {
+		list[count].filename = key;
+		list[count].total = total;
+		count++;
+	} ZEND_HASH_FOREACH_END();
+	qsort(list, count, sizeof(vld_compileprof_entry), vld_compileprof_compare_totals);
+
+	fprintf(file, "# compiles of %u files in %" ZEND_ULONG_FMT_SPEC " requests\n", count, VLD_G(compileprof_requests));
+	fprintf(file, "# compiles   total ms    mean ms     memory        ops  functions    classes  file\n");
+	for (i = 0; i < count; i++) {
+		total = list[i].total;
+		fprintf(file, "%10" ZEND_ULONG_FMT_SPEC " %10.3f %10.3f %10" ZEND_LONG_FMT_SPEC " %10" ZEND_ULONG_FMT_SPEC " %10" ZEND_ULONG_FMT_SPEC " %10" ZEND_ULONG_FMT_SPEC "  %s\n",
+			total->compiles, total->ns / 1000000.0, total->ns / 1000000.0 / total->compiles,
+			total->memory, total->ops, total->functions, total->classes, ZSTR_VAL(list[i].filename));
+	}
+
+	free(list);
+	fclose(file);
+	free(filename);
+}
+/* }}} */
+
+int vld_compileprof_enabled(void)
+{
+	return VLD_G(compile_profile) || VLD_G(include_profile) || vld_preload_enabled();
+}
+
+void vld_compileprof_minit(void)
+{
+	if (!VLD_G(include_profile)) {
+		return;
+	}
+
+	vld_compileprof_old_handler = zend_get_user_opcode_handler(ZEND_INCLUDE_OR_EVAL);
+	zend_set_user_opcode_handler(ZEND_INCLUDE_OR_EVAL, vld_compileprof_include_handler);
+}
+
+static void vld_compileprof_set_free(HashTable *set)
+{
+	if (set) {
+		zend_hash_destroy(set);
+		free(set);
+	}
+}
+
+static void vld_compileprof_total_dtor(zval *zv)
+{
+	vld_compileprof_total *total = Z_PTR_P(zv);
+
+	vld_compileprof_set_free(total->depends);
+	vld_compileprof_set_free(total->declared_classes);
+	vld_compileprof_set_free(total->declared_functions);
+	free(total);
+}
+
+void vld_compileprof_mshutdown(void)
+{
+	if (VLD_G(include_profile)) {
+		zend_set_user_opcode_handler(ZEND_INCLUDE_OR_EVAL, vld_compileprof_old_handler);
+	}
+	if (VLD_G(compileprof_totals)) {
+		zend_hash_destroy(VLD_G(compileprof_totals));
+		free(VLD_G(compileprof_totals));
+		VLD_G(compileprof_totals) = NULL;
+	}
+}
+
+/* Called before vld puts in its own compile hook, so that it wraps this
+ * one */
+void vld_compileprof_start(void)
+{
+	struct _vld_compileprof_state *state;
+
+	if (!vld_compileprof_enabled()) {
+		return;
+	}
+
+	if (vld_compileprof_files() && !VLD_G(compileprof_totals)) {
+		VLD_G(compileprof_totals) = malloc(sizeof(HashTable));
+		zend_hash_init(VLD_G(compileprof_totals), 64, NULL, vld_compileprof_total_dtor, 1);
+	}
+
+	state = calloc(1, sizeof(struct _vld_compileprof_state));
+	state->old_compile_file = zend_compile_file;
+	VLD_G(compileprof) = state;
+	zend_compile_file = vld_compileprof_compile_file;
+
+	if (VLD_G(include_profile)) {
+		zend_hash_init(&state->includes, 32, NULL, vld_compileprof_include_dtor, 0);
+		state->old_compile_string = zend_compile_string;
+		state->old_stream_open = zend_stream_open_function;
+		zend_compile_string = vld_compileprof_compile_string;
+		zend_stream_open_function = vld_compileprof_stream_open;
+#ifdef VLD_COMPILEPROF_RESOLVE_PATH
+		state->old_resolve_path = zend_resolve_path;
+		zend_resolve_path = vld_compileprof_resolve_path;
+#endif
+	}
+}
+
+/* Called after vld put back the compile hook that it found, which is this
+ * one */
+void vld_compileprof_stop(void)
+{
+	struct _vld_compileprof_state *state = VLD_G(compileprof);
+	uint32_t                       i;
+
+	if (!state) {
+		return;
+	}
+
+	zend_compile_file = state->old_compile_file;
+	if (VLD_G(include_profile)) {
+		zend_compile_string = state->old_compile_string;
+		zend_stream_open_function = state->old_stream_open;
+#ifdef VLD_COMPILEPROF_RESOLVE_PATH
+		zend_resolve_path = state->old_resolve_path;
+#endif
+	}
+	VLD_G(compileprof) = NULL;
+
+	if (vld_compileprof_files()) {
+		VLD_G(compileprof_requests)++;
+	}
+	if (VLD_G(compile_profile)) {
+		vld_compileprof_report(state);
+		vld_compileprof_write_totals();
+	}
+	if (VLD_G(include_profile)) {
+		vld_compileprof_include_end(state);
+		vld_compileprof_report_includes(state);
+		zend_hash_destroy(&state->includes);
+	}
+
+	for (i = 0; i < state->count; i++) {
+		zend_string_release(state->files[i].filename);
+		if (state->files[i].parent) {
+			zend_string_release(state->files[i].parent);
+		}
+	}
+	free(state->files);
+	free(state);
+}
@@ -0,0 +1,60 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __COMPILEPROF_H__
+#define __COMPILEPROF_H__
+
+#include "php.h"
+
+/* Compile and include profiler
+ *
+ * With vld.compile_profile, zend_compile_file is wrapped for the duration of
+ * the request, ahead of vld's own hook, so that dumping is not counted as
+ * compiling. Every compiled file gets its time on a monotonic clock, the
+ * growth of the request's memory, the number of ops in its code, functions
+ * and methods, and the number of functions and classes it declared. The
+ * file and line of the include that compiled it are taken from the user
+ * code frame that is running at the time.
+ *
+ * At the end of the request, the files are listed from the most to the
+ * least expensive, followed by the tree of includes. The totals of every
+ * request that a process served are kept as well, and are written to
+ * vld.compile_profile_totals after each request.
+ *
+ * With vld.include_profile, every INCLUDE_OR_EVAL op that ran is listed
+ * with the time it spent resolving and opening files, and the time it
+ * spent compiling them, but not the time that the included code ran for,
+ * for each file that it included. */
+
+/* The totals of a file over all requests, by file name in
+ * VLD_G(compileprof_totals). For vld.preload_script, the sets of the files
+ * whose classes its classes extend, implement or use, and of the classes
+ * and functions that it declared, are added at the end of every request. */
+typedef struct _vld_compileprof_total {
+	zend_ulong  compiles;
+	uint64_t    ns;
+	zend_long   memory;
+	zend_ulong  ops;
+	zend_ulong  functions;
+	zend_ulong  classes;
+	HashTable  *depends;
+	HashTable  *declared_classes;
+	HashTable  *declared_functions;
+} vld_compileprof_total;
+
+int vld_compileprof_enabled(void);
+void vld_compileprof_minit(void);
+void vld_compileprof_mshutdown(void);
+void vld_compileprof_start(void);
+void vld_compileprof_stop(void);
+
+#endif
@@ -0,0 +1,203 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "php.h"
+#include "php_vld.h"
+#include "compress.h"
+
+#ifdef HAVE_VLD_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_VLD_ZSTD
+#include <zstd.h>
+#endif
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+/* The output buffer is handed to the compressor whenever it fills up, so the
+ * dump is compressed as it is produced and only compressed bytes ever reach
+ * the disk. Every request writes a complete gzip member or zstd frame, and
+ * as both formats allow those to be concatenated, a file that many requests
+ * appended to still decompresses in one go. */
+#define VLD_COMPRESS_OUT_SIZE 65536
+
+struct _vld_compress_state {
+	FILE          *stream;
+	int            method;
+	unsigned char  out[VLD_COMPRESS_OUT_SIZE];
+#ifdef HAVE_VLD_ZLIB
+	z_stream       zs;
+#endif
+#ifdef HAVE_VLD_ZSTD
+	ZSTD_CCtx     *zstd;
+#endif
+};
+
+#ifdef HAVE_VLD_ZLIB
+static int vld_compress_gzip_open(struct _vld_compress_state *state)
+{
+	int level = VLD_G(compress_level) ? (int) VLD_G(compress_level) : Z_DEFAULT_COMPRESSION;
+
+	if (level > 9) {
+		level = 9;
+	}
+
+	/* 16 added to the window bits selects the gzip wrapper instead of the
+	 * zlib one */
+	return deflateInit2(&state->zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+static void vld_compress_gzip(struct _vld_compress_state *state, const char *data, size_t len, int flush)
+{
+	state->zs.next_in  = (Bytef *) data;
+	state->zs.avail_in = (uInt) len;
+
+	do {
+		state->zs.next_out  = state->out;
+		state->zs.avail_out = VLD_COMPRESS_OUT_SIZE;
+		if (deflate(&state->zs, flush) == Z_STREAM_ERROR) {
+			return;
+		}
+		fwrite(state->out, 1, VLD_COMPRESS_OUT_SIZE - state->zs.avail_out, state->stream);
+	} while (state->zs.avail_out == 0);
+}
+#endif
+
+#ifdef HAVE_VLD_ZSTD
+static int vld_compress_zstd_open(struct _vld_compress_state *state)
+{
+	int level = VLD_G(compress_level) ? (int) VLD_G(compress_level) : ZSTD_CLEVEL_DEFAULT;
+
+	if (level > ZSTD_maxCLevel()) {
+		level = ZSTD_maxCLevel();
+	}
+
+	state->zstd = ZSTD_createCCtx();
+	if (!state->zstd) {
+		return 0;
+	}
+	return !ZSTD_isError(ZSTD_CCtx_setParameter(state->zstd, ZSTD_c_compressionLevel, level));
+}
+
+static void vld_compress_zstd(struct _vld_compress_state *state, const char *data, size_t len, ZSTD_EndDirective mode)
+{
+	ZSTD_inBuffer  in = { data, len, 0 };
+	ZSTD_outBuffer out;
+	size_t         remaining;
+
+	do {
+		out.dst  = state->out;
+		out.size = VLD_COMPRESS_OUT_SIZE;
+		out.pos  = 0;
+
+		remaining = ZSTD_compressStream2(state->zstd, &out, &in, mode);
+		if (ZSTD_isError(remaining)) {
+			return;
+		}
+		fwrite(state->out, 1, out.pos, state->stream);
+	} while (mode == ZSTD_e_end ? remaining != 0 : in.pos < in.size);
+}
+#endif
+
+/* Returns 0 when the compressor could not be set up, in which case the
+ * output is written uncompressed */
+int vld_compress_open(FILE *stream)
+{
+	struct _vld_compress_state *state;
+	int                         ok = 0;
+
+	if (VLD_G(compress) == VLD_COMPRESS_NONE) {
+		return 0;
+	}
+
+	state = calloc(1, sizeof(struct _vld_compress_state));
+	state->stream = stream;
+	state->method = VLD_G(compress);
+
+	switch (state->method) {
+#ifdef HAVE_VLD_ZLIB
+		case VLD_COMPRESS_GZIP:
+			ok = vld_compress_gzip_open(state);
+			break;
+#endif
+#ifdef HAVE_VLD_ZSTD
+		case VLD_COMPRESS_ZSTD:
+			ok = vld_compress_zstd_open(state);
+			break;
+#endif
+	}
+
+	if (!ok) {
+		zend_error(E_WARNING, "vld: Could not initialise the compressor, writing uncompressed output instead");
+#ifdef HAVE_VLD_ZSTD
+		if (state->zstd) {
+			ZSTD_freeCCtx(state->zstd);
+		}
+#endif
+		free(state);
+		return 0;
+	}
+
+	VLD_G(compress_state) = state;
+	return 1;
+}
+
+void vld_compress_write(const char *data, size_t len)
+{
+	struct _vld_compress_state *state = VLD_G(compress_state);
+
+	switch (state->method) {
+#ifdef HAVE_VLD_ZLIB
+		case VLD_COMPRESS_GZIP:
+			vld_compress_gzip(state, data, len, Z_NO_FLUSH);
+			break;
+#endif
+#ifdef HAVE_VLD_ZSTD
+		case VLD_COMPRESS_ZSTD:
+			vld_compress_zstd(state, data, len, ZSTD_e_continue);
+			break;
+#endif
+	}
+}
+
+void vld_compress_close(void)
+{
+	struct _vld_compress_state *state = VLD_G(compress_state);
+
+	if (!state) {
+		return;
+	}
+
+	switch (state->method) {
+#ifdef HAVE_VLD_ZLIB
+		case VLD_COMPRESS_GZIP:
+			vld_compress_gzip(state, NULL, 0, Z_FINISH);
+			deflateEnd(&state->zs);
+			break;
+#endif
+#ifdef HAVE_VLD_ZSTD
+		case VLD_COMPRESS_ZSTD:
+			vld_compress_zstd(state, NULL, 0, ZSTD_e_end);
+			ZSTD_freeCCtx(state->zstd);
+			break;
+#endif
+	}
+
+	free(state);
+	VLD_G(compress_state) = NULL;
+}
@@ -0,0 +1,26 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+#include <stdio.h>
+
+#define VLD_COMPRESS_NONE 0
+#define VLD_COMPRESS_GZIP 1
+#define VLD_COMPRESS_ZSTD 2
+
+int vld_compress_open(FILE *stream);
+void vld_compress_write(const char *data, size_t len);
+void vld_compress_close(void);
+
+#endif
@@ -7,6 +7,15 @@ PHP_ARG_ENABLE(vld, whether to enable VLD support,
 PHP_ARG_ENABLE(vld-dev, whether to enable VLD developer build flags,
 [  --enable-vld-dev          VLD: Enable developer flags],, no)
 
+PHP_ARG_WITH(vld-sqlite, whether to enable the VLD SQLite output format,
+[  --with-vld-sqlite[=DIR]   VLD: Enable the SQLite output format], no, no)
+
+PHP_ARG_WITH(vld-zlib, whether to enable VLD gzip output compression,
+[  --with-vld-zlib[=DIR]     VLD: Enable gzip compression of the output], no, no)
+
+PHP_ARG_WITH(vld-zstd, whether to enable VLD zstd output compression,
+[  --with-vld-zstd[=DIR]     VLD: Enable zstd compression of the output], no, no)
+
 if test "$PHP_VLD" != "no"; then
   AC_MSG_CHECKING([Check for supported PHP versions])
   PHP_VLD_FOUND_VERSION=`${PHP_CONFIG} --version`
@@ -61,7 +70,74 @@ if test "$PHP_VLD" != "no"; then
     STD_CFLAGS="-g -O0 -Wall"
   fi
 
+  if test "$PHP_VLD_SQLITE" != "no"; then
+    AC_MSG_CHECKING([for sqlite3.h])
+    for i in $PHP_VLD_SQLITE /usr/local /usr; do
+      if test -r $i/include/sqlite3.h; then
+        VLD_SQLITE_DIR=$i
+        AC_MSG_RESULT([found in $i])
+        break
+      fi
+    done
+    if test -z "$VLD_SQLITE_DIR"; then
+      AC_MSG_RESULT([not found])
+      AC_MSG_ERROR([Please install the SQLite 3 development files])
+    fi
+
+    PHP_ADD_INCLUDE($VLD_SQLITE_DIR/include)
+    PHP_ADD_LIBRARY_WITH_PATH(sqlite3, $VLD_SQLITE_DIR/$PHP_LIBDIR, VLD_SHARED_LIBADD)
+    AC_DEFINE(HAVE_VLD_SQLITE, 1, [Whether the SQLite output format is available])
+  fi
+
+  if test "$PHP_VLD_ZLIB" != "no"; then
+    AC_MSG_CHECKING([for zlib.h])
+    for i in $PHP_VLD_ZLIB /usr/local /usr; do
+      if test -r $i/include/zlib.h; then
+        VLD_ZLIB_DIR=$i
+        AC_MSG_RESULT([found in $i])
+        break
+      fi
+    done
+    if test -z "$VLD_ZLIB_DIR"; then
+      AC_MSG_RESULT([not found])
+      AC_MSG_ERROR([Please install the zlib development files])
+    fi
+
+    PHP_ADD_INCLUDE($VLD_ZLIB_DIR/include)
+    PHP_ADD_LIBRARY_WITH_PATH(z, $VLD_ZLIB_DIR/$PHP_LIBDIR, VLD_SHARED_LIBADD)
+    AC_DEFINE(HAVE_VLD_ZLIB, 1, [Whether gzip output compression is available])
+  fi
+
+  if test "$PHP_VLD_ZSTD" != "no"; then
+    AC_MSG_CHECKING([for zstd.h])
+    for i in $PHP_VLD_ZSTD /usr/local /usr; do
+      if test -r $i/include/zstd.h; then
+        VLD_ZSTD_DIR=$i
+        AC_MSG_RESULT([found in $i])
+        break
+      fi
+    done
+    if test -z "$VLD_ZSTD_DIR"; then
+      AC_MSG_RESULT([not found])
+      AC_MSG_ERROR([Please install the zstd development files])
+    fi
+
+    PHP_ADD_INCLUDE($VLD_ZSTD_DIR/include)
+    PHP_ADD_LIBRARY_WITH_PATH(zstd, $VLD_ZSTD_DIR/$PHP_LIBDIR, VLD_SHARED_LIBADD)
+    AC_DEFINE(HAVE_VLD_ZSTD, 1, [Whether zstd output compression is available])
+  fi
+
+  AC_CHECK_FUNC(timer_create, [
+    AC_DEFINE(HAVE_VLD_TIMER_CREATE, 1, [Whether the sampling profiler is available])
+  ], [
+    AC_CHECK_LIB(rt, timer_create, [
+      PHP_ADD_LIBRARY(rt,, VLD_SHARED_LIBADD)
+      AC_DEFINE(HAVE_VLD_TIMER_CREATE, 1, [Whether the sampling profiler is available])
+    ])
+  ])
+  PHP_SUBST(VLD_SHARED_LIBADD)
+
   PHP_VLD_CFLAGS="$STD_CFLAGS $MAINTAINER_CFLAGS"
   PHP_ADD_MAKEFILE_FRAGMENT($abs_srcdir/Makefile.frag, $abs_srcdir)
-  PHP_NEW_EXTENSION(vld, vld.c srm_oparray.c set.c branchinfo.c, $ext_shared,,$PHP_VLD_CFLAGS)
+  PHP_NEW_EXTENSION(vld, vld.c srm_oparray.c set.c branchinfo.c arraydump.c output.c ndjson.c binary.c dumpindex.c sqlite.c arrow.c compress.c unixsock.c control.c runtime.c sampler.c allocprof.c counters.c hot.c compileprof.c preload.c classdeps.c, $ext_shared,,$PHP_VLD_CFLAGS)
 fi
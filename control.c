@@ -0,0 +1,320 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "php.h"
+#include "php_vld.h"
+#include "srm_oparray.h"
+#include "output.h"
+#include "control.h"
+
+#ifndef PHP_WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#endif
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+#ifndef PHP_WIN32
+/* {{{ Commands
+ * All output goes through vld_printf(), exactly like a normal dump, while
+ * the output is pointed at the client for the duration of the command. */
+static void vld_control_list_functions(void)
+{
+	zend_function *func;
+
+	ZEND_HASH_FOREACH_PTR(EG(function_table), func) {
+		if (func->type == ZEND_USER_FUNCTION) {
+			vld_printf(stderr, "%s %s:%d\n", ZSTR_VAL(func->common.function_name), ZSTR_VAL(func->op_array.filename), func->op_array.line_start);
+		}
+	} ZEND_HASH_FOREACH_END();
+}
+
+static void vld_control_list_classes(void)
+{
+	zend_class_entry *ce;
+
+	ZEND_HASH_FOREACH_PTR(EG(class_table), ce) {
+		if (ce->type == ZEND_USER_CLASS) {
+			vld_printf(stderr, "%s %s:%d\n", ZSTR_VAL(ce->name), ZSTR_VAL(ce->info.user.filename), ce->info.user.line_start);
+		}
+	} ZEND_HASH_FOREACH_END();
+}
+
+/* Looks classes up without autoloading, as no code may run at this point */
+static zend_class_entry *vld_control_find_class(const char *name, size_t len)
+{
+	zend_class_entry *ce;
+	zend_string      *lcname = zend_string_init(name, len, 0);
+
+	zend_str_tolower(ZSTR_VAL(lcname), len);
+	ce = zend_hash_find_ptr(EG(class_table), lcname);
+	zend_string_release(lcname);
+
+	return ce && ce->type == ZEND_USER_CLASS ? ce : NULL;
+}
+
+static void vld_control_dump_function(const char *name)
+{
+	zend_function    *func;
+	zend_string      *lcname;
+	HashTable        *table = EG(function_table);
+	const char       *sep = strstr(name, "::");
+
+	if (sep) {
+		zend_class_entry *ce = vld_control_find_class(name, sep - name);
+
+		if (!ce) {
+			vld_printf(stderr, "error: class '%.*s' does not exist\n", (int) (sep - name), name);
+			return;
+		}
+		table = &ce->function_table;
+		name = sep + 2;
+	}
+
+	lcname = zend_string_init(name, strlen(name), 0);
+	zend_str_tolower(ZSTR_VAL(lcname), ZSTR_LEN(lcname));
+	func = zend_hash_find_ptr(table, lcname);
+	zend_string_release(lcname);
+
+	if (!func || func->type != ZEND_USER_FUNCTION) {
+		vld_printf(stderr, "error: user function '%s' does not exist\n", name);
+		return;
+	}
+	vld_dump_oparray(&func->op_array);
+}
+
+static void vld_control_dump_class(const char *name)
+{
+	zend_class_entry *ce = vld_control_find_class(name, strlen(name));
+	zend_function    *func;
+
+	if (!ce) {
+		vld_printf(stderr, "error: class '%s' does not exist\n", name);
+		return;
+	}
+
+	vld_printf(stderr, "Class %s:\n", ZSTR_VAL(ce->name));
+	ZEND_HASH_FOREACH_PTR(&ce->function_table, func) {
+		if (func->type == ZEND_USER_FUNCTION && func->common.scope == ce) {
+			vld_printf(stderr, "Function %s:\n", ZSTR_VAL(func->common.function_name));
+			vld_dump_oparray(&func->op_array);
+			vld_printf(stderr, "End of function %s\n\n", ZSTR_VAL(func->common.function_name));
+		}
+	} ZEND_HASH_FOREACH_END();
+	vld_printf(stderr, "End of class %s.\n\n", ZSTR_VAL(ce->name));
+}
+
+static void vld_control_run(const char *command)
+{
+	if (strcmp(command, "functions") == 0) {
+		vld_control_list_functions();
+	} else if (strcmp(command, "classes") == 0) {
+		vld_control_list_classes();
+	} else if (strncmp(command, "function ", 9) == 0) {
+		vld_control_dump_function(command + 9);
+	} else if (strncmp(command, "class ", 6) == 0) {
+		vld_control_dump_class(command + 6);
+	} else {
+		vld_printf(stderr, "error: unknown command; use 'functions', 'classes', 'function <name>' or 'class <name>'\n");
+	}
+}
+/* }}} */
+
+static long vld_control_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/* Reads one command line from a non-blocking socket. Clients mostly sent it
+ * long before, and otherwise get until the deadline to do so */
+static int vld_control_read_command(int fd, char *command, long deadline)
+{
+	struct pollfd pfd;
+	size_t        len = 0;
+	ssize_t       n;
+	char         *eol;
+	long          left;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	while (len < VLD_CONTROL_MAX_COMMAND - 1) {
+		n = read(fd, command + len, VLD_CONTROL_MAX_COMMAND - 1 - len);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+			left = deadline - vld_control_now();
+			if (left <= 0 || poll(&pfd, 1, (int) left) <= 0) {
+				return 0;
+			}
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		len += n;
+		command[len] = '\0';
+		if ((eol = strpbrk(command, "\r\n")) != NULL) {
+			*eol = '\0';
+			return 1;
+		}
+	}
+
+	command[len] = '\0';
+	return len > 0;
+}
+
+static void vld_control_answer(int fd, long deadline)
+{
+	char           command[VLD_CONTROL_MAX_COMMAND];
+	struct timeval timeout = { 0, VLD_CONTROL_WRITE_TIMEOUT * 1000 };
+	int            saved_format = VLD_G(output_format), saved_dump_paths = VLD_G(dump_paths);
+	FILE          *stream;
+
+	if (!vld_control_read_command(fd, command, deadline) || (stream = fdopen(fd, "w")) == NULL) {
+		close(fd);
+		return;
+	}
+
+	/* The answer is written blocking, so that a client that reads it as it
+	 * comes gets all of it, but one that stops reading gets dropped after
+	 * the first write that times out */
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	VLD_G(output_stream)      = stream;
+	VLD_G(output_buffer)      = malloc(VLD_OUTPUT_BUFFER_SIZE);
+	VLD_G(output_buffer_used) = 0;
+	VLD_G(output_buffer_size) = VLD_OUTPUT_BUFFER_SIZE;
+	VLD_G(output_format)      = VLD_OUTPUT_TEXT;
+	VLD_G(dump_paths)         = 0;
+
+	vld_control_run(command);
+
+	vld_output_flush();
+	free(VLD_G(output_buffer));
+	fclose(stream);
+
+	VLD_G(output_stream)      = NULL;
+	VLD_G(output_buffer)      = NULL;
+	VLD_G(output_format)      = saved_format;
+	VLD_G(dump_paths)         = saved_dump_paths;
+}
+#endif
+
+/* Called at the start of every request, so that the socket is created in
+ * the worker process itself, and not in a parent that forks the workers */
+void vld_control_start(void)
+{
+#ifndef PHP_WIN32
+	struct sockaddr_un addr;
+	char              *path;
+	int                fd;
+
+	if (!VLD_G(control_socket) || !VLD_G(control_socket)[0] || VLD_G(control_pid) == VLD_G(pid)) {
+		return;
+	}
+
+	/* A forked child gets a socket of its own, and leaves its parent's one
+	 * alone */
+	if (VLD_G(control_fd) >= 0) {
+		close(VLD_G(control_fd));
+		free(VLD_G(control_path));
+		VLD_G(control_fd) = -1;
+		VLD_G(control_path) = NULL;
+	}
+	VLD_G(control_pid) = VLD_G(pid);
+
+	path = vld_output_filename(VLD_G(control_socket));
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		zend_error(E_WARNING, "vld: Control socket path '%s' is too long", path);
+		free(path);
+		return;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	/* Nobody can connect before listen(), so the socket is never open to
+	 * others in between */
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+		|| bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+		|| chmod(path, 0600) != 0
+		|| listen(fd, VLD_CONTROL_MAX_CLIENTS) != 0
+	) {
+		zend_error(E_WARNING, "vld: Could not listen on control socket '%s': %s", path, strerror(errno));
+		if (fd >= 0) {
+			close(fd);
+		}
+		free(path);
+		return;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	VLD_G(control_fd) = fd;
+	VLD_G(control_path) = path;
+#endif
+}
+
+/* Answers the clients that connected while the request ran. Without any,
+ * this is a single accept() call that fails straight away. */
+void vld_control_service(void)
+{
+#ifndef PHP_WIN32
+	long deadline;
+	int  fd, i;
+
+	if (VLD_G(control_fd) < 0) {
+		return;
+	}
+
+	deadline = vld_control_now() + VLD_CONTROL_READ_TIMEOUT;
+	for (i = 0; i < VLD_CONTROL_MAX_CLIENTS; i++) {
+		if ((fd = accept(VLD_G(control_fd), NULL, NULL)) < 0) {
+			break;
+		}
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		vld_control_answer(fd, deadline);
+	}
+#endif
+}
+
+void vld_control_stop(void)
+{
+#ifndef PHP_WIN32
+	if (VLD_G(control_fd) < 0) {
+		return;
+	}
+
+	close(VLD_G(control_fd));
+	if (VLD_G(control_pid) == getpid()) {
+		unlink(VLD_G(control_path));
+	}
+	free(VLD_G(control_path));
+
+	VLD_G(control_fd) = -1;
+	VLD_G(control_path) = NULL;
+#endif
+}
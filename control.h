@@ -0,0 +1,43 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __CONTROL_H__
+#define __CONTROL_H__
+
+/* Control socket
+ *
+ * With vld.control_socket set, every worker process listens on a Unix
+ * domain socket of its own. A client connects, sends one command line, and
+ * gets the answer as text, after which the connection is closed:
+ *
+ *   functions         lists all user defined functions
+ *   classes           lists all user defined classes
+ *   function <name>   dumps a function, or a method as "Class::method"
+ *   class <name>      dumps all methods of a class
+ *
+ * Connections are only answered at the end of a request, when the worker is
+ * not running any code, so a worker that is idle answers once it has handled
+ * its next request. The clients together get a few milliseconds to send
+ * their commands, and each one a little while to take its answer, so that
+ * slow clients can not hold up the worker. The socket is only accessible to
+ * the user that the worker runs as. */
+
+#define VLD_CONTROL_MAX_CLIENTS   16
+#define VLD_CONTROL_MAX_COMMAND   1024
+#define VLD_CONTROL_READ_TIMEOUT  5   /* ms, for all clients together */
+#define VLD_CONTROL_WRITE_TIMEOUT 100 /* ms, for each client */
+
+void vld_control_start(void);
+void vld_control_service(void);
+void vld_control_stop(void);
+
+#endif
@@ -0,0 +1,367 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "php.h"
+#include "php_vld.h"
+#include "srm_oparray.h"
+#include "output.h"
+#include "counters.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+#ifdef VLD_COUNTERS_AVAILABLE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define VLD_LOAD(p)         __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define VLD_STORE(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define VLD_ADD(p, v)       __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+
+/* The mapping is shared by all threads of a process, and by all processes
+ * forked off after MINIT */
+static vld_counters_header *vld_counters = NULL;
+static size_t               vld_counters_size = 0;
+static int                  vld_counters_names_full = 0;
+
+/* Returns what was in the slot, which is 0 when it was claimed */
+static uint64_t vld_counters_claim(uint64_t *slot, uint64_t value)
+{
+	uint64_t expected = VLD_LOAD(slot);
+
+	if (expected == 0) {
+		__atomic_compare_exchange_n(slot, &expected, value, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+	}
+	return expected;
+}
+
+static uint64_t vld_counters_hash(const char *file, size_t file_len, const char *name, size_t name_len, uint32_t line)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	size_t   i;
+
+	for (i = 0; i < file_len; i++) {
+		hash = (hash ^ (unsigned char) file[i]) * 1099511628211ULL;
+	}
+	hash *= 1099511628211ULL; /* the NUL in between */
+	for (i = 0; i < name_len; i++) {
+		hash = (hash ^ (unsigned char) name[i]) * 1099511628211ULL;
+	}
+	hash = (hash ^ line) * 1099511628211ULL;
+	return hash ? hash : 1;
+}
+
+/* A slot whose hash matches could still belong to another function, so the
+ * names are compared as well. The process that claimed the slot may not
+ * have filled them in yet, and is waited for a little while */
+static int vld_counters_same_function(vld_counters_function *function, zend_string *file, zend_string *name, uint32_t line)
+{
+	const char *names = VLD_COUNTERS_NAMES(vld_counters);
+	uint32_t    offset = 0;
+	int         tries;
+
+	for (tries = 0; tries < 1000 && (offset = VLD_LOAD(&function->name)) == 0; tries++) {
+		sched_yield();
+	}
+	if (offset == 0 || offset >= vld_counters->names_size) {
+		return 0;
+	}
+
+	return function->line == line
+		&& strcmp(names + offset, ZSTR_VAL(file)) == 0
+		&& strcmp(names + offset + strlen(names + offset) + 1, ZSTR_VAL(name)) == 0;
+}
+
+/* Functions are told apart by their file, name and first line, as all the
+ * closures and methods of anonymous classes in a file have the same name.
+ * Room for the names is taken before a slot is claimed, so that every
+ * claimed slot gets its names */
+static int64_t vld_counters_find_function(zend_op_array *opa)
+{
+	vld_counters_function *functions = VLD_COUNTERS_FUNCTIONS(vld_counters);
+	uint32_t               mask = vld_counters->functions_size - 1;
+	zend_string           *name;
+	uint64_t               hash, prev;
+	uint32_t               i, slot, offset = 0, len;
+	int64_t                found = -1;
+
+	name = vld_function_name((zend_function *) opa);
+	hash = vld_counters_hash(ZSTR_VAL(opa->filename), ZSTR_LEN(opa->filename), ZSTR_VAL(name), ZSTR_LEN(name), opa->line_start);
+	len = ZSTR_LEN(opa->filename) + ZSTR_LEN(name) + 2;
+
+	for (i = 0; i <= mask; i++) {
+		slot = (hash + i) & mask;
+		prev = VLD_LOAD(&functions[slot].hash);
+		if (prev == 0) {
+			if (offset == 0) {
+				offset = VLD_ADD(&vld_counters->names_used, len);
+				if ((uint64_t) offset + len > vld_counters->names_size) {
+					if (!vld_counters_names_full) {
+						vld_counters_names_full = 1;
+						zend_error(E_WARNING, "vld: There is no more room for function names in vld.shared_counters, the counts of new functions are dropped");
+					}
+					break;
+				}
+			}
+			prev = vld_counters_claim(&functions[slot].hash, hash);
+			if (prev == 0) {
+				/* Only the process that claimed the slot fills in the names */
+				char *names = VLD_COUNTERS_NAMES(vld_counters);
+
+				memcpy(names + offset, ZSTR_VAL(opa->filename), ZSTR_LEN(opa->filename) + 1);
+				memcpy(names + offset + ZSTR_LEN(opa->filename) + 1, ZSTR_VAL(name), ZSTR_LEN(name) + 1);
+				functions[slot].line = opa->line_start;
+				VLD_STORE(&functions[slot].name, offset);
+				found = slot;
+				break;
+			}
+		}
+		if (prev == hash && vld_counters_same_function(&functions[slot], opa->filename, name, opa->line_start)) {
+			found = slot;
+			break;
+		}
+	}
+	zend_string_release(name);
+
+	return found;
+}
+
+static vld_counters_op *vld_counters_find_op(uint32_t function, zend_op *opline, uint32_t nr)
+{
+	vld_counters_op *ops = VLD_COUNTERS_OPS(vld_counters);
+	uint32_t         mask = vld_counters->ops_size - 1;
+	uint64_t         key = ((uint64_t) (function + 1) << 32) | nr;
+	uint64_t         hash = key * 0x9E3779B97F4A7C15ULL;
+	uint64_t         prev;
+	uint32_t         i, slot;
+
+	for (i = 0; i <= mask; i++) {
+		slot = ((hash >> 32) + i) & mask;
+		prev = vld_counters_claim(&ops[slot].key, key);
+		if (prev == 0) {
+			ops[slot].lineno = opline->lineno;
+			ops[slot].opcode = opline->opcode;
+			return &ops[slot];
+		}
+		if (prev == key) {
+			return &ops[slot];
+		}
+	}
+	return NULL;
+}
+
+int vld_counters_enabled(void)
+{
+	return vld_counters != NULL;
+}
+
+/* A new file is created every time, so that processes that still use an
+ * older one keep their own copy */
+void vld_counters_minit(void)
+{
+	vld_counters_header header;
+	char               *filename;
+	int                 fd;
+	void               *map;
+	uint32_t            ops_size = 1024, magic;
+
+	if (!VLD_G(shared_counters) || !VLD_G(shared_counters)[0]) {
+		return;
+	}
+
+	while (ops_size < VLD_G(shared_counters_size) && ops_size < 0x40000000) {
+		ops_size <<= 1;
+	}
+	memset(&header, 0, sizeof(header));
+	header.version = VLD_COUNTERS_VERSION;
+	header.ops_size = ops_size;
+	header.functions_size = ops_size / 8;
+	header.names_size = header.functions_size * 128;
+	header.names_used = 1;
+
+	VLD_G(pid) = getpid();
+	filename = vld_output_filename(VLD_G(shared_counters));
+	unlink(filename);
+	fd = open(filename, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0 || ftruncate(fd, VLD_COUNTERS_SIZE(&header)) != 0) {
+		zend_error(E_WARNING, "vld: Could not create the shared counters in '%s': %s", filename, strerror(errno));
+		if (fd >= 0) {
+			close(fd);
+		}
+		free(filename);
+		return;
+	}
+
+	map = mmap(NULL, VLD_COUNTERS_SIZE(&header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		zend_error(E_WARNING, "vld: Could not map the shared counters in '%s': %s", filename, strerror(errno));
+		free(filename);
+		return;
+	}
+	free(filename);
+
+	/* The magic goes in last, so that readers never see half a header */
+	memcpy(map, &header, sizeof(header));
+	memcpy(&magic, VLD_COUNTERS_MAGIC, 4);
+	VLD_STORE((uint32_t *) map, magic);
+
+	vld_counters = map;
+	vld_counters_size = VLD_COUNTERS_SIZE(&header);
+}
+
+void vld_counters_mshutdown(void)
+{
+	if (vld_counters) {
+		munmap(vld_counters, vld_counters_size);
+		vld_counters = NULL;
+	}
+}
+
+/* Adds the hits of an op array from this request */
+void vld_counters_add(zend_op_array *opa, const zend_ulong *hits)
+{
+	int64_t          function;
+	vld_counters_op *op;
+	uint32_t         i;
+
+	if (!vld_counters) {
+		return;
+	}
+
+	if ((function = vld_counters_find_function(opa)) < 0) {
+		for (i = 0; i < opa->last; i++) {
+			VLD_ADD(&vld_counters->dropped, hits[i]);
+		}
+		return;
+	}
+
+	for (i = 0; i < opa->last; i++) {
+		if (!hits[i]) {
+			continue;
+		}
+		if ((op = vld_counters_find_op(function, &opa->opcodes[i], i)) == NULL) {
+			VLD_ADD(&vld_counters->dropped, hits[i]);
+			continue;
+		}
+		VLD_ADD(&op->count, hits[i]);
+	}
+}
+
+static void vld_counters_read(zval *return_value, vld_counters_header *counters)
+{
+	vld_counters_function *functions = VLD_COUNTERS_FUNCTIONS(counters);
+	vld_counters_op       *ops = VLD_COUNTERS_OPS(counters);
+	const char            *names = VLD_COUNTERS_NAMES(counters), *opcode;
+	uint64_t               key;
+	uint32_t               i, function, name;
+	zval                   entry;
+
+	for (i = 0; i < counters->ops_size; i++) {
+		if ((key = VLD_LOAD(&ops[i].key)) == 0) {
+			continue;
+		}
+		function = (uint32_t) (key >> 32) - 1;
+		if (function >= counters->functions_size) {
+			continue;
+		}
+		if ((name = VLD_LOAD(&functions[function].name)) == 0 || name >= counters->names_size) {
+			continue;
+		}
+
+		array_init(&entry);
+		add_assoc_string(&entry, "file", (char *) names + name);
+		add_assoc_string(&entry, "function", (char *) names + name + strlen(names + name) + 1);
+		add_assoc_long(&entry, "line_start", functions[function].line);
+		add_assoc_long(&entry, "op", (zend_long) (key & 0xFFFFFFFF));
+		add_assoc_long(&entry, "line", ops[i].lineno);
+		opcode = vld_opcode_name(ops[i].opcode);
+		add_assoc_string(&entry, "opcode", (char *) (opcode ? opcode : "UNKNOWN"));
+		add_assoc_long(&entry, "count", (zend_long) __atomic_load_n(&ops[i].count, __ATOMIC_RELAXED));
+		add_next_index_zval(return_value, &entry);
+	}
+}
+
+/* Every op slot that is in use, with the counts so far of all processes,
+ * from the counters of this process, or from the file of another one */
+int vld_counters_to_array(zval *return_value, const char *filename)
+{
+	vld_counters_header  header, *map;
+	struct stat          st;
+	int                  fd;
+
+	array_init(return_value);
+	if (!filename) {
+		if (vld_counters) {
+			vld_counters_read(return_value, vld_counters);
+		}
+		return SUCCESS;
+	}
+
+	if ((fd = open(filename, O_RDONLY)) < 0) {
+		return FAILURE;
+	}
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(header) || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+		|| memcmp(header.magic, VLD_COUNTERS_MAGIC, 4) != 0 || header.version != VLD_COUNTERS_VERSION
+		|| (size_t) st.st_size < VLD_COUNTERS_SIZE(&header)
+	) {
+		close(fd);
+		return FAILURE;
+	}
+	map = mmap(NULL, VLD_COUNTERS_SIZE(&header), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return FAILURE;
+	}
+
+	vld_counters_read(return_value, map);
+	munmap(map, VLD_COUNTERS_SIZE(&header));
+
+	return SUCCESS;
+}
+
+#else
+
+int vld_counters_enabled(void)
+{
+	return 0;
+}
+
+void vld_counters_minit(void)
+{
+}
+
+void vld_counters_mshutdown(void)
+{
+}
+
+void vld_counters_add(zend_op_array *opa, const zend_ulong *hits)
+{
+}
+
+int vld_counters_to_array(zval *return_value, const char *filename)
+{
+	array_init(return_value);
+	return filename ? FAILURE : SUCCESS;
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __COUNTERS_H__
+#define __COUNTERS_H__
+
+#include <stdint.h>
+
+/* Shared counters
+ *
+ * With vld.shared_counters, a file of that name is created at MINIT and
+ * mapped shared, so that every worker that is forked off afterwards adds
+ * the op counts of its requests to the same tables. Counts are added at
+ * the same time as they are reported for vld.count_executions, with
+ * relaxed atomic additions, so that nothing ever waits for a lock. The
+ * file can be read while workers keep writing to it, with
+ * vld_counters_snapshot() or with tools/vld_counters.c.
+ *
+ * All numbers are in the byte order of the machine that wrote them. After
+ * the header follow the function slots, the op slots, and the names.
+ *
+ * A function slot is claimed by putting the hash of its file, name and
+ * first line in it, after which the first line and the "file\0function\0"
+ * names are copied in, and their offset is filled in last. Slots with a
+ * name offset of 0 are still being claimed. An op slot is claimed by
+ * putting in its key, which is the function slot plus one in the upper 32
+ * bits, and the op number in the lower 32 bits. Both tables use linear
+ * probing. Counts that do not find a free slot are added to dropped. */
+
+#define VLD_COUNTERS_MAGIC   "VLDC"
+#define VLD_COUNTERS_VERSION 2
+
+typedef struct _vld_counters_header {
+	char     magic[4];
+	uint32_t version;
+	uint32_t functions_size; /* slots, a power of two */
+	uint32_t ops_size;       /* slots, a power of two */
+	uint32_t names_size;     /* bytes */
+	uint32_t names_used;     /* bytes, starting at 1 */
+	uint64_t dropped;
+} vld_counters_header;
+
+typedef struct _vld_counters_function {
+	uint64_t hash;
+	uint32_t name;
+	uint32_t line;           /* first line of the function */
+} vld_counters_function;
+
+typedef struct _vld_counters_op {
+	uint64_t key;
+	uint64_t count;
+	uint32_t lineno;
+	uint32_t opcode;
+} vld_counters_op;
+
+#define VLD_COUNTERS_FUNCTIONS(h) ((vld_counters_function *) ((char *) (h) + sizeof(vld_counters_header)))
+#define VLD_COUNTERS_OPS(h)       ((vld_counters_op *) (VLD_COUNTERS_FUNCTIONS(h) + (h)->functions_size))
+#define VLD_COUNTERS_NAMES(h)     ((char *) (VLD_COUNTERS_OPS(h) + (h)->ops_size))
+#define VLD_COUNTERS_SIZE(h)      (sizeof(vld_counters_header) + (size_t) (h)->functions_size * sizeof(vld_counters_function) + (size_t) (h)->ops_size * sizeof(vld_counters_op) + (h)->names_size)
+
+#ifndef VLD_COUNTERS_NO_PHP
+#include "php.h"
+
+#if !defined(PHP_WIN32)
+# define VLD_COUNTERS_AVAILABLE 1
+#endif
+
+int vld_counters_enabled(void);
+void vld_counters_minit(void);
+void vld_counters_mshutdown(void);
+void vld_counters_add(zend_op_array *opa, const zend_ulong *hits);
+int vld_counters_to_array(zval *return_value, const char *filename);
+#endif
+
+#endif
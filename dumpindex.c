@@ -0,0 +1,229 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "php.h"
+#include "zend_smart_str.h"
+#include "flock_compat.h"
+#include "php_vld.h"
+#include "output.h"
+#include "dumpindex.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+typedef struct _vld_dump_index_entry {
+	char     *key;
+	char     *file;
+	uint64_t  offset;
+	uint64_t  length;
+} vld_dump_index_entry;
+
+struct _vld_dump_index {
+	vld_dump_index_entry *entries;
+	size_t                count;
+	size_t                size;
+	size_t                placed; /* entries with an offset in the file */
+};
+
+static void vld_dump_index_append(struct _vld_dump_index *index, char *key, char *file, uint64_t offset, uint64_t length)
+{
+	if (index->count == index->size) {
+		index->size = index->size ? index->size * 2 : 64;
+		index->entries = realloc(index->entries, index->size * sizeof(vld_dump_index_entry));
+	}
+	index->entries[index->count].key    = key;
+	index->entries[index->count].file   = file;
+	index->entries[index->count].offset = offset;
+	index->entries[index->count].length = length;
+	index->count++;
+}
+
+void vld_dump_index_open(void)
+{
+	VLD_G(dump_index) = calloc(1, sizeof(struct _vld_dump_index));
+}
+
+void vld_dump_index_add(zend_op_array *opa, uint64_t offset, uint64_t length)
+{
+	struct _vld_dump_index *index = VLD_G(dump_index);
+	char                   *key;
+	size_t                  len;
+
+	if (!index) {
+		return;
+	}
+
+	if (!opa->function_name) {
+		key = strdup(VLD_IDX_MAIN);
+	} else if (opa->scope) {
+		len = ZSTR_LEN(opa->scope->name) + 2 + ZSTR_LEN(opa->function_name);
+		key = malloc(len + 1);
+		snprintf(key, len + 1, "%s::%s", ZSTR_VAL(opa->scope->name), ZSTR_VAL(opa->function_name));
+		zend_str_tolower(key, len);
+	} else {
+		key = strdup(ZSTR_VAL(opa->function_name));
+		zend_str_tolower(key, strlen(key));
+	}
+
+	vld_dump_index_append(index, key, strdup(opa->filename ? ZSTR_VAL(opa->filename) : ""), offset, length);
+
+	/* The output buffer grows while a dump is written, and is only written
+	 * out in between dumps */
+	if (VLD_G(output_buffer_used) >= VLD_OUTPUT_BUFFER_SIZE) {
+		vld_output_flush();
+	}
+}
+
+/* The output that starts at offset in this request's dump was written to
+ * the file at position, and holds all dumps that were not placed yet */
+void vld_dump_index_place(uint64_t offset, uint64_t position)
+{
+	struct _vld_dump_index *index = VLD_G(dump_index);
+
+	for (; index->placed < index->count; index->placed++) {
+		index->entries[index->placed].offset = index->entries[index->placed].offset - offset + position;
+	}
+}
+
+/* {{{ Writing the index file */
+static void vld_idx_put32(unsigned char *p, uint32_t value)
+{
+	p[0] = value; p[1] = value >> 8; p[2] = value >> 16; p[3] = value >> 24;
+}
+
+static void vld_idx_put64(unsigned char *p, uint64_t value)
+{
+	vld_idx_put32(p, (uint32_t) value);
+	vld_idx_put32(p + 4, (uint32_t) (value >> 32));
+}
+
+static int vld_dump_index_compare(const void *a, const void *b)
+{
+	const vld_dump_index_entry *ea = a, *eb = b;
+	int                         cmp;
+
+	if ((cmp = strcmp(ea->key, eb->key)) != 0) {
+		return cmp;
+	}
+	if ((cmp = strcmp(ea->file, eb->file)) != 0) {
+		return cmp;
+	}
+	return ea->offset < eb->offset ? -1 : (ea->offset > eb->offset);
+}
+
+/* Strings that occur more than once, mostly file names, are only stored once
+ * in the blob */
+static uint32_t vld_dump_index_blob_add(smart_str *blob, HashTable *seen, const char *str)
+{
+	size_t  len = strlen(str);
+	zval   *found, tmp;
+
+	if ((found = zend_hash_str_find(seen, str, len)) != NULL) {
+		return (uint32_t) Z_LVAL_P(found);
+	}
+
+	ZVAL_LONG(&tmp, blob->s ? ZSTR_LEN(blob->s) : 0);
+	zend_hash_str_add(seen, str, len, &tmp);
+	smart_str_appendl(blob, str, len);
+
+	return (uint32_t) Z_LVAL(tmp);
+}
+
+/* Every request appends a segment of its own to the index, under a lock, so
+ * that workers that share a dump file neither rewrite what others wrote
+ * before them nor lose each other's entries */
+static void vld_dump_index_write(struct _vld_dump_index *index, const char *filename)
+{
+	smart_str      blob = {0}, segment = {0};
+	HashTable      seen;
+	unsigned char  header[VLD_IDX_HEADER_SIZE], *entries;
+	size_t         i;
+	FILE          *f;
+	int            ok;
+
+	qsort(index->entries, index->count, sizeof(vld_dump_index_entry), vld_dump_index_compare);
+
+	zend_hash_init(&seen, 64, NULL, NULL, 0);
+	entries = calloc(index->count ? index->count : 1, VLD_IDX_ENTRY_SIZE);
+	for (i = 0; i < index->count; i++) {
+		unsigned char *entry = entries + i * VLD_IDX_ENTRY_SIZE;
+
+		vld_idx_put32(entry,      vld_dump_index_blob_add(&blob, &seen, index->entries[i].key));
+		vld_idx_put32(entry + 4,  (uint32_t) strlen(index->entries[i].key));
+		vld_idx_put32(entry + 8,  vld_dump_index_blob_add(&blob, &seen, index->entries[i].file));
+		vld_idx_put32(entry + 12, (uint32_t) strlen(index->entries[i].file));
+		vld_idx_put64(entry + 16, index->entries[i].offset);
+		vld_idx_put64(entry + 24, index->entries[i].length);
+	}
+	zend_hash_destroy(&seen);
+
+	memcpy(header, VLD_IDX_MAGIC, 4);
+	vld_idx_put32(header + 4,  VLD_IDX_VERSION);
+	vld_idx_put32(header + 8,  (uint32_t) index->count);
+	vld_idx_put32(header + 12, VLD_IDX_ENTRY_SIZE);
+	vld_idx_put64(header + 16, VLD_IDX_HEADER_SIZE + (uint64_t) index->count * VLD_IDX_ENTRY_SIZE);
+	vld_idx_put64(header + 24, blob.s ? ZSTR_LEN(blob.s) : 0);
+
+	smart_str_appendl(&segment, (char *) header, sizeof(header));
+	smart_str_appendl(&segment, (char *) entries, index->count * VLD_IDX_ENTRY_SIZE);
+	if (blob.s) {
+		smart_str_append(&segment, blob.s);
+	}
+
+	if ((f = fopen(filename, "ab")) != NULL) {
+		php_flock(fileno(f), LOCK_EX);
+		ok = fwrite(ZSTR_VAL(segment.s), 1, ZSTR_LEN(segment.s), f) == ZSTR_LEN(segment.s);
+		ok = (fflush(f) == 0) && ok;
+		php_flock(fileno(f), LOCK_UN);
+		ok = (fclose(f) == 0) && ok;
+	} else {
+		ok = 0;
+	}
+	if (!ok) {
+		zend_error(E_WARNING, "vld: Could not write the dump index '%s'", filename);
+	}
+
+	free(entries);
+	smart_str_free(&segment);
+	smart_str_free(&blob);
+}
+/* }}} */
+
+void vld_dump_index_close(const char *output_filename)
+{
+	struct _vld_dump_index *index = VLD_G(dump_index);
+	char                   *filename;
+	size_t                  i, len;
+
+	if (!index) {
+		return;
+	}
+	VLD_G(dump_index) = NULL;
+
+	if (index->count && output_filename) {
+		len = strlen(output_filename) + sizeof(".idx");
+		filename = malloc(len);
+		snprintf(filename, len, "%s.idx", output_filename);
+
+		vld_dump_index_write(index, filename);
+		free(filename);
+	}
+
+	for (i = 0; i < index->count; i++) {
+		free(index->entries[i].key);
+		free(index->entries[i].file);
+	}
+	free(index->entries);
+	free(index);
+}
@@ -0,0 +1,54 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __DUMPINDEX_H__
+#define __DUMPINDEX_H__
+
+/* Sidecar index
+ *
+ * Next to a dump written to vld.output, a file with ".idx" appended to its
+ * name maps every dumped function to the byte range of its dump. Every
+ * request that wrote to the dump appends a segment to it, which is laid out
+ * so that it can be mmap()ed and binary searched as is. Readers go through
+ * the segments one after the other, and "vld_lookup -c" merges them into
+ * one. Every dump is written to the file in one piece, under a lock, so the
+ * offsets hold also when workers share the file. All numbers are little
+ * endian.
+ *
+ * Segment header (32 bytes):
+ *   "VLDX", uint32 version, uint32 entry count, uint32 entry size,
+ *   uint64 offset of the string blob, uint64 size of the string blob,
+ *   both from the start of the segment, which ends with the blob
+ *
+ * Entries (32 bytes each), sorted by key, then file, then offset:
+ *   uint32 key offset, uint32 key length, uint32 file offset,
+ *   uint32 file length, uint64 dump offset, uint64 dump length
+ *
+ * Key and file point into the string blob. The key is the lower cased
+ * "class::function", "function", or "{main}" for the code of a file. */
+
+#define VLD_IDX_MAGIC       "VLDX"
+#define VLD_IDX_VERSION     2
+#define VLD_IDX_HEADER_SIZE 32
+#define VLD_IDX_ENTRY_SIZE  32
+#define VLD_IDX_MAIN        "{main}"
+
+#ifndef VLD_DUMPINDEX_NO_PHP
+#include "php.h"
+
+void vld_dump_index_open(void);
+void vld_dump_index_add(zend_op_array *opa, uint64_t offset, uint64_t length);
+void vld_dump_index_place(uint64_t offset, uint64_t position);
+void vld_dump_index_close(const char *output_filename);
+#endif
+
+#endif
@@ -0,0 +1,177 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "php.h"
+#include "php_vld.h"
+#include "srm_oparray.h"
+#include "hot.h"
+#if PHP_VERSION_ID >= 80000
+# include "zend_observer.h"
+#endif
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+typedef struct _vld_hot_function {
+	zend_ulong calls;
+	int        dumped;
+} vld_hot_function;
+
+#if PHP_VERSION_ID < 80000
+static void (*vld_hot_old_execute_ex)(zend_execute_data *execute_data);
+#endif
+
+static void vld_hot_function_dtor(zval *zv)
+{
+	free(Z_PTR_P(zv));
+}
+
+/* Functions are told apart by name and file, as they are compiled anew for
+ * every request without OPcache */
+static vld_hot_function *vld_hot_function_find(zend_op_array *opa, int create)
+{
+	zend_string      *name = vld_function_name((zend_function *) opa);
+	zend_string      *key;
+	vld_hot_function *f;
+
+	key = strpprintf(0, "%s %s:%d", ZSTR_VAL(name), ZSTR_VAL(opa->filename), opa->line_start);
+	zend_string_release(name);
+
+	if ((f = zend_hash_find_ptr(VLD_G(hot_functions), key)) == NULL && create) {
+		zend_string *persistent_key = zend_string_init(ZSTR_VAL(key), ZSTR_LEN(key), 1);
+
+		f = calloc(1, sizeof(vld_hot_function));
+		zend_hash_add_ptr(VLD_G(hot_functions), persistent_key, f);
+		zend_string_release(persistent_key);
+	}
+	zend_string_release(key);
+
+	return f;
+}
+
+static void vld_hot_call(zend_op_array *opa)
+{
+	zend_ulong        key = (zend_ulong) (zend_uintptr_t) opa->opcodes;
+	vld_hot_function *f;
+	zend_string      *name;
+
+	if (!opa->function_name || !VLD_G(hot_calls)) {
+		return;
+	}
+
+	if ((f = zend_hash_index_find_ptr(VLD_G(hot_calls), key)) == NULL) {
+		f = vld_hot_function_find(opa, 1);
+		zend_hash_index_add_ptr(VLD_G(hot_calls), key, f);
+	}
+
+	if (f->dumped || ++f->calls < (zend_ulong) VLD_G(hot_threshold)) {
+		return;
+	}
+	f->dumped = 1;
+
+	name = vld_function_name((zend_function *) opa);
+	vld_printf(stderr, "Function %s (hot after %" ZEND_ULONG_FMT_SPEC " calls):\n", ZSTR_VAL(name), f->calls);
+	vld_dump_oparray(opa);
+	vld_printf(stderr, "End of function %s\n\n", ZSTR_VAL(name));
+	zend_string_release(name);
+}
+
+#if PHP_VERSION_ID >= 80000
+static void vld_hot_observer_begin(zend_execute_data *execute_data)
+{
+	vld_hot_call(&execute_data->func->op_array);
+}
+
+/* Called once for every function per request, before its first call, so
+ * functions that were already dumped are not observed at all */
+static zend_observer_fcall_handlers vld_hot_observer_init(zend_execute_data *execute_data)
+{
+	zend_function                *func = execute_data->func;
+	zend_observer_fcall_handlers  handlers = { NULL, NULL };
+	vld_hot_function             *f;
+
+	if (!func || !ZEND_USER_CODE(func->type) || !func->common.function_name || !VLD_G(hot_functions)) {
+		return handlers;
+	}
+	f = vld_hot_function_find(&func->op_array, 0);
+	if (!f || !f->dumped) {
+		handlers.begin = vld_hot_observer_begin;
+	}
+	return handlers;
+}
+#else
+static void vld_hot_execute_ex(zend_execute_data *execute_data)
+{
+	vld_hot_call(&execute_data->func->op_array);
+	vld_hot_old_execute_ex(execute_data);
+}
+#endif
+
+int vld_hot_enabled(void)
+{
+	return VLD_G(hot_threshold) > 0;
+}
+
+/* Observers can only be registered while modules start up */
+void vld_hot_minit(void)
+{
+	if (!vld_hot_enabled()) {
+		return;
+	}
+
+	VLD_G(hot_functions) = malloc(sizeof(HashTable));
+	zend_hash_init(VLD_G(hot_functions), 64, NULL, vld_hot_function_dtor, 1);
+#if PHP_VERSION_ID >= 80000
+	zend_observer_fcall_register(vld_hot_observer_init);
+#endif
+}
+
+void vld_hot_mshutdown(void)
+{
+	if (VLD_G(hot_functions)) {
+		zend_hash_destroy(VLD_G(hot_functions));
+		free(VLD_G(hot_functions));
+		VLD_G(hot_functions) = NULL;
+	}
+}
+
+void vld_hot_rinit(void)
+{
+	if (!vld_hot_enabled()) {
+		return;
+	}
+
+	ALLOC_HASHTABLE(VLD_G(hot_calls));
+	zend_hash_init(VLD_G(hot_calls), 64, NULL, NULL, 0);
+#if PHP_VERSION_ID < 80000
+	/* Put back by RSHUTDOWN, together with vld's other hooks */
+	vld_hot_old_execute_ex = zend_execute_ex;
+	zend_execute_ex = vld_hot_execute_ex;
+#endif
+}
+
+void vld_hot_rshutdown(void)
+{
+	if (!VLD_G(hot_calls)) {
+		return;
+	}
+
+	zend_hash_destroy(VLD_G(hot_calls));
+	FREE_HASHTABLE(VLD_G(hot_calls));
+	VLD_G(hot_calls) = NULL;
+}
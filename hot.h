@@ -0,0 +1,35 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __HOT_H__
+#define __HOT_H__
+
+/* Hot function dumping
+ *
+ * With vld.hot_threshold, calls of user functions and methods are counted
+ * for the life of the process, by name and file, and a function is dumped
+ * once, when its count reaches the threshold. On PHP 8, the calls are
+ * counted through the observer API, which stops observing a function
+ * altogether once it has been dumped. Before that, zend_execute_ex is
+ * replaced for the request instead.
+ *
+ * Within a request, the counter of a function is found through its
+ * opcodes pointer, as with the runtime profiles, so that the name is only
+ * looked at on the first call in each request. */
+
+int vld_hot_enabled(void);
+void vld_hot_minit(void);
+void vld_hot_mshutdown(void);
+void vld_hot_rinit(void);
+void vld_hot_rshutdown(void);
+
+#endif
@@ -0,0 +1,402 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#include "php.h"
+#include "zend_smart_str.h"
+#include "php_vld.h"
+#include "branchinfo.h"
+#include "srm_oparray.h"
+#include "output.h"
+#include "ndjson.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+/* {{{ JSON helpers */
+/* Returns the length of the well formed UTF-8 sequence at the start of str,
+ * or 0 for a byte that does not start one, such as a stray continuation
+ * byte, an overlong form, a surrogate or a code point past U+10FFFF */
+static size_t vld_utf8_length(const unsigned char *str, size_t len)
+{
+	size_t   need, i;
+	uint32_t cp;
+
+	if (str[0] >= 0xc2 && str[0] <= 0xdf) {
+		need = 2; cp = str[0] & 0x1f;
+	} else if (str[0] >= 0xe0 && str[0] <= 0xef) {
+		need = 3; cp = str[0] & 0x0f;
+	} else if (str[0] >= 0xf0 && str[0] <= 0xf4) {
+		need = 4; cp = str[0] & 0x07;
+	} else {
+		return 0;
+	}
+
+	if (len < need) {
+		return 0;
+	}
+	for (i = 1; i < need; i++) {
+		if ((str[i] & 0xc0) != 0x80) {
+			return 0;
+		}
+		cp = (cp << 6) | (str[i] & 0x3f);
+	}
+
+	if ((need == 3 && (cp < 0x800 || (cp >= 0xd800 && cp <= 0xdfff))) || (need == 4 && (cp < 0x10000 || cp > 0x10ffff))) {
+		return 0;
+	}
+	return need;
+}
+
+void vld_json_string(smart_str *buf, const char *str, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t i, run = 0;
+
+	smart_str_appendc(buf, '"');
+	for (i = 0; i < len; i++) {
+		unsigned char c = (unsigned char) str[i];
+		const char   *esc = NULL;
+
+		switch (c) {
+			case '"':  esc = "\\\""; break;
+			case '\\': esc = "\\\\"; break;
+			case '\n': esc = "\\n";  break;
+			case '\r': esc = "\\r";  break;
+			case '\t': esc = "\\t";  break;
+			case '\b': esc = "\\b";  break;
+			case '\f': esc = "\\f";  break;
+			default:
+				if (c >= 0x20 && c < 0x80) {
+					continue;
+				}
+				/* String literals do not have to be UTF-8, so bytes that
+				 * are not part of a valid sequence are escaped as the code
+				 * point of the same value, to keep the line valid JSON */
+				if (c >= 0x80) {
+					size_t n = vld_utf8_length((const unsigned char *) str + i, len - i);
+
+					if (n) {
+						i += n - 1;
+						continue;
+					}
+				}
+		}
+
+		/* Copy the part that did not need escaping in one go */
+		smart_str_appendl(buf, str + run, i - run);
+		run = i + 1;
+
+		if (esc) {
+			smart_str_appends(buf, esc);
+		} else {
+			smart_str_appendl(buf, "\\u00", 4);
+			smart_str_appendc(buf, hex[c >> 4]);
+			smart_str_appendc(buf, hex[c & 0xf]);
+		}
+	}
+	smart_str_appendl(buf, str + run, len - run);
+	smart_str_appendc(buf, '"');
+}
+
+static void vld_json_zstr(smart_str *buf, zend_string *str)
+{
+	if (str) {
+		vld_json_string(buf, ZSTR_VAL(str), ZSTR_LEN(str));
+	} else {
+		smart_str_appendl(buf, "null", 4);
+	}
+}
+
+static void vld_json_key(smart_str *buf, const char *key)
+{
+	smart_str_appendc(buf, ',');
+	smart_str_appendc(buf, '"');
+	smart_str_appends(buf, key);
+	smart_str_appendc(buf, '"');
+	smart_str_appendc(buf, ':');
+}
+
+static void vld_json_key_long(smart_str *buf, const char *key, zend_long value)
+{
+	vld_json_key(buf, key);
+	smart_str_append_long(buf, value);
+}
+
+static void vld_json_key_bool(smart_str *buf, const char *key, int value)
+{
+	vld_json_key(buf, key);
+	smart_str_appends(buf, value ? "true" : "false");
+}
+
+static void vld_json_literal(smart_str *buf, zval *literal)
+{
+	char tmp[64];
+
+	switch (Z_TYPE_P(literal)) {
+		case IS_NULL:   smart_str_appends(buf, "null"); break;
+		case IS_FALSE:  smart_str_appends(buf, "false"); break;
+		case IS_TRUE:   smart_str_appends(buf, "true"); break;
+		case IS_LONG:   smart_str_append_long(buf, Z_LVAL_P(literal)); break;
+		case IS_DOUBLE:
+			if (zend_finite(Z_DVAL_P(literal))) {
+				snprintf(tmp, sizeof(tmp), "%.17g", Z_DVAL_P(literal));
+				smart_str_appends(buf, tmp);
+			} else {
+				smart_str_appends(buf, "null");
+			}
+			break;
+		case IS_STRING: vld_json_zstr(buf, Z_STR_P(literal)); break;
+		case IS_ARRAY:  smart_str_appends(buf, "\"<array>\""); break;
+		default:        smart_str_appends(buf, "\"<const ast>\""); break;
+	}
+}
+
+/* Every record goes out as a single line */
+static void vld_ndjson_emit(smart_str *buf)
+{
+	smart_str_appendc(buf, '\n');
+	smart_str_0(buf);
+	vld_output_write(ZSTR_VAL(buf->s), ZSTR_LEN(buf->s));
+	smart_str_free(buf);
+}
+
+/* All records of one op array carry the same "fid", so that the opcodes,
+ * branches and paths can be joined back to their function header. */
+static void vld_ndjson_start(smart_str *buf, const char *type)
+{
+	smart_str_appends(buf, "{\"type\":\"");
+	smart_str_appends(buf, type);
+	smart_str_appendc(buf, '"');
+	vld_json_key_long(buf, "pid", VLD_G(pid));
+	vld_json_key_long(buf, "fid", VLD_G(ndjson_fid));
+}
+
+static void vld_ndjson_identity(smart_str *buf, zend_op_array *opa)
+{
+	vld_json_key(buf, "file");
+	vld_json_zstr(buf, opa->filename);
+	vld_json_key(buf, "class");
+	vld_json_zstr(buf, opa->scope ? opa->scope->name : NULL);
+	vld_json_key(buf, "function");
+	vld_json_zstr(buf, opa->function_name);
+	vld_json_key_long(buf, "line_start", opa->line_start);
+	vld_json_key_long(buf, "line_end", opa->line_end);
+}
+/* }}} */
+
+void vld_ndjson_oparray_header(zend_op_array *opa)
+{
+	smart_str buf = {0};
+	int       i;
+
+	VLD_G(ndjson_fid)++;
+
+	vld_ndjson_start(&buf, "function");
+	vld_ndjson_identity(&buf, opa);
+	vld_json_key_long(&buf, "num_ops", opa->last);
+	vld_json_key(&buf, "compiled_vars");
+	smart_str_appendc(&buf, '[');
+	for (i = 0; i < opa->last_var; i++) {
+		if (i) {
+			smart_str_appendc(&buf, ',');
+		}
+		vld_json_zstr(&buf, opa->vars[i]);
+	}
+	smart_str_appendc(&buf, ']');
+	smart_str_appendc(&buf, '}');
+	vld_ndjson_emit(&buf);
+}
+
+void vld_ndjson_oparray_reference(zend_op_array *opa)
+{
+	smart_str buf = {0};
+
+	smart_str_appends(&buf, "{\"type\":\"reference\"");
+	vld_json_key_long(&buf, "pid", VLD_G(pid));
+	vld_ndjson_identity(&buf, opa);
+	smart_str_appendc(&buf, '}');
+	vld_ndjson_emit(&buf);
+}
+
+static void vld_ndjson_znode(smart_str *buf, const char *key, unsigned int node_type, znode_op node, zend_op_array *opa, int opline)
+{
+	vld_znode_info znode;
+
+	vld_decode_znode(opa, opline, node_type, node, &znode);
+
+	vld_json_key(buf, key);
+	smart_str_appends(buf, "{\"type\":\"");
+	smart_str_appends(buf, znode.type ? znode.type : "UNKNOWN");
+	smart_str_appendc(buf, '"');
+
+	switch (node_type) {
+		case IS_CONST:
+		case VLD_IS_CLASS:
+			vld_json_key_long(buf, "literal", znode.value);
+			vld_json_key(buf, "value");
+			vld_json_literal(buf, znode.literal);
+			break;
+
+		case IS_TMP_VAR:
+		case IS_VAR:
+		case VLD_IS_OPNUM:
+		case VLD_IS_OPLINE:
+		case VLD_IS_INDEX:
+			vld_json_key_long(buf, "value", znode.value);
+			break;
+
+		case IS_CV:
+			vld_json_key_long(buf, "value", znode.value);
+			if (znode.name) {
+				vld_json_key(buf, "name");
+				vld_json_zstr(buf, znode.name);
+			}
+			break;
+
+#if PHP_VERSION_ID >= 70200
+		case VLD_IS_JMP_ARRAY: {
+			zend_ulong   num;
+			zend_string *str_key;
+			zval        *val;
+			int          first = 1;
+
+			vld_json_key(buf, "value");
+			smart_str_appendc(buf, '[');
+			ZEND_HASH_FOREACH_KEY_VAL_IND(Z_ARRVAL_P(znode.literal), num, str_key, val) {
+				if (!first) {
+					smart_str_appendc(buf, ',');
+				}
+				first = 0;
+				smart_str_appends(buf, "{\"key\":");
+				if (str_key) {
+					vld_json_zstr(buf, str_key);
+				} else {
+					smart_str_append_long(buf, num);
+				}
+				vld_json_key_long(buf, "target", opline + (Z_LVAL_P(val) / sizeof(zend_op)));
+				smart_str_appendc(buf, '}');
+			} ZEND_HASH_FOREACH_END();
+			smart_str_appendc(buf, ']');
+			break;
+		}
+#endif
+	}
+	smart_str_appendc(buf, '}');
+}
+
+void vld_ndjson_op(zend_op_array *opa, unsigned int nr, int notdead, int entry, int start, int end)
+{
+	const zend_op *op = &opa->opcodes[nr];
+	unsigned int   base_address = (unsigned int)(zend_intptr_t)&(opa->opcodes[0]);
+	const char    *name = vld_opcode_name(op->opcode);
+	smart_str      buf = {0};
+	vld_op_info    info;
+
+	vld_decode_op(op, base_address, &info);
+
+	vld_ndjson_start(&buf, "op");
+	vld_json_key_long(&buf, "nr", nr);
+	vld_json_key_long(&buf, "line", op->lineno);
+	vld_json_key_long(&buf, "opcode", op->opcode);
+	vld_json_key(&buf, "name");
+	if (name) {
+		vld_json_string(&buf, name, strlen(name));
+	} else {
+		smart_str_appends(&buf, "null");
+	}
+	vld_json_key(&buf, "fetch");
+	vld_json_string(&buf, info.fetch_type, strlen(info.fetch_type));
+	if (info.flags & EXT_VAL) {
+		vld_json_key_long(&buf, "ext", op->extended_value);
+	}
+	vld_json_key_bool(&buf, "reachable", notdead);
+	vld_json_key_bool(&buf, "entry", entry);
+	vld_json_key_bool(&buf, "branch_start", start);
+	vld_json_key_bool(&buf, "branch_end", end);
+
+#if PHP_VERSION_ID >= 70100
+	if ((info.flags & RES_USED) && op->result_type != IS_UNUSED) {
+#else
+	if ((info.flags & RES_USED) && !(op->VLD_EXTENDED_VALUE(result) & EXT_TYPE_UNUSED)) {
+#endif
+		vld_ndjson_znode(&buf, "result", info.res_type, op->result, opa, nr);
+	}
+	if ((info.flags & OP1_USED) && info.op1_type != IS_UNUSED) {
+		vld_ndjson_znode(&buf, "op1", info.op1_type, op->op1, opa, nr);
+	}
+	if (info.flags & OP2_INCLUDE) {
+		const char *include_type = vld_include_type_name(op->extended_value);
+
+		vld_json_key(&buf, "op2");
+		smart_str_appends(&buf, "{\"type\":\"INCLUDE\",\"value\":\"");
+		smart_str_appends(&buf, include_type ? include_type : "UNKNOWN");
+		smart_str_appends(&buf, "\"}");
+	} else if ((info.flags & OP2_USED) && info.op2_type != IS_UNUSED) {
+		vld_ndjson_znode(&buf, "op2", info.op2_type, op->op2, opa, nr);
+	}
+	if (info.flags & EXT_VAL_JMP_ABS) {
+		vld_json_key_long(&buf, "ext_target", op->extended_value);
+	} else if (info.flags & EXT_VAL_JMP_REL) {
+		vld_json_key_long(&buf, "ext_target", nr + ((int) op->extended_value / (int) sizeof(zend_op)));
+	}
+
+	smart_str_appendc(&buf, '}');
+	vld_ndjson_emit(&buf);
+}
+
+void vld_ndjson_branch_info(zend_op_array *opa, vld_branch_info *branch_info)
+{
+	unsigned int i, j;
+	smart_str    buf = {0};
+
+	for (i = 0; i < branch_info->starts->size; i++) {
+		int first = 1;
+
+		if (!vld_set_in(branch_info->starts, i)) {
+			continue;
+		}
+
+		vld_ndjson_start(&buf, "branch");
+		vld_json_key_long(&buf, "branch", i);
+		vld_json_key_long(&buf, "line_start", branch_info->branches[i].start_lineno);
+		vld_json_key_long(&buf, "line_end", branch_info->branches[i].end_lineno);
+		vld_json_key_long(&buf, "op_start", i);
+		vld_json_key_long(&buf, "op_end", branch_info->branches[i].end_op);
+		vld_json_key(&buf, "outs");
+		smart_str_appendc(&buf, '[');
+		for (j = 0; j < branch_info->branches[i].outs_count; j++) {
+			if (branch_info->branches[i].outs[j]) {
+				if (!first) {
+					smart_str_appendc(&buf, ',');
+				}
+				first = 0;
+				smart_str_append_long(&buf, branch_info->branches[i].outs[j]);
+			}
+		}
+		smart_str_appends(&buf, "]}");
+		vld_ndjson_emit(&buf);
+	}
+
+	for (i = 0; i < branch_info->paths_count; i++) {
+		vld_ndjson_start(&buf, "path");
+		vld_json_key_long(&buf, "path", i + 1);
+		vld_json_key(&buf, "branches");
+		smart_str_appendc(&buf, '[');
+		for (j = 0; j < branch_info->paths[i]->elements_count; j++) {
+			if (j) {
+				smart_str_appendc(&buf, ',');
+			}
+			smart_str_append_long(&buf, branch_info->paths[i]->elements[j]);
+		}
+		smart_str_appends(&buf, "]}");
+		vld_ndjson_emit(&buf);
+	}
+}
@@ -0,0 +1,27 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __NDJSON_H__
+#define __NDJSON_H__
+
+#include "php.h"
+#include "zend_smart_str.h"
+#include "branchinfo.h"
+
+void vld_json_string(smart_str *buf, const char *str, size_t len);
+
+void vld_ndjson_oparray_header(zend_op_array *opa);
+void vld_ndjson_oparray_reference(zend_op_array *opa);
+void vld_ndjson_op(zend_op_array *opa, unsigned int nr, int notdead, int entry, int start, int end);
+void vld_ndjson_branch_info(zend_op_array *opa, vld_branch_info *branch_info);
+
+#endif
@@ -0,0 +1,201 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "php.h"
+#include "zend_smart_str.h"
+#include "flock_compat.h"
+#include "php_vld.h"
+#include "output.h"
+#include "dumpindex.h"
+#include "compress.h"
+#include "unixsock.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+/* Expands "%p" in the vld.output setting to the process ID, so that every
+ * worker of a multi process SAPI writes to a file of its own. */
+char *vld_output_filename(const char *format)
+{
+	smart_str   buf = {0};
+	const char *p;
+	char       *filename;
+
+	for (p = format; *p; p++) {
+		if (p[0] == '%' && p[1] == 'p') {
+			smart_str_append_long(&buf, VLD_G(pid));
+			p++;
+		} else {
+			smart_str_appendc(&buf, *p);
+		}
+	}
+	smart_str_0(&buf);
+
+	filename = strdup(ZSTR_VAL(buf.s));
+	smart_str_free(&buf);
+
+	return filename;
+}
+
+/* Records are collected in a fixed size buffer that is written out whenever
+ * it fills up, instead of issuing a write for every small record. */
+void vld_output_open(void)
+{
+	VLD_G(output_stream)      = stderr;
+	VLD_G(output_offset)      = 0;
+
+	if (VLD_G(output) && strncmp(VLD_G(output), VLD_UNIXSOCK_PREFIX, sizeof(VLD_UNIXSOCK_PREFIX) - 1) == 0) {
+		vld_unixsock_open(VLD_G(output) + sizeof(VLD_UNIXSOCK_PREFIX) - 1);
+	} else if (VLD_G(output) && VLD_G(output)[0]) {
+		char *filename = vld_output_filename(VLD_G(output));
+
+		VLD_G(output_stream) = fopen(filename, "ab");
+		if (!VLD_G(output_stream)) {
+			zend_error(E_WARNING, "vld: Could not open '%s' for writing, using stderr instead", filename);
+			VLD_G(output_stream) = stderr;
+			free(filename);
+		} else {
+			VLD_G(output_filename) = filename;
+			/* Arrow rows are batched up across functions, and offsets into
+			 * the uncompressed dump can not be seeked to in a compressed
+			 * file, so there are no byte ranges to index in either case */
+			if (VLD_G(output_index) && VLD_G(output_format) != VLD_OUTPUT_ARROW && VLD_G(compress) == VLD_COMPRESS_NONE) {
+				vld_dump_index_open();
+			}
+			vld_compress_open(VLD_G(output_stream));
+		}
+	} else if (VLD_G(output_format) == VLD_OUTPUT_TEXT) {
+		/* The classic text dump goes to stderr as it is produced */
+		VLD_G(output_buffer) = NULL;
+		return;
+	}
+
+	VLD_G(output_buffer)      = malloc(VLD_OUTPUT_BUFFER_SIZE);
+	VLD_G(output_buffer_used) = 0;
+	VLD_G(output_buffer_size) = VLD_OUTPUT_BUFFER_SIZE;
+}
+
+static void vld_output_sink(const char *data, size_t len)
+{
+	if (VLD_G(unixsock)) {
+		vld_unixsock_write(data, len);
+		return;
+	}
+	if (VLD_G(compress_state)) {
+		vld_compress_write(data, len);
+		return;
+	}
+
+	/* A stream that failed once, such as a control socket client that
+	 * stopped reading, is not waited for again */
+	if (!ferror(VLD_G(output_stream))) {
+		fwrite(data, 1, len, VLD_G(output_stream));
+	}
+}
+
+/* The dumps that an index points at, and the Arrow stream of a request,
+ * have to end up in the file in one piece, in between what other workers
+ * append to it */
+static int vld_output_whole(void)
+{
+	return VLD_G(dump_index) || (VLD_G(output_format) == VLD_OUTPUT_ARROW && VLD_G(output_filename));
+}
+
+/* Other workers may append to the same file, so such a buffer is written
+ * out under a lock, at a position that is looked up first, and the index
+ * entries of the dumps in it are moved to that position */
+static void vld_output_flush_locked(void)
+{
+	FILE *stream = VLD_G(output_stream);
+
+	php_flock(fileno(stream), LOCK_EX);
+	fseek(stream, 0, SEEK_END);
+	if (VLD_G(dump_index)) {
+		vld_dump_index_place(VLD_G(output_offset) - VLD_G(output_buffer_used), (uint64_t) ftell(stream));
+	}
+	vld_output_sink(VLD_G(output_buffer), VLD_G(output_buffer_used));
+	fflush(stream);
+	php_flock(fileno(stream), LOCK_UN);
+}
+
+void vld_output_flush(void)
+{
+	if (!VLD_G(output_buffer) || !VLD_G(output_buffer_used)) {
+		return;
+	}
+
+	if (vld_output_whole()) {
+		vld_output_flush_locked();
+	} else {
+		vld_output_sink(VLD_G(output_buffer), VLD_G(output_buffer_used));
+		fflush(VLD_G(output_stream));
+	}
+	VLD_G(output_buffer_used) = 0;
+}
+
+void vld_output_write(const char *data, size_t len)
+{
+	VLD_G(output_offset) += len;
+
+	if (!VLD_G(output_buffer)) {
+		fwrite(data, 1, len, stderr);
+		return;
+	}
+
+	/* Output that has to end up in the file in one piece grows the buffer
+	 * instead, which is written out by vld_dump_index_add() once a dump is
+	 * complete, or at the end of the request */
+	if (vld_output_whole() && VLD_G(output_buffer_used) + len > VLD_G(output_buffer_size)) {
+		while (VLD_G(output_buffer_used) + len > VLD_G(output_buffer_size)) {
+			VLD_G(output_buffer_size) *= 2;
+		}
+		VLD_G(output_buffer) = realloc(VLD_G(output_buffer), VLD_G(output_buffer_size));
+	}
+
+	if (VLD_G(output_buffer_used) + len > VLD_G(output_buffer_size)) {
+		vld_output_flush();
+
+		if (len > VLD_G(output_buffer_size)) {
+			vld_output_sink(data, len);
+			return;
+		}
+	}
+
+	memcpy(VLD_G(output_buffer) + VLD_G(output_buffer_used), data, len);
+	VLD_G(output_buffer_used) += len;
+}
+
+void vld_output_close(void)
+{
+	if (!VLD_G(output_buffer)) {
+		return;
+	}
+
+	vld_output_flush();
+	vld_compress_close();
+	vld_unixsock_close();
+	free(VLD_G(output_buffer));
+	VLD_G(output_buffer) = NULL;
+
+	if (VLD_G(output_stream) && VLD_G(output_stream) != stderr) {
+		fclose(VLD_G(output_stream));
+	}
+	VLD_G(output_stream) = NULL;
+
+	if (VLD_G(output_filename)) {
+		vld_dump_index_close(VLD_G(output_filename));
+		free(VLD_G(output_filename));
+		VLD_G(output_filename) = NULL;
+	}
+}
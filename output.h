@@ -0,0 +1,26 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __OUTPUT_H__
+#define __OUTPUT_H__
+
+#include <stddef.h>
+
+#define VLD_OUTPUT_BUFFER_SIZE 65536
+
+char *vld_output_filename(const char *format);
+void vld_output_open(void);
+void vld_output_write(const char *data, size_t len);
+void vld_output_flush(void);
+void vld_output_close(void);
+
+#endif
@@ -48,9 +48,75 @@ ZEND_BEGIN_MODULE_GLOBALS(vld)
 	FILE *path_dump_file;
 	int dump_paths;
 	int sg_decode;
+	int dedup;
+	HashTable *dumped_fingerprints;
+	int output_format;
+	FILE *output_stream;
+	char *output_buffer;
+	size_t output_buffer_used;
+	size_t output_buffer_size;
+	zend_long pid;
+	zend_long ndjson_fid;
+	char *output;
+	uint64_t output_offset;
+	struct _vld_binary_state *binary;
+	int output_index;
+	char *output_filename;
+	struct _vld_dump_index *dump_index;
+	struct _vld_sqlite_state *sqlite;
+	struct _vld_arrow_state *arrow;
+	int compress;
+	zend_long compress_level;
+	struct _vld_compress_state *compress_state;
+	struct _vld_unixsock_state *unixsock;
+	char *control_socket;
+	int control_fd;
+	zend_long control_pid;
+	char *control_path;
+	int count_executions;
+	HashTable *runtime_profiles;
+	const zend_op *runtime_last_opcodes;
+	struct _vld_profile *runtime_last_profile;
+	int runtime_reporting;
+	int branch_coverage;
+	int path_profile;
+	int call_sites;
+	int type_profile;
+	char *time_function;
+	const zend_op *runtime_timed_opcodes;
+	const zend_op *runtime_untimed_opcodes;
+	HashTable *runtime_timed;
+	HashTable *runtime_frames;
+	zend_long sample_frequency;
+	char *sample_folded;
+	struct _vld_sampler_state *sampler;
+	int alloc_profile;
+	zend_long alloc_sample_every;
+	zend_long alloc_sample_bytes;
+	struct _vld_alloc_state *alloc;
+	char *shared_counters;
+	zend_long shared_counters_size;
+	zend_long hot_threshold;
+	HashTable *hot_functions;
+	HashTable *hot_calls;
+	int compile_profile;
+	char *compile_profile_totals;
+	int include_profile;
+	struct _vld_compileprof_state *compileprof;
+	HashTable *compileprof_totals;
+	zend_ulong compileprof_requests;
+	char *preload_script;
+	zend_long preload_files;
 ZEND_END_MODULE_GLOBALS(vld) 
 
+#define VLD_OUTPUT_TEXT   0
+#define VLD_OUTPUT_NDJSON 1
+#define VLD_OUTPUT_BINARY 2
+#define VLD_OUTPUT_SQLITE 3
+#define VLD_OUTPUT_ARROW  4
+
 int vld_printf(FILE *stream, const char* fmt, ...);
+zend_function *vld_find_function(zend_string *name);
 
 #ifdef ZTS
 #define VLD_G(v) TSRMG(vld_globals_id, zend_vld_globals *, v)
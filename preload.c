@@ -0,0 +1,270 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "php.h"
+#include "zend_virtual_cwd.h"
+#include "php_vld.h"
+#include "output.h"
+#include "compileprof.h"
+#include "preload.h"
+
+#ifdef PHP_WIN32
+# include <process.h>
+#endif
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+typedef struct _vld_preload_file {
+	zend_string           *filename;
+	vld_compileprof_total *total;
+	int                    visited;
+} vld_preload_file;
+
+/* {{{ Recording */
+static void vld_preload_add(HashTable **set, zend_string *name)
+{
+	zend_string *key;
+
+	if (!*set) {
+		*set = malloc(sizeof(HashTable));
+		zend_hash_init(*set, 8, NULL, NULL, 1);
+	}
+	if (zend_hash_exists(*set, name)) {
+		return;
+	}
+
+	key = zend_string_init(ZSTR_VAL(name), ZSTR_LEN(name), 1);
+	zend_hash_add_empty_element(*set, key);
+	zend_string_release(key);
+}
+
+static vld_compileprof_total *vld_preload_total(zend_string *filename)
+{
+	return filename ? zend_hash_find_ptr(VLD_G(compileprof_totals), filename) : NULL;
+}
+
+static void vld_preload_depend(vld_compileprof_total *total, zend_class_entry *ce, zend_class_entry *dep)
+{
+	if (!dep || dep->type != ZEND_USER_CLASS || !dep->info.user.filename) {
+		return;
+	}
+	if (zend_string_equals(dep->info.user.filename, ce->info.user.filename)) {
+		return;
+	}
+	vld_preload_add(&total->depends, dep->info.user.filename);
+}
+
+static void vld_preload_record_class(zend_class_entry *ce)
+{
+	vld_compileprof_total *total;
+	uint32_t               i;
+
+	if (ce->type != ZEND_USER_CLASS || (total = vld_preload_total(ce->info.user.filename)) == NULL) {
+		return;
+	}
+#if PHP_VERSION_ID >= 70400
+	/* The parent and interfaces are only filled in once a class is linked */
+	if (!(ce->ce_flags & ZEND_ACC_LINKED)) {
+		return;
+	}
+#endif
+
+	vld_preload_add(&total->declared_classes, ce->name);
+	vld_preload_depend(total, ce, ce->parent);
+	for (i = 0; i < ce->num_interfaces; i++) {
+		vld_preload_depend(total, ce, ce->interfaces[i]);
+	}
+	for (i = 0; i < ce->num_traits; i++) {
+#if PHP_VERSION_ID >= 70400
+		vld_preload_depend(total, ce, zend_hash_find_ptr(EG(class_table), ce->trait_names[i].lc_name));
+#else
+		vld_preload_depend(total, ce, ce->traits[i]);
+#endif
+	}
+}
+
+/* Declarations that have not happened yet are kept under a key that starts
+ * with a NUL byte, and are left out */
+static void vld_preload_record(void)
+{
+	zend_string           *key;
+	zend_class_entry      *ce;
+	zend_function         *func;
+	vld_compileprof_total *total;
+
+	ZEND_HASH_FOREACH_STR_KEY_PTR(EG(class_table), key, ce) {
+		if (key && ZSTR_LEN(key) && ZSTR_VAL(key)[0] == '\0') {
+			continue;
+		}
+		vld_preload_record_class(ce);
+	} ZEND_HASH_FOREACH_END();
+
+	ZEND_HASH_FOREACH_STR_KEY_PTR(EG(function_table), key, func) {
+		if ((key && ZSTR_LEN(key) && ZSTR_VAL(key)[0] == '\0') || func->type != ZEND_USER_FUNCTION) {
+			continue;
+		}
+		if ((total = vld_preload_total(func->op_array.filename)) != NULL) {
+			vld_preload_add(&total->declared_functions, func->common.function_name);
+		}
+	} ZEND_HASH_FOREACH_END();
+}
+/* }}} */
+
+/* {{{ Writing */
+static int vld_preload_compare(const void *a, const void *b)
+{
+	const vld_preload_file *fa = a;
+	const vld_preload_file *fb = b;
+
+	if (fa->total->ns != fb->total->ns) {
+		return fa->total->ns < fb->total->ns ? 1 : -1;
+	}
+	return strcmp(ZSTR_VAL(fa->filename), ZSTR_VAL(fb->filename));
+}
+
+static void vld_preload_emit(FILE *script, vld_preload_file *file)
+{
+	vld_compileprof_total *total = file->total;
+	const char            *p;
+
+	fputs("opcache_compile_file('", script);
+	for (p = ZSTR_VAL(file->filename); *p; p++) {
+		if (*p == '\'' || *p == '\\') {
+			fputc('\\', script);
+		}
+		fputc(*p, script);
+	}
+	fprintf(script, "'); // %" ZEND_ULONG_FMT_SPEC " compiles, %.3f ms, %u classes, %u functions\n",
+		total->compiles, total->ns / 1000000.0,
+		total->declared_classes ? zend_hash_num_elements(total->declared_classes) : 0,
+		total->declared_functions ? zend_hash_num_elements(total->declared_functions) : 0);
+}
+
+/* A file is marked before its dependencies are visited, so that files that
+ * depend on each other are written once, in the order they were found.
+ * Dependencies count towards the files that are left to write as well */
+static void vld_preload_visit(FILE *script, vld_preload_file *files, HashTable *index, uint32_t i, uint32_t *left)
+{
+	zend_string *dependency;
+	zval        *found;
+
+	if (files[i].visited || !*left) {
+		return;
+	}
+	files[i].visited = 1;
+
+	if (files[i].total->depends) {
+		ZEND_HASH_FOREACH_STR_KEY(files[i].total->depends, dependency) {
+			if ((found = zend_hash_find(index, dependency)) != NULL) {
+				vld_preload_visit(script, files, index, (uint32_t) Z_LVAL_P(found), left);
+			}
+		} ZEND_HASH_FOREACH_END();
+	}
+	if (*left) {
+		vld_preload_emit(script, &files[i]);
+		(*left)--;
+	}
+}
+
+/* Written to a new file which then replaces the old one, so that a server
+ * that starts up meanwhile never preloads half a script. The new file has
+ * the process ID in its name, as all workers write the same script */
+static void vld_preload_write(void)
+{
+	vld_preload_file      *files;
+	vld_compileprof_total *total;
+	zend_string           *filename;
+	HashTable              index;
+	char                  *script_name, *tmp_name;
+	FILE                  *script;
+	uint32_t               count = 0, left, i;
+	zval                   nr;
+
+	files = malloc((zend_hash_num_elements(VLD_G(compileprof_totals)) + 1) * sizeof(vld_preload_file));
+	ZEND_HASH_FOREACH_STR_KEY_PTR(VLD_G(compileprof_totals), filename, total) {
+		if (!total->declared_classes && !total->declared_functions) {
+			continue;
+		}
+		if (!IS_ABSOLUTE_PATH(ZSTR_VAL(filename), ZSTR_LEN(filename))) {
+			continue;
+		}
+		files[count].filename = filename;
+		files[count].total = total;
+		files[count].visited = 0;
+		count++;
+	} ZEND_HASH_FOREACH_END();
+	if (!count) {
+		free(files);
+		return;
+	}
+	qsort(files, count, sizeof(vld_preload_file), vld_preload_compare);
+
+	zend_hash_init(&index, count, NULL, NULL, 0);
+	for (i = 0; i < count; i++) {
+		ZVAL_LONG(&nr, i);
+		zend_hash_add(&index, files[i].filename, &nr);
+	}
+
+	script_name = vld_output_filename(VLD_G(preload_script));
+	tmp_name = malloc(strlen(script_name) + MAX_LENGTH_OF_LONG + sizeof("..tmp"));
+	sprintf(tmp_name, "%s.%ld.tmp", script_name, (long) getpid());
+
+	if ((script = fopen(tmp_name, "w")) == NULL) {
+		php_error(E_WARNING, "vld: Can not open '%s' for the preload script", tmp_name);
+	} else {
+		fprintf(script, "<?php\n");
+		fprintf(script, "/* Written by vld after %" ZEND_ULONG_FMT_SPEC " requests: the files that declared classes or\n", VLD_G(compileprof_requests));
+		fprintf(script, " * functions, by compile time, after the files that they depend on */\n");
+		left = VLD_G(preload_files) > 0 && VLD_G(preload_files) < count ? (uint32_t) VLD_G(preload_files) : count;
+		for (i = 0; i < count && left; i++) {
+			vld_preload_visit(script, files, &index, i, &left);
+		}
+		fclose(script);
+#ifdef PHP_WIN32
+		remove(script_name);
+#endif
+		if (rename(tmp_name, script_name) != 0) {
+			php_error(E_WARNING, "vld: Can not replace the preload script '%s'", script_name);
+			remove(tmp_name);
+		}
+	}
+
+	free(tmp_name);
+	free(script_name);
+	zend_hash_destroy(&index);
+	free(files);
+}
+/* }}} */
+
+int vld_preload_enabled(void)
+{
+	return VLD_G(preload_script) && VLD_G(preload_script)[0];
+}
+
+/* Runs after the compile profiler stopped, while the classes and functions
+ * of the request are still around */
+void vld_preload_rshutdown(void)
+{
+	if (!vld_preload_enabled() || !VLD_G(compileprof_totals)) {
+		return;
+	}
+
+	vld_preload_record();
+	vld_preload_write();
+}
@@ -0,0 +1,31 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __PRELOAD_H__
+#define __PRELOAD_H__
+
+/* Preload script generator
+ *
+ * With vld.preload_script, the compile profiler keeps the totals of every
+ * compiled file for the life of the process, and at the end of every
+ * request, the classes and functions that are around are put down to the
+ * files that declared them, together with the files that hold the
+ * parents, interfaces and traits of those classes. A script for
+ * opcache.preload is then written, which compiles the files that declared
+ * anything, those with the most compile time in total first, but always
+ * after the files that they depend on, as OPcache only preloads a class
+ * once its parent and interfaces are there. */
+
+int vld_preload_enabled(void);
+void vld_preload_rshutdown(void);
+
+#endif
@@ -0,0 +1,1498 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "php.h"
+#include "php_vld.h"
+#include "srm_oparray.h"
+#include "branchinfo.h"
+#include "set.h"
+#include "runtime.h"
+#include "counters.h"
+#if PHP_VERSION_ID >= 80000
+# include "zend_observer.h"
+#endif
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+static user_opcode_handler_t vld_runtime_old_handlers[256];
+#if PHP_VERSION_ID < 80000
+static void (*vld_runtime_old_execute_ex)(zend_execute_data *execute_data);
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define VLD_RUNTIME_CLOCK_UNIT "cycles"
+static inline uint64_t vld_runtime_clock(void)
+{
+	uint32_t lo, hi;
+
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+#elif defined(_MSC_VER)
+# include <intrin.h>
+# define VLD_RUNTIME_CLOCK_UNIT "cycles"
+static inline uint64_t vld_runtime_clock(void)
+{
+	return __rdtsc();
+}
+#else
+# include <time.h>
+# define VLD_RUNTIME_CLOCK_UNIT "ns"
+static inline uint64_t vld_runtime_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+static int vld_runtime_timing(void)
+{
+	return VLD_G(time_function) && VLD_G(time_function)[0];
+}
+
+int vld_runtime_enabled(void)
+{
+	return VLD_G(count_executions) || VLD_G(branch_coverage) || VLD_G(path_profile) || VLD_G(call_sites) || VLD_G(type_profile) || vld_runtime_timing() || vld_counters_enabled();
+}
+
+/* Whether anything is recorded for every op array, rather than only for the
+ * one of vld.time_function */
+static int vld_runtime_all(void)
+{
+	return VLD_G(count_executions) || VLD_G(branch_coverage) || VLD_G(path_profile) || VLD_G(call_sites) || VLD_G(type_profile) || vld_counters_enabled();
+}
+
+/* Whether the state of every call is kept, from one op to the next */
+static int vld_runtime_frames(void)
+{
+	return VLD_G(branch_coverage) || VLD_G(path_profile) || VLD_G(type_profile) || vld_runtime_timing();
+}
+
+/* Whether the op arrays that ran are dumped, rather than only added to the
+ * shared counters */
+static int vld_runtime_reports(void)
+{
+	return VLD_G(count_executions) || VLD_G(branch_coverage) || VLD_G(path_profile) || VLD_G(call_sites) || VLD_G(type_profile) || vld_runtime_timing();
+}
+
+/* {{{ Profiles */
+static void vld_runtime_profile_dtor(zval *zv)
+{
+	vld_profile *profile = Z_PTR_P(zv);
+
+	free(profile->hits);
+	if (profile->branch_info) {
+		vld_branch_info_free(profile->branch_info);
+		free(profile->end_branch);
+		free(profile->edges);
+		free(profile->entries);
+	}
+	if (profile->numbering) {
+		vld_path_numbering_free(profile->numbering);
+	}
+	free(profile->cycles);
+	free(profile->cycle_counts);
+	free(profile->call_site);
+	free(profile->call_sites);
+	free(profile->types);
+	if (profile->paths) {
+		zend_hash_destroy(profile->paths);
+		FREE_HASHTABLE(profile->paths);
+	}
+	free(profile);
+}
+
+static void vld_runtime_profile_branches(vld_profile *profile, zend_op_array *opa)
+{
+	int          verbosity = VLD_G(verbosity);
+	vld_set     *set = vld_set_create(opa->last);
+	unsigned int i;
+
+	profile->branch_info = vld_branch_info_create(opa->last);
+
+	/* The analysis reports its progress through VLD_PRINT, which has no place
+	 * in the middle of a running script */
+	VLD_G(verbosity) = 0;
+	vld_analyse_oparray(opa, set, profile->branch_info);
+	vld_branch_post_process(opa, profile->branch_info);
+	VLD_G(verbosity) = verbosity;
+	vld_set_free(set);
+
+	profile->end_branch = malloc(opa->last * sizeof(int32_t));
+	for (i = 0; i < opa->last; i++) {
+		profile->end_branch[i] = -1;
+	}
+	for (i = 0; i < opa->last; i++) {
+		if (vld_set_in(profile->branch_info->starts, i)) {
+			profile->end_branch[profile->branch_info->branches[i].end_op] = i;
+		}
+	}
+
+	profile->edges = calloc((opa->last * VLD_BRANCH_MAX_OUTS + 7) / 8, 1);
+	profile->entries = calloc((opa->last + 7) / 8, 1);
+
+	if (VLD_G(path_profile)) {
+		profile->numbering = vld_branch_number_paths(profile->branch_info);
+		if (profile->numbering->num_paths) {
+			ALLOC_HASHTABLE(profile->paths);
+			zend_hash_init(profile->paths, 8, NULL, NULL, 0);
+		}
+	}
+}
+
+static int vld_runtime_is_method_call(zend_uchar opcode)
+{
+	return opcode == ZEND_INIT_METHOD_CALL || opcode == ZEND_INIT_STATIC_METHOD_CALL;
+}
+
+/* Only the method calls of an op array get a call site */
+static void vld_runtime_profile_call_sites(vld_profile *profile, zend_op_array *opa)
+{
+	uint32_t i, count = 0;
+
+	profile->call_site = malloc(opa->last * sizeof(int32_t));
+	for (i = 0; i < opa->last; i++) {
+		profile->call_site[i] = vld_runtime_is_method_call(opa->opcodes[i].opcode) ? (int32_t) count++ : -1;
+	}
+	profile->call_sites = calloc(count ? count : 1, sizeof(vld_call_site));
+}
+
+/* Checks whether an op array is the function or method named by
+ * vld.time_function */
+static int vld_runtime_matches(zend_op_array *opa)
+{
+	const char *name = VLD_G(time_function);
+	const char *sep = strstr(name, "::");
+
+	if (!opa->function_name) {
+		return 0;
+	}
+	if (sep) {
+		return opa->scope
+			&& ZSTR_LEN(opa->scope->name) == (size_t) (sep - name)
+			&& strncasecmp(ZSTR_VAL(opa->scope->name), name, sep - name) == 0
+			&& strcasecmp(ZSTR_VAL(opa->function_name), sep + 2) == 0;
+	}
+	return !opa->scope && strcasecmp(ZSTR_VAL(opa->function_name), name) == 0;
+}
+
+/* Ops mostly run in the op array of the op before them, so the last profile
+ * that was looked up is remembered */
+static vld_profile *vld_runtime_profile(zend_op_array *opa)
+{
+	zend_ulong   key = (zend_ulong) (zend_uintptr_t) opa->opcodes;
+	vld_profile *profile;
+
+	if (opa->opcodes == VLD_G(runtime_last_opcodes)) {
+		return VLD_G(runtime_last_profile);
+	}
+
+	profile = zend_hash_index_find_ptr(VLD_G(runtime_profiles), key);
+
+	/* The opcodes of a file's code are freed once it has run, so a new op
+	 * array can end up at the same address */
+	if (!profile || profile->last != opa->last) {
+		profile = calloc(1, sizeof(vld_profile));
+		profile->last = opa->last;
+		profile->hits = calloc(opa->last, sizeof(zend_ulong));
+		if (VLD_G(branch_coverage) || VLD_G(path_profile)) {
+			vld_runtime_profile_branches(profile, opa);
+		}
+		if (VLD_G(call_sites)) {
+			vld_runtime_profile_call_sites(profile, opa);
+		}
+		if (VLD_G(type_profile)) {
+			profile->types = calloc((size_t) opa->last * 3, sizeof(uint16_t));
+		}
+		if (vld_runtime_timing() && vld_runtime_matches(opa)) {
+			profile->cycles = calloc(opa->last, sizeof(uint64_t));
+			profile->cycle_counts = calloc((size_t) opa->last * VLD_RUNTIME_BUCKETS, sizeof(uint32_t));
+		}
+		zend_hash_index_update_ptr(VLD_G(runtime_profiles), key, profile);
+	}
+
+	VLD_G(runtime_last_opcodes) = opa->opcodes;
+	VLD_G(runtime_last_profile) = profile;
+
+	return profile;
+}
+
+vld_profile *vld_runtime_find(zend_op_array *opa)
+{
+	vld_profile *profile;
+
+	if (!VLD_G(runtime_profiles)) {
+		return NULL;
+	}
+
+	profile = zend_hash_index_find_ptr(VLD_G(runtime_profiles), (zend_ulong) (zend_uintptr_t) opa->opcodes);
+	if (!profile || profile->last != opa->last) {
+		return NULL;
+	}
+	return profile;
+}
+/* }}} */
+
+/* {{{ Branch coverage and path profiling
+ * The last op of a branch remembers the branch for its frame, so that the
+ * first op of the branch that runs next in the same frame knows which edge
+ * was taken to get there. Frames are told apart by their address. A frame
+ * is started afresh when a call begins, and forgotten when it ends, by
+ * returning or by throwing, so that jumping back to op 0 carries on with
+ * the same call. */
+typedef struct _vld_runtime_frame {
+	const zend_op *opcodes;
+	int32_t        pending;
+	zend_ulong     path;
+	int32_t        timed_op;
+	uint64_t       timed_start;
+	int32_t        typed_op;
+	int            fresh;
+} vld_runtime_frame;
+
+#define VLD_RUNTIME_NO_PATH ((zend_ulong) -1)
+
+static void vld_runtime_frame_dtor(zval *zv)
+{
+	efree(Z_PTR_P(zv));
+}
+
+/* Looked up at most once per op */
+static vld_runtime_frame *vld_runtime_frame_find(vld_runtime_frame **cached, zend_execute_data *execute_data, zend_op_array *opa, uint32_t nr)
+{
+	zend_ulong         key = (zend_ulong) (zend_uintptr_t) execute_data;
+	vld_runtime_frame *frame;
+
+	if (*cached) {
+		return *cached;
+	}
+
+	frame = zend_hash_index_find_ptr(VLD_G(runtime_frames), key);
+	if (!frame) {
+		frame = emalloc(sizeof(vld_runtime_frame));
+		frame->opcodes = NULL;
+		zend_hash_index_add_ptr(VLD_G(runtime_frames), key, frame);
+	}
+	if (frame->opcodes != opa->opcodes) {
+		frame->opcodes = opa->opcodes;
+		frame->pending = -1;
+		frame->path = VLD_RUNTIME_NO_PATH;
+		frame->timed_op = -1;
+		frame->typed_op = -1;
+		frame->fresh = 1;
+	}
+	*cached = frame;
+	return frame;
+}
+
+/* A generator leaves and is resumed at every yield, which does not end or
+ * begin a call. It begins in the frame of the call that created it, which
+ * ends at GENERATOR_CREATE, and carries on in a frame on the heap, which is
+ * first resumed at the op after that, and is done once it returned or
+ * threw. */
+static int vld_runtime_resuming(zend_execute_data *execute_data)
+{
+	const zend_op *opline = execute_data->opline;
+
+	if (!(execute_data->func->op_array.fn_flags & ZEND_ACC_GENERATOR) || !opline || opline == execute_data->func->op_array.opcodes) {
+		return 0;
+	}
+	switch ((opline - 1)->opcode) {
+		case ZEND_GENERATOR_CREATE:
+		case ZEND_RECV:
+		case ZEND_RECV_INIT:
+		case ZEND_RECV_VARIADIC:
+			return 0;
+	}
+	return 1;
+}
+
+static int vld_runtime_resumed(zend_execute_data *execute_data)
+{
+	return (execute_data->func->op_array.fn_flags & ZEND_ACC_GENERATOR) && execute_data->opline
+		&& execute_data->opline->opcode != ZEND_GENERATOR_CREATE
+		&& execute_data->opline->opcode != ZEND_GENERATOR_RETURN
+		&& !EG(exception);
+}
+
+/* A function without type declarations starts at the op after the RECV and
+ * RECV_INIT ops of the arguments that were passed, which never run, so they
+ * are counted when the call begins */
+static void vld_runtime_skipped_recvs(zend_execute_data *execute_data)
+{
+	zend_op_array *opa = &execute_data->func->op_array;
+	const zend_op *opline = execute_data->opline;
+	vld_profile   *profile;
+	uint32_t       nr;
+
+	if (!opline || opline == opa->opcodes || ((opline - 1)->opcode != ZEND_RECV && (opline - 1)->opcode != ZEND_RECV_INIT)) {
+		return;
+	}
+
+	profile = vld_runtime_profile(opa);
+	for (nr = 0; nr < (uint32_t) (opline - opa->opcodes); nr++) {
+		profile->hits[nr]++;
+	}
+}
+
+static void vld_runtime_call_begin(zend_execute_data *execute_data)
+{
+	if (vld_runtime_resuming(execute_data)) {
+		return;
+	}
+	if (VLD_G(runtime_frames)) {
+		zend_hash_index_del(VLD_G(runtime_frames), (zend_ulong) (zend_uintptr_t) execute_data);
+	}
+	if (vld_runtime_all()) {
+		vld_runtime_skipped_recvs(execute_data);
+	}
+}
+
+static void vld_runtime_call_end(zend_execute_data *execute_data)
+{
+	if (VLD_G(runtime_frames) && !vld_runtime_resumed(execute_data)) {
+		zend_hash_index_del(VLD_G(runtime_frames), (zend_ulong) (zend_uintptr_t) execute_data);
+	}
+}
+
+#if PHP_VERSION_ID >= 80000
+static int vld_runtime_is_timed(zend_op_array *opa);
+
+static void vld_runtime_observer_end(zend_execute_data *execute_data, zval *return_value)
+{
+	vld_runtime_call_end(execute_data);
+}
+
+/* With just vld.time_function, only the calls of the timed function are
+ * observed, and all other functions run without handlers */
+static zend_observer_fcall_handlers vld_runtime_observer_init(zend_execute_data *execute_data)
+{
+	zend_observer_fcall_handlers handlers = { NULL, NULL };
+
+	if (!execute_data->func || !ZEND_USER_CODE(execute_data->func->type)) {
+		return handlers;
+	}
+	if (!vld_runtime_all() && !vld_runtime_is_timed(&execute_data->func->op_array)) {
+		return handlers;
+	}
+	handlers.begin = vld_runtime_call_begin;
+	if (vld_runtime_frames()) {
+		handlers.end = vld_runtime_observer_end;
+	}
+	return handlers;
+}
+#else
+static void vld_runtime_execute_ex(zend_execute_data *execute_data)
+{
+	vld_runtime_call_begin(execute_data);
+	vld_runtime_old_execute_ex(execute_data);
+	vld_runtime_call_end(execute_data);
+}
+#endif
+
+static int vld_runtime_find_out(vld_profile *profile, int32_t from, int to)
+{
+	vld_branch  *branch = &profile->branch_info->branches[from];
+	unsigned int j;
+
+	for (j = 0; j < branch->outs_count; j++) {
+		if (branch->outs[j] == to) {
+			return j;
+		}
+	}
+	return -1;
+}
+
+static void vld_runtime_path_ran(vld_profile *profile, zend_ulong path)
+{
+	zval *count;
+
+	if (path == VLD_RUNTIME_NO_PATH) {
+		return;
+	}
+	if ((count = zend_hash_index_find(profile->paths, path)) != NULL) {
+		Z_LVAL_P(count)++;
+	} else {
+		zval one;
+
+		ZVAL_LONG(&one, 1);
+		zend_hash_index_add(profile->paths, path, &one);
+	}
+}
+
+/* A back edge ends the path, and starts a new one at its target */
+static void vld_runtime_path_edge(vld_profile *profile, vld_runtime_frame *frame, int32_t from, int out, int to)
+{
+	vld_path_numbering *numbering = profile->numbering;
+	uint32_t            k = numbering->first_out[from] + out;
+
+	if (numbering->out_back[k]) {
+		if (frame->path != VLD_RUNTIME_NO_PATH) {
+			vld_runtime_path_ran(profile, frame->path + numbering->out_val[k]);
+		}
+		frame->path = to >= 0 && numbering->entry_val[to] != VLD_PATH_NO_ENTRY ? numbering->entry_val[to] : VLD_RUNTIME_NO_PATH;
+	} else if (frame->path != VLD_RUNTIME_NO_PATH) {
+		frame->path += numbering->out_val[k];
+		if (to == VLD_JMP_EXIT) {
+			vld_runtime_path_ran(profile, frame->path);
+			frame->path = VLD_RUNTIME_NO_PATH;
+		}
+	}
+}
+
+static int vld_runtime_is_exit(zend_uchar opcode)
+{
+	switch (opcode) {
+		case ZEND_RETURN:
+		case ZEND_RETURN_BY_REF:
+		case ZEND_GENERATOR_RETURN:
+		case ZEND_EXIT:
+		case ZEND_THROW:
+		case ZEND_FAST_RET:
+#if PHP_VERSION_ID >= 80000
+		case ZEND_MATCH_ERROR:
+#endif
+			return 1;
+	}
+	return 0;
+}
+
+static void vld_runtime_take_edge(vld_profile *profile, vld_runtime_frame *frame, int32_t from, int to)
+{
+	int out = vld_runtime_find_out(profile, from, to);
+
+	if (out < 0) {
+		frame->path = VLD_RUNTIME_NO_PATH;
+		return;
+	}
+	VLD_BIT_SET(profile->edges, from * VLD_BRANCH_MAX_OUTS + out);
+	if (profile->paths) {
+		vld_runtime_path_edge(profile, frame, from, out, to);
+	}
+}
+
+static void vld_runtime_enter(vld_profile *profile, vld_runtime_frame *frame, uint32_t nr)
+{
+	if (vld_set_in(profile->branch_info->entry_points, nr)) {
+		VLD_BIT_SET(profile->entries, nr);
+	}
+	if (profile->paths && profile->numbering->entry_val[nr] != VLD_PATH_NO_ENTRY) {
+		frame->path = profile->numbering->entry_val[nr];
+	} else {
+		frame->path = VLD_RUNTIME_NO_PATH;
+	}
+}
+
+static void vld_runtime_cover(vld_runtime_frame **cached, zend_execute_data *execute_data, vld_profile *profile, zend_op_array *opa, uint32_t nr)
+{
+	vld_branch_info   *branch_info = profile->branch_info;
+	int32_t            end_branch = profile->end_branch[nr];
+	vld_runtime_frame *frame;
+
+	if (!vld_set_in(branch_info->starts, nr) && end_branch < 0) {
+		return;
+	}
+
+	frame = vld_runtime_frame_find(cached, execute_data, opa, nr);
+
+	/* A call that skipped its RECV ops entered the first branch past its
+	 * start, and when it started at the next branch, it took the edge to
+	 * there from the first one */
+	if (frame->fresh && nr > 0) {
+		vld_runtime_enter(profile, frame, 0);
+		if (vld_set_in(branch_info->starts, nr)) {
+			frame->pending = 0;
+		}
+	}
+	frame->fresh = 0;
+
+	if (vld_set_in(branch_info->starts, nr)) {
+		if (frame->pending >= 0) {
+			vld_runtime_take_edge(profile, frame, frame->pending, nr);
+		} else {
+			vld_runtime_enter(profile, frame, nr);
+		}
+		frame->pending = -1;
+	}
+
+	if (end_branch >= 0) {
+		if (vld_runtime_is_exit(opa->opcodes[nr].opcode)) {
+			vld_runtime_take_edge(profile, frame, end_branch, VLD_JMP_EXIT);
+		} else {
+			frame->pending = end_branch;
+		}
+	}
+}
+
+/* Returns whether an out of a branch was taken, or -1 when that is not
+ * known for the op array */
+int vld_runtime_edge_taken(zend_op_array *opa, unsigned int branch, unsigned int out)
+{
+	vld_profile *profile = vld_runtime_find(opa);
+
+	if (!profile || !profile->edges) {
+		return -1;
+	}
+	return VLD_BIT_TEST(profile->edges, branch * VLD_BRANCH_MAX_OUTS + out);
+}
+
+int vld_runtime_entry_taken(zend_op_array *opa, unsigned int branch)
+{
+	vld_profile *profile = vld_runtime_find(opa);
+
+	if (!profile || !profile->entries) {
+		return -1;
+	}
+	return VLD_BIT_TEST(profile->entries, branch);
+}
+/* }}} */
+
+/* {{{ Timing
+ * The time of an op runs from the handler call for it to the handler call
+ * for the next op in the same frame, so that calls include the time spent
+ * in the called function, and the last op that a frame runs is not timed.
+ * Times are kept in a histogram per op, with four buckets per power of two,
+ * from which the 99th percentile is read. */
+static int vld_runtime_is_timed(zend_op_array *opa)
+{
+	zend_ulong  key = (zend_ulong) (zend_uintptr_t) opa->opcodes;
+	zval       *found, tmp;
+	int         timed;
+
+	if (opa->opcodes == VLD_G(runtime_timed_opcodes)) {
+		return 1;
+	}
+	if (opa->opcodes == VLD_G(runtime_untimed_opcodes)) {
+		return 0;
+	}
+
+	/* Whether a function is timed is only worked out the first time it
+	 * runs. The code of files is never timed, and is not kept, as another
+	 * file can end up with its opcodes at the same address */
+	if (!opa->function_name) {
+		timed = 0;
+	} else if ((found = zend_hash_index_find(VLD_G(runtime_timed), key)) != NULL) {
+		timed = Z_TYPE_P(found) == IS_TRUE;
+	} else {
+		timed = vld_runtime_matches(opa);
+		ZVAL_BOOL(&tmp, timed);
+		zend_hash_index_add_new(VLD_G(runtime_timed), key, &tmp);
+	}
+
+	if (timed) {
+		VLD_G(runtime_timed_opcodes) = opa->opcodes;
+	} else {
+		VLD_G(runtime_untimed_opcodes) = opa->opcodes;
+	}
+	return timed;
+}
+
+static unsigned int vld_runtime_bucket(uint64_t value)
+{
+	unsigned int octave;
+
+	if (value < 4) {
+		return value;
+	}
+#if defined(__GNUC__)
+	octave = 63 - __builtin_clzll(value);
+#else
+	for (octave = 2; octave < 63 && (value >> (octave + 1)); octave++);
+#endif
+	return (octave - 1) * 4 + ((value >> (octave - 2)) & 3);
+}
+
+static uint64_t vld_runtime_bucket_value(unsigned int bucket)
+{
+	if (bucket < 4) {
+		return bucket;
+	}
+	return (uint64_t) (4 + bucket % 4) << (bucket / 4 - 1);
+}
+
+static void vld_runtime_time_op(vld_runtime_frame **cached, zend_execute_data *execute_data, zend_op_array *opa, uint32_t nr, uint64_t now)
+{
+	vld_profile       *profile = vld_runtime_profile(opa);
+	vld_runtime_frame *frame;
+
+	if (!profile->cycles) {
+		return;
+	}
+
+	frame = vld_runtime_frame_find(cached, execute_data, opa, nr);
+	if (frame->timed_op >= 0) {
+		uint64_t elapsed = now - frame->timed_start;
+
+		profile->cycles[frame->timed_op] += elapsed;
+		profile->cycle_counts[(size_t) frame->timed_op * VLD_RUNTIME_BUCKETS + vld_runtime_bucket(elapsed)]++;
+	}
+	frame->timed_op = nr;
+	frame->timed_start = vld_runtime_clock();
+}
+
+static void vld_runtime_op_times(vld_profile *profile, unsigned int nr, zend_ulong *count, zend_ulong *mean, zend_ulong *p99)
+{
+	uint32_t    *buckets = &profile->cycle_counts[(size_t) nr * VLD_RUNTIME_BUCKETS];
+	zend_ulong   seen = 0, rank;
+	unsigned int i;
+
+	*count = 0;
+	for (i = 0; i < VLD_RUNTIME_BUCKETS; i++) {
+		*count += buckets[i];
+	}
+	if (!*count) {
+		return;
+	}
+	*mean = profile->cycles[nr] / *count;
+
+	rank = *count - *count / 100;
+	for (i = 0; i < VLD_RUNTIME_BUCKETS; i++) {
+		seen += buckets[i];
+		if (seen >= rank) {
+			*p99 = vld_runtime_bucket_value(i);
+			break;
+		}
+	}
+}
+/* }}} */
+
+/* {{{ Call sites
+ * The class that a method is called on is looked up just before the
+ * INIT_METHOD_CALL or INIT_STATIC_METHOD_CALL op runs, the same way that
+ * the op itself is going to find it. */
+static zend_class_entry *vld_runtime_receiver(zend_execute_data *execute_data, zend_op_array *opa, const zend_op *opline)
+{
+	zval *zv;
+
+	if (opline->op1_type == IS_UNUSED) {
+		if (opline->opcode == ZEND_INIT_METHOD_CALL) {
+			return Z_TYPE(EX(This)) == IS_OBJECT ? Z_OBJCE(EX(This)) : NULL;
+		}
+		switch (opline->op1.num & ZEND_FETCH_CLASS_MASK) {
+			case ZEND_FETCH_CLASS_SELF:
+				return opa->scope;
+			case ZEND_FETCH_CLASS_PARENT:
+				return opa->scope ? opa->scope->parent : NULL;
+			case ZEND_FETCH_CLASS_STATIC:
+				return zend_get_called_scope(execute_data);
+		}
+		return NULL;
+	}
+
+	if (opline->op1_type == IS_CONST) {
+		if (opline->opcode != ZEND_INIT_STATIC_METHOD_CALL) {
+			return NULL;
+		}
+		/* The lower cased class name follows the class name */
+		zv = VLD_OP_CONSTANT(opa, opline - opa->opcodes, opline->op1) + 1;
+		return zend_hash_find_ptr(EG(class_table), Z_STR_P(zv));
+	}
+
+	zv = EX_VAR(opline->op1.var);
+	if (opline->opcode == ZEND_INIT_STATIC_METHOD_CALL && opline->op1_type == IS_VAR) {
+		return Z_CE_P(zv);
+	}
+	if (Z_TYPE_P(zv) == IS_INDIRECT) {
+		zv = Z_INDIRECT_P(zv);
+	}
+	ZVAL_DEREF(zv);
+	return Z_TYPE_P(zv) == IS_OBJECT ? Z_OBJCE_P(zv) : NULL;
+}
+
+static void vld_runtime_call_site(zend_execute_data *execute_data, vld_profile *profile, zend_op_array *opa, uint32_t nr)
+{
+	vld_call_site    *site = &profile->call_sites[profile->call_site[nr]];
+	zend_class_entry *ce = vld_runtime_receiver(execute_data, opa, &opa->opcodes[nr]);
+	unsigned int      i;
+
+	if (!ce) {
+		return;
+	}
+	for (i = 0; i < VLD_CALL_SITE_CLASSES && site->classes[i]; i++) {
+		if (site->classes[i] == ce) {
+			site->counts[i]++;
+			return;
+		}
+	}
+	if (i < VLD_CALL_SITE_CLASSES) {
+		site->classes[i] = ce;
+		site->counts[i] = 1;
+	} else {
+		site->other++;
+	}
+}
+
+#define VLD_CALL_SITE_UNUSED      0
+#define VLD_CALL_SITE_MONOMORPHIC 1
+#define VLD_CALL_SITE_POLYMORPHIC 2
+#define VLD_CALL_SITE_MEGAMORPHIC 3
+
+static const char *vld_call_site_kinds[] = { NULL, "monomorphic", "polymorphic", "megamorphic" };
+
+static int vld_runtime_call_site_kind(vld_call_site *site)
+{
+	if (site->other) {
+		return VLD_CALL_SITE_MEGAMORPHIC;
+	}
+	if (site->classes[1]) {
+		return VLD_CALL_SITE_POLYMORPHIC;
+	}
+	return site->classes[0] ? VLD_CALL_SITE_MONOMORPHIC : VLD_CALL_SITE_UNUSED;
+}
+/* }}} */
+
+/* {{{ Operand types
+ * The types of op1 and op2 are recorded just before an op runs, and the type
+ * of its result just before the next op of the same frame does, as only then
+ * has it been written. That is only done for ops that always write their
+ * result, and only when the next op is the one that follows, as ops that
+ * jump or throw may leave their result slot untouched. */
+static const char *vld_type_names[] = {
+	"undef", "null", "false", "true", "long", "double", "string", "array",
+	"object", "resource", "reference"
+};
+
+#define VLD_TYPE_NAMES (sizeof(vld_type_names) / sizeof(vld_type_names[0]))
+
+/* Some ops keep a class entry, string pointers, or an op number in a
+ * temporary, rather than a zval */
+static int vld_runtime_untyped(zend_uchar opcode, int operand)
+{
+	switch (opcode) {
+		case ZEND_FETCH_CLASS:
+		case ZEND_DECLARE_ANON_CLASS:
+#if PHP_VERSION_ID < 70400
+		case ZEND_DECLARE_ANON_INHERITED_CLASS:
+#endif
+		case ZEND_ROPE_INIT:
+		case ZEND_FAST_CALL:
+			return operand == VLD_TYPE_RESULT;
+		case ZEND_ROPE_ADD:
+			return operand != VLD_TYPE_OP2;
+		case ZEND_ROPE_END:
+		case ZEND_FAST_RET:
+		case ZEND_DISCARD_EXCEPTION:
+			return operand == VLD_TYPE_OP1;
+		case ZEND_NEW:
+		case ZEND_INIT_STATIC_METHOD_CALL:
+		case ZEND_FETCH_CLASS_CONSTANT:
+			return operand == VLD_TYPE_OP1;
+		case ZEND_INSTANCEOF:
+		case ZEND_FETCH_R:
+		case ZEND_FETCH_W:
+		case ZEND_FETCH_RW:
+		case ZEND_FETCH_IS:
+		case ZEND_FETCH_FUNC_ARG:
+		case ZEND_FETCH_UNSET:
+		case ZEND_UNSET_VAR:
+		case ZEND_ISSET_ISEMPTY_VAR:
+#if PHP_VERSION_ID >= 70400
+		case ZEND_FETCH_STATIC_PROP_R:
+		case ZEND_FETCH_STATIC_PROP_W:
+		case ZEND_FETCH_STATIC_PROP_RW:
+		case ZEND_FETCH_STATIC_PROP_IS:
+		case ZEND_FETCH_STATIC_PROP_FUNC_ARG:
+		case ZEND_FETCH_STATIC_PROP_UNSET:
+		case ZEND_ISSET_ISEMPTY_STATIC_PROP:
+		case ZEND_UNSET_STATIC_PROP:
+		case ZEND_ASSIGN_STATIC_PROP:
+		case ZEND_ASSIGN_STATIC_PROP_REF:
+		case ZEND_ASSIGN_STATIC_PROP_OP:
+		case ZEND_PRE_INC_STATIC_PROP:
+		case ZEND_PRE_DEC_STATIC_PROP:
+		case ZEND_POST_INC_STATIC_PROP:
+		case ZEND_POST_DEC_STATIC_PROP:
+#endif
+			return operand == VLD_TYPE_OP2;
+	}
+	return 0;
+}
+
+static int vld_runtime_writes_result(zend_uchar opcode)
+{
+	switch (opcode) {
+		case ZEND_ADD:
+		case ZEND_SUB:
+		case ZEND_MUL:
+		case ZEND_DIV:
+		case ZEND_MOD:
+		case ZEND_POW:
+		case ZEND_SL:
+		case ZEND_SR:
+		case ZEND_BW_OR:
+		case ZEND_BW_AND:
+		case ZEND_BW_XOR:
+		case ZEND_BW_NOT:
+		case ZEND_BOOL_NOT:
+		case ZEND_BOOL_XOR:
+		case ZEND_CONCAT:
+		case ZEND_FAST_CONCAT:
+		case ZEND_IS_EQUAL:
+		case ZEND_IS_NOT_EQUAL:
+		case ZEND_IS_IDENTICAL:
+		case ZEND_IS_NOT_IDENTICAL:
+		case ZEND_IS_SMALLER:
+		case ZEND_IS_SMALLER_OR_EQUAL:
+		case ZEND_SPACESHIP:
+		case ZEND_CAST:
+		case ZEND_BOOL:
+		case ZEND_QM_ASSIGN:
+		case ZEND_PRE_INC:
+		case ZEND_PRE_DEC:
+		case ZEND_POST_INC:
+		case ZEND_POST_DEC:
+		case ZEND_ASSIGN:
+		case ZEND_STRLEN:
+		case ZEND_TYPE_CHECK:
+		case ZEND_DEFINED:
+		case ZEND_INSTANCEOF:
+		case ZEND_FETCH_DIM_R:
+		case ZEND_FETCH_OBJ_R:
+		case ZEND_FETCH_CONSTANT:
+		case ZEND_ISSET_ISEMPTY_DIM_OBJ:
+		case ZEND_ISSET_ISEMPTY_PROP_OBJ:
+		case ZEND_DO_FCALL:
+		case ZEND_DO_ICALL:
+		case ZEND_DO_UCALL:
+		case ZEND_DO_FCALL_BY_NAME:
+#if PHP_VERSION_ID >= 70400
+		case ZEND_ASSIGN_OP:
+#else
+		case ZEND_ASSIGN_ADD:
+		case ZEND_ASSIGN_SUB:
+		case ZEND_ASSIGN_MUL:
+		case ZEND_ASSIGN_DIV:
+		case ZEND_ASSIGN_MOD:
+		case ZEND_ASSIGN_POW:
+		case ZEND_ASSIGN_SL:
+		case ZEND_ASSIGN_SR:
+		case ZEND_ASSIGN_BW_OR:
+		case ZEND_ASSIGN_BW_AND:
+		case ZEND_ASSIGN_BW_XOR:
+		case ZEND_ASSIGN_CONCAT:
+#endif
+			return 1;
+	}
+	return 0;
+}
+
+static void vld_runtime_record_type(zend_execute_data *execute_data, vld_profile *profile, zend_op_array *opa, uint32_t nr, int operand)
+{
+	const zend_op *opline = &opa->opcodes[nr];
+	zend_uchar     op_type;
+	zval          *zv;
+
+	switch (operand) {
+		case VLD_TYPE_OP1:
+			op_type = opline->op1_type;
+			break;
+		case VLD_TYPE_OP2:
+			op_type = opline->op2_type;
+			break;
+		default:
+			op_type = opline->result_type;
+	}
+
+	if (op_type == IS_UNUSED) {
+		return;
+	}
+	if ((op_type & (IS_TMP_VAR | IS_VAR)) && vld_runtime_untyped(opline->opcode, operand)) {
+		return;
+	}
+
+	switch (operand) {
+		case VLD_TYPE_OP1:
+			zv = op_type == IS_CONST ? VLD_OP_CONSTANT(opa, nr, opline->op1) : EX_VAR(opline->op1.var);
+			break;
+		case VLD_TYPE_OP2:
+			zv = op_type == IS_CONST ? VLD_OP_CONSTANT(opa, nr, opline->op2) : EX_VAR(opline->op2.var);
+			break;
+		default:
+			zv = EX_VAR(opline->result.var);
+	}
+	if (Z_TYPE_P(zv) == IS_INDIRECT) {
+		zv = Z_INDIRECT_P(zv);
+	}
+	ZVAL_DEREF(zv);
+
+	if (Z_TYPE_P(zv) < VLD_TYPE_NAMES) {
+		profile->types[nr * 3 + operand] |= 1 << Z_TYPE_P(zv);
+	}
+}
+
+static void vld_runtime_types(vld_runtime_frame **cached, zend_execute_data *execute_data, vld_profile *profile, zend_op_array *opa, uint32_t nr)
+{
+	vld_runtime_frame *frame = vld_runtime_frame_find(cached, execute_data, opa, nr);
+
+	if (frame->typed_op >= 0 && (uint32_t) frame->typed_op + 1 == nr) {
+		vld_runtime_record_type(execute_data, profile, opa, frame->typed_op, VLD_TYPE_RESULT);
+	}
+	vld_runtime_record_type(execute_data, profile, opa, nr, VLD_TYPE_OP1);
+	vld_runtime_record_type(execute_data, profile, opa, nr, VLD_TYPE_OP2);
+	if (opa->opcodes[nr].result_type != IS_UNUSED && vld_runtime_writes_result(opa->opcodes[nr].opcode)) {
+		frame->typed_op = (int32_t) nr;
+	} else {
+		frame->typed_op = -1;
+	}
+}
+
+static int vld_runtime_is_arithmetic(const zend_op *opline)
+{
+	switch (opline->opcode) {
+		case ZEND_ADD:
+		case ZEND_SUB:
+		case ZEND_MUL:
+		case ZEND_DIV:
+		case ZEND_MOD:
+		case ZEND_POW:
+		case ZEND_SL:
+		case ZEND_SR:
+		case ZEND_BW_OR:
+		case ZEND_BW_AND:
+		case ZEND_BW_XOR:
+		case ZEND_BW_NOT:
+		case ZEND_PRE_INC:
+		case ZEND_PRE_DEC:
+		case ZEND_POST_INC:
+		case ZEND_POST_DEC:
+			return 1;
+#if PHP_VERSION_ID >= 70400
+		case ZEND_ASSIGN_OP:
+			return opline->extended_value != ZEND_CONCAT;
+#else
+		case ZEND_ASSIGN_ADD:
+		case ZEND_ASSIGN_SUB:
+		case ZEND_ASSIGN_MUL:
+		case ZEND_ASSIGN_DIV:
+		case ZEND_ASSIGN_MOD:
+		case ZEND_ASSIGN_POW:
+		case ZEND_ASSIGN_SL:
+		case ZEND_ASSIGN_SR:
+		case ZEND_ASSIGN_BW_OR:
+		case ZEND_ASSIGN_BW_AND:
+		case ZEND_ASSIGN_BW_XOR:
+			/* Otherwise op2 is a dimension or a property name */
+			return opline->extended_value == 0;
+#endif
+	}
+	return 0;
+}
+
+static int vld_runtime_is_comparison(zend_uchar opcode)
+{
+	switch (opcode) {
+		case ZEND_IS_EQUAL:
+		case ZEND_IS_NOT_EQUAL:
+		case ZEND_IS_IDENTICAL:
+		case ZEND_IS_NOT_IDENTICAL:
+		case ZEND_IS_SMALLER:
+		case ZEND_IS_SMALLER_OR_EQUAL:
+		case ZEND_SPACESHIP:
+		case ZEND_CASE:
+#if PHP_VERSION_ID >= 80000
+		case ZEND_CASE_STRICT:
+#endif
+			return 1;
+	}
+	return 0;
+}
+
+/* false and true count as one type, as they are to the JIT */
+static int vld_runtime_type_stable(uint16_t mask)
+{
+	if (mask & (1 << IS_TRUE)) {
+		mask = (mask & ~(1 << IS_TRUE)) | (1 << IS_FALSE);
+	}
+	return (mask & (mask - 1)) == 0;
+}
+
+static int vld_runtime_op_type_stable(vld_profile *profile, unsigned int nr)
+{
+	return vld_runtime_type_stable(profile->types[nr * 3 + VLD_TYPE_OP1]) && vld_runtime_type_stable(profile->types[nr * 3 + VLD_TYPE_OP2]);
+}
+
+/* 0 for arithmetic ops that ran, 1 for comparisons that ran, and -1 for
+ * anything else */
+static int vld_runtime_typed_kind(vld_profile *profile, zend_op_array *opa, unsigned int nr)
+{
+	if (!profile->hits[nr]) {
+		return -1;
+	}
+	if (vld_runtime_is_arithmetic(&opa->opcodes[nr])) {
+		return 0;
+	}
+	return vld_runtime_is_comparison(opa->opcodes[nr].opcode) ? 1 : -1;
+}
+
+static void vld_runtime_dump_types(vld_profile *profile, unsigned int nr)
+{
+	static const char *operands[] = { "op1", "op2", "result" };
+	int                operand, first = 1;
+	unsigned int       type, count;
+
+	for (operand = VLD_TYPE_OP1; operand <= VLD_TYPE_RESULT; operand++) {
+		uint16_t mask = profile->types[nr * 3 + operand];
+
+		if (!mask) {
+			continue;
+		}
+		vld_printf(stderr, "%s%s: ", first ? "  ; " : ", ", operands[operand]);
+		first = 0;
+		for (type = 0, count = 0; type < VLD_TYPE_NAMES; type++) {
+			if (mask & (1 << type)) {
+				vld_printf(stderr, "%s%s", count++ ? "|" : "", vld_type_names[type]);
+			}
+		}
+	}
+}
+/* }}} */
+
+/* {{{ Reporting */
+static void vld_runtime_dump(zend_op_array *opa)
+{
+	HashTable *dumped_fingerprints = VLD_G(dumped_fingerprints);
+
+	/* Op arrays that were dumped when they were compiled need to be dumped
+	 * again, now with what happened at runtime */
+	VLD_G(dumped_fingerprints) = NULL;
+	VLD_G(runtime_reporting)   = 1;
+
+	vld_dump_oparray(opa);
+
+	VLD_G(runtime_reporting)   = 0;
+	VLD_G(dumped_fingerprints) = dumped_fingerprints;
+}
+
+/* On PHP 8.1 and later, closures are only found through the op array that
+ * declares them. Their dumps are part of its dump, and their counts are
+ * added here */
+static void vld_runtime_add_counters(zend_op_array *opa, vld_profile *profile)
+{
+#if PHP_VERSION_ID >= 80100
+	vld_profile *closure;
+	uint32_t     i;
+#endif
+
+	vld_counters_add(opa, profile->hits);
+#if PHP_VERSION_ID >= 80100
+	for (i = 0; i < opa->num_dynamic_func_defs; i++) {
+		if ((closure = vld_runtime_find(opa->dynamic_func_defs[i])) != NULL) {
+			vld_runtime_add_counters(opa->dynamic_func_defs[i], closure);
+		}
+	}
+#endif
+}
+
+/* The code of a file is dumped as soon as it is done running, as it is
+ * freed straight after that */
+static void vld_runtime_finish_file(zend_op_array *opa)
+{
+	zend_ulong   key = (zend_ulong) (zend_uintptr_t) opa->opcodes;
+	vld_profile *profile = vld_runtime_find(opa);
+
+	if (!profile) {
+		return;
+	}
+
+	vld_runtime_add_counters(opa, profile);
+	if (vld_runtime_reports()) {
+		vld_runtime_dump(opa);
+	}
+
+	zend_hash_index_del(VLD_G(runtime_profiles), key);
+	VLD_G(runtime_last_opcodes) = NULL;
+	VLD_G(runtime_last_profile) = NULL;
+	VLD_G(runtime_timed_opcodes) = NULL;
+	VLD_G(runtime_untimed_opcodes) = NULL;
+}
+
+static int vld_runtime_compare_ids(const void *a, const void *b)
+{
+	zend_ulong ia = *(const zend_ulong *) a;
+	zend_ulong ib = *(const zend_ulong *) b;
+
+	return ia < ib ? -1 : (ia > ib ? 1 : 0);
+}
+
+/* Lists the paths that ran, with the static path of the dump that they are,
+ * if any */
+void vld_runtime_dump_paths(zend_op_array *opa, vld_branch_info *branch_info)
+{
+	vld_profile  *profile = vld_runtime_find(opa);
+	zend_ulong   *ids, id;
+	unsigned int *elements, count, i, j, k, n = 0;
+	int           loops_to;
+
+	if (!profile || !profile->numbering) {
+		return;
+	}
+	if (!profile->paths) {
+		printf("path profile: too many paths\n");
+		return;
+	}
+
+	printf("path profile: %u of %u paths ran\n", zend_hash_num_elements(profile->paths), profile->numbering->num_paths);
+
+	ids = malloc((zend_hash_num_elements(profile->paths) + 1) * sizeof(zend_ulong));
+	ZEND_HASH_FOREACH_NUM_KEY(profile->paths, id) {
+		ids[n++] = id;
+	} ZEND_HASH_FOREACH_END();
+	qsort(ids, n, sizeof(zend_ulong), vld_runtime_compare_ids);
+
+	elements = malloc(profile->branch_info->size * sizeof(unsigned int));
+	for (i = 0; i < n; i++) {
+		count = vld_path_numbering_decode(profile->branch_info, profile->numbering, ids[i], elements, &loops_to);
+
+		printf("path id %u: ", (unsigned int) ids[i]);
+		for (j = 0; j < count; j++) {
+			printf("%d, ", elements[j]);
+		}
+		printf("ran " ZEND_LONG_FMT " times", Z_LVAL_P(zend_hash_index_find(profile->paths, ids[i])));
+		if (loops_to >= 0) {
+			printf("; loops back to %d", loops_to);
+		}
+		for (k = 0; k < branch_info->paths_count; k++) {
+			if (branch_info->paths[k]->elements_count == count && memcmp(branch_info->paths[k]->elements, elements, count * sizeof(unsigned int)) == 0) {
+				printf("; path #%d", k + 1);
+				break;
+			}
+		}
+		printf("\n");
+	}
+
+	free(elements);
+	free(ids);
+}
+
+void vld_runtime_dump_header(int separator)
+{
+	if (VLD_G(count_executions)) {
+		if (separator) {
+			vld_printf(stderr, "-----------");
+		} else if (VLD_G(format)) {
+			vld_printf(stderr, "hits%s", VLD_G(col_sep));
+		} else {
+			vld_printf(stderr, "      hits ");
+		}
+	}
+	if (vld_runtime_timing()) {
+		if (separator) {
+			vld_printf(stderr, "----------------------");
+		} else if (VLD_G(format)) {
+			vld_printf(stderr, "mean%sp99%s", VLD_G(col_sep), VLD_G(col_sep));
+		} else {
+			vld_printf(stderr, "      mean        p99 ");
+		}
+	}
+}
+
+/* Classifies the call site of a method call at the end of its line */
+static void vld_runtime_dump_call_site(vld_profile *profile, unsigned int nr)
+{
+	vld_call_site *site;
+	int            kind;
+	unsigned int   i;
+
+	if (!profile->call_site || profile->call_site[nr] < 0) {
+		return;
+	}
+	site = &profile->call_sites[profile->call_site[nr]];
+	if ((kind = vld_runtime_call_site_kind(site)) == VLD_CALL_SITE_UNUSED) {
+		return;
+	}
+
+	vld_printf(stderr, "  ; %s", vld_call_site_kinds[kind]);
+	for (i = 0; i < VLD_CALL_SITE_CLASSES && site->classes[i]; i++) {
+		vld_printf(stderr, "%s %s %" ZEND_ULONG_FMT_SPEC, i ? "," : "", ZSTR_VAL(site->classes[i]->name), site->counts[i]);
+	}
+	if (site->other) {
+		vld_printf(stderr, ", others %" ZEND_ULONG_FMT_SPEC, site->other);
+	}
+}
+
+void vld_runtime_dump_op_note(zend_op_array *opa, unsigned int nr)
+{
+	vld_profile *profile = vld_runtime_find(opa);
+
+	if (!profile) {
+		return;
+	}
+	vld_runtime_dump_call_site(profile, nr);
+	if (profile->types) {
+		vld_runtime_dump_types(profile, nr);
+	}
+}
+
+static void vld_runtime_dump_call_sites(zend_op_array *opa, vld_profile *profile)
+{
+	unsigned int i, kinds[4] = { 0, 0, 0, 0 };
+
+	for (i = 0; i < opa->last; i++) {
+		if (profile->call_site[i] >= 0) {
+			kinds[vld_runtime_call_site_kind(&profile->call_sites[profile->call_site[i]])]++;
+		}
+	}
+	if (kinds[VLD_CALL_SITE_MONOMORPHIC] || kinds[VLD_CALL_SITE_POLYMORPHIC] || kinds[VLD_CALL_SITE_MEGAMORPHIC]) {
+		vld_printf(stderr, "call sites: %u monomorphic, %u polymorphic, %u megamorphic\n\n",
+			kinds[VLD_CALL_SITE_MONOMORPHIC], kinds[VLD_CALL_SITE_POLYMORPHIC], kinds[VLD_CALL_SITE_MEGAMORPHIC]);
+	}
+}
+
+/* Lists the arithmetic and comparison ops that ran with more than one type
+ * for an operand, as the JIT can not specialise those */
+static void vld_runtime_dump_type_stability(zend_op_array *opa, vld_profile *profile)
+{
+	unsigned int i, counts[2] = { 0, 0 }, unstable[2] = { 0, 0 }, shown = 0;
+	int          kind;
+
+	for (i = 0; i < opa->last; i++) {
+		if ((kind = vld_runtime_typed_kind(profile, opa, i)) < 0) {
+			continue;
+		}
+		counts[kind]++;
+		if (!vld_runtime_op_type_stable(profile, i)) {
+			unstable[kind]++;
+		}
+	}
+	if (!counts[0] && !counts[1]) {
+		return;
+	}
+
+	vld_printf(stderr, "type unstable: %u of %u arithmetic ops, %u of %u comparisons", unstable[0], counts[0], unstable[1], counts[1]);
+	for (i = 0; i < opa->last; i++) {
+		if (vld_runtime_typed_kind(profile, opa, i) >= 0 && !vld_runtime_op_type_stable(profile, i)) {
+			vld_printf(stderr, "%s%u", shown++ ? ", " : "; ops ", i);
+		}
+	}
+	vld_printf(stderr, "\n\n");
+}
+
+void vld_runtime_dump_summary(zend_op_array *opa)
+{
+	vld_profile *profile = vld_runtime_find(opa);
+
+	if (!profile) {
+		return;
+	}
+	if (profile->call_site) {
+		vld_runtime_dump_call_sites(opa, profile);
+	}
+	if (profile->types) {
+		vld_runtime_dump_type_stability(opa, profile);
+	}
+}
+
+/* With vld.format, every column is followed by vld.col_sep, as the columns
+ * of the op itself are */
+void vld_runtime_dump_op(zend_op_array *opa, unsigned int nr)
+{
+	vld_profile *profile = vld_runtime_find(opa);
+	zend_ulong   count = 0, mean = 0, p99 = 0;
+	const char  *sep = VLD_G(format) ? VLD_G(col_sep) : "";
+
+	if (VLD_G(count_executions)) {
+		if (profile) {
+			vld_printf(stderr, "%10" ZEND_ULONG_FMT_SPEC " %s", profile->hits[nr], sep);
+		} else {
+			vld_printf(stderr, "%10s %s", "-", sep);
+		}
+	}
+	if (vld_runtime_timing()) {
+		if (profile && profile->cycles) {
+			vld_runtime_op_times(profile, nr, &count, &mean, &p99);
+		}
+		if (count) {
+			vld_printf(stderr, "%10" ZEND_ULONG_FMT_SPEC " %s", mean, sep);
+			vld_printf(stderr, "%10" ZEND_ULONG_FMT_SPEC " %s", p99, sep);
+		} else {
+			vld_printf(stderr, "%10s %s", "-", sep);
+			vld_printf(stderr, "%10s %s", "-", sep);
+		}
+	}
+}
+/* }}} */
+
+static int vld_runtime_opcode_handler(zend_execute_data *execute_data)
+{
+	const zend_op         *opline = execute_data->opline;
+	zend_op_array         *opa = &execute_data->func->op_array;
+	user_opcode_handler_t  old_handler = vld_runtime_old_handlers[opline->opcode];
+	vld_profile           *profile;
+
+	if (VLD_G(runtime_profiles)) {
+		uint32_t           nr = opline - opa->opcodes;
+		vld_runtime_frame *frame = NULL;
+
+		if (vld_runtime_all()) {
+			profile = vld_runtime_profile(opa);
+			profile->hits[nr]++;
+			if (profile->branch_info) {
+				vld_runtime_cover(&frame, execute_data, profile, opa, nr);
+			}
+			if (profile->call_site && profile->call_site[nr] >= 0) {
+				vld_runtime_call_site(execute_data, profile, opa, nr);
+			}
+			if (profile->types) {
+				vld_runtime_types(&frame, execute_data, profile, opa, nr);
+			}
+		}
+		if (vld_runtime_timing() && vld_runtime_is_timed(opa)) {
+			vld_runtime_time_op(&frame, execute_data, opa, nr, vld_runtime_clock());
+		}
+
+		if (opline->opcode == ZEND_RETURN && !opa->function_name) {
+			vld_runtime_finish_file(opa);
+		} else if (opline->opcode == ZEND_EXIT) {
+			zend_execute_data *ex;
+
+			for (ex = execute_data; ex; ex = ex->prev_execute_data) {
+				if (ex->func && ZEND_USER_CODE(ex->func->type) && !ex->func->op_array.function_name) {
+					vld_runtime_finish_file(&ex->func->op_array);
+				}
+			}
+		}
+	}
+
+	return old_handler ? old_handler(execute_data) : ZEND_USER_OPCODE_DISPATCH;
+}
+
+void vld_runtime_minit(void)
+{
+	int i;
+
+	if (!vld_runtime_enabled()) {
+		return;
+	}
+
+	for (i = 0; i < 256; i++) {
+		if (i == ZEND_HANDLE_EXCEPTION) {
+			continue;
+		}
+		vld_runtime_old_handlers[i] = zend_get_user_opcode_handler(i);
+		zend_set_user_opcode_handler(i, vld_runtime_opcode_handler);
+	}
+#if PHP_VERSION_ID >= 80000
+	zend_observer_fcall_register(vld_runtime_observer_init);
+#endif
+}
+
+void vld_runtime_rinit(void)
+{
+	if (!vld_runtime_enabled()) {
+		return;
+	}
+
+	ALLOC_HASHTABLE(VLD_G(runtime_profiles));
+	zend_hash_init(VLD_G(runtime_profiles), 64, NULL, vld_runtime_profile_dtor, 0);
+	VLD_G(runtime_timed_opcodes) = NULL;
+	VLD_G(runtime_untimed_opcodes) = NULL;
+	if (vld_runtime_timing()) {
+		ALLOC_HASHTABLE(VLD_G(runtime_timed));
+		zend_hash_init(VLD_G(runtime_timed), 16, NULL, NULL, 0);
+	}
+	if (vld_runtime_frames()) {
+		ALLOC_HASHTABLE(VLD_G(runtime_frames));
+		zend_hash_init(VLD_G(runtime_frames), 32, NULL, vld_runtime_frame_dtor, 0);
+	}
+#if PHP_VERSION_ID < 80000
+	/* Put back by RSHUTDOWN, together with vld's other hooks */
+	vld_runtime_old_execute_ex = zend_execute_ex;
+	zend_execute_ex = vld_runtime_execute_ex;
+#endif
+	VLD_G(runtime_last_opcodes) = NULL;
+	VLD_G(runtime_last_profile) = NULL;
+}
+
+static void vld_runtime_finish_function(zend_function *func, vld_profile *profile)
+{
+	vld_runtime_add_counters(&func->op_array, profile);
+	if (vld_runtime_reports()) {
+		vld_printf(stderr, "Function %s:\n", ZSTR_VAL(func->common.function_name));
+		vld_runtime_dump(&func->op_array);
+		vld_printf(stderr, "End of function %s\n\n", ZSTR_VAL(func->common.function_name));
+	}
+}
+
+/* Dumps every function and method that ran, while they are all still
+ * around */
+void vld_runtime_rshutdown(void)
+{
+	zend_function    *func;
+	zend_class_entry *ce;
+	vld_profile      *profile;
+
+	if (!VLD_G(runtime_profiles)) {
+		return;
+	}
+
+	ZEND_HASH_FOREACH_PTR(EG(function_table), func) {
+		if (func->type == ZEND_USER_FUNCTION && (profile = vld_runtime_find(&func->op_array)) != NULL) {
+			vld_runtime_finish_function(func, profile);
+		}
+	} ZEND_HASH_FOREACH_END();
+
+	ZEND_HASH_FOREACH_PTR(EG(class_table), ce) {
+		int have_fe = 0;
+
+		if (ce->type != ZEND_USER_CLASS) {
+			continue;
+		}
+		ZEND_HASH_FOREACH_PTR(&ce->function_table, func) {
+			if (func->type != ZEND_USER_FUNCTION || func->common.scope != ce || (profile = vld_runtime_find(&func->op_array)) == NULL) {
+				continue;
+			}
+			if (!have_fe && vld_runtime_reports()) {
+				vld_printf(stderr, "Class %s:\n", ZSTR_VAL(ce->name));
+				have_fe = 1;
+			}
+			vld_runtime_finish_function(func, profile);
+		} ZEND_HASH_FOREACH_END();
+		if (have_fe) {
+			vld_printf(stderr, "End of class %s.\n\n", ZSTR_VAL(ce->name));
+		}
+	} ZEND_HASH_FOREACH_END();
+
+	zend_hash_destroy(VLD_G(runtime_profiles));
+	FREE_HASHTABLE(VLD_G(runtime_profiles));
+	VLD_G(runtime_profiles) = NULL;
+	if (VLD_G(runtime_frames)) {
+		zend_hash_destroy(VLD_G(runtime_frames));
+		FREE_HASHTABLE(VLD_G(runtime_frames));
+		VLD_G(runtime_frames) = NULL;
+	}
+	if (VLD_G(runtime_timed)) {
+		zend_hash_destroy(VLD_G(runtime_timed));
+		FREE_HASHTABLE(VLD_G(runtime_timed));
+		VLD_G(runtime_timed) = NULL;
+	}
+	VLD_G(runtime_last_opcodes) = NULL;
+	VLD_G(runtime_last_profile) = NULL;
+}
+
+void vld_runtime_mshutdown(void)
+{
+	int i;
+
+	if (!vld_runtime_enabled()) {
+		return;
+	}
+
+	for (i = 0; i < 256; i++) {
+		if (i != ZEND_HANDLE_EXCEPTION) {
+			zend_set_user_opcode_handler(i, vld_runtime_old_handlers[i]);
+		}
+	}
+}
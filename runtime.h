@@ -0,0 +1,94 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __RUNTIME_H__
+#define __RUNTIME_H__
+
+#include "php.h"
+#include "branchinfo.h"
+
+/* Runtime profiling
+ *
+ * When one of the runtime modes is enabled, a user opcode handler is
+ * installed for every opcode at MINIT, which records what each executed op
+ * does in a profile that belongs to its op array. At the end of the request,
+ * every op array that ran is dumped once more with the recorded data as
+ * extra columns.
+ *
+ * Profiles are found through the op array's opcodes pointer, just like the
+ * op arrays that were already dumped, rather than through a reserved slot
+ * in the op array, as with OPcache op arrays live in shared memory which
+ * must not be written to. */
+
+#define VLD_BIT_SET(map, bit)  ((map)[(bit) / 8] |= (1 << ((bit) % 8)))
+#define VLD_BIT_TEST(map, bit) (((map)[(bit) / 8] >> ((bit) % 8)) & 1)
+
+/* With vld.branch_coverage, the branches of an op array are worked out when
+ * it first runs, and every out of every branch gets a bit in the edges
+ * bitmap, at branch * VLD_BRANCH_MAX_OUTS + out. With vld.path_profile, the
+ * paths through them are numbered as well, and paths counts how often each
+ * path number ran. The op array of vld.time_function gets the total time
+ * of each op in cycles, and a histogram of VLD_RUNTIME_BUCKETS buckets of
+ * its times per op in cycle_counts. */
+#define VLD_RUNTIME_BUCKETS 256
+
+/* With vld.call_sites, every INIT_METHOD_CALL and INIT_STATIC_METHOD_CALL
+ * op has an index into call_sites in call_site, and -1 for other ops. A
+ * call site keeps the first VLD_CALL_SITE_CLASSES classes that methods
+ * were called on, and counts the calls on any other class together. */
+#define VLD_CALL_SITE_CLASSES 4
+
+/* With vld.type_profile, types has three masks per op, for op1, op2 and the
+ * result, at nr * 3 + VLD_TYPE_OP1 and so on, with bit 1 << type set for
+ * every zval type that was seen. */
+#define VLD_TYPE_OP1    0
+#define VLD_TYPE_OP2    1
+#define VLD_TYPE_RESULT 2
+
+typedef struct _vld_call_site {
+	zend_class_entry *classes[VLD_CALL_SITE_CLASSES];
+	zend_ulong        counts[VLD_CALL_SITE_CLASSES];
+	zend_ulong        other;
+} vld_call_site;
+
+typedef struct _vld_profile {
+	uint32_t            last;
+	zend_ulong         *hits;
+	vld_branch_info    *branch_info;
+	int32_t            *end_branch;
+	unsigned char      *edges;
+	unsigned char      *entries;
+	vld_path_numbering *numbering;
+	HashTable          *paths;
+	uint64_t           *cycles;
+	uint32_t           *cycle_counts;
+	int32_t            *call_site;
+	vld_call_site      *call_sites;
+	uint16_t           *types;
+} vld_profile;
+
+void vld_runtime_minit(void);
+void vld_runtime_mshutdown(void);
+int vld_runtime_enabled(void);
+void vld_runtime_rinit(void);
+void vld_runtime_rshutdown(void);
+
+vld_profile *vld_runtime_find(zend_op_array *opa);
+void vld_runtime_dump_header(int separator);
+void vld_runtime_dump_op(zend_op_array *opa, unsigned int nr);
+void vld_runtime_dump_op_note(zend_op_array *opa, unsigned int nr);
+void vld_runtime_dump_summary(zend_op_array *opa);
+int vld_runtime_edge_taken(zend_op_array *opa, unsigned int branch, unsigned int out);
+int vld_runtime_entry_taken(zend_op_array *opa, unsigned int branch);
+void vld_runtime_dump_paths(zend_op_array *opa, vld_branch_info *branch_info);
+
+#endif
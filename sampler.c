@@ -0,0 +1,430 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "php.h"
+#include "php_vld.h"
+#include "zend_smart_str.h"
+#include "srm_oparray.h"
+#include "output.h"
+#include "sampler.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+#ifdef VLD_SAMPLER_AVAILABLE
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+/* Orders the accesses of the signal handler against those of the code it
+ * interrupted */
+#define VLD_SIGNAL_FENCE() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+
+typedef struct _vld_sample_frame {
+	const zend_function *func;
+	const zend_op       *opline;
+} vld_sample_frame;
+
+typedef struct _vld_sample_function {
+	zend_string *name;
+	zend_string *filename;
+	uint32_t     line_start;
+	zend_ulong   self;
+	zend_ulong   total;
+	uint32_t     last;
+	uint32_t    *lines;
+	zend_uchar  *opcodes;
+	zend_ulong  *hits;
+} vld_sample_function;
+
+struct _vld_sampler_state {
+	volatile uint32_t  raised;  /* only written by the signal handler */
+	uint32_t           taken;   /* only written outside of it */
+	zend_ulong         samples;
+	timer_t            timer;
+	int                have_timer;
+	HashTable          functions;
+	HashTable          stacks;
+};
+
+static void (*vld_sampler_old_interrupt)(zend_execute_data *execute_data);
+
+/* {{{ Taking samples */
+/* The stack can change under the signal handler, and the functions on it
+ * may be gone by the time anything looks at a copy of it, so the handler
+ * only asks the VM to stop at its next interrupt check */
+static void vld_sampler_signal(int signo, siginfo_t *info, void *context)
+{
+	struct _vld_sampler_state *state = VLD_G(sampler);
+
+	if (!state) {
+		return;
+	}
+
+	state->raised++;
+	VLD_SIGNAL_FENCE();
+#if PHP_VERSION_ID >= 80200
+	zend_atomic_bool_store_ex(&EG(vm_interrupt), true);
+#else
+	EG(vm_interrupt) = 1;
+#endif
+}
+/* }}} */
+
+/* {{{ Adding up samples */
+static void vld_sample_function_dtor(zval *zv)
+{
+	vld_sample_function *f = Z_PTR_P(zv);
+
+	zend_string_release(f->name);
+	if (f->filename) {
+		zend_string_release(f->filename);
+	}
+	free(f->lines);
+	free(f->opcodes);
+	free(f->hits);
+	free(f);
+}
+
+static vld_sample_function *vld_sampler_function(struct _vld_sampler_state *state, const zend_function *func)
+{
+	zend_string         *name = vld_function_name(func);
+	zend_string         *key;
+	vld_sample_function *f;
+	uint32_t             i;
+
+	if (ZEND_USER_CODE(func->type)) {
+		key = strpprintf(0, "%s %s:%d", ZSTR_VAL(name), ZSTR_VAL(func->op_array.filename), func->op_array.line_start);
+	} else {
+		key = zend_string_copy(name);
+	}
+
+	if ((f = zend_hash_find_ptr(&state->functions, key)) != NULL) {
+		zend_string_release(key);
+		zend_string_release(name);
+		return f;
+	}
+
+	f = calloc(1, sizeof(vld_sample_function));
+	f->name = name;
+	if (ZEND_USER_CODE(func->type)) {
+		f->filename = zend_string_copy(func->op_array.filename);
+		f->line_start = func->op_array.line_start;
+		f->last = func->op_array.last;
+		f->lines = calloc(f->last, sizeof(uint32_t));
+		f->opcodes = calloc(f->last, sizeof(zend_uchar));
+		f->hits = calloc(f->last, sizeof(zend_ulong));
+		for (i = 0; i < f->last; i++) {
+			f->lines[i] = func->op_array.opcodes[i].lineno;
+			f->opcodes[i] = func->op_array.opcodes[i].opcode;
+		}
+	}
+	zend_hash_add_ptr(&state->functions, key, f);
+	zend_string_release(key);
+
+	return f;
+}
+
+static void vld_sampler_add(struct _vld_sampler_state *state, vld_sample_frame *frames, uint32_t depth, uint32_t weight)
+{
+	vld_sample_function *seen[VLD_SAMPLE_DEPTH];
+	smart_str            folded = {0};
+	zval                *count;
+	uint32_t             i, j;
+
+	state->samples += weight;
+
+	for (i = 0; i < depth; i++) {
+		const zend_function *func = frames[i].func;
+		vld_sample_function *f = vld_sampler_function(state, func);
+
+		if (i == 0) {
+			f->self += weight;
+			if (f->hits && frames[i].opline) {
+				ptrdiff_t nr = frames[i].opline - func->op_array.opcodes;
+
+				if (nr >= 0 && nr < f->last) {
+					f->hits[nr] += weight;
+				}
+			}
+		}
+
+		/* Recursive functions only count once towards the total */
+		for (j = 0; j < i && seen[j] != f; j++);
+		if (j == i) {
+			f->total += weight;
+		}
+		seen[i] = f;
+	}
+
+	/* Folded stacks go from the outermost frame inwards */
+	for (i = depth; i > 0; i--) {
+		smart_str_append(&folded, seen[i - 1]->name);
+		if (i > 1) {
+			smart_str_appendc(&folded, ';');
+		}
+	}
+	if (!folded.s) {
+		return;
+	}
+	smart_str_0(&folded);
+
+	if ((count = zend_hash_find(&state->stacks, folded.s)) != NULL) {
+		Z_LVAL_P(count) += weight;
+	} else {
+		zval first;
+
+		ZVAL_LONG(&first, weight);
+		zend_hash_add(&state->stacks, folded.s, &first);
+	}
+	smart_str_free(&folded);
+}
+
+/* Signals that arrived since the last interrupt all go to the stack as it
+ * is now, while every function on it is still around */
+static void vld_sampler_take(struct _vld_sampler_state *state)
+{
+	vld_sample_frame   frames[VLD_SAMPLE_DEPTH];
+	zend_execute_data *ex;
+	uint32_t           raised, depth = 0;
+
+	raised = state->raised;
+	VLD_SIGNAL_FENCE();
+	if (raised == state->taken) {
+		return;
+	}
+
+	for (ex = EG(current_execute_data); ex && depth < VLD_SAMPLE_DEPTH; ex = ex->prev_execute_data) {
+		if (!ex->func) {
+			continue;
+		}
+		frames[depth].func = ex->func;
+		frames[depth].opline = ZEND_USER_CODE(ex->func->type) ? ex->opline : NULL;
+		depth++;
+	}
+
+	vld_sampler_add(state, frames, depth, raised - state->taken);
+	state->taken = raised;
+}
+
+static void vld_sampler_interrupt(zend_execute_data *execute_data)
+{
+	if (VLD_G(sampler)) {
+		vld_sampler_take(VLD_G(sampler));
+	}
+	if (vld_sampler_old_interrupt) {
+		vld_sampler_old_interrupt(execute_data);
+	}
+}
+/* }}} */
+
+/* {{{ Reporting */
+static int vld_sampler_compare(const void *a, const void *b)
+{
+	const vld_sample_function *fa = *(const vld_sample_function **) a;
+	const vld_sample_function *fb = *(const vld_sample_function **) b;
+
+	if (fa->self != fb->self) {
+		return fa->self < fb->self ? 1 : -1;
+	}
+	if (fa->total != fb->total) {
+		return fa->total < fb->total ? 1 : -1;
+	}
+	return 0;
+}
+
+static void vld_sampler_report(struct _vld_sampler_state *state)
+{
+	vld_sample_function **list, *f;
+	uint32_t              count = 0, i, j;
+
+	vld_printf(stderr, "Samples: %" ZEND_ULONG_FMT_SPEC " at %" ZEND_LONG_FMT_SPEC " Hz\n\n", state->samples, VLD_G(sample_frequency));
+	if (!state->samples) {
+		return;
+	}
+
+	list = malloc(zend_hash_num_elements(&state->functions) * sizeof(vld_sample_function *));
+	ZEND_HASH_FOREACH_PTR(&state->functions, f) {
+		list[count++] = f;
+	} ZEND_HASH_FOREACH_END();
+	qsort(list, count, sizeof(vld_sample_function *), vld_sampler_compare);
+
+	vld_printf(stderr, "      self      total  function\n");
+	vld_printf(stderr, "-------------------------------------------------------------------------------------\n");
+	for (i = 0; i < count; i++) {
+		f = list[i];
+		if (f->filename) {
+			vld_printf(stderr, "%10" ZEND_ULONG_FMT_SPEC " %10" ZEND_ULONG_FMT_SPEC "  %s %s:%d\n", f->self, f->total, ZSTR_VAL(f->name), ZSTR_VAL(f->filename), f->line_start);
+		} else {
+			vld_printf(stderr, "%10" ZEND_ULONG_FMT_SPEC " %10" ZEND_ULONG_FMT_SPEC "  %s\n", f->self, f->total, ZSTR_VAL(f->name));
+		}
+	}
+	vld_printf(stderr, "\n");
+
+	for (i = 0; i < count; i++) {
+		f = list[i];
+		if (!f->self || !f->hits) {
+			continue;
+		}
+		vld_printf(stderr, "Samples of %s:\n", ZSTR_VAL(f->name));
+		vld_printf(stderr, "line      # op                               samples\n");
+		vld_printf(stderr, "-------------------------------------------------------------------------------------\n");
+		for (j = 0; j < f->last; j++) {
+			if (f->hits[j]) {
+				const char *name = vld_opcode_name(f->opcodes[j]);
+
+				vld_printf(stderr, "%5u %6u %-28s %10" ZEND_ULONG_FMT_SPEC "\n", f->lines[j], j, name ? name : "UNKNOWN", f->hits[j]);
+			}
+		}
+		vld_printf(stderr, "\n");
+	}
+
+	free(list);
+}
+
+static void vld_sampler_write_folded(struct _vld_sampler_state *state)
+{
+	char        *filename;
+	FILE        *file;
+	zend_string *stack;
+	zval        *count;
+
+	if (!VLD_G(sample_folded) || !VLD_G(sample_folded)[0] || !zend_hash_num_elements(&state->stacks)) {
+		return;
+	}
+
+	filename = vld_output_filename(VLD_G(sample_folded));
+	if ((file = fopen(filename, "a")) == NULL) {
+		php_error(E_WARNING, "vld: Can not open '%s' for the folded stacks", filename);
+		free(filename);
+		return;
+	}
+
+	ZEND_HASH_FOREACH_STR_KEY_VAL(&state->stacks, stack, count) {
+		fprintf(file, "%s " ZEND_LONG_FMT "\n", ZSTR_VAL(stack), Z_LVAL_P(count));
+	} ZEND_HASH_FOREACH_END();
+
+	fclose(file);
+	free(filename);
+}
+/* }}} */
+
+int vld_sampler_enabled(void)
+{
+	return VLD_G(sample_frequency) > 0;
+}
+
+/* The signal handler stays installed for the life of the process, so that
+ * a signal that is still pending when the timer is deleted is ignored
+ * rather than killing the process */
+void vld_sampler_minit(void)
+{
+	struct sigaction sa;
+
+	if (!vld_sampler_enabled()) {
+		return;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = vld_sampler_signal;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(VLD_SAMPLE_SIGNAL, &sa, NULL);
+
+	vld_sampler_old_interrupt = zend_interrupt_function;
+	zend_interrupt_function = vld_sampler_interrupt;
+}
+
+void vld_sampler_start(void)
+{
+	struct _vld_sampler_state *state;
+	struct sigevent            sev;
+	struct itimerspec          its;
+	long                       interval;
+
+	if (!vld_sampler_enabled()) {
+		return;
+	}
+
+	state = calloc(1, sizeof(struct _vld_sampler_state));
+	zend_hash_init(&state->functions, 64, NULL, vld_sample_function_dtor, 0);
+	zend_hash_init(&state->stacks, 64, NULL, NULL, 0);
+
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_SIGNAL;
+	sev.sigev_signo = VLD_SAMPLE_SIGNAL;
+	if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &sev, &state->timer) != 0) {
+		php_error(E_WARNING, "vld: Can not create the sampling timer: %s", strerror(errno));
+	} else {
+		state->have_timer = 1;
+	}
+
+	VLD_SIGNAL_FENCE();
+	VLD_G(sampler) = state;
+
+	if (state->have_timer) {
+		interval = VLD_G(sample_frequency) > 1000000000 ? 1 : 1000000000 / VLD_G(sample_frequency);
+		its.it_interval.tv_sec = interval / 1000000000;
+		its.it_interval.tv_nsec = interval % 1000000000;
+		its.it_value = its.it_interval;
+		timer_settime(state->timer, 0, &its, NULL);
+	}
+}
+
+void vld_sampler_stop(void)
+{
+	struct _vld_sampler_state *state = VLD_G(sampler);
+
+	if (!state) {
+		return;
+	}
+
+	if (state->have_timer) {
+		timer_delete(state->timer);
+	}
+	VLD_G(sampler) = NULL;
+	VLD_SIGNAL_FENCE();
+
+	vld_sampler_report(state);
+	vld_sampler_write_folded(state);
+
+	zend_hash_destroy(&state->functions);
+	zend_hash_destroy(&state->stacks);
+	free(state);
+}
+
+#else
+
+int vld_sampler_enabled(void)
+{
+	return 0;
+}
+
+void vld_sampler_minit(void)
+{
+}
+
+void vld_sampler_start(void)
+{
+}
+
+void vld_sampler_stop(void)
+{
+}
+
+#endif
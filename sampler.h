@@ -0,0 +1,45 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __SAMPLER_H__
+#define __SAMPLER_H__
+
+/* Sampling profiler
+ *
+ * With vld.sample_frequency set, a CPU time timer sends a signal at that
+ * frequency, and the signal handler does nothing but count it and ask the
+ * VM to interrupt. The stack is sampled in the interrupt function, where
+ * the current frame is valid and every function on the stack is alive,
+ * and the samples are added up per function, per op, and per stack. At the
+ * end of the request that is written after the dump, and the stacks are
+ * appended to vld.sample_folded in the folded format of flame graph tools.
+ *
+ * The VM only checks for interrupts on jumps and calls, so that is where
+ * the innermost op of a sample is. PHP's own max_execution_time timer uses
+ * SIGPROF, so a real time signal is used instead. Sampling needs the
+ * interrupt function of PHP 7.1, and is only available in non thread safe
+ * builds, as the executor globals can not be reached from a signal handler
+ * otherwise. */
+
+#define VLD_SAMPLE_DEPTH  64
+#define VLD_SAMPLE_SIGNAL (SIGRTMIN + 5)
+
+#if defined(HAVE_VLD_TIMER_CREATE) && !defined(ZTS) && !defined(PHP_WIN32) && PHP_VERSION_ID >= 70100
+# define VLD_SAMPLER_AVAILABLE 1
+#endif
+
+int vld_sampler_enabled(void);
+void vld_sampler_minit(void);
+void vld_sampler_start(void);
+void vld_sampler_stop(void);
+
+#endif
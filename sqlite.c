@@ -0,0 +1,565 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "zend_smart_str.h"
+#include "php_vld.h"
+#include "branchinfo.h"
+#include "srm_oparray.h"
+#include "output.h"
+#include "sqlite.h"
+
+#ifdef HAVE_VLD_SQLITE
+#include <sqlite3.h>
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+/* The rows of a request are kept in memory, and only go into the database
+ * at the end of it, in one short transaction, so that processes that share
+ * the database only wait for each other while one of them writes out its
+ * rows, and never store half a request. The indexes are only created after
+ * that, which is much faster than keeping them up to date while
+ * inserting. A process waits for the others for at most this many
+ * milliseconds. */
+#define VLD_SQLITE_BUSY_TIMEOUT 5000
+
+static const char *vld_sqlite_schema =
+	"PRAGMA journal_mode = WAL;"
+	"PRAGMA synchronous = NORMAL;"
+	"CREATE TABLE IF NOT EXISTS files ("
+		"id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);"
+	"CREATE TABLE IF NOT EXISTS functions ("
+		"id INTEGER PRIMARY KEY, pid INTEGER, file_id INTEGER REFERENCES files(id),"
+		"class TEXT, name TEXT, line_start INTEGER, line_end INTEGER,"
+		"num_ops INTEGER, compiled_vars TEXT, already_dumped INTEGER NOT NULL DEFAULT 0);"
+	"CREATE TABLE IF NOT EXISTS opcodes ("
+		"function_id INTEGER NOT NULL REFERENCES functions(id), nr INTEGER NOT NULL,"
+		"line INTEGER, opcode INTEGER, name TEXT, fetch TEXT, extended_value INTEGER,"
+		"reachable INTEGER, entry INTEGER, branch_start INTEGER, branch_end INTEGER,"
+		"ext_target INTEGER);"
+	"CREATE TABLE IF NOT EXISTS operands ("
+		"function_id INTEGER NOT NULL REFERENCES functions(id), nr INTEGER NOT NULL,"
+		"position TEXT NOT NULL, type TEXT NOT NULL, value, name TEXT);"
+	"CREATE TABLE IF NOT EXISTS branches ("
+		"function_id INTEGER NOT NULL REFERENCES functions(id), op_start INTEGER NOT NULL,"
+		"op_end INTEGER, line_start INTEGER, line_end INTEGER);"
+	"CREATE TABLE IF NOT EXISTS branch_outs ("
+		"function_id INTEGER NOT NULL REFERENCES functions(id), op_start INTEGER NOT NULL,"
+		"out INTEGER NOT NULL);"
+	"CREATE TABLE IF NOT EXISTS paths ("
+		"function_id INTEGER NOT NULL REFERENCES functions(id), path INTEGER NOT NULL,"
+		"position INTEGER NOT NULL, op_start INTEGER NOT NULL);";
+
+static const char *vld_sqlite_indexes =
+	"CREATE INDEX IF NOT EXISTS functions_name ON functions(name);"
+	"CREATE INDEX IF NOT EXISTS functions_file ON functions(file_id);"
+	"CREATE INDEX IF NOT EXISTS opcodes_function ON opcodes(function_id, nr);"
+	"CREATE INDEX IF NOT EXISTS opcodes_name ON opcodes(name);"
+	"CREATE INDEX IF NOT EXISTS operands_function ON operands(function_id, nr);"
+	"CREATE INDEX IF NOT EXISTS branches_function ON branches(function_id, op_start);"
+	"CREATE INDEX IF NOT EXISTS branch_outs_function ON branch_outs(function_id, op_start);"
+	"CREATE INDEX IF NOT EXISTS paths_function ON paths(function_id, path);";
+
+enum {
+	VLD_SQLITE_FILE_INSERT,
+	VLD_SQLITE_FILE_SELECT,
+	VLD_SQLITE_FUNCTION,
+	VLD_SQLITE_OPCODE,
+	VLD_SQLITE_OPERAND,
+	VLD_SQLITE_BRANCH,
+	VLD_SQLITE_BRANCH_OUT,
+	VLD_SQLITE_PATH,
+	VLD_SQLITE_STATEMENT_COUNT
+};
+
+static const char *vld_sqlite_statements[VLD_SQLITE_STATEMENT_COUNT] = {
+	"INSERT OR IGNORE INTO files (name) VALUES (?)",
+	"SELECT id FROM files WHERE name = ?",
+	"INSERT INTO functions (pid, file_id, class, name, line_start, line_end, num_ops, compiled_vars, already_dumped) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)",
+	"INSERT INTO opcodes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+	"INSERT INTO operands VALUES (?, ?, ?, ?, ?, ?)",
+	"INSERT INTO branches VALUES (?, ?, ?, ?, ?)",
+	"INSERT INTO branch_outs VALUES (?, ?, ?)",
+	"INSERT INTO paths VALUES (?, ?, ?, ?)"
+};
+
+/* The number of parameters of each statement */
+static const int vld_sqlite_columns[VLD_SQLITE_STATEMENT_COUNT] = { 1, 1, 9, 12, 6, 5, 3, 4 };
+
+/* A row is a statement with the values of its parameters, which are longs,
+ * doubles, strings, or static strings as pointers. Parameters that are not
+ * set are NULL. The function_id of a row is that of the function row before
+ * it, and the file_id of a function row is looked up from its file name */
+typedef struct _vld_sqlite_row {
+	int      statement;
+	uint32_t first;
+} vld_sqlite_row;
+
+struct _vld_sqlite_state {
+	char           *filename;
+	vld_sqlite_row *rows;
+	uint32_t        rows_count;
+	uint32_t        rows_size;
+	zval           *values;
+	uint32_t        values_count;
+	uint32_t        values_size;
+
+	sqlite3        *db;
+	sqlite3_stmt   *statements[VLD_SQLITE_STATEMENT_COUNT];
+	sqlite3_int64   function_id;
+	HashTable       files;
+};
+
+/* {{{ Collecting rows */
+static zval *vld_sqlite_row(struct _vld_sqlite_state *state, int statement)
+{
+	int   columns = vld_sqlite_columns[statement];
+	zval *row;
+	int   i;
+
+	if (state->rows_count == state->rows_size) {
+		state->rows_size = state->rows_size ? state->rows_size * 2 : 1024;
+		state->rows = realloc(state->rows, state->rows_size * sizeof(vld_sqlite_row));
+	}
+	while (state->values_count + columns + 1 > state->values_size) {
+		state->values_size = state->values_size ? state->values_size * 2 : 4096;
+		state->values = realloc(state->values, state->values_size * sizeof(zval));
+	}
+
+	state->rows[state->rows_count].statement = statement;
+	state->rows[state->rows_count].first = state->values_count;
+	state->rows_count++;
+
+	/* The first value is not used, so that parameters are numbered from 1,
+	 * like in sqlite3_bind_*() */
+	row = &state->values[state->values_count];
+	state->values_count += columns + 1;
+	for (i = 0; i <= columns; i++) {
+		ZVAL_NULL(&row[i]);
+	}
+
+	return row;
+}
+
+static void vld_sqlite_set_zstr(zval *row, int column, zend_string *str)
+{
+	if (str) {
+		ZVAL_STR_COPY(&row[column], str);
+	}
+}
+
+static void vld_sqlite_set_str(zval *row, int column, const char *str)
+{
+	if (str) {
+		ZVAL_PTR(&row[column], (void *) str);
+	}
+}
+
+static void vld_sqlite_function_row(struct _vld_sqlite_state *state, zend_op_array *opa, int already_dumped)
+{
+	zval *row = vld_sqlite_row(state, VLD_SQLITE_FUNCTION);
+
+	ZVAL_LONG(&row[1], VLD_G(pid));
+	vld_sqlite_set_zstr(row, 2, opa->filename);
+	vld_sqlite_set_zstr(row, 3, opa->scope ? opa->scope->name : NULL);
+	vld_sqlite_set_zstr(row, 4, opa->function_name);
+	ZVAL_LONG(&row[5], opa->line_start);
+	ZVAL_LONG(&row[6], opa->line_end);
+	ZVAL_LONG(&row[9], already_dumped);
+
+	if (!already_dumped) {
+		smart_str vars = {0};
+		int       i;
+
+		for (i = 0; i < opa->last_var; i++) {
+			if (i) {
+				smart_str_appendc(&vars, ',');
+			}
+			smart_str_append(&vars, opa->vars[i]);
+		}
+		smart_str_0(&vars);
+
+		ZVAL_LONG(&row[7], opa->last);
+		if (vars.s) {
+			ZVAL_STR(&row[8], vars.s);
+		} else {
+			vld_sqlite_set_str(row, 8, "");
+		}
+	}
+}
+/* }}} */
+
+/* {{{ Writing rows */
+static void vld_sqlite_error(struct _vld_sqlite_state *state, const char *what)
+{
+	zend_error(E_WARNING, "vld: SQLite %s failed, the dump of this request is lost: %s", what, sqlite3_errmsg(state->db));
+}
+
+static sqlite3_stmt *vld_sqlite_statement(struct _vld_sqlite_state *state, int which)
+{
+	sqlite3_stmt *stmt = state->statements[which];
+
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+
+	return stmt;
+}
+
+static void vld_sqlite_bind(sqlite3_stmt *stmt, int column, zval *value)
+{
+	switch (Z_TYPE_P(value)) {
+		case IS_LONG:   sqlite3_bind_int64(stmt, column, Z_LVAL_P(value)); break;
+		case IS_DOUBLE: sqlite3_bind_double(stmt, column, Z_DVAL_P(value)); break;
+		case IS_STRING: sqlite3_bind_text(stmt, column, Z_STRVAL_P(value), Z_STRLEN_P(value), SQLITE_STATIC); break;
+		case IS_PTR:    sqlite3_bind_text(stmt, column, Z_PTR_P(value), -1, SQLITE_STATIC); break;
+		default:        break;
+	}
+}
+
+static int vld_sqlite_file_id(struct _vld_sqlite_state *state, zval *filename, sqlite3_int64 *id)
+{
+	sqlite3_stmt  *stmt;
+	zval          *cached, tmp;
+
+	*id = 0;
+	if (Z_TYPE_P(filename) != IS_STRING) {
+		return SUCCESS;
+	}
+	if ((cached = zend_hash_find(&state->files, Z_STR_P(filename))) != NULL) {
+		*id = Z_LVAL_P(cached);
+		return SUCCESS;
+	}
+
+	stmt = vld_sqlite_statement(state, VLD_SQLITE_FILE_INSERT);
+	vld_sqlite_bind(stmt, 1, filename);
+	if (sqlite3_step(stmt) != SQLITE_DONE) {
+		return FAILURE;
+	}
+
+	stmt = vld_sqlite_statement(state, VLD_SQLITE_FILE_SELECT);
+	vld_sqlite_bind(stmt, 1, filename);
+	if (sqlite3_step(stmt) != SQLITE_ROW) {
+		return FAILURE;
+	}
+	*id = sqlite3_column_int64(stmt, 0);
+
+	ZVAL_LONG(&tmp, *id);
+	zend_hash_add(&state->files, Z_STR_P(filename), &tmp);
+
+	return SUCCESS;
+}
+
+static int vld_sqlite_write_row(struct _vld_sqlite_state *state, vld_sqlite_row *row)
+{
+	zval          *values = &state->values[row->first];
+	sqlite3_stmt  *stmt;
+	sqlite3_int64  file_id = 0;
+	int            i;
+
+	if (row->statement == VLD_SQLITE_FUNCTION && vld_sqlite_file_id(state, &values[2], &file_id) == FAILURE) {
+		return FAILURE;
+	}
+
+	stmt = vld_sqlite_statement(state, row->statement);
+	for (i = 1; i <= vld_sqlite_columns[row->statement]; i++) {
+		vld_sqlite_bind(stmt, i, &values[i]);
+	}
+	if (row->statement == VLD_SQLITE_FUNCTION) {
+		if (file_id) {
+			sqlite3_bind_int64(stmt, 2, file_id);
+		} else {
+			sqlite3_bind_null(stmt, 2);
+		}
+	} else {
+		sqlite3_bind_int64(stmt, 1, state->function_id);
+	}
+
+	if (sqlite3_step(stmt) != SQLITE_DONE) {
+		return FAILURE;
+	}
+	if (row->statement == VLD_SQLITE_FUNCTION) {
+		state->function_id = sqlite3_last_insert_rowid(state->db);
+	}
+	return SUCCESS;
+}
+
+/* BEGIN IMMEDIATE takes the write lock straight away, so that waiting for
+ * other processes only ever happens there, and not halfway through */
+static void vld_sqlite_write_rows(struct _vld_sqlite_state *state)
+{
+	uint32_t i;
+
+	if (sqlite3_exec(state->db, "BEGIN IMMEDIATE", NULL, NULL, NULL) != SQLITE_OK) {
+		vld_sqlite_error(state, "begin");
+		return;
+	}
+
+	zend_hash_init(&state->files, 16, NULL, NULL, 0);
+	for (i = 0; i < state->rows_count; i++) {
+		if (vld_sqlite_write_row(state, &state->rows[i]) == FAILURE) {
+			break;
+		}
+	}
+	zend_hash_destroy(&state->files);
+
+	if (i < state->rows_count) {
+		vld_sqlite_error(state, "insert");
+		sqlite3_exec(state->db, "ROLLBACK", NULL, NULL, NULL);
+		return;
+	}
+	if (sqlite3_exec(state->db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+		vld_sqlite_error(state, "commit");
+		sqlite3_exec(state->db, "ROLLBACK", NULL, NULL, NULL);
+		return;
+	}
+	if (sqlite3_exec(state->db, vld_sqlite_indexes, NULL, NULL, NULL) != SQLITE_OK) {
+		zend_error(E_WARNING, "vld: SQLite index creation failed: %s", sqlite3_errmsg(state->db));
+	}
+}
+
+static void vld_sqlite_write(struct _vld_sqlite_state *state)
+{
+	int i;
+
+	if (sqlite3_open(state->filename, &state->db) != SQLITE_OK) {
+		zend_error(E_WARNING, "vld: Could not open the SQLite database '%s': %s", state->filename, sqlite3_errmsg(state->db));
+		sqlite3_close(state->db);
+		return;
+	}
+	sqlite3_busy_timeout(state->db, VLD_SQLITE_BUSY_TIMEOUT);
+
+	if (sqlite3_exec(state->db, vld_sqlite_schema, NULL, NULL, NULL) != SQLITE_OK) {
+		vld_sqlite_error(state, "schema creation");
+		sqlite3_close(state->db);
+		return;
+	}
+	for (i = 0; i < VLD_SQLITE_STATEMENT_COUNT; i++) {
+		if (sqlite3_prepare_v2(state->db, vld_sqlite_statements[i], -1, &state->statements[i], NULL) != SQLITE_OK) {
+			vld_sqlite_error(state, "prepare");
+			break;
+		}
+	}
+	if (i == VLD_SQLITE_STATEMENT_COUNT) {
+		vld_sqlite_write_rows(state);
+	}
+
+	while (--i >= 0) {
+		sqlite3_finalize(state->statements[i]);
+	}
+	sqlite3_close(state->db);
+}
+/* }}} */
+
+void vld_sqlite_open(void)
+{
+	struct _vld_sqlite_state *state;
+
+	state = calloc(1, sizeof(struct _vld_sqlite_state));
+	if (VLD_G(output) && VLD_G(output)[0]) {
+		state->filename = vld_output_filename(VLD_G(output));
+	} else {
+		state->filename = malloc(strlen(VLD_G(save_dir)) + sizeof("/vld.sqlite"));
+		sprintf(state->filename, "%s/vld.sqlite", VLD_G(save_dir));
+	}
+
+	VLD_G(sqlite) = state;
+}
+
+void vld_sqlite_close(void)
+{
+	struct _vld_sqlite_state *state = VLD_G(sqlite);
+	uint32_t                  i;
+
+	if (!state) {
+		return;
+	}
+	VLD_G(sqlite) = NULL;
+
+	if (state->rows_count) {
+		vld_sqlite_write(state);
+	}
+
+	for (i = 0; i < state->values_count; i++) {
+		if (Z_TYPE(state->values[i]) == IS_STRING) {
+			zend_string_release(Z_STR(state->values[i]));
+		}
+	}
+	free(state->values);
+	free(state->rows);
+	free(state->filename);
+	free(state);
+}
+
+void vld_sqlite_oparray_header(zend_op_array *opa)
+{
+	if (VLD_G(sqlite)) {
+		vld_sqlite_function_row(VLD_G(sqlite), opa, 0);
+	}
+}
+
+void vld_sqlite_oparray_reference(zend_op_array *opa)
+{
+	if (VLD_G(sqlite)) {
+		vld_sqlite_function_row(VLD_G(sqlite), opa, 1);
+	}
+}
+
+/* {{{ Operands */
+static void vld_sqlite_set_literal(zval *row, int column, zval *literal)
+{
+	switch (Z_TYPE_P(literal)) {
+		case IS_FALSE:  ZVAL_LONG(&row[column], 0); break;
+		case IS_TRUE:   ZVAL_LONG(&row[column], 1); break;
+		case IS_LONG:   ZVAL_LONG(&row[column], Z_LVAL_P(literal)); break;
+		case IS_DOUBLE: ZVAL_DOUBLE(&row[column], Z_DVAL_P(literal)); break;
+		case IS_STRING: vld_sqlite_set_zstr(row, column, Z_STR_P(literal)); break;
+		case IS_ARRAY:  vld_sqlite_set_str(row, column, "<array>"); break;
+		case IS_NULL:   break;
+		default:        vld_sqlite_set_str(row, column, "<const ast>"); break;
+	}
+}
+
+static void vld_sqlite_operand(struct _vld_sqlite_state *state, zend_op_array *opa, unsigned int nr, const char *position, unsigned int node_type, znode_op node)
+{
+	vld_znode_info  znode;
+	zval           *row;
+
+	vld_decode_znode(opa, nr, node_type, node, &znode);
+	if (!znode.type) {
+		return;
+	}
+
+	row = vld_sqlite_row(state, VLD_SQLITE_OPERAND);
+	ZVAL_LONG(&row[2], nr);
+	vld_sqlite_set_str(row, 3, position);
+	vld_sqlite_set_str(row, 4, znode.type);
+
+	switch (node_type) {
+		case IS_CONST:
+		case VLD_IS_CLASS:
+			vld_sqlite_set_literal(row, 5, znode.literal);
+			break;
+#if PHP_VERSION_ID >= 70200
+		case VLD_IS_JMP_ARRAY:
+			break;
+#endif
+		default:
+			ZVAL_LONG(&row[5], znode.value);
+			if (znode.name) {
+				vld_sqlite_set_zstr(row, 6, znode.name);
+			}
+			break;
+	}
+}
+/* }}} */
+
+void vld_sqlite_op(zend_op_array *opa, unsigned int nr, int notdead, int entry, int start, int end)
+{
+	struct _vld_sqlite_state *state = VLD_G(sqlite);
+	const zend_op            *op = &opa->opcodes[nr];
+	unsigned int              base_address = (unsigned int)(zend_intptr_t)&(opa->opcodes[0]);
+	zval                     *row;
+	vld_op_info               info;
+
+	if (!state) {
+		return;
+	}
+
+	vld_decode_op(op, base_address, &info);
+
+	row = vld_sqlite_row(state, VLD_SQLITE_OPCODE);
+	ZVAL_LONG(&row[2], nr);
+	ZVAL_LONG(&row[3], op->lineno);
+	ZVAL_LONG(&row[4], op->opcode);
+	vld_sqlite_set_str(row, 5, vld_opcode_name(op->opcode));
+	vld_sqlite_set_str(row, 6, info.fetch_type);
+	if (info.flags & EXT_VAL) {
+		ZVAL_LONG(&row[7], op->extended_value);
+	}
+	ZVAL_LONG(&row[8], notdead ? 1 : 0);
+	ZVAL_LONG(&row[9], entry ? 1 : 0);
+	ZVAL_LONG(&row[10], start ? 1 : 0);
+	ZVAL_LONG(&row[11], end ? 1 : 0);
+	if (info.flags & EXT_VAL_JMP_ABS) {
+		ZVAL_LONG(&row[12], op->extended_value);
+	} else if (info.flags & EXT_VAL_JMP_REL) {
+		ZVAL_LONG(&row[12], nr + ((int) op->extended_value / (int) sizeof(zend_op)));
+	}
+
+#if PHP_VERSION_ID >= 70100
+	if ((info.flags & RES_USED) && op->result_type != IS_UNUSED) {
+#else
+	if ((info.flags & RES_USED) && !(op->VLD_EXTENDED_VALUE(result) & EXT_TYPE_UNUSED)) {
+#endif
+		vld_sqlite_operand(state, opa, nr, "result", info.res_type, op->result);
+	}
+	if ((info.flags & OP1_USED) && info.op1_type != IS_UNUSED) {
+		vld_sqlite_operand(state, opa, nr, "op1", info.op1_type, op->op1);
+	}
+	if (info.flags & OP2_INCLUDE) {
+		const char *include_type = vld_include_type_name(op->extended_value);
+
+		row = vld_sqlite_row(state, VLD_SQLITE_OPERAND);
+		ZVAL_LONG(&row[2], nr);
+		vld_sqlite_set_str(row, 3, "op2");
+		vld_sqlite_set_str(row, 4, "INCLUDE");
+		vld_sqlite_set_str(row, 5, include_type ? include_type : "UNKNOWN");
+	} else if ((info.flags & OP2_USED) && info.op2_type != IS_UNUSED) {
+		vld_sqlite_operand(state, opa, nr, "op2", info.op2_type, op->op2);
+	}
+}
+
+void vld_sqlite_branch_info(zend_op_array *opa, vld_branch_info *branch_info)
+{
+	struct _vld_sqlite_state *state = VLD_G(sqlite);
+	zval                     *row;
+	unsigned int              i, j;
+
+	if (!state) {
+		return;
+	}
+
+	for (i = 0; i < branch_info->starts->size; i++) {
+		if (!vld_set_in(branch_info->starts, i)) {
+			continue;
+		}
+
+		row = vld_sqlite_row(state, VLD_SQLITE_BRANCH);
+		ZVAL_LONG(&row[2], i);
+		ZVAL_LONG(&row[3], branch_info->branches[i].end_op);
+		ZVAL_LONG(&row[4], branch_info->branches[i].start_lineno);
+		ZVAL_LONG(&row[5], branch_info->branches[i].end_lineno);
+
+		for (j = 0; j < branch_info->branches[i].outs_count; j++) {
+			if (!branch_info->branches[i].outs[j]) {
+				continue;
+			}
+			row = vld_sqlite_row(state, VLD_SQLITE_BRANCH_OUT);
+			ZVAL_LONG(&row[2], i);
+			ZVAL_LONG(&row[3], branch_info->branches[i].outs[j]);
+		}
+	}
+
+	for (i = 0; i < branch_info->paths_count; i++) {
+		for (j = 0; j < branch_info->paths[i]->elements_count; j++) {
+			row = vld_sqlite_row(state, VLD_SQLITE_PATH);
+			ZVAL_LONG(&row[2], i + 1);
+			ZVAL_LONG(&row[3], j);
+			ZVAL_LONG(&row[4], branch_info->paths[i]->elements[j]);
+		}
+	}
+}
+#endif
@@ -0,0 +1,28 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __SQLITE_H__
+#define __SQLITE_H__
+
+#include "php.h"
+#include "branchinfo.h"
+
+#ifdef HAVE_VLD_SQLITE
+void vld_sqlite_open(void);
+void vld_sqlite_close(void);
+void vld_sqlite_oparray_header(zend_op_array *opa);
+void vld_sqlite_oparray_reference(zend_op_array *opa);
+void vld_sqlite_op(zend_op_array *opa, unsigned int nr, int notdead, int entry, int start, int end);
+void vld_sqlite_branch_info(zend_op_array *opa, vld_branch_info *branch_info);
+#endif
+
+#endif
@@ -13,6 +13,10 @@
  */
 /* $Id: srm_oparray.c,v 1.60 2009-11-25 12:55:40 derick Exp $ */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "php.h"
 #include "zend_alloc.h"
 #include "branchinfo.h"
@@ -20,6 +24,12 @@
 #include "ext/standard/url.h"
 #include "set.h"
 #include "php_vld.h"
+#include "ndjson.h"
+#include "binary.h"
+#include "sqlite.h"
+#include "arrow.h"
+#include "dumpindex.h"
+#include "runtime.h"
 
 ZEND_EXTERN_MODULE_GLOBALS(vld)
 
@@ -668,133 +678,258 @@ static const char *get_assign_operation(uint32_t extended_value)
 }
 #endif
 
-void vld_dump_op(int nr, zend_op * op_ptr, unsigned int base_address, int notdead, int entry, int start, int end, zend_op_array *opa)
+const char *vld_opcode_name(zend_uchar opcode)
 {
-	static unsigned int last_lineno = (unsigned int) -1;
-	int print_sep = 0, len;
-	const char *fetch_type = "None";
-	unsigned int flags, op1_type, op2_type, res_type;
-	const zend_op op = op_ptr[nr];
+	if (opcode >= NUM_KNOWN_OPCODES) {
+		return NULL;
+	}
+	return opcodes[opcode].name;
+}
 
-	if (op.lineno == 0) {
-		return;
+const char *vld_include_type_name(uint32_t extended_value)
+{
+	switch (extended_value) {
+		case ZEND_INCLUDE_ONCE: return "INCLUDE_ONCE";
+		case ZEND_REQUIRE_ONCE: return "REQUIRE_ONCE";
+		case ZEND_INCLUDE:      return "INCLUDE";
+		case ZEND_REQUIRE:      return "REQUIRE";
+		case ZEND_EVAL:         return "EVAL";
 	}
+	return NULL;
+}
 
-	if (op.opcode >= NUM_KNOWN_OPCODES) {
-		flags = ALL_USED;
+/* The name that the profilers report a function under: "Class::method",
+ * "function", or "{main}" for the code of a file. PHP itself names closures
+ * "{closure}". The caller releases the string */
+zend_string *vld_function_name(const zend_function *func)
+{
+	if (!func->common.function_name) {
+		return zend_string_init("{main}", sizeof("{main}") - 1, 0);
+	}
+	if (func->common.scope) {
+		return strpprintf(0, "%s::%s", ZSTR_VAL(func->common.scope->name), ZSTR_VAL(func->common.function_name));
+	}
+	return zend_string_copy(func->common.function_name);
+}
+
+/* Works out which operands an opline uses, how they should be displayed and
+ * what its fetch type column says. Shared by all the dump formats. */
+void vld_decode_op(const zend_op *op, unsigned int base_address, vld_op_info *info)
+{
+	info->fetch_type = "None";
+
+	if (op->opcode >= NUM_KNOWN_OPCODES) {
+		info->flags = ALL_USED;
 	} else {
-		flags = opcodes[op.opcode].flags;
+		info->flags = opcodes[op->opcode].flags;
 	}
 
-	op1_type = op.VLD_TYPE(op1);
-	op2_type = op.VLD_TYPE(op2);
-	res_type = op.VLD_TYPE(result);
+	info->op1_type = op->VLD_TYPE(op1);
+	info->op2_type = op->VLD_TYPE(op2);
+	info->res_type = op->VLD_TYPE(result);
 
-	if (flags == SPECIAL) {
-		flags = vld_get_special_flags(&op, base_address);
+	if (info->flags == SPECIAL) {
+		info->flags = vld_get_special_flags(op, base_address);
 	}
-	if (flags & OP1_OPLINE) {
-		op1_type = VLD_IS_OPLINE;
+	if (info->flags & OP1_OPLINE) {
+		info->op1_type = VLD_IS_OPLINE;
 	}
-	if (flags & OP2_OPLINE) {
-		op2_type = VLD_IS_OPLINE;
+	if (info->flags & OP2_OPLINE) {
+		info->op2_type = VLD_IS_OPLINE;
 	}
-	if (flags & OP1_OPNUM) {
-		op1_type = VLD_IS_OPNUM;
+	if (info->flags & OP1_OPNUM) {
+		info->op1_type = VLD_IS_OPNUM;
 	}
-	if (flags & OP2_OPNUM) {
-		op2_type = VLD_IS_OPNUM;
+	if (info->flags & OP2_OPNUM) {
+		info->op2_type = VLD_IS_OPNUM;
 	}
-	if (flags & OP2_INDEX) {
-		op2_type = VLD_IS_INDEX;
+	if (info->flags & OP2_INDEX) {
+		info->op2_type = VLD_IS_INDEX;
 	}
-	if (flags & OP1_CLASS) {
-		op1_type = VLD_IS_CLASS;
+	if (info->flags & OP1_CLASS) {
+		info->op1_type = VLD_IS_CLASS;
 	}
-	if (flags & RES_CLASS) {
-		res_type = VLD_IS_CLASS;
+	if (info->flags & RES_CLASS) {
+		info->res_type = VLD_IS_CLASS;
 	}
-	if (flags & OP2_JMP_ARRAY) {
-		op2_type = VLD_IS_JMP_ARRAY;
+	if (info->flags & OP2_JMP_ARRAY) {
+		info->op2_type = VLD_IS_JMP_ARRAY;
 	}
 
 #if PHP_VERSION_ID >= 70000 && PHP_VERSION_ID < 70100
-	switch (op.opcode) {
+	switch (op->opcode) {
 		case ZEND_FAST_RET:
-			if (op.extended_value == ZEND_FAST_RET_TO_FINALLY) {
-				fetch_type = "to_finally";
-			} else if (op.extended_value == ZEND_FAST_RET_TO_CATCH) {
-				fetch_type = "to_catch";
+			if (op->extended_value == ZEND_FAST_RET_TO_FINALLY) {
+				info->fetch_type = "to_finally";
+			} else if (op->extended_value == ZEND_FAST_RET_TO_CATCH) {
+				info->fetch_type = "to_catch";
 			}
 			break;
 		case ZEND_FAST_CALL:
-			if (op.extended_value == ZEND_FAST_CALL_FROM_FINALLY) {
-				fetch_type = "from_finally";
+			if (op->extended_value == ZEND_FAST_CALL_FROM_FINALLY) {
+				info->fetch_type = "from_finally";
 			}
 			break;
 	}
 #endif
 
 #if PHP_VERSION_ID >= 70400
-	if (op.opcode == ZEND_ASSIGN_DIM_OP) {
-		fetch_type = get_assign_operation(op.extended_value);
+	if (op->opcode == ZEND_ASSIGN_DIM_OP) {
+		info->fetch_type = get_assign_operation(op->extended_value);
 	}
 #endif
 #if PHP_VERSION_ID >= 70100
-	if (op.opcode == ZEND_NEW/* && op1_type == IS_UNUSED*/) {
-		int ftype = op.op1.num & ZEND_FETCH_CLASS_MASK;
+	if (op->opcode == ZEND_NEW/* && op1_type == IS_UNUSED*/) {
+		int ftype = op->op1.num & ZEND_FETCH_CLASS_MASK;
 #else
-	if (op.opcode == ZEND_FETCH_CLASS) {
-		int ftype = op.extended_value & ZEND_FETCH_CLASS_MASK;
+	if (op->opcode == ZEND_FETCH_CLASS) {
+		int ftype = op->extended_value & ZEND_FETCH_CLASS_MASK;
 #endif
 		switch (ftype) {
 			case ZEND_FETCH_CLASS_SELF:
-				fetch_type = "self";
+				info->fetch_type = "self";
 				break;
 			case ZEND_FETCH_CLASS_PARENT:
-				fetch_type = "parent";
+				info->fetch_type = "parent";
 				break;
 			case ZEND_FETCH_CLASS_STATIC:
-				fetch_type = "static";
+				info->fetch_type = "static";
 				break;
 			case ZEND_FETCH_CLASS_AUTO:
-				fetch_type = "auto";
+				info->fetch_type = "auto";
 				break;
 		}
 	}
 
-	if (flags & OP_FETCH) {
-		switch (op.VLD_EXTENDED_VALUE(op2)) {
+	if (info->flags & OP_FETCH) {
+		switch (op->VLD_EXTENDED_VALUE(op2)) {
 			case ZEND_FETCH_GLOBAL:
-				fetch_type = "global";
+				info->fetch_type = "global";
 				break;
 			case ZEND_FETCH_LOCAL:
-				fetch_type = "local";
+				info->fetch_type = "local";
 				break;
 #if PHP_VERSION_ID < 70100
 			case ZEND_FETCH_STATIC:
-				fetch_type = "static";
+				info->fetch_type = "static";
 				break;
 			case ZEND_FETCH_STATIC_MEMBER:
-				fetch_type = "static member";
+				info->fetch_type = "static member";
 				break;
 #endif
 #ifdef ZEND_FETCH_GLOBAL_LOCK
 			case ZEND_FETCH_GLOBAL_LOCK:
-				fetch_type = "global lock";
+				info->fetch_type = "global lock";
 				break;
 #endif
 #ifdef ZEND_FETCH_AUTO_GLOBAL
 			case ZEND_FETCH_AUTO_GLOBAL:
-				fetch_type = "auto global";
+				info->fetch_type = "auto global";
 				break;
 #endif
 			default:
-				fetch_type = "unknown";
+				info->fetch_type = "unknown";
 				break;
 		}
 	}
 
+}
+
+/* Works out what an operand refers to: its type name, the slot, op number
+ * or index it holds, and the literal or compiled variable behind it. Shared
+ * by the structured dump formats, which only differ in how they write it. */
+void vld_decode_znode(zend_op_array *opa, int opline, unsigned int node_type, znode_op node, vld_znode_info *info)
+{
+	zend_op *base_address = &(opa->opcodes[0]);
+
+	info->type    = NULL;
+	info->value   = 0;
+	info->literal = NULL;
+	info->name    = NULL;
+
+	switch (node_type) {
+		case IS_CONST:
+		case VLD_IS_CLASS:
+			info->type    = node_type == IS_CONST ? "CONST" : "CLASS";
+			info->literal = VLD_OP_CONSTANT(opa, opline, node);
+			info->value   = info->literal - opa->literals;
+			break;
+		case IS_TMP_VAR:
+			info->type  = "TMP_VAR";
+			info->value = VAR_NUM(node.var);
+			break;
+		case IS_VAR:
+			info->type  = "VAR";
+			info->value = VAR_NUM(node.var);
+			break;
+		case IS_CV:
+			info->type  = "CV";
+			info->value = VAR_NUM(node.var);
+			if (info->value < opa->last_var) {
+				info->name = opa->vars[info->value];
+			}
+			break;
+		case VLD_IS_OPNUM:
+		case VLD_IS_OPLINE:
+			info->type  = "JMP";
+			info->value = VLD_ZNODE_JMP_LINE(node, opline, base_address);
+			break;
+		case VLD_IS_INDEX:
+			info->type  = "INDEX";
+			info->value = node.var;
+			break;
+#if PHP_VERSION_ID >= 70200
+		case VLD_IS_JMP_ARRAY:
+			info->type    = "JMP_ARRAY";
+			info->literal = VLD_OP_CONSTANT(opa, opline, node);
+			break;
+#endif
+	}
+}
+
+void vld_dump_op(int nr, zend_op * op_ptr, unsigned int base_address, int notdead, int entry, int start, int end, zend_op_array *opa)
+{
+	static unsigned int last_lineno = (unsigned int) -1;
+	int print_sep = 0, len;
+	const char *fetch_type;
+	unsigned int flags, op1_type, op2_type, res_type;
+	const zend_op op = op_ptr[nr];
+	vld_op_info info;
+
+	if (op.lineno == 0) {
+		return;
+	}
+
+	if (VLD_G(output_format) == VLD_OUTPUT_NDJSON) {
+		vld_ndjson_op(opa, nr, notdead, entry, start, end);
+		return;
+	}
+	if (VLD_G(output_format) == VLD_OUTPUT_BINARY) {
+		vld_binary_op(opa, nr, notdead, entry, start, end);
+		return;
+	}
+	if (VLD_G(output_format) == VLD_OUTPUT_ARROW) {
+		vld_arrow_op(opa, nr, notdead, entry, start, end);
+		return;
+	}
+#ifdef HAVE_VLD_SQLITE
+	if (VLD_G(output_format) == VLD_OUTPUT_SQLITE) {
+		vld_sqlite_op(opa, nr, notdead, entry, start, end);
+		return;
+	}
+#endif
+
+	vld_decode_op(&op, base_address, &info);
+	flags      = info.flags;
+	op1_type   = info.op1_type;
+	op2_type   = info.op2_type;
+	res_type   = info.res_type;
+	fetch_type = info.fetch_type;
+
+	if (VLD_G(runtime_reporting)) {
+		vld_runtime_dump_op(opa, nr);
+	}
+
 	if (op.lineno == last_lineno) {
 		vld_printf(stderr, "%5d ", op.lineno);
 		last_lineno = op.lineno;
@@ -864,29 +999,12 @@ void vld_dump_op(int nr, zend_op * op_ptr, unsigned int base_address, int notdea
 	if (flags & OP2_USED) {
 		VLD_PRINT(3, " OP2[ ");
 		if (flags & OP2_INCLUDE) {
+			const char *include_type = vld_include_type_name(op.extended_value);
+
 			if (VLD_G(verbosity) < 3 && print_sep) {
 				vld_printf(stderr, ", ");
 			}
-			switch (op.extended_value) {
-				case ZEND_INCLUDE_ONCE:
-					vld_printf(stderr, "INCLUDE_ONCE");
-					break;
-				case ZEND_REQUIRE_ONCE:
-					vld_printf(stderr, "REQUIRE_ONCE");
-					break;
-				case ZEND_INCLUDE:
-					vld_printf(stderr, "INCLUDE");
-					break;
-				case ZEND_REQUIRE:
-					vld_printf(stderr, "REQUIRE");
-					break;
-				case ZEND_EVAL:
-					vld_printf(stderr, "EVAL");
-					break;
-				default:
-					vld_printf(stderr, "!!ERROR!!");
-					break;
-			}
+			vld_printf(stderr, "%s", include_type ? include_type : "!!ERROR!!");
 		} else {
 			vld_dump_znode (&print_sep, op2_type, op.op2, base_address, opa, nr);
 		}
@@ -906,11 +1024,155 @@ void vld_dump_op(int nr, zend_op * op_ptr, unsigned int base_address, int notdea
 		zend_op next_op = op_ptr[nr+1];
 		vld_dump_znode (&print_sep, VLD_IS_OPNUM, next_op.op2, base_address, opa, nr);
 	}
+	if (VLD_G(runtime_reporting)) {
+		vld_runtime_dump_op_note(opa, nr);
+	}
 	vld_printf (stderr, "\n");
 }
 
-void vld_analyse_oparray(zend_op_array *opa, vld_set *set, vld_branch_info *branch_info);
-void vld_analyse_branch(zend_op_array *opa, unsigned int position, vld_set *set, vld_branch_info *branch_info);
+/* {{{ Duplicate detection
+ * Op arrays are remembered by a fingerprint of their contents, which
+ * closures share with the op array they were created from, and which
+ * catches the same code being compiled again by another include. Their
+ * opcodes pointer is no use for this, as the code of eval() or of a file
+ * that ran is freed, and its address may be given to different code. The
+ * fingerprint is 64 bits wide also on 32 bit builds, and covers every
+ * operand, and every byte of strings and arrays. */
+#define VLD_FINGERPRINT_ADD(v) h = (h ^ (uint64_t) (v)) * 0x100000001b3ULL
+
+static uint64_t vld_oparray_fingerprint_bytes(uint64_t h, const char *str, size_t len)
+{
+	size_t i;
+
+	VLD_FINGERPRINT_ADD(len);
+	for (i = 0; i < len; i++) {
+		VLD_FINGERPRINT_ADD((unsigned char) str[i]);
+	}
+	return h;
+}
+
+static uint64_t vld_oparray_fingerprint_string(uint64_t h, zend_string *str)
+{
+	return str ? vld_oparray_fingerprint_bytes(h, ZSTR_VAL(str), ZSTR_LEN(str)) : vld_oparray_fingerprint_bytes(h, "", 0);
+}
+
+static uint64_t vld_oparray_fingerprint_literal(uint64_t h, zval *literal)
+{
+	uint64_t     bits;
+	zend_ulong   index;
+	zend_string *key;
+	zval        *element;
+
+	VLD_FINGERPRINT_ADD(Z_TYPE_P(literal));
+	switch (Z_TYPE_P(literal)) {
+		case IS_LONG:
+			VLD_FINGERPRINT_ADD(Z_LVAL_P(literal));
+			break;
+		case IS_DOUBLE:
+			memcpy(&bits, &Z_DVAL_P(literal), sizeof(bits));
+			VLD_FINGERPRINT_ADD(bits);
+			break;
+		case IS_STRING:
+			h = vld_oparray_fingerprint_string(h, Z_STR_P(literal));
+			break;
+		case IS_ARRAY:
+			VLD_FINGERPRINT_ADD(zend_hash_num_elements(Z_ARRVAL_P(literal)));
+			ZEND_HASH_FOREACH_KEY_VAL(Z_ARRVAL_P(literal), index, key, element) {
+				if (key) {
+					h = vld_oparray_fingerprint_string(h, key);
+				} else {
+					VLD_FINGERPRINT_ADD(index);
+				}
+				h = vld_oparray_fingerprint_literal(h, element);
+			} ZEND_HASH_FOREACH_END();
+			break;
+	}
+
+	return h;
+}
+
+/* Constants count by their number, and all other operands by their value:
+ * the slot of a variable, or the distance of a jump. Builds that keep
+ * absolute jump addresses in ops can therefore not tell that two copies of
+ * the same code with jumps are alike, and dump both */
+static uint64_t vld_oparray_fingerprint_operand(zend_op_array *opa, const zend_op *op, zend_uchar type, VLD_ZNODE node)
+{
+	if (type == IS_CONST) {
+#if PHP_VERSION_ID >= 70300
+		return RT_CONSTANT(op, node) - opa->literals;
+#else
+		return RT_CONSTANT_EX(opa->literals, node) - opa->literals;
+#endif
+	}
+	return node.num;
+}
+
+static uint64_t vld_oparray_fingerprint(zend_op_array *opa)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	int      l;
+	uint32_t i;
+
+	h = vld_oparray_fingerprint_string(h, opa->filename);
+	h = vld_oparray_fingerprint_string(h, opa->function_name);
+	VLD_FINGERPRINT_ADD(opa->line_start);
+	VLD_FINGERPRINT_ADD(opa->line_end);
+	VLD_FINGERPRINT_ADD(opa->last);
+	VLD_FINGERPRINT_ADD(opa->last_var);
+	VLD_FINGERPRINT_ADD(opa->last_literal);
+
+	for (i = 0; i < opa->last; i++) {
+		const zend_op *op = &opa->opcodes[i];
+
+		VLD_FINGERPRINT_ADD(op->opcode);
+		VLD_FINGERPRINT_ADD((op->op1_type << 16) | (op->op2_type << 8) | op->result_type);
+		VLD_FINGERPRINT_ADD(vld_oparray_fingerprint_operand(opa, op, op->op1_type, op->op1));
+		VLD_FINGERPRINT_ADD(vld_oparray_fingerprint_operand(opa, op, op->op2_type, op->op2));
+		VLD_FINGERPRINT_ADD(op->result.num);
+		VLD_FINGERPRINT_ADD(op->extended_value);
+		VLD_FINGERPRINT_ADD(op->lineno);
+	}
+	for (l = 0; l < opa->last_literal; l++) {
+		h = vld_oparray_fingerprint_literal(h, &opa->literals[l]);
+	}
+
+	return h;
+}
+#undef VLD_FINGERPRINT_ADD
+
+/* Kept as a string key of 8 bytes, as an index key is only 32 bits wide on
+ * 32 bit builds */
+static int vld_oparray_already_dumped(zend_op_array *opa)
+{
+	uint64_t fingerprint;
+
+	if (!VLD_G(dumped_fingerprints)) {
+		return 0;
+	}
+
+	fingerprint = vld_oparray_fingerprint(opa);
+	if (zend_hash_str_exists(VLD_G(dumped_fingerprints), (const char *) &fingerprint, sizeof(fingerprint))) {
+		return 1;
+	}
+	zend_hash_str_add_empty_element(VLD_G(dumped_fingerprints), (const char *) &fingerprint, sizeof(fingerprint));
+
+	return 0;
+}
+
+static void vld_dump_oparray_reference(zend_op_array *opa)
+{
+	if (VLD_G(format)) {
+		vld_printf (stderr, "filename:%s%s\n", VLD_G(col_sep), ZSTRING_VALUE(opa->filename));
+		vld_printf (stderr, "function name:%s%s\n", VLD_G(col_sep), ZSTRING_VALUE(opa->function_name));
+		vld_printf (stderr, "already dumped:%s%d-%d\n", VLD_G(col_sep), opa->line_start, opa->line_end);
+	} else {
+		vld_printf (stderr, "filename:       %s\n", ZSTRING_VALUE(opa->filename));
+		vld_printf (stderr, "function name:  %s\n", ZSTRING_VALUE(opa->function_name));
+		vld_printf (stderr, "already dumped: lines %d-%d, see above\n", opa->line_start, opa->line_end);
+	}
+	vld_printf(stderr, "\n");
+}
+/* }}} */
 
 void vld_dump_oparray(zend_op_array *opa)
 {
@@ -919,14 +1181,43 @@ void vld_dump_oparray(zend_op_array *opa)
 	vld_set *set;
 	vld_branch_info *branch_info;
 	unsigned int base_address = (unsigned int)(zend_intptr_t)&(opa->opcodes[0]);
+	uint64_t dump_offset;
+
+	if (vld_oparray_already_dumped(opa)) {
+		if (VLD_G(output_format) == VLD_OUTPUT_NDJSON) {
+			vld_ndjson_oparray_reference(opa);
+		} else if (VLD_G(output_format) == VLD_OUTPUT_BINARY) {
+			vld_binary_oparray_reference(opa);
+		} else if (VLD_G(output_format) == VLD_OUTPUT_ARROW) {
+			/* Rows are only written for ops, and those have already been */
+#ifdef HAVE_VLD_SQLITE
+		} else if (VLD_G(output_format) == VLD_OUTPUT_SQLITE) {
+			vld_sqlite_oparray_reference(opa);
+#endif
+		} else {
+			vld_dump_oparray_reference(opa);
+		}
+		return;
+	}
 
+	dump_offset = VLD_G(output_offset);
 	set = vld_set_create(opa->last);
 	branch_info = vld_branch_info_create(opa->last);
 
 	if (VLD_G(dump_paths)) {
 		vld_analyse_oparray(opa, set, branch_info);
 	}
-	if (VLD_G(format)) {
+	if (VLD_G(output_format) == VLD_OUTPUT_NDJSON) {
+		vld_ndjson_oparray_header(opa);
+	} else if (VLD_G(output_format) == VLD_OUTPUT_BINARY) {
+		vld_binary_oparray_header(opa);
+	} else if (VLD_G(output_format) == VLD_OUTPUT_ARROW) {
+		vld_arrow_oparray_header(opa);
+#ifdef HAVE_VLD_SQLITE
+	} else if (VLD_G(output_format) == VLD_OUTPUT_SQLITE) {
+		vld_sqlite_oparray_header(opa);
+#endif
+	} else if (VLD_G(format)) {
 		vld_printf (stderr, "filename:%s%s\n", VLD_G(col_sep), ZSTRING_VALUE(opa->filename));
 		vld_printf (stderr, "function name:%s%s\n", VLD_G(col_sep), ZSTRING_VALUE(opa->function_name));
 		vld_printf (stderr, "number of ops:%s%d\n", VLD_G(col_sep), opa->last);
@@ -944,16 +1235,25 @@ void vld_dump_oparray(zend_op_array *opa)
 		vld_printf(stderr, "none\n");
 	}
 
+	if (VLD_G(runtime_reporting)) {
+		vld_runtime_dump_header(0);
+	}
 	if (VLD_G(format)) {
 		vld_printf(stderr, "line%s# *%s%s%sop%sfetch%sext%sreturn%soperands\n",VLD_G(col_sep),VLD_G(col_sep),VLD_G(col_sep),VLD_G(col_sep),VLD_G(col_sep),VLD_G(col_sep),VLD_G(col_sep),VLD_G(col_sep));
 	} else {
 		vld_printf(stderr, "line      #* E I O op                           fetch          ext  return  operands\n");
+		if (VLD_G(runtime_reporting)) {
+			vld_runtime_dump_header(1);
+		}
 		vld_printf(stderr, "-------------------------------------------------------------------------------------\n");
 	}
 	for (i = 0; i < opa->last; i++) {
 		vld_dump_op(i, opa->opcodes, base_address, vld_set_in(set, i), vld_set_in(branch_info->entry_points, i), vld_set_in(branch_info->starts, i), vld_set_in(branch_info->ends, i), opa);
 	}
 	vld_printf(stderr, "\n");
+	if (VLD_G(runtime_reporting)) {
+		vld_runtime_dump_summary(opa);
+	}
 
 	if (VLD_G(dump_paths)) {
 		vld_branch_post_process(opa, branch_info);
@@ -964,6 +1264,8 @@ void vld_dump_oparray(zend_op_array *opa)
 	vld_set_free(set);
 	vld_branch_info_free(branch_info);
 
+	vld_dump_index_add(opa, dump_offset, VLD_G(output_offset) - dump_offset);
+
 #if PHP_VERSION_ID >= 80100
 	if (!opa->num_dynamic_func_defs) {
 		return;
@@ -16,6 +16,7 @@
 #define VLD_OPARRAY_H
 
 #include "php.h"
+#include "branchinfo.h"
 
 
 #define VLD_ZNODE znode_op
@@ -25,6 +26,12 @@
 
 #define VAR_NUM(v) EX_VAR_TO_NUM(v)
 
+#if PHP_VERSION_ID >= 70300
+# define VLD_OP_CONSTANT(opa, nr, node) RT_CONSTANT((opa)->opcodes + (nr), (node))
+#else
+# define VLD_OP_CONSTANT(opa, nr, node) RT_CONSTANT_EX((opa)->literals, (node))
+#endif
+
 // flags used in the op array list
 #define OP1_USED   1<<0
 #define OP2_USED   1<<1
@@ -63,7 +70,33 @@ typedef struct _op_usage {
 	unsigned int flags;
 } op_usage;
 
+typedef struct _vld_op_info {
+	unsigned int flags;
+	unsigned int op1_type;
+	unsigned int op2_type;
+	unsigned int res_type;
+	const char  *fetch_type;
+} vld_op_info;
+
+/* type is NULL for an operand type that is not known, and value is the
+ * literal's index for CONST and CLASS, the slot number for TMP_VAR, VAR and
+ * CV, the op number for JMP and the index for INDEX */
+typedef struct _vld_znode_info {
+	const char  *type;
+	zend_long    value;
+	zval        *literal;
+	zend_string *name;
+} vld_znode_info;
+
+const char *vld_opcode_name(zend_uchar opcode);
+const char *vld_include_type_name(uint32_t extended_value);
+zend_string *vld_function_name(const zend_function *func);
+void vld_decode_op(const zend_op *op, unsigned int base_address, vld_op_info *info);
+void vld_decode_znode(zend_op_array *opa, int opline, unsigned int node_type, znode_op node, vld_znode_info *info);
+
 void vld_dump_oparray (zend_op_array *opa);
+void vld_analyse_oparray(zend_op_array *opa, vld_set *set, vld_branch_info *branch_info);
+void vld_analyse_branch(zend_op_array *opa, unsigned int position, vld_set *set, vld_branch_info *branch_info);
 void vld_mark_dead_code (zend_op_array *opa);
 
 #endif
@@ -0,0 +1,24 @@
+--TEST--
+vld.alloc_profile attributes allocations to the op that made them
+--INI--
+vld.alloc_profile=1
+--FILE--
+<?php
+function build($n)
+{
+	$s = str_repeat('x', $n);
+	return $s;
+}
+
+$keep = build(1000000);
+echo strlen($keep), "\n";
+?>
+--EXPECTF--
+1000000
+Allocations: %d of %d bytes, %d sampled every 1 allocations
+
+%AAllocations of build %salloc-profile-001.php:2, %d bytes:
+line      # op                               allocs      bytes       peak       live      freed
+-------------------------------------------------------------------------------------------------
+    4      %d DO_%s %s 1    10000%d    10000%d    10000%d %s
+%A
@@ -0,0 +1,79 @@
+--TEST--
+vld.output_format=arrow writes one complete stream per request when workers append to one file at once
+--SKIPIF--
+<?php
+if (substr(PHP_OS, 0, 3) == 'WIN') { echo "skip Not available on Windows\n"; }
+if (!function_exists('proc_open')) { echo "skip proc_open required\n"; }
+if (PHP_INT_SIZE < 8) { echo "skip 64-bit only\n"; }
+?>
+--FILE--
+<?php
+/* Walks the messages of the IPC streams in $data, by their continuation
+ * marker, metadata length and the body length in the Message table */
+function arrow_messages($data)
+{
+	$messages = array();
+	$pos = 0;
+
+	while ($pos < strlen($data)) {
+		$head = unpack('Vmarker/Vlength', substr($data, $pos, 8));
+		if ($head['marker'] != 0xffffffff || $head['length'] % 8) {
+			return "bad framing at $pos";
+		}
+		$pos += 8;
+		if ($head['length'] == 0) {
+			$messages[] = 'end';
+			continue;
+		}
+
+		$meta   = substr($data, $pos, $head['length']);
+		$table  = unpack('V', $meta)[1];
+		$vtable = $table - unpack('l', substr($meta, $table, 4))[1];
+		$fields = unpack('v*', substr($meta, $vtable, unpack('v', substr($meta, $vtable, 2))[1]));
+		$type   = empty($fields[4]) ? 0 : ord($meta[$table + $fields[4]]);
+		$body   = empty($fields[6]) ? 0 : unpack('P', substr($meta, $table + $fields[6], 8))[1];
+
+		$messages[] = $type == 1 ? 'schema' : ($type == 3 ? 'batch' : "type $type");
+		$pos += $head['length'] + $body;
+	}
+
+	return $pos == strlen($data) ? $messages : "truncated at $pos";
+}
+
+$dump = sys_get_temp_dir() . '/vld-arrow-001-' . getmypid() . '.arrow';
+$script = __DIR__ . '/arrow-001.inc';
+$code = "<?php\n";
+for ($i = 0; $i < 400; $i++) {
+	$code .= "function f_$i(\$a) { return \$a * $i + strlen('padding for function $i'); }\n";
+}
+file_put_contents($script, $code);
+@unlink($dump);
+
+$php = getenv('TEST_PHP_EXECUTABLE') ?: PHP_BINARY;
+$cmd = escapeshellarg($php) . ' -n'
+	. ' -d extension_dir=' . escapeshellarg(ini_get('extension_dir'))
+	. ' -d extension=vld.' . PHP_SHLIB_SUFFIX
+	. ' -d vld.active=1 -d vld.execute=0 -d vld.output_format=arrow'
+	. ' -d vld.output=' . escapeshellarg($dump)
+	. ' ' . escapeshellarg($script);
+$children = array();
+for ($i = 0; $i < 2; $i++) {
+	$children[$i] = proc_open($cmd, array(1 => array('pipe', 'w'), 2 => array('pipe', 'w')), $pipes[$i]);
+}
+for ($i = 0; $i < 2; $i++) {
+	stream_get_contents($pipes[$i][1]);
+	echo stream_get_contents($pipes[$i][2]);
+	proc_close($children[$i]);
+}
+
+$messages = arrow_messages(file_get_contents($dump));
+echo is_array($messages) ? implode(' ', $messages) : $messages, "\n";
+
+unlink($dump);
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/arrow-001.inc');
+?>
+--EXPECT--
+schema batch end schema batch end
@@ -0,0 +1,60 @@
+--TEST--
+vld.output_format=binary dumps can be read back with vld_binary_read()
+--SKIPIF--
+<?php
+if (!function_exists('proc_open')) { echo "skip proc_open required\n"; }
+?>
+--FILE--
+<?php
+require __DIR__ . '/../tools/vld_binary.php';
+
+$dump = sys_get_temp_dir() . '/vld-binary-001-' . getmypid() . '.vldb';
+$script = __DIR__ . '/binary-001.inc';
+file_put_contents($script, "<?php\nfunction foo(\$a)\n{\n\treturn \$a + 1;\n}\necho foo(41), \"\\n\";\n");
+@unlink($dump);
+
+$php = getenv('TEST_PHP_EXECUTABLE') ?: PHP_BINARY;
+$cmd = escapeshellarg($php) . ' -n'
+	. ' -d extension_dir=' . escapeshellarg(ini_get('extension_dir'))
+	. ' -d extension=vld.' . PHP_SHLIB_SUFFIX
+	. ' -d vld.active=1 -d vld.output_format=binary'
+	. ' -d vld.output=' . escapeshellarg($dump)
+	. ' ' . escapeshellarg($script);
+$child = proc_open($cmd, array(1 => array('pipe', 'w'), 2 => array('pipe', 'w')), $pipes);
+echo stream_get_contents($pipes[1]);
+echo stream_get_contents($pipes[2]);
+proc_close($child);
+
+$functions = vld_binary_read($dump);
+foreach ($functions as $function) {
+	if ($function['function_name'] === null) {
+		continue;
+	}
+	echo $function['function_name'], ' in ', basename($function['filename']), ': ';
+	echo $function['num_ops'] === count($function['opcodes']) ? 'all ops' : 'missing ops', ', ', implode(',', $function['compiled_vars']), "\n";
+	$foo = $function;
+}
+
+for ($i = 0; $i < 3; $i++) {
+	$op = $foo['opcodes'][$i];
+	echo $op['line'], ' ', $op['name'];
+	foreach (array('result', 'op1', 'op2') as $operand) {
+		if ($op[$operand] !== null) {
+			echo ' ', $operand, '=', $op[$operand]['type'], ':', isset($op[$operand]['name']) ? $op[$operand]['name'] : var_export($op[$operand]['value'], true);
+		}
+	}
+	echo "\n";
+}
+
+unlink($dump);
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/binary-001.inc');
+?>
+--EXPECTF--
+42
+foo in binary-001.inc: all ops, a
+2 RECV result=CV:a%S
+4 ADD result=TMP_VAR:%d op1=CV:a op2=CONST:1
+4 RETURN op1=TMP_VAR:%d
@@ -0,0 +1,25 @@
+--TEST--
+vld.branch_coverage records which outs of a branch were taken
+--INI--
+vld.branch_coverage=1
+--FILE--
+<?php
+function foo($a)
+{
+	if ($a) {
+		return 1;
+	}
+	return 2;
+}
+
+foo(true);
+
+foreach (vld_dump_function('foo')['branches'] as $nr => $branch) {
+	echo $nr, ': ', json_encode($branch['outs']), ' ', json_encode($branch['taken']), "\n";
+}
+?>
+--EXPECTF--
+0: [%d,%d] [true,false]
+%d: [-2] [true]
+%d: [-2] [false]
+%A
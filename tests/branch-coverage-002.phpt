@@ -0,0 +1,28 @@
+--TEST--
+vld.branch_coverage and vld.path_profile follow a loop back to op 0
+--INI--
+vld.branch_coverage=1
+vld.path_profile=1
+--FILE--
+<?php
+function loop()
+{
+	do {
+		$i = isset($i) ? $i + 1 : 1;
+	} while ($i < 3);
+	return $i;
+}
+
+echo loop(), "\n";
+
+foreach (vld_dump_function('loop')['branches'] as $nr => $branch) {
+	if (in_array(0, $branch['outs'], true)) {
+		echo $nr, ': ', json_encode($branch['outs']), ' ', json_encode($branch['taken']), "\n";
+	}
+}
+?>
+--EXPECTF--
+3
+%d: [0,%d] [true,true]
+%Apath id %d: %s; loops back to 0
+%A
@@ -0,0 +1,29 @@
+--TEST--
+vld.branch_coverage enters the first branch of a call that skipped its RECV ops into a loop
+--INI--
+vld.branch_coverage=1
+--FILE--
+<?php
+function countdown($n)
+{
+	do {
+		$n--;
+	} while ($n > 0);
+	return $n;
+}
+
+echo countdown(3), "\n";
+
+$branches = vld_dump_function('countdown')['branches'];
+echo json_encode($branches[0]['outs']), ' ', json_encode($branches[0]['taken']), "\n";
+foreach ($branches as $nr => $branch) {
+	if ($nr && in_array($nr, $branch['outs'], true)) {
+		echo json_encode($branch['outs']), ' ', json_encode($branch['taken']), "\n";
+	}
+}
+?>
+--EXPECTF--
+0
+[1] [true]
+[1,%d] [true,true]
+%A
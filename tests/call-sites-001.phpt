@@ -0,0 +1,39 @@
+--TEST--
+vld.call_sites classifies method call sites by the classes they saw
+--INI--
+vld.call_sites=1
+--FILE--
+<?php
+interface Shape { function area(); }
+class Square implements Shape { function area() { return 4; } }
+class Circle implements Shape { function area() { return 3; } }
+
+function total(array $shapes)
+{
+	$t = 0;
+	foreach ($shapes as $shape) {
+		$t += $shape->area();
+	}
+	return $t;
+}
+
+function one(Square $s)
+{
+	return $s->area();
+}
+
+echo total(array(new Square, new Circle, new Square)), "\n";
+echo one(new Square), "\n";
+?>
+--EXPECTF--
+11
+4
+%AFunction total:
+%AINIT_METHOD_CALL%s; polymorphic Square 2, Circle 1
+%Acall sites: 0 monomorphic, 1 polymorphic, 0 megamorphic
+
+End of function total
+%AFunction one:
+%AINIT_METHOD_CALL%s; monomorphic Square 1
+%Acall sites: 1 monomorphic, 0 polymorphic, 0 megamorphic
+%A
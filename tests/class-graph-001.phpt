@@ -0,0 +1,43 @@
+--TEST--
+vld_class_graph() orders classes after the classes they refer to
+--SKIPIF--
+<?php if (!extension_loaded("vld")) print "skip"; ?>
+--FILE--
+<?php
+$dir = __DIR__;
+file_put_contents("$dir/class-graph-001-a.inc", "<?php\nclass Child extends Base implements Named {\n\tfunction make() { return new Helper; }\n}\n");
+file_put_contents("$dir/class-graph-001-b.inc", "<?php\ninterface Named {}\nclass Base { function name() { return Child::NAME; } }\n");
+file_put_contents("$dir/class-graph-001-c.inc", "<?php\nclass Helper { function check(\$o) { return \$o instanceof Missing; } }\n");
+
+$graph = vld_class_graph(["$dir/class-graph-001-a.inc", "$dir/class-graph-001-b.inc", "$dir/class-graph-001-c.inc"]);
+
+foreach ($graph['classmap'] as $class => $file) {
+	echo $class, ' ', basename($file), "\n";
+}
+foreach ($graph['dependencies']['Child'] as $class => $kinds) {
+	echo "Child -> $class: ", implode(', ', $kinds), "\n";
+}
+echo "Helper -> ", implode(', ', array_keys($graph['dependencies']['Helper'])), "\n";
+echo json_encode($graph['order']), "\n";
+echo implode(' ', array_map('basename', $graph['files'])), "\n";
+var_dump(class_exists('Child', false), interface_exists('Named', false));
+?>
+--CLEAN--
+<?php
+foreach (['a', 'b', 'c'] as $f) {
+	@unlink(__DIR__ . "/class-graph-001-$f.inc");
+}
+?>
+--EXPECT--
+Child class-graph-001-a.inc
+Named class-graph-001-b.inc
+Base class-graph-001-b.inc
+Helper class-graph-001-c.inc
+Child -> Base: extends
+Child -> Named: implements
+Child -> Helper: new
+Helper -> Missing
+[["Named"],["Helper"],["Base","Child"]]
+class-graph-001-b.inc class-graph-001-c.inc class-graph-001-a.inc
+bool(false)
+bool(false)
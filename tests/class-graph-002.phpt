@@ -0,0 +1,26 @@
+--TEST--
+vld_class_graph() takes files that were included already
+--SKIPIF--
+<?php if (!extension_loaded("vld")) print "skip"; ?>
+--FILE--
+<?php
+$file = __DIR__ . '/class-graph-002.inc';
+file_put_contents($file, "<?php\nfunction polyfill() { return new Filled; }\nclass Filled extends ArrayObject {}\n");
+
+include $file;
+$graph = vld_class_graph([$file]);
+
+foreach ($graph['classmap'] as $class => $declared) {
+	echo $class, ' ', basename($declared), "\n";
+}
+echo "Filled -> ", implode(', ', array_keys($graph['dependencies']['Filled'])), "\n";
+echo get_class(polyfill()), "\n";
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/class-graph-002.inc');
+?>
+--EXPECT--
+Filled class-graph-002.inc
+Filled -> ArrayObject
+Filled
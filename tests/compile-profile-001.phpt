@@ -0,0 +1,26 @@
+--TEST--
+vld.compile_profile lists the compiled files with what they declared
+--INI--
+vld.compile_profile=1
+--FILE--
+<?php
+$file = __DIR__ . '/compile-profile-001.inc';
+file_put_contents($file, "<?php\nclass Included { function a() { return 1; } }\nfunction included() { return 2; }\n");
+include $file;
+echo "done\n";
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/compile-profile-001.inc');
+?>
+--EXPECTF--
+done
+%ACompiled files: 2 in %f ms
+ time (ms)     memory    ops functions classes  file
+-------------------------------------------------------
+%A%w1%w1  %scompile-profile-001.inc
+%A
+Include tree:
+%scompile-profile-001.php %f ms
+  %scompile-profile-001.inc %f ms, from %scompile-profile-001.php:4
+%A
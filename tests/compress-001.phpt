@@ -0,0 +1,58 @@
+--TEST--
+vld.compress=gzip writes a gzip member per request that decodes to the plain dump
+--SKIPIF--
+<?php
+if (!function_exists('proc_open')) { echo "skip proc_open required\n"; }
+if (!function_exists('gzdecode')) { echo "skip zlib required\n"; }
+ob_start();
+phpinfo(INFO_MODULES);
+if (strpos(ob_get_clean(), 'gzip output compression') === false) { echo "skip vld gzip output compression required\n"; }
+?>
+--FILE--
+<?php
+$tmp = sys_get_temp_dir() . '/vld-compress-001-' . getmypid();
+$script = __DIR__ . '/compress-001.inc';
+file_put_contents($script, "<?php\nfunction foo(\$a) {\n\treturn \$a + 1;\n}\nclass Bar { function baz() {} }\n");
+@unlink("$tmp.txt");
+@unlink("$tmp.txt.gz");
+
+function run_vld($script, $output, $settings)
+{
+	$php = getenv('TEST_PHP_EXECUTABLE') ?: PHP_BINARY;
+	$cmd = escapeshellarg($php) . ' -n'
+		. ' -d extension_dir=' . escapeshellarg(ini_get('extension_dir'))
+		. ' -d extension=vld.' . PHP_SHLIB_SUFFIX
+		. ' -d vld.active=1 -d vld.execute=0 ' . $settings
+		. ' -d vld.output=' . escapeshellarg($output)
+		. ' ' . escapeshellarg($script);
+	$child = proc_open($cmd, array(1 => array('pipe', 'w'), 2 => array('pipe', 'w')), $pipes);
+	stream_get_contents($pipes[1]);
+	echo stream_get_contents($pipes[2]);
+	proc_close($child);
+}
+
+run_vld($script, "$tmp.txt", '');
+$plain = file_get_contents("$tmp.txt");
+echo strpos($plain, 'Function foo:') !== false ? "plain dump\n" : "no plain dump\n";
+
+run_vld($script, "$tmp.txt.gz", '-d vld.compress=gzip');
+$compressed = file_get_contents("$tmp.txt.gz");
+echo substr($compressed, 0, 2) === "\x1f\x8b" ? "gzip magic\n" : "no gzip magic\n";
+var_dump(gzdecode($compressed) === $plain);
+
+/* A second request appends a member of its own */
+run_vld($script, "$tmp.txt.gz", '-d vld.compress=gzip -d vld.compress_level=9');
+var_dump(file_get_contents("compress.zlib://$tmp.txt.gz") === $plain . $plain);
+
+unlink("$tmp.txt");
+unlink("$tmp.txt.gz");
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/compress-001.inc');
+?>
+--EXPECT--
+plain dump
+gzip magic
+bool(true)
+bool(true)
@@ -0,0 +1,50 @@
+--TEST--
+vld.control_socket answers commands at the end of a request
+--SKIPIF--
+<?php
+if (substr(PHP_OS, 0, 3) == 'WIN') { echo "skip Unix domain sockets required\n"; }
+if (!function_exists('proc_open')) { echo "skip proc_open required\n"; }
+?>
+--FILE--
+<?php
+$socket = sys_get_temp_dir() . '/vld-control-001-' . getmypid() . '.sock';
+
+$php = getenv('TEST_PHP_EXECUTABLE') ?: PHP_BINARY;
+$cmd = escapeshellarg($php) . ' -n'
+	. ' -d extension_dir=' . escapeshellarg(ini_get('extension_dir'))
+	. ' -d extension=vld.' . PHP_SHLIB_SUFFIX
+	. ' -d vld.control_socket=' . escapeshellarg($socket)
+	. ' -r ' . escapeshellarg('function foo() { return 42; } class Bar { function baz() {} } sleep(2);');
+$child = proc_open($cmd, array(1 => array('pipe', 'w'), 2 => array('pipe', 'w')), $pipes);
+
+for ($i = 0; $i < 50 && !file_exists($socket); $i++) {
+	usleep(100000);
+}
+
+clearstatcache();
+printf("mode %o\n", fileperms($socket) & 0777);
+
+$clients = array();
+foreach (array("functions\n", "function foo\n", "class Bar\n", "function nope\n") as $command) {
+	$client = stream_socket_client("unix://$socket");
+	fwrite($client, $command);
+	$clients[] = $client;
+}
+foreach ($clients as $client) {
+	$answers[] = stream_get_contents($client);
+}
+proc_close($child);
+
+echo $answers[0];
+echo strpos($answers[1], 'function name:  foo') !== false ? "dump of foo\n" : "no dump of foo\n";
+echo strpos($answers[2], 'function name:  baz') !== false ? "dump of Bar\n" : "no dump of Bar\n";
+echo $answers[3];
+var_dump(file_exists($socket));
+?>
+--EXPECT--
+mode 600
+foo Command line code:1
+dump of foo
+dump of Bar
+error: user function 'nope' does not exist
+bool(false)
@@ -0,0 +1,33 @@
+--TEST--
+vld.count_executions counts how often each op ran
+--INI--
+vld.count_executions=1
+--FILE--
+<?php
+function foo($n)
+{
+	$s = 0;
+	for ($i = 0; $i < $n; $i++) {
+		$s += $i;
+	}
+	return $s;
+}
+
+foo(10);
+foo(5);
+
+foreach (vld_dump_function('foo')['opcodes'] as $op) {
+	if (in_array($op['name'], array('RECV', 'ASSIGN_OP', 'ASSIGN_ADD', 'RETURN'))) {
+		echo $op['name'], ' ', $op['hits'], "\n";
+	}
+}
+?>
+--EXPECTF--
+RECV 2
+ASSIGN_%s 15
+RETURN 2
+RETURN 0
+%AFunction foo:
+%A      hits line%A
+End of function foo
+%A
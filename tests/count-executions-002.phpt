@@ -0,0 +1,25 @@
+--TEST--
+vld.count_executions with vld.format=1 separates the hits from the other columns
+--INI--
+vld.count_executions=1
+vld.format=1
+vld.col_sep=|
+--FILE--
+<?php
+function foo($n)
+{
+	return $n;
+}
+
+foo(1);
+foo(2);
+echo "done\n";
+?>
+--EXPECTF--
+done
+%AFunction foo:
+%Ahits|line|# *|%s
+%w2 |%w2%w0 |%sRECV%s
+%w2 |%w4%w1 |%sRETURN%s
+%AEnd of function foo
+%A
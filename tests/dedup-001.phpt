@@ -0,0 +1,36 @@
+--TEST--
+Op arrays that were already dumped are only referenced
+--INI--
+vld.active=1
+vld.dedup=1
+vld.verbosity=0
+vld.dump_paths=0
+--SKIPIF--
+<?php if (PHP_VERSION_ID < 70000) { echo "skip PHP 7 required\n"; } ?>
+--FILE--
+<?php
+function foo()
+{
+	return 42;
+}
+
+eval('$a = foo();');
+echo $a, "\n";
+?>
+--EXPECTF--
+Function foo:
+filename:       %sdedup-001.php
+function name:  foo
+number of ops:  %d
+%A
+End of function foo
+
+%A
+Function foo:
+filename:       %sdedup-001.php
+function name:  foo
+already dumped: lines 2-5, see above
+
+End of function foo
+%A
+42
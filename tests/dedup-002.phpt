@@ -0,0 +1,25 @@
+--TEST--
+Op arrays that only differ in their literals are both dumped
+--INI--
+vld.active=1
+vld.dedup=1
+vld.verbosity=0
+vld.dump_paths=0
+--SKIPIF--
+<?php if (PHP_VERSION_ID < 70000) { echo "skip PHP 7 required\n"; } ?>
+--FILE--
+<?php
+$a = function () { return 'first'; }; $b = function () { return 'second'; };
+echo $a(), ' ', $b(), "\n";
+?>
+--EXPECTF--
+%A
+function name:  {closure}
+number of ops:  %d
+%A'first'
+%A
+function name:  {closure}
+number of ops:  %d
+%A'second'
+%A
+first second
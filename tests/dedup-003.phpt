@@ -0,0 +1,32 @@
+--TEST--
+Op arrays that only differ in their operands, or deep inside an array literal, are all dumped
+--INI--
+vld.active=1
+vld.dedup=1
+vld.verbosity=0
+vld.dump_paths=0
+--SKIPIF--
+<?php if (PHP_VERSION_ID < 70400) { echo "skip PHP 7.4 required\n"; } ?>
+--FILE--
+<?php
+$a = fn($a, $b) => $a - $b; $b = fn($a, $b) => $b - $a;
+$c = function () { return [1, [2, 3]]; }; $d = function () { return [1, [2, 4]]; };
+echo $a(3, 1), ' ', $b(3, 1), ' ', json_encode($c()), ' ', json_encode($d()), "\n";
+?>
+--EXPECTF--
+%A
+function name:  {closure}
+number of ops:  %d
+%ASUB %s!0, !1
+%A
+function name:  {closure}
+number of ops:  %d
+%ASUB %s!1, !0
+%A
+function name:  {closure}
+number of ops:  %d
+%A
+function name:  {closure}
+number of ops:  %d
+%A
+2 -2 [1,[2,3]] [1,[2,4]]
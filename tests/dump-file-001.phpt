@@ -0,0 +1,39 @@
+--TEST--
+vld_dump_file() leaves no declarations behind, and dumps files that were included already
+--SKIPIF--
+<?php if (!extension_loaded("vld")) print "skip"; ?>
+--FILE--
+<?php
+$fresh = __DIR__ . '/dump-file-001-fresh.inc';
+$included = __DIR__ . '/dump-file-001-included.inc';
+file_put_contents($fresh, "<?php\nfunction fresh_function() { return 'fresh'; }\nclass FreshClass { function run() {} }\n");
+file_put_contents($included, "<?php\nfunction included_function() { return 'included'; }\nclass IncludedClass {}\n");
+
+foreach (array(1, 2) as $run) {
+	$r = vld_dump_file($fresh);
+	echo "fresh $run: ", implode(', ', array_keys($r['functions'])), '; ', implode(', ', array_keys($r['classes'])), "\n";
+}
+var_dump(function_exists('fresh_function'), class_exists('FreshClass', false));
+include $fresh;
+echo fresh_function(), "\n";
+
+include $included;
+$r = vld_dump_file($included);
+echo "included: ", implode(', ', array_keys($r['functions'])), '; ', implode(', ', array_keys($r['classes'])), "\n";
+echo included_function(), "\n";
+var_dump(class_exists('IncludedClass', false));
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/dump-file-001-fresh.inc');
+@unlink(__DIR__ . '/dump-file-001-included.inc');
+?>
+--EXPECT--
+fresh 1: fresh_function; FreshClass
+fresh 2: fresh_function; FreshClass
+bool(false)
+bool(false)
+fresh
+included: included_function; IncludedClass
+included
+bool(true)
@@ -0,0 +1,30 @@
+--TEST--
+vld_dump_function() returns an op array as a PHP array
+--SKIPIF--
+<?php if (!extension_loaded("vld")) print "skip"; ?>
+--FILE--
+<?php
+function foo($a)
+{
+	if ($a > 1) {
+		return $a + 1;
+	}
+	return 0;
+}
+
+$r = vld_dump_function('foo');
+var_dump($r['function_name'], $r['num_ops'] === count($r['opcodes']), $r['compiled_vars']);
+echo $r['opcodes'][0]['name'], ' ', $r['opcodes'][0]['result']['type'], ' ', $r['opcodes'][0]['result']['name'], "\n";
+var_dump(count($r['paths']));
+var_dump(@vld_dump_function('does_not_exist'));
+?>
+--EXPECT--
+string(3) "foo"
+bool(true)
+array(1) {
+  [0]=>
+  string(1) "a"
+}
+RECV CV a
+int(2)
+bool(false)
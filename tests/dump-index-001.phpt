@@ -0,0 +1,58 @@
+--TEST--
+vld.output_index appends a sorted segment to the index for every request
+--SKIPIF--
+<?php
+if (!function_exists('proc_open')) { echo "skip proc_open required\n"; }
+if (PHP_INT_SIZE < 8) { echo "skip 64-bit only\n"; }
+?>
+--FILE--
+<?php
+$dump = sys_get_temp_dir() . '/vld-dump-index-001-' . getmypid() . '.txt';
+$script = __DIR__ . '/dump-index-001.inc';
+file_put_contents($script, "<?php\nfunction foo() {}\nclass Bar { function baz() {} }\n");
+@unlink($dump);
+@unlink("$dump.idx");
+
+$php = getenv('TEST_PHP_EXECUTABLE') ?: PHP_BINARY;
+$cmd = escapeshellarg($php) . ' -n'
+	. ' -d extension_dir=' . escapeshellarg(ini_get('extension_dir'))
+	. ' -d extension=vld.' . PHP_SHLIB_SUFFIX
+	. ' -d vld.active=1 -d vld.execute=0'
+	. ' -d vld.output=' . escapeshellarg($dump)
+	. ' ' . escapeshellarg($script);
+for ($i = 0; $i < 2; $i++) {
+	$child = proc_open($cmd, array(1 => array('pipe', 'w'), 2 => array('pipe', 'w')), $pipes);
+	stream_get_contents($pipes[1]);
+	echo stream_get_contents($pipes[2]);
+	proc_close($child);
+}
+
+$text = file_get_contents($dump);
+$index = file_get_contents("$dump.idx");
+for ($start = 0, $segment = 1; $start < strlen($index); $start += $header['blob_offset'] + $header['blob_size'], $segment++) {
+	$header = unpack('a4magic/Vversion/Vcount/Ventry_size/Pblob_offset/Pblob_size', substr($index, $start, 32));
+	echo "segment $segment: {$header['magic']} version {$header['version']}, {$header['count']} entries\n";
+	$blob = substr($index, $start + $header['blob_offset'], $header['blob_size']);
+	for ($i = 0; $i < $header['count']; $i++) {
+		$entry = unpack('Vkey/Vkey_len/Vfile/Vfile_len/Poffset/Plength', substr($index, $start + 32 + $i * $header['entry_size'], 32));
+		$part = substr($text, $entry['offset'], $entry['length']);
+		echo "\t", substr($blob, $entry['key'], $entry['key_len']), ': ';
+		echo preg_match('/^filename:\s+(\S+)\nfunction name:\s+(\S*)\n/', $part, $m) ? basename($m[1]) . ' ' . $m[2] : 'not the start of a dump', "\n";
+	}
+}
+unlink($dump);
+unlink("$dump.idx");
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/dump-index-001.inc');
+?>
+--EXPECT--
+segment 1: VLDX version 2, 3 entries
+	bar::baz: dump-index-001.inc baz
+	foo: dump-index-001.inc foo
+	{main}: dump-index-001.inc (null)
+segment 2: VLDX version 2, 3 entries
+	bar::baz: dump-index-001.inc baz
+	foo: dump-index-001.inc foo
+	{main}: dump-index-001.inc (null)
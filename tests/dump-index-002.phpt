@@ -0,0 +1,60 @@
+--TEST--
+tools/vld_lookup shows dumps from every request in the index
+--SKIPIF--
+<?php
+if (substr(PHP_OS, 0, 3) == 'WIN') { echo "skip Not available on Windows\n"; }
+if (!function_exists('proc_open')) { echo "skip proc_open required\n"; }
+if (!trim((string) shell_exec('command -v cc'))) { echo "skip cc required\n"; }
+?>
+--FILE--
+<?php
+$tmp = sys_get_temp_dir() . '/vld-dump-index-002-' . getmypid();
+$lookup = "$tmp.lookup";
+$dump = "$tmp.txt";
+$script = __DIR__ . '/dump-index-002.inc';
+file_put_contents($script, "<?php\nfunction foo() {}\nclass Bar { function baz() {} }\n");
+@unlink($dump);
+@unlink("$dump.idx");
+
+exec('cc -O2 -o ' . escapeshellarg($lookup) . ' ' . escapeshellarg(__DIR__ . '/../tools/vld_lookup.c'), $output, $status);
+echo "build: $status\n";
+
+$php = getenv('TEST_PHP_EXECUTABLE') ?: PHP_BINARY;
+$cmd = escapeshellarg($php) . ' -n'
+	. ' -d extension_dir=' . escapeshellarg(ini_get('extension_dir'))
+	. ' -d extension=vld.' . PHP_SHLIB_SUFFIX
+	. ' -d vld.active=1 -d vld.execute=0'
+	. ' -d vld.output=' . escapeshellarg($dump)
+	. ' ' . escapeshellarg($script);
+for ($i = 0; $i < 2; $i++) {
+	$child = proc_open($cmd, array(1 => array('pipe', 'w'), 2 => array('pipe', 'w')), $pipes);
+	stream_get_contents($pipes[1]);
+	echo stream_get_contents($pipes[2]);
+	proc_close($child);
+}
+
+$shown = shell_exec(escapeshellarg($lookup) . ' ' . escapeshellarg($dump) . ' BAR::baz');
+echo preg_match_all('/^function name:\s+baz$/m', $shown), " dumps of Bar::baz\n";
+echo strpos($shown, 'function name:  foo') === false ? "no dump of foo\n" : "dump of foo\n";
+
+$listed = shell_exec(escapeshellarg($lookup) . ' -l ' . escapeshellarg($dump) . ' foo ' . escapeshellarg($script));
+echo count(explode("\n", trim($listed))), " listed for foo\n";
+
+passthru(escapeshellarg($lookup) . ' ' . escapeshellarg($dump) . ' nope 2>&1', $status);
+echo "exit: $status\n";
+
+unlink($lookup);
+unlink($dump);
+unlink("$dump.idx");
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/dump-index-002.inc');
+?>
+--EXPECTF--
+build: 0
+2 dumps of Bar::baz
+no dump of foo
+2 listed for foo
+%s: no dump found for 'nope'
+exit: 1
@@ -0,0 +1,66 @@
+--TEST--
+vld.output_index points at the right dumps when workers write to one file at once, and vld_lookup -c merges the segments
+--SKIPIF--
+<?php
+if (substr(PHP_OS, 0, 3) == 'WIN') { echo "skip Not available on Windows\n"; }
+if (!function_exists('proc_open')) { echo "skip proc_open required\n"; }
+if (!trim((string) shell_exec('command -v cc'))) { echo "skip cc required\n"; }
+?>
+--FILE--
+<?php
+$tmp = sys_get_temp_dir() . '/vld-dump-index-003-' . getmypid();
+$lookup = "$tmp.lookup";
+$dump = "$tmp.txt";
+$script = __DIR__ . '/dump-index-003.inc';
+$code = "<?php\n";
+for ($i = 0; $i < 400; $i++) {
+	$code .= "function f_$i(\$a) { return \$a * $i + strlen('padding for function $i'); }\n";
+}
+file_put_contents($script, $code);
+@unlink($dump);
+@unlink("$dump.idx");
+
+exec('cc -O2 -o ' . escapeshellarg($lookup) . ' ' . escapeshellarg(__DIR__ . '/../tools/vld_lookup.c'), $output, $status);
+echo "build: $status\n";
+
+$php = getenv('TEST_PHP_EXECUTABLE') ?: PHP_BINARY;
+$cmd = escapeshellarg($php) . ' -n'
+	. ' -d extension_dir=' . escapeshellarg(ini_get('extension_dir'))
+	. ' -d extension=vld.' . PHP_SHLIB_SUFFIX
+	. ' -d vld.active=1 -d vld.execute=0'
+	. ' -d vld.output=' . escapeshellarg($dump)
+	. ' ' . escapeshellarg($script);
+$children = array();
+for ($i = 0; $i < 2; $i++) {
+	$children[$i] = proc_open($cmd, array(1 => array('pipe', 'w'), 2 => array('pipe', 'w')), $pipes[$i]);
+}
+for ($i = 0; $i < 2; $i++) {
+	stream_get_contents($pipes[$i][1]);
+	echo stream_get_contents($pipes[$i][2]);
+	proc_close($children[$i]);
+}
+
+echo preg_match('/: merged 2 segments with \d+ entries$/', trim(shell_exec(escapeshellarg($lookup) . ' -c ' . escapeshellarg($dump)))) ? "merged\n" : "not merged\n";
+
+$wrong = 0;
+foreach (array(0, 123, 250, 399) as $i) {
+	$shown = shell_exec(escapeshellarg($lookup) . ' ' . escapeshellarg($dump) . " f_$i");
+	preg_match_all('/^function name:\s+(\S+)$/m', $shown, $m);
+	if ($m[1] !== array("f_$i", "f_$i")) {
+		$wrong++;
+	}
+}
+echo "$wrong wrong dumps\n";
+
+unlink($lookup);
+unlink($dump);
+unlink("$dump.idx");
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/dump-index-003.inc');
+?>
+--EXPECT--
+build: 0
+merged
+0 wrong dumps
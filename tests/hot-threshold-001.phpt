@@ -0,0 +1,28 @@
+--TEST--
+vld.hot_threshold dumps a function once it has been called often enough
+--INI--
+vld.hot_threshold=3
+--FILE--
+<?php
+function hot($a)
+{
+	return $a + 1;
+}
+
+function cold($a)
+{
+	return $a - 1;
+}
+
+for ($i = 0; $i < 10; $i++) {
+	hot($i);
+}
+cold(1);
+echo "done\n";
+?>
+--EXPECTF--
+Function hot (hot after 3 calls):
+%Afunction name:  hot
+%AEnd of function hot
+
+done
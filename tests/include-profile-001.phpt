@@ -0,0 +1,28 @@
+--TEST--
+vld.include_profile times the includes of each include op
+--INI--
+vld.include_profile=1
+--FILE--
+<?php
+$file = __DIR__ . '/include-profile-001.inc';
+file_put_contents($file, "<?php\nreturn 42;\n");
+for ($i = 0; $i < 2; $i++) {
+	echo include $file, "\n";
+}
+require_once $file;
+echo "done\n";
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/include-profile-001.inc');
+?>
+--EXPECTF--
+42
+42
+done
+%AIncludes: 3 in %f ms, %f ms resolving, %f ms compiling
+     count   resolve (ms)   compile (ms)  line      # type          function, file -> included file
+-----------------------------------------------------------------------------------------------------
+%A         2 %w%f %w%f     5 %w%d INCLUDE       {main}, %sinclude-profile-001.php -> %sinclude-profile-001.inc
+%A         1 %w%f %w%f     7 %w%d REQUIRE_ONCE  {main}, %sinclude-profile-001.php -> %s
+%A
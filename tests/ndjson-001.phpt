@@ -0,0 +1,23 @@
+--TEST--
+vld.output_format=ndjson writes one JSON object per line
+--INI--
+vld.active=1
+vld.output_format=ndjson
+--SKIPIF--
+<?php if (PHP_VERSION_ID < 70100) { echo "skip PHP 7.1 required\n"; } ?>
+--FILE--
+<?php
+function foo($a)
+{
+	return $a;
+}
+echo "done\n";
+?>
+--EXPECTF--
+done
+{"type":"function","pid":%d,"fid":%d,"file":"%sndjson-001.php","class":null,"function":"foo","line_start":2,"line_end":5,"num_ops":%d,"compiled_vars":["a"]}
+{"type":"op","pid":%d,"fid":%d,"nr":0,"line":2,"opcode":%d,"name":"RECV",%s,"result":{"type":"CV","value":0,"name":"a"}}
+{"type":"op","pid":%d,"fid":%d,"nr":1,"line":4,"opcode":%d,"name":"RETURN",%s,"op1":{"type":"CV","value":0,"name":"a"}}
+%A{"type":"branch","pid":%d,"fid":%d,"branch":0,"line_start":2,"line_end":4,"op_start":0,"op_end":1,"outs":[-2]}
+%A{"type":"path","pid":%d,"fid":%d,"path":1,"branches":[0]}
+%A
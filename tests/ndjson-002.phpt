@@ -0,0 +1,20 @@
+--TEST--
+vld.output_format=ndjson escapes bytes of string literals that are not valid UTF-8
+--INI--
+vld.active=1
+vld.output_format=ndjson
+--SKIPIF--
+<?php if (PHP_VERSION_ID < 70100) { echo "skip PHP 7.1 required\n"; } ?>
+--FILE--
+<?php
+function foo()
+{
+	return "caf\xc3\xa9 \xff\xc3 \xed\xa0\x80";
+}
+echo "done\n";
+?>
+--EXPECTF--
+done
+{"type":"function",%s"function":"foo",%s}
+{"type":"op",%s"name":"RETURN",%s"op1":{"type":"CONST","literal":%d,"value":"café \u00ff\u00c3 \u00ed\u00a0\u0080"}}
+%A
@@ -0,0 +1,25 @@
+--TEST--
+vld.path_profile counts paths that loop back to op 0 once per iteration
+--INI--
+vld.path_profile=1
+--FILE--
+<?php
+$n = 0;
+
+function spin()
+{
+	do {
+		$GLOBALS['n']++;
+	} while ($GLOBALS['n'] % 3);
+}
+
+spin();
+echo $n, "\n";
+?>
+--EXPECTF--
+3
+%AFunction spin:
+%Apath profile: 2 of %d paths ran
+%Apath id %d: 0, ran 2 times; loops back to 0
+%AEnd of function spin
+%A
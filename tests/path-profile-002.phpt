@@ -0,0 +1,23 @@
+--TEST--
+vld.path_profile starts the path of a call that skipped its RECV ops at op 0
+--INI--
+vld.path_profile=1
+--FILE--
+<?php
+function countdown($n)
+{
+	do {
+		$n--;
+	} while ($n > 0);
+}
+
+countdown(3);
+echo "done\n";
+?>
+--EXPECTF--
+done
+%AFunction countdown:
+%Apath profile: 3 of %d paths ran
+%Apath id %d: 0, %d, ran 1 times; loops back to %d
+%AEnd of function countdown
+%A
@@ -0,0 +1,50 @@
+--TEST--
+vld.preload_script writes dependencies first, and vld.preload_files counts them
+--SKIPIF--
+<?php
+if (!function_exists('proc_open')) { echo "skip proc_open required\n"; }
+?>
+--FILE--
+<?php
+$dir = __DIR__ . '/preload-001';
+@mkdir($dir);
+file_put_contents("$dir/base.inc", "<?php\nclass Base {}\n");
+file_put_contents("$dir/child.inc", "<?php\nclass Child extends Base {}\n");
+file_put_contents("$dir/helpers.inc", "<?php\nfunction helper() {}\n");
+file_put_contents("$dir/main.inc", "<?php\nrequire '$dir/base.inc';\nrequire '$dir/child.inc';\nrequire '$dir/helpers.inc';\n");
+
+$php = getenv('TEST_PHP_EXECUTABLE') ?: PHP_BINARY;
+foreach (array(0, 1) as $limit) {
+	$cmd = escapeshellarg($php) . ' -n'
+		. ' -d extension_dir=' . escapeshellarg(ini_get('extension_dir'))
+		. ' -d extension=vld.' . PHP_SHLIB_SUFFIX
+		. ' -d vld.preload_script=' . escapeshellarg("$dir/preload.php")
+		. ' -d vld.preload_files=' . $limit
+		. ' ' . escapeshellarg("$dir/main.inc");
+	$child = proc_open($cmd, array(1 => array('pipe', 'w'), 2 => array('pipe', 'w')), $pipes);
+	stream_get_contents($pipes[1]);
+	echo stream_get_contents($pipes[2]);
+	proc_close($child);
+
+	preg_match_all("@opcache_compile_file\\('.*[^a-z]([a-z]+)\\.inc'\\)@", file_get_contents("$dir/preload.php"), $m);
+	echo "vld.preload_files=$limit: ", count($m[1]), " files\n";
+	$order = array_flip($m[1]);
+	if (isset($order['child'])) {
+		echo isset($order['base']) && $order['base'] < $order['child'] ? "base before child\n" : "child without base\n";
+	}
+}
+echo glob("$dir/*.tmp") ? "temporary files left\n" : "no temporary files left\n";
+?>
+--CLEAN--
+<?php
+$dir = __DIR__ . '/preload-001';
+foreach (glob("$dir/*") as $file) {
+	unlink($file);
+}
+@rmdir($dir);
+?>
+--EXPECT--
+vld.preload_files=0: 3 files
+base before child
+vld.preload_files=1: 1 files
+no temporary files left
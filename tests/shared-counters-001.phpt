@@ -0,0 +1,58 @@
+--TEST--
+vld.shared_counters keeps apart the methods of anonymous classes in one file
+--SKIPIF--
+<?php
+if (substr(PHP_OS, 0, 3) == 'WIN') { echo "skip Not available on Windows\n"; }
+if (!function_exists('proc_open')) { echo "skip proc_open required\n"; }
+?>
+--FILE--
+<?php
+$counters = sys_get_temp_dir() . '/vld-shared-counters-001-' . getmypid() . '.counters';
+$script = __DIR__ . '/shared-counters-001.inc';
+
+file_put_contents($script, <<<'CODE'
+<?php
+$a = new class {
+	function run() { return 1; }
+};
+$b = new class {
+	function run() { return 2; }
+};
+$a->run();
+$b->run();
+$b->run();
+CODE
+);
+
+$php = getenv('TEST_PHP_EXECUTABLE') ?: PHP_BINARY;
+$cmd = escapeshellarg($php) . ' -n'
+	. ' -d extension_dir=' . escapeshellarg(ini_get('extension_dir'))
+	. ' -d extension=vld.' . PHP_SHLIB_SUFFIX
+	. ' -d vld.shared_counters=' . escapeshellarg($counters)
+	. ' ' . escapeshellarg($script);
+$child = proc_open($cmd, array(1 => array('pipe', 'w'), 2 => array('pipe', 'w')), $pipes);
+stream_get_contents($pipes[1]);
+echo stream_get_contents($pipes[2]);
+echo "exit: ", proc_close($child), "\n";
+
+$runs = array();
+foreach (vld_counters_snapshot($counters) as $entry) {
+	if ($entry['function'] != '{main}' && $entry['op'] == 0) {
+		$runs[$entry['function'] . ' from line ' . $entry['line_start']] = $entry['count'];
+	}
+}
+unlink($counters);
+
+ksort($runs);
+foreach ($runs as $function => $count) {
+	echo "$function: $count\n";
+}
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/shared-counters-001.inc');
+?>
+--EXPECT--
+exit: 0
+class@anonymous::run from line 3: 1
+class@anonymous::run from line 6: 2
@@ -0,0 +1,54 @@
+--TEST--
+vld.shared_counters and vld.count_executions get the closures that only their declaring function knows about
+--SKIPIF--
+<?php
+if (PHP_VERSION_ID < 80100) { echo "skip PHP 8.1 required\n"; }
+if (substr(PHP_OS, 0, 3) == 'WIN') { echo "skip Not available on Windows\n"; }
+if (!function_exists('proc_open')) { echo "skip proc_open required\n"; }
+?>
+--FILE--
+<?php
+$counters = sys_get_temp_dir() . '/vld-shared-counters-002-' . getmypid() . '.counters';
+$script = __DIR__ . '/shared-counters-002.inc';
+
+file_put_contents($script, <<<'CODE'
+<?php
+function outer()
+{
+	$double = function ($x) { return $x * 2; };
+	return $double(1) + $double(2) + $double(3);
+}
+echo outer(), "\n";
+CODE
+);
+
+$php = getenv('TEST_PHP_EXECUTABLE') ?: PHP_BINARY;
+$cmd = escapeshellarg($php) . ' -n'
+	. ' -d extension_dir=' . escapeshellarg(ini_get('extension_dir'))
+	. ' -d extension=vld.' . PHP_SHLIB_SUFFIX
+	. ' -d vld.count_executions=1'
+	. ' -d vld.shared_counters=' . escapeshellarg($counters)
+	. ' ' . escapeshellarg($script);
+$child = proc_open($cmd, array(1 => array('pipe', 'w'), 2 => array('pipe', 'w')), $pipes);
+echo stream_get_contents($pipes[1]);
+$dump = stream_get_contents($pipes[2]);
+echo "exit: ", proc_close($child), "\n";
+
+echo preg_match('/Dynamic Function 0\n.*?function name:\s+\{closure\}.*?\n\s+3 .*?RETURN.*?End of Dynamic Function 0/s', $dump) ? "closure dumped with its hits\n" : "closure not dumped\n";
+
+foreach (vld_counters_snapshot($counters) as $entry) {
+	if ($entry['function'] == '{closure}' && $entry['op'] == 0) {
+		echo "{closure}: ", $entry['count'], "\n";
+	}
+}
+unlink($counters);
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/shared-counters-002.inc');
+?>
+--EXPECT--
+12
+exit: 0
+closure dumped with its hits
+{closure}: 3
@@ -0,0 +1,61 @@
+--TEST--
+vld.output_format=sqlite stores the dump of every request whole
+--SKIPIF--
+<?php
+if (!function_exists('proc_open')) { echo "skip proc_open required\n"; }
+if (!class_exists('SQLite3')) { echo "skip SQLite3 required\n"; }
+ob_start();
+phpinfo(INFO_MODULES);
+if (strpos(ob_get_clean(), 'SQLite output format') === false) { echo "skip vld SQLite output format required\n"; }
+?>
+--FILE--
+<?php
+$db = sys_get_temp_dir() . '/vld-sqlite-001-' . getmypid() . '.sqlite';
+$script = __DIR__ . '/sqlite-001.inc';
+file_put_contents($script, "<?php\nfunction foo(\$a) {\n\treturn \$a + 1;\n}\nclass Bar { function baz() {} }\n");
+
+$php = getenv('TEST_PHP_EXECUTABLE') ?: PHP_BINARY;
+$cmd = escapeshellarg($php) . ' -n'
+	. ' -d extension_dir=' . escapeshellarg(ini_get('extension_dir'))
+	. ' -d extension=vld.' . PHP_SHLIB_SUFFIX
+	. ' -d vld.active=1 -d vld.execute=0 -d vld.output_format=sqlite'
+	. ' -d vld.output=' . escapeshellarg($db)
+	. ' ' . escapeshellarg($script);
+
+/* Two requests at the same time, which both have to end up whole */
+$children = array();
+for ($i = 0; $i < 2; $i++) {
+	$children[] = proc_open($cmd, array(1 => array('pipe', 'w'), 2 => array('pipe', 'w')), $pipes[$i]);
+}
+foreach ($children as $i => $child) {
+	stream_get_contents($pipes[$i][1]);
+	echo stream_get_contents($pipes[$i][2]);
+	proc_close($child);
+}
+
+$sqlite = new SQLite3($db);
+echo $sqlite->querySingle('SELECT COUNT(*) FROM files'), " file\n";
+$result = $sqlite->query('SELECT f.class, f.name, COUNT(o.nr) AS ops FROM functions f LEFT JOIN opcodes o ON o.function_id = f.id GROUP BY f.id ORDER BY f.class, f.name, f.id');
+while ($row = $result->fetchArray(SQLITE3_ASSOC)) {
+	echo $row['class'] ? "{$row['class']}::" : '', $row['name'] ?: '{main}', ": ", $row['ops'] ? 'ops' : 'no ops', "\n";
+}
+echo $sqlite->querySingle("SELECT COUNT(*) FROM operands p JOIN functions f ON f.id = p.function_id WHERE f.name = 'foo' AND p.type = 'CV' AND p.name = 'a'"), " uses of \$a\n";
+$sqlite->close();
+
+foreach (array('', '-wal', '-shm') as $suffix) {
+	@unlink($db . $suffix);
+}
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/sqlite-001.inc');
+?>
+--EXPECT--
+1 file
+{main}: ops
+{main}: ops
+foo: ops
+foo: ops
+Bar::baz: ops
+Bar::baz: ops
+4 uses of $a
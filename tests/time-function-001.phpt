@@ -0,0 +1,31 @@
+--TEST--
+vld.time_function only times the function that it names
+--INI--
+vld.time_function=foo
+--FILE--
+<?php
+function foo($a)
+{
+	return $a + 1;
+}
+
+class Bar
+{
+	function foo($a)
+	{
+		return $a - 1;
+	}
+}
+
+$bar = new Bar;
+for ($i = 0; $i < 10; $i++) {
+	foo($i);
+	$bar->foo($i);
+}
+echo "done\n";
+?>
+--EXPECTF--
+done
+Function foo:
+%A      mean        p99 line%A
+End of function foo
@@ -0,0 +1,35 @@
+--TEST--
+vld.type_profile records the operand types of each op
+--INI--
+vld.type_profile=1
+--FILE--
+<?php
+function add($a, $b)
+{
+	return $a + $b;
+}
+
+function half($a)
+{
+	return $a / 2;
+}
+
+echo add(1, 2), "\n";
+echo add(1.5, 2), "\n";
+echo half(4), "\n";
+?>
+--EXPECTF--
+3
+3.5
+2
+%AFunction add:
+%AADD%s; op1: long|double, op2: long, result: long|double
+%Atype unstable: 1 of 1 arithmetic ops, 0 of 0 comparisons; ops 2
+
+End of function add
+%AFunction half:
+%ADIV%s; op1: long, op2: long, result: long
+%Atype unstable: 0 of 1 arithmetic ops, 0 of 0 comparisons
+
+End of function half
+%A
@@ -0,0 +1,23 @@
+--TEST--
+vld.type_profile leaves out results that ops do not always write
+--INI--
+vld.type_profile=1
+--SKIPIF--
+<?php if (PHP_VERSION_ID < 70000) { echo "skip PHP 7 required\n"; } ?>
+--FILE--
+<?php
+function fallback($a)
+{
+	return $a ?? 5;
+}
+
+echo fallback(null), "\n";
+echo fallback(3), "\n";
+?>
+--EXPECTF--
+5
+3
+%AFunction fallback:
+%ACOALESCE%s; op1: null|long
+%AEnd of function fallback
+%A
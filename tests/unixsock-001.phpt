@@ -0,0 +1,50 @@
+--TEST--
+vld.output=unix:// streams framed dumps to a listening socket
+--SKIPIF--
+<?php
+if (substr(PHP_OS, 0, 3) == 'WIN') { echo "skip Unix domain sockets required\n"; }
+if (!function_exists('proc_open')) { echo "skip proc_open required\n"; }
+?>
+--FILE--
+<?php
+$socket = sys_get_temp_dir() . '/vld-unixsock-001-' . getmypid() . '.sock';
+@unlink($socket);
+$server = stream_socket_server("unix://$socket", $errno, $errstr);
+
+$php = getenv('TEST_PHP_EXECUTABLE') ?: PHP_BINARY;
+$cmd = escapeshellarg($php) . ' -n'
+	. ' -d extension_dir=' . escapeshellarg(ini_get('extension_dir'))
+	. ' -d extension=vld.' . PHP_SHLIB_SUFFIX
+	. ' -d vld.active=1 -d vld.execute=0'
+	. ' -d vld.output=' . escapeshellarg("unix://$socket")
+	. ' -r ' . escapeshellarg('function foo() { return 42; }');
+$child = proc_open($cmd, array(1 => array('pipe', 'w'), 2 => array('pipe', 'w')), $pipes);
+
+$client = stream_socket_accept($server, 10);
+$data = stream_get_contents($client);
+proc_close($child);
+unlink($socket);
+
+$dump = '';
+for ($pos = 0; $pos < strlen($data); $pos += 5 + $frame['len']) {
+	$frame = unpack('Vlen/Ctype', substr($data, $pos, 5));
+	$payload = substr($data, $pos + 5, $frame['len']);
+	switch ($frame['type']) {
+		case 1:
+			echo "hello\n";
+			break;
+		case 2:
+			$dump .= $payload;
+			break;
+		case 3:
+			$dropped = unpack('Vframes', $payload);
+			echo "end, dropped: {$dropped['frames']}\n";
+			break;
+	}
+}
+echo strpos($dump, 'function name:  foo') !== false ? "dump of foo received\n" : "no dump\n";
+?>
+--EXPECT--
+hello
+end, dropped: 0
+dump of foo received
@@ -0,0 +1,62 @@
+--TEST--
+vld.output=unix:// drops frames that do not fit behind a partly sent frame
+--SKIPIF--
+<?php
+if (substr(PHP_OS, 0, 3) == 'WIN') { echo "skip Unix domain sockets required\n"; }
+if (!function_exists('proc_open')) { echo "skip proc_open required\n"; }
+?>
+--FILE--
+<?php
+$socket = sys_get_temp_dir() . '/vld-unixsock-002-' . getmypid() . '.sock';
+$script = __DIR__ . '/unixsock-002.inc';
+@unlink($socket);
+$server = stream_socket_server("unix://$socket", $errno, $errstr);
+
+/* A dump of many megabytes, which the socket takes only part of, as
+ * nothing reads from it until the request is over */
+$code = "<?php\n";
+for ($i = 0; $i < 1000; $i++) {
+	$code .= "function f$i(\$a) {\n" . str_repeat("\t\$a = \$a + $i * \$a - strlen('x$i');\n", 40) . "\treturn \$a;\n}\n";
+}
+file_put_contents($script, $code);
+
+$php = getenv('TEST_PHP_EXECUTABLE') ?: PHP_BINARY;
+$cmd = escapeshellarg($php) . ' -n'
+	. ' -d extension_dir=' . escapeshellarg(ini_get('extension_dir'))
+	. ' -d extension=vld.' . PHP_SHLIB_SUFFIX
+	. ' -d vld.active=1 -d vld.execute=0'
+	. ' -d vld.output=' . escapeshellarg("unix://$socket")
+	. ' ' . escapeshellarg($script);
+$child = proc_open($cmd, array(1 => array('pipe', 'w'), 2 => array('pipe', 'w')), $pipes);
+stream_get_contents($pipes[1]);
+stream_get_contents($pipes[2]);
+echo "exit: ", proc_close($child), "\n";
+
+$client = stream_socket_accept($server, 10);
+$data = stream_get_contents($client);
+unlink($socket);
+
+$types = array();
+$dropped = null;
+for ($pos = 0; $pos + 5 <= strlen($data); $pos += 5 + $frame['len']) {
+	$frame = unpack('Vlen/Ctype', substr($data, $pos, 5));
+	$types[] = $frame['type'];
+	if ($frame['type'] == 3) {
+		$dropped = unpack('Vframes', substr($data, $pos + 5, 8));
+	}
+}
+echo $pos == strlen($data) ? "frames intact\n" : "frames broken\n";
+echo $types[0] == 1 && end($types) == 3 ? "hello .. end\n" : "unexpected frames\n";
+echo count(array_diff($types, array(1, 2, 3))) == 0 ? "known types\n" : "unknown types\n";
+echo $dropped && $dropped['frames'] > 0 ? "frames dropped\n" : "nothing dropped\n";
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/unixsock-002.inc');
+?>
+--EXPECT--
+exit: 0
+frames intact
+hello .. end
+known types
+frames dropped
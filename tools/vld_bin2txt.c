@@ -0,0 +1,612 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+/* Converts dumps written with vld.output_format=binary back into the text
+ * format. Build with: cc -O2 -o vld_bin2txt tools/vld_bin2txt.c
+ *
+ * Usage: vld_bin2txt [-f function] dumpfile
+ *
+ * With -f only the matching functions are shown, found through the index at
+ * the end of each dump. The name is either "function" or "Class::method". */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+
+#define VLD_BINARY_NO_PHP
+#include "../binary.h"
+
+typedef struct _bin_string {
+	const char *str;
+	size_t      len;
+} bin_string;
+
+typedef struct _bin_reader {
+	const unsigned char *data;
+	size_t               size;
+	size_t               pos;
+	int                  error;
+} bin_reader;
+
+typedef struct _bin_index_entry {
+	uint64_t offset;
+	uint64_t file;
+	uint64_t class_name;
+	uint64_t function_name;
+} bin_index_entry;
+
+typedef struct _bin_dump {
+	const unsigned char *data;
+	size_t               size;
+	uint64_t             index_offset;
+	bin_string          *strings;
+	uint64_t             string_count;
+	bin_index_entry     *index;
+	uint64_t             index_count;
+} bin_dump;
+
+/* {{{ Decoding helpers */
+static int read_byte(bin_reader *r)
+{
+	if (r->pos >= r->size) {
+		r->error = 1;
+		return 0;
+	}
+	return r->data[r->pos++];
+}
+
+static uint64_t read_uint(bin_reader *r)
+{
+	uint64_t value = 0;
+	int      shift = 0;
+
+	while (r->pos < r->size && shift < 64) {
+		unsigned char c = r->data[r->pos++];
+
+		value |= (uint64_t) (c & 0x7f) << shift;
+		if (!(c & 0x80)) {
+			return value;
+		}
+		shift += 7;
+	}
+	r->error = 1;
+	return 0;
+}
+
+static int64_t read_int(bin_reader *r)
+{
+	uint64_t value = read_uint(r);
+
+	return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static uint64_t read_fixed64(const unsigned char *p)
+{
+	uint64_t value = 0;
+	int      i;
+
+	for (i = 7; i >= 0; i--) {
+		value = (value << 8) | p[i];
+	}
+	return value;
+}
+
+static double read_double(bin_reader *r)
+{
+	uint64_t bits;
+	double   value;
+
+	if (r->pos + 8 > r->size) {
+		r->error = 1;
+		return 0;
+	}
+	bits = read_fixed64(r->data + r->pos);
+	r->pos += 8;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static void skip_string(bin_reader *r)
+{
+	uint64_t len = read_uint(r);
+
+	if (r->pos + len > r->size) {
+		r->error = 1;
+		return;
+	}
+	r->pos += len;
+}
+
+static bin_string get_string(bin_dump *dump, uint64_t id)
+{
+	bin_string none = { "(null)", 6 };
+
+	if (id == 0 || id > dump->string_count) {
+		return none;
+	}
+	return dump->strings[id - 1];
+}
+
+static int print_string(bin_dump *dump, uint64_t id)
+{
+	bin_string s = get_string(dump, id);
+
+	return printf("%.*s", (int) s.len, s.str);
+}
+
+/* The same encoding as PHP's urlencode(), which the text dump uses for
+ * string literals */
+static int print_urlencoded(bin_dump *dump, uint64_t id)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	bin_string s = get_string(dump, id);
+	size_t     i;
+	int        len = 0;
+
+	for (i = 0; i < s.len; i++) {
+		unsigned char c = (unsigned char) s.str[i];
+
+		if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.') {
+			putchar(c);
+			len++;
+		} else if (c == ' ') {
+			putchar('+');
+			len++;
+		} else {
+			putchar('%');
+			putchar(hex[c >> 4]);
+			putchar(hex[c & 15]);
+			len += 3;
+		}
+	}
+	return len;
+}
+/* }}} */
+
+/* {{{ Loading a dump
+ * Reads the INDEX record, and through it the string table, so that strings
+ * can be resolved no matter where reading starts. */
+static int load_dump(bin_dump *dump, const unsigned char *data, size_t size)
+{
+	bin_reader r;
+	uint64_t   i, offset = 0;
+
+	memset(dump, 0, sizeof(*dump));
+	if (size < VLD_BIN_HEADER_SIZE + VLD_BIN_TRAILER_SIZE || memcmp(data, VLD_BIN_MAGIC, 4) != 0) {
+		return 0;
+	}
+	dump->data = data;
+	dump->size = size;
+	dump->index_offset = read_fixed64(data + size - VLD_BIN_TRAILER_SIZE);
+
+	r.data  = data;
+	r.size  = size - VLD_BIN_TRAILER_SIZE;
+	r.pos   = dump->index_offset;
+	r.error = 0;
+
+	if (read_byte(&r) != VLD_BIN_INDEX) {
+		return 0;
+	}
+
+	dump->index_count = read_uint(&r);
+	if (r.error || dump->index_count > r.size) {
+		return 0;
+	}
+	dump->index = calloc(dump->index_count + 1, sizeof(bin_index_entry));
+	for (i = 0; i < dump->index_count; i++) {
+		dump->index[i].offset        = read_uint(&r);
+		dump->index[i].file          = read_uint(&r);
+		dump->index[i].class_name    = read_uint(&r);
+		dump->index[i].function_name = read_uint(&r);
+	}
+
+	dump->string_count = read_uint(&r);
+	if (r.error || dump->string_count > r.size) {
+		return 0;
+	}
+	dump->strings = calloc(dump->string_count + 1, sizeof(bin_string));
+	for (i = 0; i < dump->string_count && !r.error; i++) {
+		bin_reader s;
+
+		offset += read_uint(&r);
+
+		s.data  = data;
+		s.size  = dump->index_offset;
+		s.pos   = offset;
+		s.error = 0;
+		if (read_byte(&s) != VLD_BIN_STRING) {
+			return 0;
+		}
+		dump->strings[i].len = read_uint(&s);
+		dump->strings[i].str = (const char *) data + s.pos;
+		if (s.error || s.pos + dump->strings[i].len > s.size) {
+			return 0;
+		}
+	}
+
+	return !r.error;
+}
+
+static void free_dump(bin_dump *dump)
+{
+	free(dump->strings);
+	free(dump->index);
+}
+/* }}} */
+
+/* {{{ Text output */
+static int print_operand(bin_dump *dump, bin_reader *r, int *print_sep)
+{
+	int      kind = read_byte(r);
+	int      len = 0;
+	double   dval;
+	uint64_t value;
+
+	if (kind == VLD_BIN_OPERAND_NONE) {
+		return 0;
+	}
+	if (print_sep) {
+		if (*print_sep) {
+			len += printf(", ");
+		}
+		*print_sep = 1;
+	}
+
+	switch (kind) {
+		case VLD_BIN_OPERAND_NULL:
+			len += printf("null");
+			break;
+		case VLD_BIN_OPERAND_FALSE:
+			len += printf("<false>");
+			break;
+		case VLD_BIN_OPERAND_TRUE:
+			len += printf("<true>");
+			break;
+		case VLD_BIN_OPERAND_LONG:
+			len += printf("%" PRId64, read_int(r));
+			break;
+		case VLD_BIN_OPERAND_DOUBLE:
+			dval = read_double(r);
+			len += printf("%g", dval);
+			break;
+		case VLD_BIN_OPERAND_STRING:
+			value = read_uint(r);
+			len += printf("'");
+			len += print_urlencoded(dump, value);
+			len += printf("'");
+			break;
+		case VLD_BIN_OPERAND_TEXT:
+		case VLD_BIN_OPERAND_INCLUDE:
+			len += print_string(dump, read_uint(r));
+			break;
+		case VLD_BIN_OPERAND_TMP_VAR:
+			len += printf("~%" PRIu64, read_uint(r));
+			break;
+		case VLD_BIN_OPERAND_VAR:
+			len += printf("$%" PRIu64, read_uint(r));
+			break;
+		case VLD_BIN_OPERAND_CV:
+			len += printf("!%" PRIu64, read_uint(r));
+			break;
+		case VLD_BIN_OPERAND_JMP:
+			len += printf("->%" PRId64, read_int(r));
+			break;
+		case VLD_BIN_OPERAND_INDEX:
+			len += printf("[%" PRIu64 "]", read_uint(r));
+			break;
+		default:
+			r->error = 1;
+			break;
+	}
+	return len;
+}
+
+static void print_op(bin_dump *dump, bin_reader *r)
+{
+	uint64_t nr, line, opcode, name, fetch, ext = 0;
+	int      flags, len, print_sep = 0;
+	char     opname[32];
+
+	nr     = read_uint(r);
+	line   = read_uint(r);
+	opcode = read_uint(r);
+	name   = read_uint(r);
+	fetch  = read_uint(r);
+	flags  = (int) read_uint(r);
+	if (flags & VLD_BIN_FLAG_EXT) {
+		ext = read_uint(r);
+	}
+
+	if (name) {
+		bin_string s = get_string(dump, name);
+
+		snprintf(opname, sizeof(opname), "%.*s", (int) s.len, s.str);
+	} else {
+		snprintf(opname, sizeof(opname), "<%03d>", (int) opcode);
+	}
+
+	printf("%5" PRIu64 " ", line);
+	printf("%5" PRIu64 "%c %c %c %c %-28s ", nr,
+		(flags & VLD_BIN_FLAG_REACHABLE) ? '-' : '*',
+		(flags & VLD_BIN_FLAG_ENTRY) ? 'E' : 'N',
+		(flags & VLD_BIN_FLAG_START) ? '>' : 'x',
+		(flags & VLD_BIN_FLAG_END) ? '>' : 'x',
+		opname);
+	len = print_string(dump, fetch);
+	printf("%*s ", 14 - len > 0 ? 14 - len : 0, "");
+
+	if (flags & VLD_BIN_FLAG_EXT_LAST) {
+		printf("last ");
+	} else if (flags & VLD_BIN_FLAG_EXT) {
+		printf("%3d  ", (int) ext);
+	} else {
+		printf("     ");
+	}
+
+	len = print_operand(dump, r, NULL);
+	if (len) {
+		printf("%*s", 8 - len, " ");
+	} else {
+		printf("        ");
+	}
+
+	print_operand(dump, r, &print_sep);
+	print_operand(dump, r, &print_sep);
+
+	if (flags & VLD_BIN_FLAG_EXT_JMP) {
+		printf(", ->%" PRId64, read_int(r));
+	}
+	printf("\n");
+}
+
+static void print_branch(bin_reader *r)
+{
+	uint64_t start, end_op, line_start, line_end, outs, j;
+
+	start      = read_uint(r);
+	end_op     = read_uint(r);
+	line_start = read_uint(r);
+	line_end   = read_uint(r);
+	outs       = read_uint(r);
+
+	printf("branch: #%3d; line: %5d-%5d; sop: %5d; eop: %5d", (int) start, (int) line_start, (int) line_end, (int) start, (int) end_op);
+	for (j = 0; j < outs && !r->error; j++) {
+		int64_t out = read_int(r);
+
+		if (out) {
+			printf("; out%d: %3d", (int) j, (int) out);
+		}
+	}
+	printf("\n");
+}
+
+static void print_path(bin_reader *r, int nr)
+{
+	uint64_t count, j;
+
+	count = read_uint(r);
+	printf("path #%d: ", nr);
+	for (j = 0; j < count && !r->error; j++) {
+		printf("%d, ", (int) read_uint(r));
+	}
+	printf("\n");
+}
+
+static void print_reference(bin_dump *dump, bin_reader *r)
+{
+	uint64_t file, function_name, line_start, line_end;
+
+	file          = read_uint(r);
+	(void) read_uint(r);
+	function_name = read_uint(r);
+	line_start    = read_uint(r);
+	line_end      = read_uint(r);
+
+	printf("filename:       "); print_string(dump, file); printf("\n");
+	printf("function name:  "); print_string(dump, function_name); printf("\n");
+	printf("already dumped: lines %d-%d, see above\n", (int) line_start, (int) line_end);
+}
+
+/* Prints the function that starts at the reader's position, and everything
+ * that belongs to it, up to the next function */
+static void print_function(bin_dump *dump, bin_reader *r)
+{
+	uint64_t file, function_name, num_ops, num_vars, i;
+	int      paths = 0, in_ops = 1;
+
+	file          = read_uint(r);
+	(void) read_uint(r);
+	function_name = read_uint(r);
+	(void) read_uint(r);
+	(void) read_uint(r);
+	num_ops       = read_uint(r);
+	num_vars      = read_uint(r);
+
+	printf("filename:       "); print_string(dump, file); printf("\n");
+	printf("function name:  "); print_string(dump, function_name); printf("\n");
+	printf("number of ops:  %d\n", (int) num_ops);
+	printf("compiled vars:  ");
+	for (i = 0; i < num_vars && !r->error; i++) {
+		printf("!%d = $", (int) i);
+		print_string(dump, read_uint(r));
+		printf("%s", (i + 1) == num_vars ? "\n" : ", ");
+	}
+	if (!num_vars) {
+		printf("none\n");
+	}
+	printf("line      #* E I O op                           fetch          ext  return  operands\n");
+	printf("-------------------------------------------------------------------------------------\n");
+
+	while (r->pos < dump->index_offset && !r->error) {
+		int tag = r->data[r->pos];
+
+		if (tag == VLD_BIN_STRING) {
+			r->pos++;
+			skip_string(r);
+			continue;
+		}
+		if (tag != VLD_BIN_OP && in_ops) {
+			printf("\n");
+			in_ops = 0;
+		}
+		if (tag == VLD_BIN_OP) {
+			r->pos++;
+			print_op(dump, r);
+		} else if (tag == VLD_BIN_BRANCH) {
+			r->pos++;
+			print_branch(r);
+		} else if (tag == VLD_BIN_PATH) {
+			r->pos++;
+			print_path(r, ++paths);
+		} else {
+			break;
+		}
+	}
+	if (in_ops) {
+		printf("\n");
+	}
+}
+/* }}} */
+
+static int function_matches(bin_dump *dump, bin_index_entry *entry, const char *wanted)
+{
+	bin_string  class_name = get_string(dump, entry->class_name);
+	bin_string  function_name = get_string(dump, entry->function_name);
+	const char *sep = strstr(wanted, "::");
+
+	if (!entry->function_name) {
+		return 0;
+	}
+	if (sep) {
+		return entry->class_name
+			&& class_name.len == (size_t) (sep - wanted) && strncasecmp(class_name.str, wanted, class_name.len) == 0
+			&& function_name.len == strlen(sep + 2) && strncasecmp(function_name.str, sep + 2, function_name.len) == 0;
+	}
+	return !entry->class_name
+		&& function_name.len == strlen(wanted) && strncasecmp(function_name.str, wanted, function_name.len) == 0;
+}
+
+static int convert_dump(const unsigned char *data, size_t size, const char *wanted)
+{
+	bin_dump   dump;
+	bin_reader r;
+	uint64_t   i;
+
+	if (!load_dump(&dump, data, size)) {
+		free_dump(&dump);
+		return 0;
+	}
+
+	r.data  = data;
+	r.size  = dump.index_offset;
+	r.error = 0;
+
+	if (wanted) {
+		for (i = 0; i < dump.index_count; i++) {
+			if (function_matches(&dump, &dump.index[i], wanted)) {
+				r.pos = dump.index[i].offset + 1;
+				print_function(&dump, &r);
+			}
+		}
+	} else {
+		r.pos = VLD_BIN_HEADER_SIZE;
+		while (r.pos < dump.index_offset && !r.error) {
+			switch (read_byte(&r)) {
+				case VLD_BIN_STRING:
+					skip_string(&r);
+					break;
+				case VLD_BIN_FUNCTION:
+					print_function(&dump, &r);
+					break;
+				case VLD_BIN_REFERENCE:
+					print_reference(&dump, &r);
+					break;
+				default:
+					r.error = 1;
+					break;
+			}
+		}
+	}
+
+	free_dump(&dump);
+	return !r.error;
+}
+
+int main(int argc, char *argv[])
+{
+	const char    *wanted = NULL, *filename;
+	unsigned char *data;
+	size_t        *starts = NULL, count = 0, end, size;
+	long           length;
+	FILE          *f;
+	int            i, ok = 1;
+
+	if (argc == 4 && strcmp(argv[1], "-f") == 0) {
+		wanted = argv[2];
+		filename = argv[3];
+	} else if (argc == 2) {
+		filename = argv[1];
+	} else {
+		fprintf(stderr, "Usage: %s [-f function] dumpfile\n", argv[0]);
+		return 1;
+	}
+
+	if ((f = fopen(filename, "rb")) == NULL) {
+		perror(filename);
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = malloc(length > 0 ? length : 1);
+	if (length < 0 || fread(data, 1, length, f) != (size_t) length) {
+		fprintf(stderr, "%s: could not read file\n", filename);
+		fclose(f);
+		return 1;
+	}
+	fclose(f);
+
+	/* Every request appended a dump of its own; find them by walking from
+	 * trailer to trailer, starting at the end of the file */
+	end = length;
+	while (end >= VLD_BIN_HEADER_SIZE + VLD_BIN_TRAILER_SIZE) {
+		if (memcmp(data + end - 4, VLD_BIN_TRAILER_MAGIC, 4) != 0) {
+			break;
+		}
+		size = read_fixed64(data + end - 12);
+		if (size > end) {
+			break;
+		}
+		starts = realloc(starts, (count + 2) * sizeof(size_t));
+		starts[count++] = end - size;
+		end -= size;
+	}
+	if (end != 0) {
+		fprintf(stderr, "%s: not a (complete) vld binary dump\n", filename);
+		ok = 0;
+	}
+
+	for (i = (int) count - 1; i >= 0; i--) {
+		size_t dump_end = i > 0 ? starts[i - 1] : (size_t) length;
+
+		if (!convert_dump(data + starts[i], dump_end - starts[i], wanted)) {
+			fprintf(stderr, "%s: corrupt dump at offset %zu\n", filename, starts[i]);
+			ok = 0;
+		}
+	}
+
+	free(starts);
+	free(data);
+	return ok ? 0 : 1;
+}
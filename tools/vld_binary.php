@@ -0,0 +1,272 @@
+<?php
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+/* Reads a file written with vld.output_format=binary, and returns one array
+ * per dumped function, in the same layout as vld_dump_function() uses. Op
+ * arrays that were dumped before show up with 'already_dumped' set to true.
+ *
+ * The format is described in binary.h. Running this script directly prints
+ * what it read:  php tools/vld_binary.php dumpfile */
+
+function vld_binary_read($filename)
+{
+	$data = file_get_contents($filename);
+	if ($data === false) {
+		return false;
+	}
+
+	$result = array();
+	$pos = 0;
+	$length = strlen($data);
+
+	while ($pos < $length) {
+		if (substr($data, $pos, 4) !== 'VLDB') {
+			trigger_error("vld_binary_read(): no dump found at offset $pos", E_USER_WARNING);
+			return false;
+		}
+
+		$dump = new VldBinaryReader($data, $pos);
+		foreach ($dump->functions() as $function) {
+			$result[] = $function;
+		}
+		$pos = $dump->end;
+	}
+
+	return $result;
+}
+
+class VldBinaryReader
+{
+	const STRING    = 0x01;
+	const FUNCTION_ = 0x02;
+	const REFERENCE = 0x03;
+	const OP        = 0x04;
+	const BRANCH    = 0x05;
+	const PATH      = 0x06;
+	const INDEX     = 0x07;
+
+	private static $operandTypes = array(
+		1 => 'CONST', 2 => 'CONST', 3 => 'CONST', 4 => 'CONST', 5 => 'CONST',
+		6 => 'CONST', 7 => 'CONST', 8 => 'TMP_VAR', 9 => 'VAR', 10 => 'CV',
+		11 => 'JMP', 12 => 'INDEX', 13 => 'INCLUDE',
+	);
+
+	public $end;
+
+	private $data;
+	private $start;
+	private $pos;
+	private $strings = array();
+
+	public function __construct($data, $start)
+	{
+		$this->data = $data;
+		$this->start = $start;
+		$this->pos = $start + 5;
+	}
+
+	public function functions()
+	{
+		$functions = array();
+		$current = null;
+
+		while (true) {
+			$tag = ord($this->data[$this->pos++]);
+
+			switch ($tag) {
+				case self::STRING:
+					$len = $this->uint();
+					$this->strings[count($this->strings) + 1] = substr($this->data, $this->pos, $len);
+					$this->pos += $len;
+					break;
+
+				case self::FUNCTION_:
+					if ($current !== null) {
+						$functions[] = $current;
+					}
+					$current = $this->functionRecord();
+					break;
+
+				case self::REFERENCE:
+					if ($current !== null) {
+						$functions[] = $current;
+						$current = null;
+					}
+					$functions[] = array(
+						'filename' => $this->string(),
+						'class' => $this->string(),
+						'function_name' => $this->string(),
+						'line_start' => $this->uint(),
+						'line_end' => $this->uint(),
+						'already_dumped' => true,
+					);
+					break;
+
+				case self::OP:
+					$current['opcodes'][] = $this->opRecord($current);
+					break;
+
+				case self::BRANCH:
+					$start = $this->uint();
+					$end = $this->uint();
+					$branch = array(
+						'line_start' => $this->uint(),
+						'line_end' => $this->uint(),
+						'op_start' => $start,
+						'op_end' => $end,
+						'outs' => array(),
+					);
+					for ($i = $this->uint(); $i > 0; $i--) {
+						$out = $this->int();
+						if ($out) {
+							$branch['outs'][] = $out;
+						}
+					}
+					$current['branches'][$start] = $branch;
+					break;
+
+				case self::PATH:
+					$path = array();
+					for ($i = $this->uint(); $i > 0; $i--) {
+						$path[] = $this->uint();
+					}
+					$current['paths'][] = $path;
+					break;
+
+				case self::INDEX:
+					if ($current !== null) {
+						$functions[] = $current;
+					}
+					$this->skipIndex();
+					return $functions;
+
+				default:
+					throw new RuntimeException(sprintf('Unknown record %d at offset %d', $tag, $this->pos - 1 - $this->start));
+			}
+		}
+	}
+
+	private function functionRecord()
+	{
+		$function = array(
+			'filename' => $this->string(),
+			'class' => $this->string(),
+			'function_name' => $this->string(),
+			'line_start' => $this->uint(),
+			'line_end' => $this->uint(),
+			'num_ops' => $this->uint(),
+			'compiled_vars' => array(),
+			'opcodes' => array(),
+			'branches' => array(),
+			'paths' => array(),
+			'already_dumped' => false,
+		);
+		for ($i = $this->uint(); $i > 0; $i--) {
+			$function['compiled_vars'][] = $this->string();
+		}
+		return $function;
+	}
+
+	private function opRecord($function)
+	{
+		$this->uint();
+		$op = array(
+			'line' => $this->uint(),
+			'opcode' => $this->uint(),
+			'name' => $this->string(),
+			'fetch' => $this->string(),
+		);
+		$flags = $this->uint();
+		$op['extended_value'] = ($flags & 0x10) ? $this->uint() : null;
+		$op['reachable'] = (bool) ($flags & 0x01);
+		$op['entry'] = (bool) ($flags & 0x02);
+		$op['branch_start'] = (bool) ($flags & 0x04);
+		$op['branch_end'] = (bool) ($flags & 0x08);
+		$op['result'] = $this->operand($function);
+		$op['op1'] = $this->operand($function);
+		$op['op2'] = $this->operand($function);
+		if ($flags & 0x40) {
+			$op['ext_target'] = $this->int();
+		}
+		return $op;
+	}
+
+	private function operand($function)
+	{
+		$kind = ord($this->data[$this->pos++]);
+
+		switch ($kind) {
+			case 0:  return null;
+			case 1:  $value = null; break;
+			case 2:  $value = false; break;
+			case 3:  $value = true; break;
+			case 4:  $value = $this->int(); break;
+			case 5:
+				$value = unpack('e', substr($this->data, $this->pos, 8));
+				$value = $value[1];
+				$this->pos += 8;
+				break;
+			case 6:  $value = $this->string(); break;
+			case 7:  return array('type' => 'TEXT', 'value' => $this->string());
+			case 11: $value = $this->int(); break;
+			case 13: $value = $this->string(); break;
+			default: $value = $this->uint(); break;
+		}
+
+		$operand = array('type' => self::$operandTypes[$kind], 'value' => $value);
+		if ($kind == 10 && isset($function['compiled_vars'][$value])) {
+			$operand['name'] = $function['compiled_vars'][$value];
+		}
+		return $operand;
+	}
+
+	private function skipIndex()
+	{
+		for ($i = $this->uint(); $i > 0; $i--) {
+			$this->uint(); $this->uint(); $this->uint(); $this->uint();
+		}
+		for ($i = $this->uint(); $i > 0; $i--) {
+			$this->uint();
+		}
+		$trailer = unpack('P2', substr($this->data, $this->pos, 16));
+		$this->end = $this->start + $trailer[2];
+	}
+
+	private function string()
+	{
+		$id = $this->uint();
+		return $id ? $this->strings[$id] : null;
+	}
+
+	private function uint()
+	{
+		$value = 0;
+		$shift = 0;
+		do {
+			$byte = ord($this->data[$this->pos++]);
+			$value |= ($byte & 0x7f) << $shift;
+			$shift += 7;
+		} while ($byte & 0x80);
+		return $value;
+	}
+
+	private function int()
+	{
+		$value = $this->uint();
+		return ($value >> 1) ^ -($value & 1);
+	}
+}
+
+if (isset($argv[1]) && realpath($argv[0]) === __FILE__) {
+	var_dump(vld_binary_read($argv[1]));
+}
@@ -0,0 +1,273 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+/* Reference collector for vld.output=unix://... that writes the dumps it
+ * receives into one file per script.
+ * Build with: cc -O2 -o vld_collector tools/vld_collector.c
+ *
+ * Usage: vld_collector [-d directory] socket
+ *
+ * The dump of a script ends up in the directory (the current one by
+ * default), in a file named after the script's path with the slashes
+ * replaced by underscores, and ".vld" appended. Every request is first
+ * collected on its own, and only appended to that file once it is complete,
+ * so that the dumps of workers running the same script do not interleave.
+ * Dropped frames are reported on stderr. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define VLD_UNIXSOCK_NO_PHP
+#include "../unixsock.h"
+
+typedef struct _client {
+	int            fd;
+	unsigned char *buffer;
+	size_t         used;
+	size_t         size;
+	uint32_t       pid;
+	char          *script;
+	FILE          *request;
+} client;
+
+static volatile sig_atomic_t stop = 0;
+static const char           *directory = ".";
+
+static void on_signal(int sig)
+{
+	(void) sig;
+	stop = 1;
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t get64(const unsigned char *p)
+{
+	return (uint64_t) get32(p) | ((uint64_t) get32(p + 4) << 32);
+}
+
+/* Appends the collected dump of a request to the file of its script */
+static void finish_request(client *c)
+{
+	char   *filename, *p, buffer[65536];
+	size_t  n;
+	FILE   *out;
+
+	if (!c->request || !c->script) {
+		return;
+	}
+
+	filename = malloc(strlen(directory) + strlen(c->script) + sizeof("/.vld"));
+	sprintf(filename, "%s/%s.vld", directory, c->script[0] == '/' ? c->script + 1 : c->script);
+	for (p = filename + strlen(directory) + 1; *p; p++) {
+		if (*p == '/') {
+			*p = '_';
+		}
+	}
+
+	if ((out = fopen(filename, "ab")) == NULL) {
+		perror(filename);
+	} else {
+		rewind(c->request);
+		while ((n = fread(buffer, 1, sizeof(buffer), c->request)) > 0) {
+			fwrite(buffer, 1, n, out);
+		}
+		fclose(out);
+	}
+	free(filename);
+
+	fclose(c->request);
+	c->request = NULL;
+}
+
+static void handle_frame(client *c, int type, const unsigned char *payload, uint32_t len)
+{
+	switch (type) {
+		case VLD_UNIXSOCK_HELLO:
+			if (len < 4) {
+				return;
+			}
+			finish_request(c);
+			free(c->script);
+			c->pid = get32(payload);
+			c->script = malloc(len - 4 + 1);
+			memcpy(c->script, payload + 4, len - 4);
+			c->script[len - 4] = '\0';
+			c->request = tmpfile();
+			break;
+
+		case VLD_UNIXSOCK_DATA:
+			if (c->request) {
+				fwrite(payload, 1, len, c->request);
+			}
+			break;
+
+		case VLD_UNIXSOCK_END:
+			if (len >= 16 && get64(payload)) {
+				fprintf(stderr, "%s (pid %" PRIu32 "): %" PRIu64 " frames with %" PRIu64 " bytes dropped\n",
+					c->script ? c->script : "-", c->pid, get64(payload), get64(payload + 8));
+			}
+			finish_request(c);
+			break;
+	}
+}
+
+/* Reads what is available, and handles all complete frames. Returns 0 once
+ * the worker has closed its end. */
+static int handle_client(client *c)
+{
+	ssize_t n;
+	size_t  pos = 0;
+
+	if (c->size - c->used < 65536) {
+		c->size = c->size ? c->size * 2 : 131072;
+		c->buffer = realloc(c->buffer, c->size);
+	}
+
+	n = read(c->fd, c->buffer + c->used, c->size - c->used);
+	if (n < 0 && errno == EINTR) {
+		return 1;
+	}
+	if (n <= 0) {
+		return 0;
+	}
+	c->used += n;
+
+	while (c->used - pos >= VLD_UNIXSOCK_FRAME_HEADER) {
+		uint32_t len = get32(c->buffer + pos);
+
+		if (c->used - pos - VLD_UNIXSOCK_FRAME_HEADER < len) {
+			break;
+		}
+		handle_frame(c, c->buffer[pos + 4], c->buffer + pos + VLD_UNIXSOCK_FRAME_HEADER, len);
+		pos += VLD_UNIXSOCK_FRAME_HEADER + len;
+	}
+
+	memmove(c->buffer, c->buffer + pos, c->used - pos);
+	c->used -= pos;
+	return 1;
+}
+
+static void close_client(client *c)
+{
+	/* A worker that went away without an END frame still had its dump
+	 * collected so far */
+	finish_request(c);
+	close(c->fd);
+	free(c->buffer);
+	free(c->script);
+}
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_un addr;
+	struct pollfd     *fds = NULL;
+	client            *clients = NULL;
+	size_t             count = 0, i;
+	const char        *path;
+	int                listener, opt;
+
+	while ((opt = getopt(argc, argv, "d:")) != -1) {
+		if (opt == 'd') {
+			directory = optarg;
+		} else {
+			optind = argc + 1;
+		}
+	}
+	if (optind != argc - 1) {
+		fprintf(stderr, "Usage: %s [-d directory] socket\n", argv[0]);
+		return 1;
+	}
+	path = argv[optind];
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: socket path too long\n", path);
+		return 1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	unlink(path);
+	if ((listener = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+		|| bind(listener, (struct sockaddr *) &addr, sizeof(addr)) != 0
+		|| listen(listener, 128) != 0
+	) {
+		perror(path);
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, SIG_IGN);
+
+	/* The listener is always the first entry, followed by one per worker */
+	fds = malloc(sizeof(struct pollfd));
+	fds[0].fd = listener;
+	fds[0].events = POLLIN;
+
+	while (!stop) {
+		if (poll(fds, count + 1, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("poll");
+			break;
+		}
+
+		for (i = count; i > 0; i--) {
+			if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+				continue;
+			}
+			if (!handle_client(&clients[i - 1])) {
+				close_client(&clients[i - 1]);
+				count--;
+				clients[i - 1] = clients[count];
+				fds[i] = fds[count + 1];
+			}
+		}
+
+		if (fds[0].revents & POLLIN) {
+			int fd = accept(listener, NULL, NULL);
+
+			if (fd >= 0) {
+				count++;
+				clients = realloc(clients, count * sizeof(client));
+				fds = realloc(fds, (count + 1) * sizeof(struct pollfd));
+				memset(&clients[count - 1], 0, sizeof(client));
+				clients[count - 1].fd = fd;
+				fds[count].fd = fd;
+				fds[count].events = POLLIN;
+				fds[count].revents = 0;
+			}
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		close_client(&clients[i]);
+	}
+	close(listener);
+	unlink(path);
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+/* Shows the op counts in a vld.shared_counters file, with the most
+ * executed ops first, while the workers that write to it keep running.
+ * Build with: cc -O2 -o vld_counters tools/vld_counters.c
+ *
+ * Usage: vld_counters [-n count] [-f name] countersfile
+ *
+ * With -n only the first count ops are shown, and with -f only the ops of
+ * functions with that name, matched case insensitively. Opcodes are shown
+ * by number, as the names are only known to PHP. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define VLD_COUNTERS_NO_PHP
+#include "../counters.h"
+
+typedef struct _op_count {
+	uint64_t    count;
+	const char *file;
+	const char *function;
+	uint32_t    line_start;
+	uint32_t    nr;
+	uint32_t    lineno;
+	uint32_t    opcode;
+} op_count;
+
+static int compare_counts(const void *a, const void *b)
+{
+	const op_count *ca = a;
+	const op_count *cb = b;
+
+	if (ca->count != cb->count) {
+		return ca->count < cb->count ? 1 : -1;
+	}
+	return ca->nr < cb->nr ? -1 : (ca->nr > cb->nr);
+}
+
+static vld_counters_header *open_counters(const char *filename, size_t *size)
+{
+	vld_counters_header  header;
+	struct stat          st;
+	int                  fd;
+	void                *map;
+
+	if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+		perror(filename);
+		return NULL;
+	}
+	if ((size_t) st.st_size < sizeof(header) || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+		|| memcmp(header.magic, VLD_COUNTERS_MAGIC, 4) != 0 || header.version != VLD_COUNTERS_VERSION
+		|| (size_t) st.st_size < VLD_COUNTERS_SIZE(&header)
+	) {
+		fprintf(stderr, "%s: not a vld counters file\n", filename);
+		close(fd);
+		return NULL;
+	}
+	*size = VLD_COUNTERS_SIZE(&header);
+	map = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror(filename);
+		return NULL;
+	}
+	return map;
+}
+
+int main(int argc, char *argv[])
+{
+	vld_counters_header   *counters;
+	vld_counters_function *functions;
+	vld_counters_op       *ops;
+	const char            *names, *name = NULL;
+	op_count              *list;
+	size_t                 size;
+	uint64_t               key;
+	uint32_t               i, function, offset, count = 0, limit = 0;
+	int                    argi = 1;
+
+	while (argi + 1 < argc && argv[argi][0] == '-') {
+		if (strcmp(argv[argi], "-n") == 0) {
+			limit = (uint32_t) strtoul(argv[argi + 1], NULL, 10);
+		} else if (strcmp(argv[argi], "-f") == 0) {
+			name = argv[argi + 1];
+		} else {
+			break;
+		}
+		argi += 2;
+	}
+	if (argc - argi != 1) {
+		fprintf(stderr, "Usage: %s [-n count] [-f name] countersfile\n", argv[0]);
+		return 1;
+	}
+
+	if ((counters = open_counters(argv[argi], &size)) == NULL) {
+		return 1;
+	}
+	functions = VLD_COUNTERS_FUNCTIONS(counters);
+	ops = VLD_COUNTERS_OPS(counters);
+	names = VLD_COUNTERS_NAMES(counters);
+
+	list = malloc((size_t) counters->ops_size * sizeof(op_count));
+	for (i = 0; i < counters->ops_size; i++) {
+		if ((key = __atomic_load_n(&ops[i].key, __ATOMIC_ACQUIRE)) == 0) {
+			continue;
+		}
+		function = (uint32_t) (key >> 32) - 1;
+		if (function >= counters->functions_size) {
+			continue;
+		}
+		offset = __atomic_load_n(&functions[function].name, __ATOMIC_ACQUIRE);
+		if (offset == 0 || offset >= counters->names_size) {
+			continue;
+		}
+		list[count].file = names + offset;
+		list[count].function = names + offset + strlen(names + offset) + 1;
+		if (name && strcasecmp(list[count].function, name) != 0) {
+			continue;
+		}
+		list[count].line_start = functions[function].line;
+		list[count].count = __atomic_load_n(&ops[i].count, __ATOMIC_RELAXED);
+		list[count].nr = (uint32_t) key;
+		list[count].lineno = ops[i].lineno;
+		list[count].opcode = ops[i].opcode;
+		count++;
+	}
+	qsort(list, count, sizeof(op_count), compare_counts);
+
+	printf("%12s %6s %6s %6s  %s\n", "count", "op", "line", "opcode", "function");
+	for (i = 0; i < count && (!limit || i < limit); i++) {
+		printf("%12" PRIu64 " %6u %6u %6u  %s %s:%u\n", list[i].count, list[i].nr, list[i].lineno, list[i].opcode, list[i].function, list[i].file, list[i].line_start);
+	}
+	if (counters->dropped) {
+		printf("%" PRIu64 " counts did not fit\n", counters->dropped);
+	}
+
+	free(list);
+	munmap(counters, size);
+
+	return 0;
+}
@@ -0,0 +1,425 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+/* Shows the dump of one function from a file written to vld.output, using
+ * the ".idx" file next to it, without reading the rest of the dump.
+ * Build with: cc -O2 -o vld_lookup tools/vld_lookup.c
+ *
+ * Usage: vld_lookup [-l] dumpfile name [filename]
+ *        vld_lookup -c dumpfile
+ *
+ * The name is "function", "Class::method", or "{main}" for the code of a
+ * file, and is matched case insensitively. The optional filename narrows the
+ * matches down to functions from that file. With -l the matches are listed
+ * instead of shown. With -c the segments that requests appended to the
+ * index are merged into one, so that lookups search it only once. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define VLD_DUMPINDEX_NO_PHP
+#include "../dumpindex.h"
+
+typedef struct _idx_file {
+	const unsigned char *data;
+	size_t               size;
+	uint32_t             count;
+	uint32_t             entry_size;
+	const unsigned char *blob;
+	uint64_t             blob_size;
+} idx_file;
+
+static uint32_t get32(const unsigned char *p)
+{
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t get64(const unsigned char *p)
+{
+	return (uint64_t) get32(p) | ((uint64_t) get32(p + 4) << 32);
+}
+
+typedef struct _idx_entry {
+	const char *key;
+	uint32_t    key_len;
+	const char *file;
+	uint32_t    file_len;
+	uint64_t    offset;
+	uint64_t    length;
+	uint32_t    key_offset;
+	uint32_t    file_offset;
+} idx_entry;
+
+static const unsigned char *entry_at(idx_file *idx, uint32_t i)
+{
+	return idx->data + VLD_IDX_HEADER_SIZE + (size_t) i * idx->entry_size;
+}
+
+/* Compares a blob string with a plain one, the way strcmp() does */
+static int compare_string(idx_file *idx, uint32_t offset, uint32_t len, const char *str, size_t str_len)
+{
+	size_t n = len < str_len ? len : str_len;
+	int    cmp;
+
+	if ((uint64_t) offset + len > idx->blob_size) {
+		return 1;
+	}
+	if ((cmp = memcmp(idx->blob + offset, str, n)) != 0) {
+		return cmp;
+	}
+	return len < str_len ? -1 : (len > str_len);
+}
+
+static void put32(unsigned char *p, uint32_t value)
+{
+	p[0] = value; p[1] = value >> 8; p[2] = value >> 16; p[3] = value >> 24;
+}
+
+static void put64(unsigned char *p, uint64_t value)
+{
+	put32(p, (uint32_t) value);
+	put32(p + 4, (uint32_t) (value >> 32));
+}
+
+static const unsigned char *map_index(const char *filename, size_t *size)
+{
+	struct stat st;
+	int         fd;
+	void       *map;
+
+	if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+		perror(filename);
+		return NULL;
+	}
+	if (st.st_size < VLD_IDX_HEADER_SIZE) {
+		fprintf(stderr, "%s: not a vld dump index\n", filename);
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror(filename);
+		return NULL;
+	}
+
+	*size = st.st_size;
+	return map;
+}
+
+/* Reads the header of the segment that starts at data, which may be no
+ * longer than size bytes */
+static int open_segment(idx_file *idx, const unsigned char *data, size_t size)
+{
+	uint64_t blob_offset;
+
+	if (size < VLD_IDX_HEADER_SIZE) {
+		return 0;
+	}
+
+	idx->data       = data;
+	idx->count      = get32(idx->data + 8);
+	idx->entry_size = get32(idx->data + 12);
+	blob_offset     = get64(idx->data + 16);
+	idx->blob_size  = get64(idx->data + 24);
+	idx->blob       = idx->data + blob_offset;
+	idx->size       = blob_offset + idx->blob_size;
+
+	return memcmp(idx->data, VLD_IDX_MAGIC, 4) == 0 && get32(idx->data + 4) == VLD_IDX_VERSION
+		&& idx->entry_size >= VLD_IDX_ENTRY_SIZE
+		&& VLD_IDX_HEADER_SIZE + (uint64_t) idx->count * idx->entry_size <= blob_offset
+		&& blob_offset + idx->blob_size <= size;
+}
+
+/* Finds the first entry whose key is not smaller than the one looked for */
+static uint32_t lower_bound(idx_file *idx, const char *key)
+{
+	uint32_t low = 0, high = idx->count;
+	size_t   key_len = strlen(key);
+
+	while (low < high) {
+		uint32_t             mid = low + (high - low) / 2;
+		const unsigned char *entry = entry_at(idx, mid);
+
+		if (compare_string(idx, get32(entry), get32(entry + 4), key, key_len) < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+static int show_range(FILE *dump, uint64_t offset, uint64_t length)
+{
+	char buffer[65536];
+
+	if (fseeko(dump, (off_t) offset, SEEK_SET) != 0) {
+		return 0;
+	}
+	while (length) {
+		size_t chunk = length < sizeof(buffer) ? (size_t) length : sizeof(buffer);
+
+		if (fread(buffer, 1, chunk, dump) != chunk) {
+			return 0;
+		}
+		fwrite(buffer, 1, chunk, stdout);
+		length -= chunk;
+	}
+	return 1;
+}
+
+/* {{{ Compacting */
+static int compare_bytes(const char *a, uint32_t a_len, const char *b, uint32_t b_len)
+{
+	int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+
+	return cmp ? cmp : (a_len < b_len ? -1 : (a_len > b_len));
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+	const idx_entry *ea = a, *eb = b;
+	int              cmp;
+
+	if ((cmp = compare_bytes(ea->key, ea->key_len, eb->key, eb->key_len)) != 0) {
+		return cmp;
+	}
+	if ((cmp = compare_bytes(ea->file, ea->file_len, eb->file, eb->file_len)) != 0) {
+		return cmp;
+	}
+	return ea->offset < eb->offset ? -1 : (ea->offset > eb->offset);
+}
+
+static int compare_files(const void *a, const void *b)
+{
+	const idx_entry *ea = *(const idx_entry **) a, *eb = *(const idx_entry **) b;
+
+	return compare_bytes(ea->file, ea->file_len, eb->file, eb->file_len);
+}
+
+/* Every key and file name is stored once in the blob. Keys are next to each
+ * other once the entries are sorted, file names are sorted separately */
+static size_t build_blob(idx_entry *entries, uint32_t count, unsigned char *blob)
+{
+	idx_entry **by_file = malloc((count ? count : 1) * sizeof(idx_entry *));
+	size_t      used = 0;
+	uint32_t    i;
+
+	for (i = 0; i < count; i++) {
+		if (i && compare_bytes(entries[i].key, entries[i].key_len, entries[i - 1].key, entries[i - 1].key_len) == 0) {
+			entries[i].key_offset = entries[i - 1].key_offset;
+		} else {
+			entries[i].key_offset = (uint32_t) used;
+			memcpy(blob + used, entries[i].key, entries[i].key_len);
+			used += entries[i].key_len;
+		}
+		by_file[i] = &entries[i];
+	}
+
+	qsort(by_file, count, sizeof(idx_entry *), compare_files);
+	for (i = 0; i < count; i++) {
+		if (i && compare_files(&by_file[i], &by_file[i - 1]) == 0) {
+			by_file[i]->file_offset = by_file[i - 1]->file_offset;
+		} else {
+			by_file[i]->file_offset = (uint32_t) used;
+			memcpy(blob + used, by_file[i]->file, by_file[i]->file_len);
+			used += by_file[i]->file_len;
+		}
+	}
+	free(by_file);
+
+	return used;
+}
+
+/* The index is rewritten in place, under the lock that requests take to
+ * append to it, so that no segment gets lost. The merged segment is never
+ * larger than the segments it replaces, and whatever follows the last
+ * whole segment is kept after it */
+static int compact(const char *idx_filename)
+{
+	idx_file        idx;
+	idx_entry      *entries;
+	unsigned char  *data, *merged, *entry;
+	struct stat     st;
+	size_t          start, blob_size, merged_size;
+	uint32_t        count = 0, segments = 0, i, j;
+	int             fd;
+
+	if ((fd = open(idx_filename, O_RDWR)) < 0 || flock(fd, LOCK_EX) != 0 || fstat(fd, &st) != 0) {
+		perror(idx_filename);
+		return 1;
+	}
+	data = malloc(st.st_size ? st.st_size : 1);
+	if (pread(fd, data, st.st_size, 0) != st.st_size) {
+		perror(idx_filename);
+		return 1;
+	}
+
+	for (start = 0; start < (size_t) st.st_size && open_segment(&idx, data + start, st.st_size - start); start += idx.size) {
+		count += idx.count;
+		segments++;
+	}
+	if (segments < 2) {
+		printf("%s: %u segment(s), nothing to merge\n", idx_filename, segments);
+		flock(fd, LOCK_UN);
+		close(fd);
+		return 0;
+	}
+
+	entries = malloc(count * sizeof(idx_entry));
+	count = 0;
+	for (start = 0; start < (size_t) st.st_size && open_segment(&idx, data + start, st.st_size - start); start += idx.size) {
+		for (j = 0; j < idx.count; j++) {
+			const unsigned char *e = entry_at(&idx, j);
+
+			if ((uint64_t) get32(e) + get32(e + 4) > idx.blob_size || (uint64_t) get32(e + 8) + get32(e + 12) > idx.blob_size) {
+				continue;
+			}
+			entries[count].key      = (const char *) idx.blob + get32(e);
+			entries[count].key_len  = get32(e + 4);
+			entries[count].file     = (const char *) idx.blob + get32(e + 8);
+			entries[count].file_len = get32(e + 12);
+			entries[count].offset   = get64(e + 16);
+			entries[count].length   = get64(e + 24);
+			count++;
+		}
+	}
+	qsort(entries, count, sizeof(idx_entry), compare_entries);
+
+	merged = malloc(st.st_size);
+	blob_size = build_blob(entries, count, merged + VLD_IDX_HEADER_SIZE + (size_t) count * VLD_IDX_ENTRY_SIZE);
+
+	memcpy(merged, VLD_IDX_MAGIC, 4);
+	put32(merged + 4,  VLD_IDX_VERSION);
+	put32(merged + 8,  count);
+	put32(merged + 12, VLD_IDX_ENTRY_SIZE);
+	put64(merged + 16, VLD_IDX_HEADER_SIZE + (uint64_t) count * VLD_IDX_ENTRY_SIZE);
+	put64(merged + 24, blob_size);
+	for (i = 0; i < count; i++) {
+		entry = merged + VLD_IDX_HEADER_SIZE + (size_t) i * VLD_IDX_ENTRY_SIZE;
+		put32(entry,      entries[i].key_offset);
+		put32(entry + 4,  entries[i].key_len);
+		put32(entry + 8,  entries[i].file_offset);
+		put32(entry + 12, entries[i].file_len);
+		put64(entry + 16, entries[i].offset);
+		put64(entry + 24, entries[i].length);
+	}
+	merged_size = VLD_IDX_HEADER_SIZE + (size_t) count * VLD_IDX_ENTRY_SIZE + blob_size;
+	memcpy(merged + merged_size, data + start, st.st_size - start);
+	merged_size += st.st_size - start;
+
+	if (pwrite(fd, merged, merged_size, 0) != (ssize_t) merged_size || ftruncate(fd, merged_size) != 0 || fsync(fd) != 0) {
+		perror(idx_filename);
+		return 1;
+	}
+	flock(fd, LOCK_UN);
+	close(fd);
+
+	printf("%s: merged %u segments with %u entries\n", idx_filename, segments, count);
+	free(merged);
+	free(entries);
+	free(data);
+	return 0;
+}
+/* }}} */
+
+int main(int argc, char *argv[])
+{
+	idx_file             idx;
+	const unsigned char *data;
+	const char          *dump_filename, *file = NULL;
+	char                *idx_filename, *key;
+	size_t               i, key_len, size, start;
+	uint32_t             pos;
+	int                  list = 0, found = 0, argi = 1;
+	FILE                *dump = NULL;
+
+	if (argc == 3 && strcmp(argv[1], "-c") == 0) {
+		idx_filename = malloc(strlen(argv[2]) + sizeof(".idx"));
+		sprintf(idx_filename, "%s.idx", argv[2]);
+		return compact(idx_filename);
+	}
+	if (argi < argc && strcmp(argv[argi], "-l") == 0) {
+		list = 1;
+		argi++;
+	}
+	if (argc - argi < 2 || argc - argi > 3) {
+		fprintf(stderr, "Usage: %s [-l] dumpfile name [filename]\n       %s -c dumpfile\n", argv[0], argv[0]);
+		return 1;
+	}
+	dump_filename = argv[argi];
+	key = strdup(argv[argi + 1]);
+	if (argc - argi == 3) {
+		file = argv[argi + 2];
+	}
+
+	key_len = strlen(key);
+	for (i = 0; i < key_len; i++) {
+		key[i] = tolower((unsigned char) key[i]);
+	}
+
+	idx_filename = malloc(strlen(dump_filename) + sizeof(".idx"));
+	sprintf(idx_filename, "%s.idx", dump_filename);
+	if ((data = map_index(idx_filename, &size)) == NULL) {
+		return 1;
+	}
+
+	if (!list && (dump = fopen(dump_filename, "rb")) == NULL) {
+		perror(dump_filename);
+		return 1;
+	}
+
+	/* A segment that is not whole yet is being appended to, and ends the
+	 * index for now */
+	for (start = 0; start < size && open_segment(&idx, data + start, size - start); start += idx.size) {
+		for (pos = lower_bound(&idx, key); pos < idx.count; pos++) {
+			const unsigned char *entry = entry_at(&idx, pos);
+			uint32_t             file_offset = get32(entry + 8), file_len = get32(entry + 12);
+
+			if (compare_string(&idx, get32(entry), get32(entry + 4), key, key_len) != 0) {
+				break;
+			}
+			if (file && compare_string(&idx, file_offset, file_len, file, strlen(file)) != 0) {
+				continue;
+			}
+
+			found++;
+			if (list) {
+				printf("%.*s %.*s %" PRIu64 " %" PRIu64 "\n",
+					(int) get32(entry + 4), (const char *) idx.blob + get32(entry),
+					(int) file_len, (const char *) idx.blob + file_offset,
+					get64(entry + 16), get64(entry + 24));
+			} else if (!show_range(dump, get64(entry + 16), get64(entry + 24))) {
+				fprintf(stderr, "%s: could not read %" PRIu64 " bytes at offset %" PRIu64 "\n", dump_filename, get64(entry + 24), get64(entry + 16));
+				return 1;
+			}
+		}
+	}
+	if (start == 0) {
+		fprintf(stderr, "%s: not a vld dump index\n", idx_filename);
+		return 1;
+	}
+
+	if (!found) {
+		fprintf(stderr, "%s: no dump found for '%s'\n", dump_filename, argv[argi + 1]);
+	}
+	return found ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "php.h"
+#include "SAPI.h"
+#include "php_vld.h"
+#include "unixsock.h"
+
+#ifndef PHP_WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+#endif
+
+ZEND_EXTERN_MODULE_GLOBALS(vld)
+
+/* Queued frames live in buffer[start .. start + used], and the frame that is
+ * being sent begins at head. The buffer has room for an END frame on top of
+ * VLD_UNIXSOCK_BUFFER_SIZE, so that one can always be queued. */
+struct _vld_unixsock_state {
+	int            fd;
+	unsigned char *buffer;
+	size_t         head;
+	size_t         start;
+	size_t         used;
+	uint64_t       dropped_frames;
+	uint64_t       dropped_bytes;
+};
+
+#define VLD_UNIXSOCK_END_SIZE (VLD_UNIXSOCK_FRAME_HEADER + 16)
+
+#ifndef PHP_WIN32
+static void vld_unixsock_put32(unsigned char *p, uint32_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+}
+
+static void vld_unixsock_put64(unsigned char *p, uint64_t value)
+{
+	vld_unixsock_put32(p, (uint32_t) value);
+	vld_unixsock_put32(p + 4, (uint32_t) (value >> 32));
+}
+
+static size_t vld_unixsock_frame_size(struct _vld_unixsock_state *state, size_t pos)
+{
+	const unsigned char *p = state->buffer + pos;
+
+	return VLD_UNIXSOCK_FRAME_HEADER + ((uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24));
+}
+
+/* Sends as much of the queue as the socket takes without blocking */
+static void vld_unixsock_drain(struct _vld_unixsock_state *state)
+{
+	ssize_t sent;
+
+	while (state->used) {
+		sent = send(state->fd, state->buffer + state->start, state->used, MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				/* The collector went away; everything from here on is lost */
+				close(state->fd);
+				state->fd = -1;
+				state->dropped_frames++;
+				state->dropped_bytes += state->used;
+				state->used = 0;
+			}
+			break;
+		}
+		state->start += sent;
+		state->used  -= sent;
+	}
+
+	if (!state->used) {
+		state->head = state->start = 0;
+		return;
+	}
+	while (state->head + vld_unixsock_frame_size(state, state->head) <= state->start) {
+		state->head += vld_unixsock_frame_size(state, state->head);
+	}
+}
+
+/* Throws away all queued frames that have not been started on yet, counting
+ * them as dropped, so that the END frame is next in line */
+static void vld_unixsock_discard(struct _vld_unixsock_state *state)
+{
+	size_t end = state->start + state->used, pos = state->head;
+
+	if (state->head < state->start) {
+		pos += vld_unixsock_frame_size(state, state->head);
+	}
+	state->used = pos - state->start;
+
+	while (pos < end) {
+		state->dropped_frames++;
+		state->dropped_bytes += vld_unixsock_frame_size(state, pos) - VLD_UNIXSOCK_FRAME_HEADER;
+		pos += vld_unixsock_frame_size(state, pos);
+	}
+}
+
+static void vld_unixsock_wait(struct _vld_unixsock_state *state)
+{
+	struct pollfd pfd;
+	int           waited;
+
+	for (waited = 0; state->fd >= 0 && state->used && waited < VLD_UNIXSOCK_CLOSE_TIMEOUT; waited += 10) {
+		pfd.fd = state->fd;
+		pfd.events = POLLOUT;
+		poll(&pfd, 1, 10);
+		vld_unixsock_drain(state);
+	}
+}
+
+static void vld_unixsock_frame(struct _vld_unixsock_state *state, int type, const unsigned char *data, size_t len, size_t limit)
+{
+	unsigned char *p;
+
+	if (state->fd < 0) {
+		state->dropped_frames++;
+		state->dropped_bytes += len;
+		return;
+	}
+
+	/* The part of the frame at head that was sent already stays in the
+	 * buffer, as it is moved along with the rest */
+	vld_unixsock_drain(state);
+	if (state->fd < 0 || (state->start - state->head) + state->used + VLD_UNIXSOCK_FRAME_HEADER + len > limit) {
+		state->dropped_frames++;
+		state->dropped_bytes += len;
+		return;
+	}
+
+	if (state->start + state->used + VLD_UNIXSOCK_FRAME_HEADER + len > limit) {
+		memmove(state->buffer, state->buffer + state->head, state->start - state->head + state->used);
+		state->start -= state->head;
+		state->head = 0;
+	}
+
+	p = state->buffer + state->start + state->used;
+	vld_unixsock_put32(p, (uint32_t) len);
+	p[4] = type;
+	memcpy(p + VLD_UNIXSOCK_FRAME_HEADER, data, len);
+	state->used += VLD_UNIXSOCK_FRAME_HEADER + len;
+
+	vld_unixsock_drain(state);
+}
+
+static int vld_unixsock_connect(const char *path)
+{
+	struct sockaddr_un addr;
+	int                fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		return -1;
+	}
+#ifdef SO_NOSIGPIPE
+	{
+		int on = 1;
+		setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+	}
+#endif
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+#endif
+
+/* Connecting fails quietly when there is no collector, as warning about it
+ * in every request would flood the very log this sink is meant to keep
+ * clean. The dump of such a request is counted as dropped. */
+int vld_unixsock_open(const char *path)
+{
+#ifndef PHP_WIN32
+	struct _vld_unixsock_state *state = calloc(1, sizeof(struct _vld_unixsock_state));
+	unsigned char               hello[4];
+	const char                 *script = SG(request_info).path_translated;
+	char                       *payload;
+	size_t                      script_len;
+
+	state->fd     = vld_unixsock_connect(path);
+	state->buffer = malloc(VLD_UNIXSOCK_BUFFER_SIZE + VLD_UNIXSOCK_END_SIZE);
+	VLD_G(unixsock) = state;
+
+	if (!script) {
+		script = "-";
+	}
+	script_len = strlen(script);
+
+	vld_unixsock_put32(hello, (uint32_t) VLD_G(pid));
+	payload = malloc(sizeof(hello) + script_len);
+	memcpy(payload, hello, sizeof(hello));
+	memcpy(payload + sizeof(hello), script, script_len);
+	vld_unixsock_frame(state, VLD_UNIXSOCK_HELLO, (unsigned char *) payload, sizeof(hello) + script_len, VLD_UNIXSOCK_BUFFER_SIZE);
+	free(payload);
+
+	return 1;
+#else
+	zend_error(E_WARNING, "vld: Unix domain sockets are not supported on this platform, using stderr instead");
+	return 0;
+#endif
+}
+
+void vld_unixsock_write(const char *data, size_t len)
+{
+#ifndef PHP_WIN32
+	vld_unixsock_frame(VLD_G(unixsock), VLD_UNIXSOCK_DATA, (const unsigned char *) data, len, VLD_UNIXSOCK_BUFFER_SIZE);
+#endif
+}
+
+/* Gives the collector a short while to take what is still queued. What it
+ * could not take by then is dropped, but the END frame with the number of
+ * dropped frames still gets its own chance to be sent. */
+void vld_unixsock_close(void)
+{
+#ifndef PHP_WIN32
+	struct _vld_unixsock_state *state = VLD_G(unixsock);
+	unsigned char               end[16];
+
+	if (!state) {
+		return;
+	}
+
+	if (state->fd >= 0) {
+		vld_unixsock_wait(state);
+		if (state->fd >= 0 && state->used) {
+			vld_unixsock_discard(state);
+		}
+
+		vld_unixsock_put64(end, state->dropped_frames);
+		vld_unixsock_put64(end + 8, state->dropped_bytes);
+		vld_unixsock_frame(state, VLD_UNIXSOCK_END, end, sizeof(end), VLD_UNIXSOCK_BUFFER_SIZE + VLD_UNIXSOCK_END_SIZE);
+		vld_unixsock_wait(state);
+
+		if (state->fd >= 0) {
+			close(state->fd);
+		}
+	}
+
+	free(state->buffer);
+	free(state);
+	VLD_G(unixsock) = NULL;
+#endif
+}
@@ -0,0 +1,47 @@
+/*
+   +----------------------------------------------------------------------+
+   | Copyright (c) 1997-2019 Derick Rethans                               |
+   +----------------------------------------------------------------------+
+   | This source file is subject to the 2-Clause BSD license which is     |
+   | available through the LICENSE file, or online at                     |
+   | http://opensource.org/licenses/bsd-license.php                       |
+   +----------------------------------------------------------------------+
+   | Authors:  Derick Rethans <derick@derickrethans.nl>                   |
+   +----------------------------------------------------------------------+
+ */
+
+#ifndef __UNIXSOCK_H__
+#define __UNIXSOCK_H__
+
+/* Unix domain socket sink
+ *
+ * With vld.output set to "unix:///path/to/socket", every request connects to
+ * that socket and streams its dump as frames. Each frame is a uint32 payload
+ * length, followed by a one byte frame type and the payload. All numbers are
+ * little endian.
+ *
+ * HELLO: uint32 pid, followed by the script's filename
+ * DATA:  a chunk of the dump, in whatever vld.output_format says
+ * END:   uint64 frames dropped, uint64 bytes dropped
+ *
+ * Writes never block the request. Frames are queued in a buffer of at most
+ * VLD_UNIXSOCK_BUFFER_SIZE bytes, and DATA frames that do not fit because the
+ * collector is lagging behind are dropped and counted in the END frame. */
+
+#define VLD_UNIXSOCK_PREFIX        "unix://"
+#define VLD_UNIXSOCK_FRAME_HEADER  5
+#define VLD_UNIXSOCK_HELLO         1
+#define VLD_UNIXSOCK_DATA          2
+#define VLD_UNIXSOCK_END           3
+#define VLD_UNIXSOCK_BUFFER_SIZE   (4 * 1024 * 1024)
+#define VLD_UNIXSOCK_CLOSE_TIMEOUT 100 /* ms */
+
+#ifndef VLD_UNIXSOCK_NO_PHP
+#include <stddef.h>
+
+int vld_unixsock_open(const char *path);
+void vld_unixsock_write(const char *data, size_t len);
+void vld_unixsock_close(void);
+#endif
+
+#endif
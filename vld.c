@@ -21,7 +21,29 @@
 #include "ext/standard/url.h"
 #include "php_vld.h"
 #include "srm_oparray.h"
+#include "arraydump.h"
+#include "output.h"
+#include "binary.h"
+#include "sqlite.h"
+#include "arrow.h"
+#include "compress.h"
+#include "control.h"
+#include "runtime.h"
+#include "sampler.h"
+#include "allocprof.h"
+#include "counters.h"
+#include "hot.h"
+#include "compileprof.h"
+#include "preload.h"
+#include "classdeps.h"
 #include "php_globals.h"
+#if PHP_VERSION_ID >= 80000
+# include "zend_observer.h"
+#endif
+
+#ifdef PHP_WIN32
+# include <process.h>
+#endif
 
 static zend_op_array* (*old_compile_file)(zend_file_handle* file_handle, int type);
 static zend_op_array* vld_compile_file(zend_file_handle*, int);
@@ -34,8 +56,12 @@ static zend_op_array* (*old_compile_string)(zend_string *source_string, const ch
 static zend_op_array* vld_compile_string(zend_string *source_string, const char *filename);
 #endif
 
+#if PHP_VERSION_ID < 80000
 static void (*old_execute_ex)(zend_execute_data *execute_data);
 static void vld_execute_ex(zend_execute_data *execute_data);
+#else
+static zend_observer_fcall_handlers vld_observer_init(zend_execute_data *execute_data);
+#endif
 
 /* {{{ forward declarations */
 static int vld_check_fe (zend_op_array *fe, zend_bool *have_fe);
@@ -43,7 +69,40 @@ static int vld_dump_fe (zend_op_array *fe, int num_args, va_list args, zend_hash
 static int vld_dump_cle (zend_class_entry *class_entry);
 /* }}} */
 
+/* {{{ arginfo */
+ZEND_BEGIN_ARG_INFO_EX(arginfo_vld_dump_function, 0, 0, 1)
+	ZEND_ARG_INFO(0, name)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_vld_dump_file, 0, 0, 1)
+	ZEND_ARG_INFO(0, filename)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_vld_dump_class, 0, 0, 1)
+	ZEND_ARG_INFO(0, class_name)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_vld_counters_snapshot, 0, 0, 0)
+	ZEND_ARG_INFO(0, filename)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_vld_class_graph, 0, 0, 1)
+	ZEND_ARG_INFO(0, filenames)
+ZEND_END_ARG_INFO()
+/* }}} */
+
+PHP_FUNCTION(vld_dump_function);
+PHP_FUNCTION(vld_dump_file);
+PHP_FUNCTION(vld_dump_class);
+PHP_FUNCTION(vld_counters_snapshot);
+PHP_FUNCTION(vld_class_graph);
+
 zend_function_entry vld_functions[] = {
+	PHP_FE(vld_dump_function, arginfo_vld_dump_function)
+	PHP_FE(vld_dump_file,     arginfo_vld_dump_file)
+	PHP_FE(vld_dump_class,    arginfo_vld_dump_class)
+	PHP_FE(vld_counters_snapshot, arginfo_vld_counters_snapshot)
+	PHP_FE(vld_class_graph,   arginfo_vld_class_graph)
 	ZEND_FE_END
 };
 
@@ -68,6 +127,44 @@ ZEND_GET_MODULE(vld)
 
 ZEND_DECLARE_MODULE_GLOBALS(vld)
 
+static ZEND_INI_MH(OnUpdateOutputFormat)
+{
+	if (!new_value || !ZSTR_LEN(new_value) || strcasecmp(ZSTR_VAL(new_value), "text") == 0) {
+		VLD_G(output_format) = VLD_OUTPUT_TEXT;
+	} else if (strcasecmp(ZSTR_VAL(new_value), "ndjson") == 0) {
+		VLD_G(output_format) = VLD_OUTPUT_NDJSON;
+	} else if (strcasecmp(ZSTR_VAL(new_value), "binary") == 0) {
+		VLD_G(output_format) = VLD_OUTPUT_BINARY;
+	} else if (strcasecmp(ZSTR_VAL(new_value), "arrow") == 0) {
+		VLD_G(output_format) = VLD_OUTPUT_ARROW;
+#ifdef HAVE_VLD_SQLITE
+	} else if (strcasecmp(ZSTR_VAL(new_value), "sqlite") == 0) {
+		VLD_G(output_format) = VLD_OUTPUT_SQLITE;
+#endif
+	} else {
+		return FAILURE;
+	}
+	return SUCCESS;
+}
+
+static ZEND_INI_MH(OnUpdateCompress)
+{
+	if (!new_value || !ZSTR_LEN(new_value) || strcasecmp(ZSTR_VAL(new_value), "none") == 0) {
+		VLD_G(compress) = VLD_COMPRESS_NONE;
+#ifdef HAVE_VLD_ZLIB
+	} else if (strcasecmp(ZSTR_VAL(new_value), "gzip") == 0) {
+		VLD_G(compress) = VLD_COMPRESS_GZIP;
+#endif
+#ifdef HAVE_VLD_ZSTD
+	} else if (strcasecmp(ZSTR_VAL(new_value), "zstd") == 0) {
+		VLD_G(compress) = VLD_COMPRESS_ZSTD;
+#endif
+	} else {
+		return FAILURE;
+	}
+	return SUCCESS;
+}
+
 PHP_INI_BEGIN()
 	STD_PHP_INI_ENTRY("vld.active",       "0", PHP_INI_SYSTEM, OnUpdateBool, active,       zend_vld_globals, vld_globals)
 	STD_PHP_INI_ENTRY("vld.skip_prepend", "0", PHP_INI_SYSTEM, OnUpdateBool, skip_prepend, zend_vld_globals, vld_globals)
@@ -80,6 +177,32 @@ PHP_INI_BEGIN()
 	STD_PHP_INI_ENTRY("vld.save_paths",   "0", PHP_INI_SYSTEM, OnUpdateBool, save_paths,   zend_vld_globals, vld_globals)
 	STD_PHP_INI_ENTRY("vld.dump_paths",   "1", PHP_INI_SYSTEM, OnUpdateBool, dump_paths,   zend_vld_globals, vld_globals)
 	STD_PHP_INI_ENTRY("vld.sg_decode",    "0", PHP_INI_SYSTEM, OnUpdateBool, sg_decode,    zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.dedup",        "0", PHP_INI_SYSTEM, OnUpdateBool, dedup,        zend_vld_globals, vld_globals)
+	PHP_INI_ENTRY("vld.output_format",    "text", PHP_INI_SYSTEM, OnUpdateOutputFormat)
+	STD_PHP_INI_ENTRY("vld.output",       "", PHP_INI_SYSTEM, OnUpdateString, output,      zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.output_index", "1", PHP_INI_SYSTEM, OnUpdateBool, output_index, zend_vld_globals, vld_globals)
+	PHP_INI_ENTRY("vld.compress",         "", PHP_INI_SYSTEM, OnUpdateCompress)
+	STD_PHP_INI_ENTRY("vld.compress_level", "0", PHP_INI_SYSTEM, OnUpdateLong, compress_level, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.control_socket", "", PHP_INI_SYSTEM, OnUpdateString, control_socket, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.count_executions", "0", PHP_INI_SYSTEM, OnUpdateBool, count_executions, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.branch_coverage", "0", PHP_INI_SYSTEM, OnUpdateBool, branch_coverage, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.path_profile", "0", PHP_INI_SYSTEM, OnUpdateBool, path_profile, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.call_sites", "0", PHP_INI_SYSTEM, OnUpdateBool, call_sites, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.type_profile", "0", PHP_INI_SYSTEM, OnUpdateBool, type_profile, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.time_function", "", PHP_INI_SYSTEM, OnUpdateString, time_function, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.sample_frequency", "0", PHP_INI_SYSTEM, OnUpdateLong, sample_frequency, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.sample_folded", "", PHP_INI_SYSTEM, OnUpdateString, sample_folded, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.alloc_profile", "0", PHP_INI_SYSTEM, OnUpdateBool, alloc_profile, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.alloc_sample_every", "1", PHP_INI_SYSTEM, OnUpdateLong, alloc_sample_every, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.alloc_sample_bytes", "0", PHP_INI_SYSTEM, OnUpdateLong, alloc_sample_bytes, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.shared_counters", "", PHP_INI_SYSTEM, OnUpdateString, shared_counters, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.shared_counters_size", "262144", PHP_INI_SYSTEM, OnUpdateLong, shared_counters_size, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.hot_threshold", "0", PHP_INI_SYSTEM, OnUpdateLong, hot_threshold, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.compile_profile", "0", PHP_INI_SYSTEM, OnUpdateBool, compile_profile, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.compile_profile_totals", "", PHP_INI_SYSTEM, OnUpdateString, compile_profile_totals, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.include_profile", "0", PHP_INI_SYSTEM, OnUpdateBool, include_profile, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.preload_script", "", PHP_INI_SYSTEM, OnUpdateString, preload_script, zend_vld_globals, vld_globals)
+	STD_PHP_INI_ENTRY("vld.preload_files", "0", PHP_INI_SYSTEM, OnUpdateLong, preload_files, zend_vld_globals, vld_globals)
 PHP_INI_END()
 
 static void vld_init_globals(zend_vld_globals *vg)
@@ -95,6 +218,65 @@ static void vld_init_globals(zend_vld_globals *vg)
 	vg->save_paths   = 0;
 	vg->verbosity    = 1;
 	vg->sg_decode    = 0;
+	vg->dedup        = 0;
+	vg->dumped_fingerprints = NULL;
+	vg->output_format      = VLD_OUTPUT_TEXT;
+	vg->output             = NULL;
+	vg->output_offset      = 0;
+	vg->output_stream      = NULL;
+	vg->output_buffer      = NULL;
+	vg->output_buffer_used = 0;
+	vg->output_buffer_size = 0;
+	vg->pid                = 0;
+	vg->ndjson_fid         = 0;
+	vg->binary             = NULL;
+	vg->output_index       = 1;
+	vg->output_filename    = NULL;
+	vg->dump_index         = NULL;
+	vg->sqlite             = NULL;
+	vg->arrow              = NULL;
+	vg->compress           = VLD_COMPRESS_NONE;
+	vg->compress_level     = 0;
+	vg->compress_state     = NULL;
+	vg->unixsock           = NULL;
+	vg->control_socket     = NULL;
+	vg->control_fd         = -1;
+	vg->control_pid        = 0;
+	vg->control_path       = NULL;
+	vg->count_executions   = 0;
+	vg->runtime_profiles   = NULL;
+	vg->runtime_last_opcodes = NULL;
+	vg->runtime_last_profile = NULL;
+	vg->runtime_reporting  = 0;
+	vg->branch_coverage    = 0;
+	vg->path_profile       = 0;
+	vg->call_sites         = 0;
+	vg->type_profile       = 0;
+	vg->time_function      = NULL;
+	vg->runtime_timed_opcodes   = NULL;
+	vg->runtime_untimed_opcodes = NULL;
+	vg->runtime_timed      = NULL;
+	vg->runtime_frames     = NULL;
+	vg->sample_frequency   = 0;
+	vg->sample_folded      = NULL;
+	vg->sampler            = NULL;
+	vg->alloc_profile      = 0;
+	vg->alloc_sample_every = 1;
+	vg->alloc_sample_bytes = 0;
+	vg->alloc              = NULL;
+	vg->shared_counters    = NULL;
+	vg->shared_counters_size = 262144;
+	vg->hot_threshold      = 0;
+	vg->hot_functions      = NULL;
+	vg->hot_calls          = NULL;
+	vg->compile_profile    = 0;
+	vg->compile_profile_totals = NULL;
+	vg->include_profile    = 0;
+	vg->compileprof        = NULL;
+	vg->compileprof_totals = NULL;
+	vg->compileprof_requests = 0;
+	vg->preload_script     = NULL;
+	vg->preload_files      = 0;
 }
 
 
@@ -102,6 +284,20 @@ PHP_MINIT_FUNCTION(vld)
 {
 	ZEND_INIT_MODULE_GLOBALS(vld, vld_init_globals, NULL);
 	REGISTER_INI_ENTRIES();
+#if PHP_VERSION_ID >= 80000
+	/* Observers can only be registered while modules start up, and only
+	 * sg_decode needs to see code start running */
+	if (VLD_G(active) && !VLD_G(execute) && VLD_G(sg_decode)) {
+		zend_observer_fcall_register(vld_observer_init);
+	}
+#endif
+	/* Op arrays pick up the user opcode handlers when they are compiled, so
+	 * the handlers are set here, before anything is */
+	vld_counters_minit();
+	vld_runtime_minit();
+	vld_compileprof_minit();
+	vld_sampler_minit();
+	vld_hot_minit();
 
 	return SUCCESS;
 }
@@ -109,11 +305,18 @@ PHP_MINIT_FUNCTION(vld)
 
 PHP_MSHUTDOWN_FUNCTION(vld)
 {
+	vld_control_stop();
+	vld_compileprof_mshutdown();
+	vld_runtime_mshutdown();
+	vld_counters_mshutdown();
+	vld_hot_mshutdown();
 	UNREGISTER_INI_ENTRIES();
 
 	zend_compile_file   = old_compile_file;
 	zend_compile_string = old_compile_string;
+#if PHP_VERSION_ID < 80000
 	zend_execute_ex     = old_execute_ex;
+#endif
 
 	return SUCCESS;
 }
@@ -122,16 +325,48 @@ PHP_MSHUTDOWN_FUNCTION(vld)
 
 PHP_RINIT_FUNCTION(vld)
 {
+	vld_compileprof_start();
+
 	old_compile_file = zend_compile_file;
 	old_compile_string = zend_compile_string;
+#if PHP_VERSION_ID < 80000
 	old_execute_ex = zend_execute_ex;
+#endif
+
+	VLD_G(pid) = getpid();
+	vld_control_start();
+
+	/* The runtime modes report at the end of the request, also when
+	 * nothing is dumped while compiling */
+	if (VLD_G(active) || vld_runtime_enabled() || vld_sampler_enabled() || vld_alloc_enabled() || vld_hot_enabled() || vld_compileprof_enabled()) {
+#ifdef HAVE_VLD_SQLITE
+		if (VLD_G(output_format) == VLD_OUTPUT_SQLITE) {
+			vld_sqlite_open();
+		} else
+#endif
+		{
+			vld_output_open();
+			if (VLD_G(output_format) == VLD_OUTPUT_BINARY) {
+				vld_binary_open();
+			} else if (VLD_G(output_format) == VLD_OUTPUT_ARROW) {
+				vld_arrow_open();
+			}
+		}
+	}
 
 	if (VLD_G(active)) {
 		zend_compile_file = vld_compile_file;
 		zend_compile_string = vld_compile_string;
+#if PHP_VERSION_ID < 80000
 		if (!VLD_G(execute)) {
 			zend_execute_ex = vld_execute_ex;
 		}
+#endif
+	}
+
+	if (VLD_G(dedup)) {
+		ALLOC_HASHTABLE(VLD_G(dumped_fingerprints));
+		zend_hash_init(VLD_G(dumped_fingerprints), 32, NULL, NULL, 0);
 	}
 
 	if (VLD_G(save_paths)) {
@@ -147,6 +382,12 @@ PHP_RINIT_FUNCTION(vld)
 			fprintf(VLD_G(path_dump_file), "digraph {\n");
 		}
 	}
+
+	vld_runtime_rinit();
+	vld_sampler_start();
+	vld_alloc_start();
+	vld_hot_rinit();
+
 	return SUCCESS;
 }
 
@@ -156,13 +397,36 @@ PHP_RSHUTDOWN_FUNCTION(vld)
 {
 	zend_compile_file   = old_compile_file;
 	zend_compile_string = old_compile_string;
+#if PHP_VERSION_ID < 80000
 	zend_execute_ex     = old_execute_ex;
+#endif
+
+	vld_alloc_stop();
+	vld_sampler_stop();
+	vld_hot_rshutdown();
+	vld_runtime_rshutdown();
+	vld_compileprof_stop();
+	vld_preload_rshutdown();
+	vld_binary_close();
+	vld_arrow_close();
+	vld_output_close();
+#ifdef HAVE_VLD_SQLITE
+	vld_sqlite_close();
+#endif
 
 	if (VLD_G(path_dump_file)) {
 		fprintf(VLD_G(path_dump_file), "}\n");
 		fclose(VLD_G(path_dump_file));
 	}
 
+	if (VLD_G(dumped_fingerprints)) {
+		zend_hash_destroy(VLD_G(dumped_fingerprints));
+		FREE_HASHTABLE(VLD_G(dumped_fingerprints));
+		VLD_G(dumped_fingerprints) = NULL;
+	}
+
+	vld_control_service();
+
 	return SUCCESS;
 }
 
@@ -171,6 +435,21 @@ PHP_MINFO_FUNCTION(vld)
 {
 	php_info_print_table_start();
 	php_info_print_table_header(2, "vld support", "enabled");
+#ifdef HAVE_VLD_SQLITE
+	php_info_print_table_row(2, "SQLite output format", "enabled");
+#endif
+#ifdef HAVE_VLD_ZLIB
+	php_info_print_table_row(2, "gzip output compression", "enabled");
+#endif
+#ifdef HAVE_VLD_ZSTD
+	php_info_print_table_row(2, "zstd output compression", "enabled");
+#endif
+#ifdef VLD_SAMPLER_AVAILABLE
+	php_info_print_table_row(2, "Sampling profiler", "enabled");
+#endif
+#ifdef VLD_COUNTERS_AVAILABLE
+	php_info_print_table_row(2, "Shared counters", "enabled");
+#endif
 	php_info_print_table_end();
 
 	DISPLAY_INI_ENTRIES();
@@ -206,6 +485,11 @@ int vld_printf(FILE *stream, const char* fmt, ...)
 	char *ptr;
 	const char EOL='\n';
 
+	/* Only the text format is written through printf style calls */
+	if (VLD_G(output_format) != VLD_OUTPUT_TEXT) {
+		return 0;
+	}
+
 	va_start(args, fmt);
 	len = vspprintf(&message, 0, fmt, args);
 	va_end(args);
@@ -219,7 +503,14 @@ int vld_printf(FILE *stream, const char* fmt, ...)
 		}
 		ptr[i] = 0;
 
-		fprintf(stream, "%s%s", VLD_G(col_sep), ptr);
+		if (stream == stderr) {
+			vld_output_write(VLD_G(col_sep), strlen(VLD_G(col_sep)));
+			vld_output_write(ptr, i);
+		} else {
+			fprintf(stream, "%s%s", VLD_G(col_sep), ptr);
+		}
+	} else if (stream == stderr) {
+		vld_output_write(message, len);
 	} else {
 		fprintf(stream, "%s", message);
 	}
@@ -284,6 +575,181 @@ static int vld_dump_cle (zend_class_entry *class_entry)
 }
 
 
+/* {{{ zend_function *vld_find_function(name)
+ *    Looks up a user function by name, or a method when given "Class::method" */
+zend_function *vld_find_function(zend_string *name)
+{
+	zend_function *func;
+	zend_string   *lcname;
+	const char    *sep = zend_memnstr(ZSTR_VAL(name), "::", 2, ZSTR_VAL(name) + ZSTR_LEN(name));
+
+	if (sep) {
+		zend_class_entry *ce;
+		zend_string      *class_name = zend_string_init(ZSTR_VAL(name), sep - ZSTR_VAL(name), 0);
+
+		ce = zend_lookup_class(class_name);
+		zend_string_release(class_name);
+		if (!ce) {
+			return NULL;
+		}
+
+		lcname = zend_string_init(sep + 2, ZSTR_VAL(name) + ZSTR_LEN(name) - (sep + 2), 0);
+		zend_str_tolower(ZSTR_VAL(lcname), ZSTR_LEN(lcname));
+		func = zend_hash_find_ptr(&ce->function_table, lcname);
+	} else {
+		lcname = zend_string_tolower(name);
+		func = zend_hash_find_ptr(EG(function_table), lcname);
+	}
+	zend_string_release(lcname);
+
+	if (!func || func->type != ZEND_USER_FUNCTION) {
+		return NULL;
+	}
+	return func;
+}
+/* }}} */
+
+/* {{{ proto array vld_dump_function(string name)
+ *    Returns the op array of a user defined function, or of a method when
+ *    "Class::method" is given, as an array */
+PHP_FUNCTION(vld_dump_function)
+{
+	zend_string   *name;
+	zend_function *func;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "S", &name) == FAILURE) {
+		return;
+	}
+
+	func = vld_find_function(name);
+	if (!func) {
+		php_error_docref(NULL, E_WARNING, "User function '%s' does not exist", ZSTR_VAL(name));
+		RETURN_FALSE;
+	}
+
+	vld_oparray_to_array(return_value, &func->op_array);
+}
+/* }}} */
+
+/* {{{ proto array vld_dump_class(string class_name)
+ *    Returns a user defined class, and the op arrays of all its methods, as an array */
+PHP_FUNCTION(vld_dump_class)
+{
+	zend_string      *name;
+	zend_class_entry *ce;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "S", &name) == FAILURE) {
+		return;
+	}
+
+	ce = zend_lookup_class(name);
+	if (!ce || ce->type != ZEND_USER_CLASS) {
+		php_error_docref(NULL, E_WARNING, "User class '%s' does not exist", ZSTR_VAL(name));
+		RETURN_FALSE;
+	}
+
+	vld_class_to_array(return_value, ce);
+}
+/* }}} */
+
+/* {{{ proto array vld_counters_snapshot([string filename])
+ *    Returns the op counts that all workers added to vld.shared_counters so
+ *    far, or those in the shared counters file of another process */
+PHP_FUNCTION(vld_counters_snapshot)
+{
+	char   *filename = NULL;
+	size_t  filename_len = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "|p", &filename, &filename_len) == FAILURE) {
+		return;
+	}
+
+	if (vld_counters_to_array(return_value, filename) == FAILURE) {
+		php_error_docref(NULL, E_WARNING, "Could not read the shared counters in '%s'", filename);
+		zval_ptr_dtor(return_value);
+		RETURN_FALSE;
+	}
+}
+/* }}} */
+
+/* {{{ proto array vld_dump_file(string filename)
+ *    Compiles, but does not run, a file and returns its main op array
+ *    together with the functions and classes it declares. Unlike with
+ *    include, the declared functions and classes do not stay around. */
+PHP_FUNCTION(vld_dump_file)
+{
+	char             *filename;
+	size_t            filename_len;
+	zend_op_array    *op_array;
+	HashTable         file_functions;
+	uint32_t          num_functions, num_classes, idx;
+	zend_function    *func;
+	zend_class_entry *ce;
+	zval              functions, classes, tmp;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "p", &filename, &filename_len) == FAILURE) {
+		return;
+	}
+
+	vld_classdeps_functions_init(&file_functions);
+	num_functions = zend_hash_num_elements(&file_functions);
+	num_classes   = zend_hash_num_elements(CG(class_table));
+
+	if ((op_array = vld_classdeps_compile(filename, &file_functions)) == NULL) {
+		vld_classdeps_functions_destroy(&file_functions, num_functions);
+		vld_classdeps_forget(CG(class_table), num_classes);
+		RETURN_FALSE;
+	}
+
+	array_init(return_value);
+	vld_oparray_to_array(&tmp, op_array);
+	add_assoc_zval(return_value, "main", &tmp);
+
+	array_init(&functions);
+	idx = 0;
+	ZEND_HASH_FOREACH_PTR(&file_functions, func) {
+		if (idx++ < num_functions || func->type != ZEND_USER_FUNCTION) {
+			continue;
+		}
+		vld_oparray_to_array(&tmp, &func->op_array);
+		zend_hash_update(Z_ARRVAL(functions), func->common.function_name, &tmp);
+	} ZEND_HASH_FOREACH_END();
+	add_assoc_zval(return_value, "functions", &functions);
+
+	array_init(&classes);
+	idx = 0;
+	ZEND_HASH_FOREACH_PTR(CG(class_table), ce) {
+		if (idx++ < num_classes || ce->type != ZEND_USER_CLASS) {
+			continue;
+		}
+		vld_class_to_array(&tmp, ce);
+		zend_hash_update(Z_ARRVAL(classes), ce->name, &tmp);
+	} ZEND_HASH_FOREACH_END();
+	add_assoc_zval(return_value, "classes", &classes);
+
+	destroy_op_array(op_array);
+	efree_size(op_array, sizeof(zend_op_array));
+
+	vld_classdeps_functions_destroy(&file_functions, num_functions);
+	vld_classdeps_forget(CG(class_table), num_classes);
+}
+/* }}} */
+
+/* {{{ proto array vld_class_graph(array filenames)
+ *    Compiles, but does not run, the files and returns the classes they
+ *    declare with the classes that each refers to, in load order */
+PHP_FUNCTION(vld_class_graph)
+{
+	HashTable *filenames;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "h", &filenames) == FAILURE) {
+		return;
+	}
+
+	vld_classdeps_to_array(return_value, filenames);
+}
+/* }}} */
+
 /* {{{ zend_op_array vld_compile_file (file_handle, type)
  *    This function provides a hook for compilation */
 static zend_op_array *vld_compile_file(zend_file_handle *file_handle, int type)
@@ -2599,8 +3065,8 @@ static char executed_filename[256];
 static int execute_count;
 
 /* {{{
- *    This function provides a hook for execution */
-static void vld_execute_ex(zend_execute_data *execute_data)
+ *    Called whenever code starts running */
+static void vld_execute_begin(zend_execute_data *execute_data)
 {
 	if (VLD_G(sg_decode))
 	{
@@ -2628,7 +3094,32 @@ static void vld_execute_ex(zend_execute_data *execute_data)
 	}
 
 	execute_count++;
+}
+/* }}} */
+
+#if PHP_VERSION_ID < 80000
+/* {{{
+ *    This function provides a hook for execution */
+static void vld_execute_ex(zend_execute_data *execute_data)
+{
+	vld_execute_begin(execute_data);
 
   return old_execute_ex(execute_data TSRMLS_DC);
 }
 /* }}} */
+#else
+/* {{{
+ *    Overriding zend_execute_ex sends every call through a C level
+ *    execute_ex, so code that starts running is observed instead, and only
+ *    until the decoded code has been dumped */
+static zend_observer_fcall_handlers vld_observer_init(zend_execute_data *execute_data)
+{
+	zend_observer_fcall_handlers handlers = { NULL, NULL };
+
+	if (execute_count <= 1 && execute_data->func && ZEND_USER_CODE(execute_data->func->type)) {
+		handlers.begin = vld_execute_begin;
+	}
+	return handlers;
+}
+/* }}} */
+#endif